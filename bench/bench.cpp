@@ -0,0 +1,457 @@
+#include "AllocationTracker.hpp"
+#include "AsyncFileReader.hpp"
+#include "BinaryFeed.hpp"
+#include "BookArena.hpp"
+#include "CaptureArchive.hpp"
+#include "FeedParser.hpp"
+#include "L3Book.hpp"
+#include "OrderBook.hpp"
+#include "SignalEngine.hpp"
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Micro benchmarks for the hot paths, run with ./SmartOrderBookBench [iterations].
+// Heap allocations per op are reported next to the time, the book benches
+// are expected to show 0
+
+class BenchSuite {
+public:
+    void addBench(const std::string& name, std::function<size_t()> func) {
+        benches.push_back({name, func});
+    }
+
+    void run(int iterations) {
+        for (const auto& b : benches) {
+            size_t ops = 0;
+            AllocationScope allocations;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                ops += b.second();
+            }
+            auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            double allocationsPerOp = ops ? static_cast<double>(allocations.getAllocations()) / ops : 0.0;
+            std::cout << b.first << ": " << (ops ? elapsed / ops : 0.0) << " ns/op, "
+                << allocationsPerOp << " allocs/op (" << ops << " ops)\n";
+        }
+    }
+
+private:
+    std::vector<std::pair<std::string, std::function<size_t()>>> benches;
+};
+
+static volatile double sink;
+
+static std::vector<std::string> makeL2Lines(size_t n, int depth) {
+    std::vector<std::string> lines;
+    std::mt19937 rng(42);
+    for (size_t i = 0; i < n; ++i) {
+        std::ostringstream ss;
+        ss << 1000 + i << " BID";
+        for (int l = 0; l < depth; ++l) ss << " " << 100.0 - l * 0.25 << " " << 100 + rng() % 900;
+        ss << " ASK";
+        for (int l = 0; l < depth; ++l) ss << " " << 100.25 + l * 0.25 << " " << 100 + rng() % 900;
+        lines.push_back(ss.str());
+    }
+    return lines;
+}
+
+static std::vector<std::string> makeL3Lines(size_t n) {
+    std::vector<std::string> lines;
+    std::mt19937 rng(7);
+    const char* actions[] = {"ADD", "MODIFY", "CANCEL"};
+    for (size_t i = 0; i < n; ++i) {
+        std::ostringstream ss;
+        int action = rng() % 3;
+        ss << 1000 + i << " " << actions[action] << " " << 10000 + rng() % 5000;
+        if (action != 2) {
+            ss << (rng() % 2 ? " SELL " : " BUY ") << 100.0 + (rng() % 40) * 0.25 << " " << 100 + rng() % 900;
+        }
+        lines.push_back(ss.str());
+    }
+    return lines;
+}
+
+// The istringstream decoding the ingestor and OrderBook used before FeedParser
+static double legacyParseL2(const std::string& line) {
+    std::istringstream ts(line);
+    uint64_t timestamp;
+    ts >> timestamp;
+    std::string data = line.substr(line.find(' ') + 1);
+
+    std::istringstream ss(data);
+    std::string token;
+    Quantity qty;
+    double total = 0;
+    ss >> token;
+    while (ss >> token && token != "ASK") {
+        Price price = std::stod(token);
+        ss >> qty;
+        total += price * qty;
+    }
+    while (ss >> token) {
+        Price price = std::stod(token);
+        ss >> qty;
+        total += price * qty;
+    }
+    return total;
+}
+
+static double legacyParseL3(const std::string& line) {
+    std::istringstream ts(line);
+    uint64_t timestamp;
+    ts >> timestamp;
+    std::string data = line.substr(line.find(' ') + 1);
+
+    std::istringstream ss(data);
+    std::string action, side;
+    Price price = 0;
+    Quantity size = 0;
+    int orderId;
+    ss >> action >> orderId >> side >> price >> size;
+    return price * size + orderId + (side == "SELL");
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 20;
+
+    auto l2Lines = makeL2Lines(2000, 20);
+    auto l3Lines = makeL3Lines(20000);
+
+    BenchSuite suite;
+    suite.addBench("L2 parse, istringstream", [&]() {
+        for (const auto& line : l2Lines) sink = legacyParseL2(line);
+        return l2Lines.size();
+    });
+    suite.addBench("L2 parse, FeedParser", [&]() {
+        L2Snapshot snapshot;
+        for (const auto& line : l2Lines) {
+            const char* p = line.data();
+            const char* end = p + line.size();
+            parseTimestamp(p, end, snapshot.timestamp);
+            parseL2Snapshot(p, end, snapshot);
+            sink = snapshot.bids.prices[0];
+        }
+        return l2Lines.size();
+    });
+    suite.addBench("L3 parse, istringstream", [&]() {
+        for (const auto& line : l3Lines) sink = legacyParseL3(line);
+        return l3Lines.size();
+    });
+    suite.addBench("L3 parse, FeedParser", [&]() {
+        L3Update update;
+        for (const auto& line : l3Lines) {
+            const char* p = line.data();
+            const char* end = p + line.size();
+            parseTimestamp(p, end, update.timestamp);
+            parseL3Update(p, end, update);
+            sink = update.price;
+        }
+        return l3Lines.size();
+    });
+
+    // whole-file decode of the same L3 capture as text and as an archive
+    {
+        std::ofstream out("bench_l3.txt");
+        for (const auto& line : l3Lines) out << line << "\n";
+    }
+    ArchiveWriter::convert("bench_l3.txt", EventType::L3_UPDATE, "bench_l3.sobarc", 4);
+    MappedFile textFile;
+    textFile.open("bench_l3.txt");
+    ArchiveReader archive;
+    archive.open("bench_l3.sobarc");
+    std::ofstream("bench_trades.txt").close();
+    BinaryFeedWriter::convert("bench_l3.txt", "bench_trades.txt", "bench_l3.itch");
+    BinaryFeedWriter::convert("bench_l3.txt", "bench_trades.txt", "bench_l3.pcap", BinaryFeedFormat::PCAP);
+    MappedFile binaryFile;
+    binaryFile.open("bench_l3.itch");
+    std::cout << "L3 capture: " << textFile.size() << " bytes as text, " << archive.getFileSize()
+        << " bytes as archive, " << binaryFile.size() << " bytes as binary feed\n";
+
+    suite.addBench("L3 file decode, text", [&]() {
+        ParsedChunk chunk;
+        const char* p = textFile.data();
+        const char* end = p + textFile.size();
+        while (p < end) {
+            const char* lineEnd = findLineEnd(p, end);
+            MarketEvent event;
+            if (parseCaptureLine(p, lineEnd, EventType::L3_UPDATE, event, chunk.snapshots) == ParseStatus::OK) {
+                chunk.events.push_back(event);
+            }
+            p = lineEnd + 1;
+        }
+        return chunk.events.size();
+    });
+    suite.addBench("L3 file decode, archive", [&]() {
+        ParsedChunk chunk;
+        for (size_t i = 0; i < archive.getBlockCount(); ++i) {
+            archive.readBlock(i, chunk);
+        }
+        return chunk.events.size();
+    });
+
+    suite.addBench("L3 file decode, binary stream", [&]() {
+        BinaryFeedReader reader;
+        reader.open("bench_l3.itch");
+        ParsedChunk chunk;
+        return reader.readAll(chunk);
+    });
+    suite.addBench("L3 file decode, binary pcap", [&]() {
+        BinaryFeedReader reader;
+        reader.open("bench_l3.pcap");
+        ParsedChunk chunk;
+        return reader.readAll(chunk);
+    });
+
+    // raw read of the text capture, lines counted so every byte is touched
+    suite.addBench("L3 file read, mmap", [&]() {
+        MappedFile mapped;
+        mapped.open("bench_l3.txt");
+        return static_cast<size_t>(std::count(mapped.data(), mapped.data() + mapped.size(), '\n'));
+    });
+    for (ReadEngine engine : {ReadEngine::IO_URING, ReadEngine::PREAD}) {
+        std::string name = engine == ReadEngine::IO_URING ? "io_uring" : "pread";
+        suite.addBench("L3 file read, " + name + " 64 KiB blocks", [engine]() {
+            AsyncFileReader reader(64 << 10, 3);
+            reader.open("bench_l3.txt", engine);
+            size_t lines = 0;
+            ReadBlock block;
+            while (reader.next(block)) {
+                lines += std::count(block.data, block.data + block.size, '\n');
+                reader.release(block);
+            }
+            return lines;
+        });
+    }
+
+    // top of book churn on a deep resting book: adds and cancels at the
+    // touch and a trade against the best ask, the queue scans and level
+    // headers these touch are what the order and level layout is sized for
+    std::ostream quiet(nullptr);
+    setLogStream(&quiet);
+    std::cout << "Order node: " << sizeof(OrderNode) << " bytes, level header: " << sizeof(L3PriceLevel) << " bytes\n";
+    // on an arena, as in a replay, so cancelled orders' id map nodes are reused
+    BookArena arena;
+    L3Book book(arena.resource());
+    std::pmr::vector<OrderInfo> executions(arena.resource());
+    OrderId nextId = 1;
+    for (int level = 0; level < 40; ++level) {
+        for (int k = 0; k < 50; ++k) {
+            book.addOrder(nextId++, false, 100, 100.0 - level * 0.25);
+            book.addOrder(nextId++, true, 100, 100.25 + level * 0.25);
+        }
+    }
+    suite.addBench("L3 book top of book churn", [&]() {
+        const size_t rounds = 20000;
+        for (size_t i = 0; i < rounds; ++i) {
+            OrderId bid = nextId++;
+            OrderId ask = nextId++;
+            book.addOrder(bid, false, 10, 100.0);
+            book.addOrder(ask, true, 110, 100.25);
+            book.executeAtPrice(100.25, 10, false, executions);
+            book.modifyOrder(bid, 5, 100.0);
+            book.cancelOrder(bid);
+            book.cancelOrder(ask);
+            sink = book.getBestBid() + book.getBestAsk();
+        }
+        return rounds * 6;
+    });
+    // the same churn with the signals kept up to date, against reading them
+    // off getTopBids and getTopAsks copies after every change
+    SignalEngine signals(5);
+    suite.addBench("L3 book churn with incremental signals", [&]() {
+        const size_t rounds = 20000;
+        book.setSignalEngine(&signals);
+        for (size_t i = 0; i < rounds; ++i) {
+            OrderId bid = nextId++;
+            OrderId ask = nextId++;
+            book.addOrder(bid, false, 10, 100.0);
+            book.addOrder(ask, true, 110, 100.25);
+            book.executeAtPrice(100.25, 10, false, executions);
+            book.modifyOrder(bid, 5, 100.0);
+            book.cancelOrder(bid);
+            book.cancelOrder(ask);
+            sink = signals.getSignals().microprice;
+        }
+        book.setSignalEngine(nullptr);
+        return rounds * 6;
+    });
+    suite.addBench("L3 book churn with signals from top level copies", [&]() {
+        const size_t rounds = 20000;
+        auto microprice = [&]() {
+            std::vector<L3PriceLevel> bids = book.getTopBids(5);
+            std::vector<L3PriceLevel> asks = book.getTopAsks(5);
+            const L3PriceLevel& bid = bids.front();
+            const L3PriceLevel& ask = asks.front();
+            return (bid.price * ask.quantity + ask.price * bid.quantity) / (bid.quantity + ask.quantity);
+        };
+        for (size_t i = 0; i < rounds; ++i) {
+            OrderId bid = nextId++;
+            OrderId ask = nextId++;
+            book.addOrder(bid, false, 10, 100.0);
+            sink = microprice();
+            book.addOrder(ask, true, 110, 100.25);
+            sink = microprice();
+            book.executeAtPrice(100.25, 10, false, executions);
+            sink = microprice();
+            book.modifyOrder(bid, 5, 100.0);
+            sink = microprice();
+            book.cancelOrder(bid);
+            sink = microprice();
+            book.cancelOrder(ask);
+            sink = microprice();
+        }
+        return rounds * 6;
+    });
+
+    // what-if branches of a 2000 order book, each rerunning a reduction, a
+    // trade and the L3 update after it: OrderBook::fork against a deep copy,
+    // which needs both the exchange book and the SmartBook copied
+    L2Book branchL2;
+    L3Book branchL3;
+    TradeContainer branchTrades;
+    OrderBook parent(branchL2, branchL3, branchTrades);
+    parent.setPrintBook(false);
+    L2Snapshot depth;
+    Timestamp now = 0;
+    OrderId branchId = 1;
+    for (int level = 0; level < 40; ++level) {
+        for (int k = 0; k < 25; ++k) {
+            parent.processL3Update(L3Update{++now, L3Action::ADD, branchId++, false, 100.0 - level * 0.25, 100});
+            parent.processL3Update(L3Update{++now, L3Action::ADD, branchId++, true, 100.25 + level * 0.25, 100});
+        }
+        depth.bids.push(100.0 - level * 0.25, 2500);
+        depth.asks.push(100.25 + level * 0.25, 2500);
+    }
+    parent.processL2Snapshot(depth, ++now);
+    parent.enableForking();
+    L2Snapshot reduced = depth;
+    reduced.bids.quantities[0] -= 100;
+    Timestamp branchTime = now;
+    auto runBranch = [&reduced, branchTime](OrderBook& branch) {
+        branch.processL2Snapshot(reduced, branchTime + 1);
+        branch.processTrade(TradeInfo{100.0, 100, branchTime + 2, OrderSide::SELL, 0});
+        branch.processL3Update(L3Update{branchTime + 3, L3Action::CANCEL, 1, false, 100.0, 100});
+    };
+    const size_t branches = 100;
+    struct DeepCopy {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades{0};
+        std::unique_ptr<OrderBook> book;
+    };
+    std::vector<std::unique_ptr<OrderBook>> forks;
+    std::vector<std::unique_ptr<DeepCopy>> copies;
+    auto forkBranches = [&]() {
+        forks.clear();
+        for (size_t b = 0; b < branches; ++b) {
+            forks.push_back(parent.fork(b % 2 ? 0.0 : 1.0));
+            runBranch(*forks.back());
+        }
+        return branches;
+    };
+    auto copyBranches = [&]() {
+        copies.clear();
+        for (size_t b = 0; b < branches; ++b) {
+            auto copy = std::make_unique<DeepCopy>();
+            copy->l2 = branchL2;
+            copy->l3 = branchL3;
+            copy->book = std::make_unique<OrderBook>(copy->l2, copy->l3, copy->trades, b % 2 ? 0.0 : 1.0);
+            copy->book->setPrintBook(false);
+            runBranch(*copy->book);
+            copies.push_back(std::move(copy));
+        }
+        return branches;
+    };
+    auto branchBytes = [](const std::function<size_t()>& run) {
+        AllocationScope scope;
+        size_t count = run();
+        return scope.getStats().bytes / count;
+    };
+    uint64_t forkBytes = branchBytes(forkBranches);
+    forks.clear();
+    uint64_t copyBytes = branchBytes(copyBranches);
+    copies.clear();
+    suite.addBench("OrderBook what-if branch, fork", forkBranches);
+    suite.addBench("OrderBook what-if branch, deep copy", copyBranches);
+    std::cout << "What-if branch of a " << branchL3.getTotalOrders() << " order book: " << forkBytes
+        << " bytes allocated forked, " << copyBytes << " bytes as a deep copy\n";
+
+    // exchange packets of L3 updates on a 2000 order book with a depth
+    // consumer, applied with processBatch against one event at a time
+    struct BatchBook {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades{0};
+        std::unique_ptr<OrderBook> book;
+        size_t depthUpdates = 0;
+    };
+    auto makeBatchBook = []() {
+        auto b = std::make_unique<BatchBook>();
+        b->book = std::make_unique<OrderBook>(b->l2, b->l3, b->trades);
+        b->book->setPrintBook(false);
+        Callbacks callbacks;
+        callbacks.onDepthUpdate = [raw = b.get()](const DepthUpdate&) { raw->depthUpdates++; };
+        b->book->setCallbacks(callbacks);
+        OrderId id = 1;
+        for (int level = 0; level < 40; ++level) {
+            for (int k = 0; k < 25; ++k) {
+                b->book->processL3Update(L3Update{1, L3Action::ADD, id++, false, 100.0 - level * 0.25, 100});
+                b->book->processL3Update(L3Update{1, L3Action::ADD, id++, true, 100.25 + level * 0.25, 100});
+            }
+        }
+        b->depthUpdates = 0;
+        return b;
+    };
+    const size_t packets = 2000;
+    std::vector<MarketEvent> packetEvents;
+    for (size_t p = 0; p < packets; ++p) {
+        Timestamp ts = 10 + p;
+        OrderId base = 100000 + static_cast<OrderId>(p) * 3;
+        Price bid = 100.0 - (p % 8) * 0.25;
+        Price ask = 100.25 + (p % 8) * 0.25;
+        const L3Update updates[] = {
+            {ts, L3Action::ADD, base, false, bid, 10},
+            {ts, L3Action::ADD, base + 1, true, ask, 10},
+            {ts, L3Action::MODIFY, base, false, bid, 5},
+            {ts, L3Action::ADD, base + 2, false, bid - 0.25, 10},
+            {ts, L3Action::CANCEL, base, false, bid, 5},
+            {ts, L3Action::CANCEL, base + 1, true, ask, 10},
+            {ts, L3Action::CANCEL, base + 2, false, bid - 0.25, 10},
+        };
+        for (const L3Update& update : updates) {
+            MarketEvent e{};
+            e.type = EventType::L3_UPDATE;
+            e.timestamp = ts;
+            e.l3Update = update;
+            packetEvents.push_back(e);
+        }
+    }
+    const size_t packetSize = packetEvents.size() / packets;
+    auto perEventBook = makeBatchBook();
+    auto batchedBook = makeBatchBook();
+    auto applyPerEvent = [&]() {
+        for (const MarketEvent& e : packetEvents) perEventBook->book->processL3Update(e.l3Update);
+        return packetEvents.size();
+    };
+    auto applyBatched = [&]() {
+        for (size_t p = 0; p < packets; ++p) batchedBook->book->processBatch(packetEvents.data() + p * packetSize, packetSize);
+        return packetEvents.size();
+    };
+    applyPerEvent();
+    applyBatched();
+    std::cout << "Depth updates per " << packetSize << " event packet: " << perEventBook->depthUpdates / double(packets)
+        << " per event, " << batchedBook->depthUpdates / double(packets) << " batched\n";
+    suite.addBench("OrderBook packets, per event", applyPerEvent);
+    suite.addBench("OrderBook packets, processBatch", applyBatched);
+
+    suite.run(iterations);
+    setLogStream(nullptr);
+    return 0;
+}
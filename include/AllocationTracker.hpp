@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocation counting for the tests and benchmarks. The replacement
+// global operator new and delete are in src/AllocationTracker.cpp, which
+// only those targets link, so the engine itself keeps the plain allocator.
+// Counts are per thread and are only read by the thread that made them.
+// Optionally the call stacks of the first few allocations are kept, which
+// is how a regression on the hot path is tracked down.
+
+struct AllocationStats {
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+    uint64_t bytes = 0;         // requested, frees do not subtract
+};
+
+class AllocationTracker {
+public:
+    static const size_t MAX_STACKS = 8;
+    static const int STACK_DEPTH = 24;
+
+    // everything the calling thread has allocated since it started
+    static AllocationStats threadStats();
+    // Keeps the stacks of the next MAX_STACKS allocations of the calling
+    // thread; enabling drops the stacks kept so far
+    static void captureStacks(bool enabled);
+    static size_t getCapturedStacks();
+    // symbols go straight to fd, nothing is allocated
+    static void dumpStacks(int fd = 2);
+};
+
+// Allocations of the calling thread while the scope is alive
+class AllocationScope {
+private:
+    AllocationStats start;
+    bool capturing;
+
+public:
+    explicit AllocationScope(bool captureStacks = false);
+    ~AllocationScope();
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    AllocationStats getStats() const;
+    uint64_t getAllocations() const { return getStats().allocations; }
+};
\ No newline at end of file
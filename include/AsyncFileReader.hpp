@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streams a file through a small ring of large read buffers, handing the
+// blocks out in file order. With io_uring every buffer that is not held by
+// the consumer has a read in flight, so the device works on the next blocks
+// while the current one is parsed. The buffers are registered with the kernel
+// once when the memlock limit allows it. Without io_uring (old kernel,
+// seccomp) blocks are read with pread when they are asked for.
+
+enum class ReadEngine {
+    IO_URING,
+    PREAD
+};
+
+struct ReadBlock {
+    char* data = nullptr;       // up to getHeadroom() bytes before data are free scratch space
+    size_t size = 0;
+    uint64_t offset = 0;
+    size_t index = 0;
+};
+
+class AsyncFileReader {
+private:
+    enum class SlotState { IDLE, READING, READY, HELD };
+
+    struct Slot {
+        char* buffer = nullptr;
+        SlotState state = SlotState::IDLE;
+        size_t index = 0;
+        size_t length = 0;      // bytes of the block
+        size_t done = 0;        // bytes read so far
+        bool failed = false;
+    };
+
+    struct Ring;
+
+    size_t blockSize;
+    size_t depth;
+    size_t headroom;
+    bool direct;
+    int fd = -1;
+    uint64_t fileSize = 0;
+    size_t blockCount = 0;
+    size_t nextBlock = 0;
+    char* memory = nullptr;
+    std::vector<Slot> slots;
+    std::unique_ptr<Ring> ring;
+    bool fixedBuffers = false;
+
+    bool setupRing();
+    void startRead(size_t slot, size_t index);
+    bool submitRead(size_t slot);
+    bool waitCompletions();
+    bool readSync(Slot& slot);
+    size_t requestLength(const Slot& slot) const;
+
+public:
+    // blockSize and headroom are rounded up to 4 KiB, depth is the number of
+    // buffers (3 for triple buffering). direct opens the file with O_DIRECT
+    // when the filesystem supports it
+    explicit AsyncFileReader(size_t blockSize = 1 << 20, size_t depth = 3,
+                             size_t headroom = 64 << 10, bool direct = false);
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    // Falls back to pread if io_uring cannot be set up
+    bool open(const std::string& file, ReadEngine preferred = ReadEngine::IO_URING);
+    void close();
+
+    // Waits for the next block, false at the end of the file or on a read
+    // error. A block stays valid until released, at most depth are held
+    bool next(ReadBlock& block);
+    // Hands the buffer back so it can take the read of a later block
+    void release(const ReadBlock& block);
+
+    bool atEnd() const { return nextBlock >= blockCount; }
+    ReadEngine getEngine() const { return ring ? ReadEngine::IO_URING : ReadEngine::PREAD; }
+    bool usesFixedBuffers() const { return fixedBuffers; }
+    uint64_t getFileSize() const { return fileSize; }
+    size_t getBlockCount() const { return blockCount; }
+    size_t getHeadroom() const { return headroom; }
+
+    static bool ioUringAvailable();
+};
\ No newline at end of file
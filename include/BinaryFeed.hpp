@@ -0,0 +1,164 @@
+#pragma once
+#include "FeedParser.hpp"
+#include "MappedFile.hpp"
+#include <fstream>
+#include <string>
+
+// ITCH-style order-level binary feed.
+//
+// Messages are fixed width with big-endian fields: a one byte type, a u64
+// timestamp, then the message body. Prices are u32 with four implied
+// decimals. On disk messages are either framed as a stream (u16 big-endian
+// length before every message) or carried in UDP datagrams of a pcap capture,
+// each payload being a MoldUDP64 style packet: 10 byte session, u64 sequence
+// number of the first message, u16 message count, then length-prefixed
+// messages.
+
+const int64_t BINARY_PRICE_SCALE = 10000;
+
+enum class BinaryMessageType : char {
+    ADD_ORDER = 'A',
+    MODIFY_ORDER = 'U',
+    DELETE_ORDER = 'D',
+    EXECUTION = 'E'
+};
+
+#pragma pack(push, 1)
+struct BinaryAddOrder {
+    char type;
+    uint64_t timestamp;
+    uint64_t orderId;
+    char side;              // 'B' or 'S'
+    uint32_t shares;
+    uint32_t price;
+};
+
+// same layout as an add, replaces size and price of a resting order
+struct BinaryModifyOrder {
+    char type;
+    uint64_t timestamp;
+    uint64_t orderId;
+    char side;
+    uint32_t shares;
+    uint32_t price;
+};
+
+struct BinaryDeleteOrder {
+    char type;
+    uint64_t timestamp;
+    uint64_t orderId;
+};
+
+struct BinaryExecution {
+    char type;
+    uint64_t timestamp;
+    uint64_t orderId;       // 0 when the venue does not attribute the trade
+    uint32_t shares;
+    uint32_t price;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(BinaryAddOrder) == 26, "binary add order must be packed");
+static_assert(sizeof(BinaryModifyOrder) == 26, "binary modify order must be packed");
+static_assert(sizeof(BinaryDeleteOrder) == 17, "binary delete order must be packed");
+static_assert(sizeof(BinaryExecution) == 25, "binary execution must be packed");
+
+// Decodes one message in place, without copying it out of the buffer.
+// rawData of the event is left empty
+ParseStatus decodeBinaryMessage(const char* begin, const char* end, MarketEvent& event);
+
+// Encodes an L3 update or trade into out, returns the message size or 0 if
+// the event cannot be represented (L2 snapshot, off-tick price, bad id)
+size_t encodeBinaryMessage(const MarketEvent& event, char* out);
+
+const size_t MOLD_HEADER_SIZE = 20;
+const size_t MAX_DATAGRAM_PAYLOAD = 1400;
+
+// Writes the header of a datagram carrying count messages from sequence on
+void encodeMoldHeader(char* out, uint64_t sequence, uint16_t count);
+
+// Decodes MoldUDP64 style datagram payloads, tracking sequence numbers
+// across datagrams. Shared by the pcap reader and the UDP receiver
+class MoldDecoder {
+private:
+    const char* payload = nullptr;
+    const char* payloadEnd = nullptr;
+    uint32_t pendingMessages = 0;
+    uint64_t skipMessages = 0;
+    uint64_t nextSequence = 0;
+    size_t missedMessages = 0;
+    size_t decodeErrors = 0;
+
+public:
+    // Starts on a datagram, returns false if it carries no new messages
+    bool beginDatagram(const char* data, size_t size);
+    // Next message of the current datagram, false once it is used up
+    bool next(MarketEvent& event);
+    void reset() { *this = MoldDecoder(); }
+
+    uint64_t getNextSequence() const { return nextSequence; }
+    // messages lost to sequence number gaps, duplicates are dropped silently
+    size_t getMissedMessages() const { return missedMessages; }
+    size_t getDecodeErrors() const { return decodeErrors; }
+};
+
+enum class BinaryFeedFormat {
+    STREAM,
+    PCAP
+};
+
+class BinaryFeedReader {
+private:
+    MappedFile file;
+    BinaryFeedFormat format = BinaryFeedFormat::STREAM;
+    bool swapped = false;       // pcap written on a host of the other endianness
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    MoldDecoder mold;
+    size_t packets = 0;
+    size_t decodeErrors = 0;
+
+    bool nextPacket();
+
+public:
+    bool open(const std::string& path);
+
+    // Decodes the next message, returns false at the end of the feed.
+    // Malformed messages and packets are counted and skipped
+    bool next(MarketEvent& event);
+
+    // Appends all remaining events to out
+    size_t readAll(ParsedChunk& out);
+
+    BinaryFeedFormat getFormat() const { return format; }
+    size_t getPackets() const { return packets; }
+    size_t getMissedMessages() const { return mold.getMissedMessages(); }
+    size_t getDecodeErrors() const { return decodeErrors + mold.getDecodeErrors(); }
+
+    static bool isPcap(const char* data, size_t size);
+};
+
+class BinaryFeedWriter {
+private:
+    BinaryFeedFormat format;
+    std::ofstream out;
+    uint64_t sequence = 1;
+    std::string packet;         // messages of the datagram being built
+    uint16_t packetMessages = 0;
+    Timestamp packetTimestamp = 0;
+
+    bool flushPacket();
+
+public:
+    explicit BinaryFeedWriter(BinaryFeedFormat format = BinaryFeedFormat::STREAM) : format(format) {}
+
+    bool open(const std::string& file);
+    // Returns false if the event cannot be encoded
+    bool append(const MarketEvent& event);
+    bool close();
+
+    // Merges an L3 and a trade text capture in timestamp order into one
+    // binary feed, returns false on any error
+    static bool convert(const std::string& l3File, const std::string& tradeFile,
+                        const std::string& feedFile, BinaryFeedFormat format = BinaryFeedFormat::STREAM);
+};
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Memory of one instrument's books. Pages are mapped up front (and more
+// whenever they run out) and carved up by an unsynchronized pool, so the
+// orders, levels and hash nodes a book frees are reused and no other thread
+// ever contends for them. Blocks above 64 KiB (large hash tables) are not
+// recycled. Single threaded like the book it serves.
+// Everything goes back to the OS in one go when the arena is destroyed, so
+// the books using it must be destroyed first.
+
+struct BookArenaConfig {
+    size_t initialBytes = 4 << 20;  // mapped at construction
+    bool hugePages = false;         // MAP_HUGETLB, else transparent huge pages if available
+    bool prefault = false;          // fault every page in at construction (MAP_POPULATE)
+    bool lockMemory = false;        // mlock the blocks so they are never paged out
+    int numaNode = -1;              // bind the blocks to this node, e.g. ThreadConfig::bookNode()
+};
+
+class BookArena {
+private:
+    // bump allocator over mapped blocks, frees nothing until destroyed
+    class Region : public std::pmr::memory_resource {
+    public:
+        explicit Region(const BookArenaConfig& config);
+        ~Region();
+
+        size_t mappedBytes = 0;
+        size_t usedBytes = 0;
+        size_t lockedBytes = 0;
+        bool hugePages = false;         // whether the blocks really are MAP_HUGETLB
+
+    private:
+        BookArenaConfig config;
+        std::vector<std::pair<char*, size_t>> blocks;
+        char* cursor = nullptr;
+        char* end = nullptr;
+
+        bool mapBlock(size_t bytes);
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void*, size_t, size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    Region region;
+    std::pmr::unsynchronized_pool_resource pool;
+
+public:
+    explicit BookArena(const BookArenaConfig& config = BookArenaConfig());
+
+    BookArena(const BookArena&) = delete;
+    BookArena& operator=(const BookArena&) = delete;
+
+    // pass to L3Book, TradeContainer and OrderBook
+    std::pmr::memory_resource* resource() { return &pool; }
+
+    size_t getMappedBytes() const { return region.mappedBytes; }
+    // handed to the pool so far, freed blocks are reused within it
+    size_t getUsedBytes() const { return region.usedBytes; }
+    bool usesHugePages() const { return region.hugePages; }
+    // less than mapped if mlock hit RLIMIT_MEMLOCK
+    size_t getLockedBytes() const { return region.lockedBytes; }
+};
\ No newline at end of file
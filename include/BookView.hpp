@@ -0,0 +1,90 @@
+#pragma once
+#include "Epoch.hpp"
+#include "L3Book.hpp"
+#include "DataStructures.hpp"
+#include "PersistentMap.hpp"
+#include "Types.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Read-only views of a full L3Book for analytics threads. Each side of a view
+// is a persistent map, so after an event the writer rebuilds only the levels
+// that changed, pays O(log n) per level to put them in the map, and publishes
+// a new view that shares every other node and level with the previous one.
+// Readers pin an epoch, traverse a view for as long as they like while the
+// writer carries on, and a view is freed only once no reader can still see
+// it. Freeing a view releases just the nodes and levels no newer view shares.
+
+struct LevelView {
+    Price price;
+    Quantity quantity;
+    int numOrders;
+    std::vector<Order> orders;      // queue order
+};
+
+using LevelViewPtr = std::shared_ptr<const LevelView>;
+using BidLevelViews = PersistentMap<Price, LevelViewPtr, BidComparator>;
+using AskLevelViews = PersistentMap<Price, LevelViewPtr, AskComparator>;
+
+struct BookView {
+    uint64_t version = 0;       // one per published view, from 1
+    Timestamp timestamp = 0;
+    BidLevelViews bids;         // by price, best first
+    AskLevelViews asks;
+};
+
+class BookViewPublisher {
+private:
+    EpochManager epochs;
+    std::atomic<const BookView*> current{nullptr};
+
+    // writer side, the sides of the current view
+    BidLevelViews bidLevels;
+    AskLevelViews askLevels;
+    uint64_t version = 0;
+
+    template<typename Levels, typename Side>
+    bool refreshLevel(Levels& levels, const Side& side, Price price);
+    void swapView(Timestamp timestamp);
+
+public:
+    BookViewPublisher() = default;
+    // no reader may hold a view any more
+    ~BookViewPublisher();
+
+    BookViewPublisher(const BookViewPublisher&) = delete;
+    BookViewPublisher& operator=(const BookViewPublisher&) = delete;
+
+    // Writer: rebuilds the given levels, nothing is published if none changed
+    void publish(const L3Book& book, const DirtyLevels& dirty, Timestamp timestamp);
+    // Writer: rebuilds every level, e.g. for the first view or after a restore
+    void publishFull(const L3Book& book, Timestamp timestamp);
+
+    class Reader {
+    private:
+        BookViewPublisher* publisher;
+        int slot;
+
+    public:
+        explicit Reader(BookViewPublisher& publisher);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // false if all reader slots were taken
+        bool isValid() const { return slot >= 0; }
+        // Calls visit with the latest view, which stays valid for the whole
+        // call. visit gets nullptr before the first publish
+        template<typename Visit>
+        void read(Visit&& visit) {
+            EpochManager::Guard guard = publisher->epochs.pin(slot);
+            visit(publisher->current.load(std::memory_order_seq_cst));
+        }
+    };
+
+    uint64_t getVersion() const { return version; }
+    // levels and views waiting for readers to move on
+    size_t getRetired() const { return epochs.getRetired(); }
+};
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include "DataStructures.hpp"
+#include "DepthFeed.hpp"
 #include "Types.hpp"
+#include <functional>
 
 class OrderBook;
 
@@ -11,6 +13,8 @@ struct Callbacks {
     OrderBookCallback onOrderCancel;
     OrderBookCallback onOrderModify;
     OrderBookCallback onOrderExecution;
+    // aggregated SmartBook depth changes after each input event
+    DepthUpdateCallback onDepthUpdate;
 };
 
 void onOrderAdd(OrderBook& smartOrderBook, const OrderInfo& orderInfo);
@@ -0,0 +1,80 @@
+#pragma once
+#include "FeedParser.hpp"
+#include "MappedFile.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Columnar archive of one capture feed.
+//
+// A file is a header, a run of independently decodable blocks, a block index
+// and a footer pointing at the index. Each block holds up to blockSize
+// records stored column by column: zigzag varint timestamp deltas, prices as
+// tick deltas (ticks = price * priceScale), varint sizes, and for L3 a flags
+// column and order id deltas. Delta state resets at every block so a reader
+// can start at any block found through the index.
+
+struct ArchiveBlockInfo {
+    uint64_t offset;
+    Timestamp firstTimestamp;
+    Timestamp lastTimestamp;
+    uint32_t records;
+    uint32_t bytes;
+};
+
+class ArchiveWriter {
+private:
+    EventType type;
+    int64_t priceScale;
+    size_t blockSize;
+    std::ofstream out;
+    uint64_t offset = 0;
+    std::vector<ArchiveBlockInfo> index;
+
+    // records of the block being built
+    std::vector<Timestamp> timestamps;
+    std::vector<L3Update> l3Updates;
+    std::vector<TradeInfo> trades;
+    std::vector<L2Snapshot> snapshots;
+
+    bool toTicks(Price price, int64_t& ticks) const;
+    bool flushBlock();
+    void write(const std::string& bytes);
+
+public:
+    // priceScale is the number of ticks per unit of price, e.g. 100 for 0.01 ticks
+    explicit ArchiveWriter(EventType type, int64_t priceScale = 100, size_t blockSize = 4096);
+
+    bool open(const std::string& file);
+    // Returns false if a price is not a whole number of ticks
+    bool append(const MarketEvent& event, const L2Snapshot* snapshot);
+    bool close();
+
+    // Converts a text capture in the README format, returns false on any error
+    static bool convert(const std::string& textFile, EventType type, const std::string& archiveFile,
+                        int64_t priceScale = 100, size_t blockSize = 4096);
+};
+
+class ArchiveReader {
+private:
+    MappedFile file;
+    EventType type;
+    int64_t priceScale;
+    std::vector<ArchiveBlockInfo> index;
+
+public:
+    bool open(const std::string& path);
+
+    EventType getType() const { return type; }
+    size_t getBlockCount() const { return index.size(); }
+    const std::vector<ArchiveBlockInfo>& getIndex() const { return index; }
+    size_t getFileSize() const { return file.size(); }
+
+    // Appends the decoded events of block i to out
+    bool readBlock(size_t i, ParsedChunk& out) const;
+
+    // First block that may contain events at or after timestamp
+    size_t findBlock(Timestamp timestamp) const;
+
+    static bool isArchive(const char* data, size_t size);
+};
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+#include "DataStructures.hpp"
+#include "DepthFeed.hpp"
+#include "OrderBook.hpp"
+#include "Types.hpp"
+#include <array>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Depth of one instrument merged across the venues it trades on. Each
+// venue's SmartBook depth feed patches the merged levels as it arrives,
+// so the consolidated book and its BBO are always current and never
+// rebuilt from the venue books. Every merged level keeps each venue's
+// share of it. Single threaded: venues whose books run on other threads
+// must hand their updates over to the thread that owns this book.
+
+const size_t MAX_VENUES = 8;
+
+struct ConsolidatedLevel {
+    Quantity quantity = 0;
+    int numOrders = 0;
+    int numVenues = 0;                          // venues with orders at this price
+    std::array<DepthLevel, MAX_VENUES> venues;  // per venue, by venue id
+};
+
+struct ConsolidatedBbo {
+    Price bidPrice = 0.0;
+    Quantity bidQuantity = 0;
+    int bidVenues = 0;
+    Price askPrice = 0.0;
+    Quantity askQuantity = 0;
+    int askVenues = 0;
+    Timestamp timestamp = 0;        // of the update that last changed it
+
+    bool operator==(const ConsolidatedBbo& other) const {
+        return bidPrice == other.bidPrice && bidQuantity == other.bidQuantity && bidVenues == other.bidVenues
+            && askPrice == other.askPrice && askQuantity == other.askQuantity && askVenues == other.askVenues;
+    }
+    bool operator!=(const ConsolidatedBbo& other) const { return !(*this == other); }
+};
+
+using BboCallback = std::function<void(const ConsolidatedBbo&)>;
+
+class ConsolidatedBook {
+private:
+    struct Venue {
+        std::string name;
+        uint64_t lastSequence = 0;
+        bool synced = false;
+        size_t gaps = 0;
+    };
+
+    std::vector<Venue> venues;
+    OneSideBook<ConsolidatedLevel, BidComparator> bids;
+    OneSideBook<ConsolidatedLevel, AskComparator> asks;
+    ConsolidatedBbo bbo;
+    BboCallback onBboChange;
+
+    template<typename Side>
+    void setLevel(Side& side, int venue, Price price, Quantity quantity, int numOrders);
+    template<typename Side>
+    void clearSide(Side& side, int venue);
+    // takes the venue's levels out of the merged book
+    void clearVenue(int venue);
+    // the best levels are the first of each side, so this is O(1)
+    void refreshBbo(Timestamp timestamp);
+
+public:
+    explicit ConsolidatedBook(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : bids(resource), asks(resource) {}
+
+    // attached depth feeds call back into this book, so it stays put
+    ConsolidatedBook(const ConsolidatedBook&) = delete;
+    ConsolidatedBook& operator=(const ConsolidatedBook&) = delete;
+    ConsolidatedBook(ConsolidatedBook&&) = delete;
+    ConsolidatedBook& operator=(ConsolidatedBook&&) = delete;
+
+    // Returns the venue id, -1 once MAX_VENUES are registered
+    int addVenue(const std::string& name);
+    // Registers a venue fed by orderBook's depth feed, the given callbacks
+    // still run after the merge. Returns the venue id, -1 if full
+    int attach(OrderBook& orderBook, const std::string& name, Callbacks callbacks = Callbacks());
+
+    // Merges one depth update of venue. A snapshot replaces everything the
+    // venue had. On a sequence gap the venue's levels are taken out until
+    // its next snapshot, stale liquidity is worse than none; returns false
+    bool apply(int venue, const DepthUpdate& update);
+
+    // called whenever the merged BBO changes
+    void setBboCallback(const BboCallback& callback) { onBboChange = callback; }
+
+    const ConsolidatedBbo& getBbo() const { return bbo; }
+    Price getBestBid() const { return bbo.bidPrice; }
+    Price getBestAsk() const { return bbo.askPrice; }
+    // one venue's bid at or above another's ask
+    bool isCrossed() const { return bbo.bidPrice != 0.0 && bbo.askPrice != 0.0 && bbo.bidPrice >= bbo.askPrice; }
+
+    const OneSideBook<ConsolidatedLevel, BidComparator>& getBids() const { return bids; }
+    const OneSideBook<ConsolidatedLevel, AskComparator>& getAsks() const { return asks; }
+    // nullptr if no venue has orders at price on that side
+    const ConsolidatedLevel* getLevel(bool isSell, Price price) const;
+
+    size_t getVenueCount() const { return venues.size(); }
+    const std::string& getVenueName(int venue) const { return venues[venue].name; }
+    bool isSynced(int venue) const { return venues[venue].synced; }
+    size_t getGaps(int venue) const { return venues[venue].gaps; }
+};
\ No newline at end of file
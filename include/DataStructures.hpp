@@ -2,6 +2,7 @@
 #include <map>
 #include <unordered_map>
 #include <list>
+#include <memory_resource>
 
 struct BidComparator {
     bool operator()(const double& lhs, const double& rhs) const {
@@ -16,4 +17,4 @@ struct AskComparator {
 };
 
 template<typename LevelType, typename Comparator>
-using OneSideBook = std::map<double, LevelType, Comparator>;
+using OneSideBook = std::pmr::map<double, LevelType, Comparator>;
@@ -0,0 +1,91 @@
+#pragma once
+#include "L3Book.hpp"
+#include "DataStructures.hpp"
+#include "Types.hpp"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Incremental aggregated-depth feed. After each input event the publisher
+// sends only the price levels whose quantity or order count changed, found
+// through the dirty levels of an L3Book. Every update has a sequence number,
+// and a full snapshot goes out first and then every snapshotInterval updates
+// so that a consumer that missed updates can resync.
+
+struct DepthLevelUpdate {
+    Price price;
+    bool isSell;
+    Quantity quantity;      // 0 when the level is gone
+    int numOrders;
+};
+
+struct DepthUpdate {
+    uint64_t sequence = 0;
+    Timestamp timestamp = 0;
+    bool isSnapshot = false;        // replaces the whole book rather than patching it
+    std::vector<DepthLevelUpdate> levels;
+};
+
+using DepthUpdateCallback = std::function<void(const DepthUpdate&)>;
+
+class DepthFeedPublisher {
+private:
+    struct PublishedLevel {
+        Quantity quantity;
+        int numOrders;
+    };
+
+    size_t snapshotInterval;
+    uint64_t sequence = 0;
+    size_t updatesSinceSnapshot = 0;
+    bool snapshotDue = true;
+    std::unordered_map<Price, PublishedLevel> publishedBids;
+    std::unordered_map<Price, PublishedLevel> publishedAsks;
+
+    // reused between events
+    DepthUpdate update;
+
+    void publishSnapshot(const L3Book& book, Timestamp timestamp, const DepthUpdateCallback& callback);
+
+public:
+    // snapshotInterval of 0 only sends the first snapshot and requested ones
+    explicit DepthFeedPublisher(size_t snapshotInterval = 1000) : snapshotInterval(snapshotInterval) {}
+
+    // Turns the dirty levels taken from book into an update, sorting them by
+    // side and price and dropping duplicates in place. Returns false if no
+    // level actually changed, nothing is sent then
+    bool publish(const L3Book& book, DirtyLevels& dirty, Timestamp timestamp, const DepthUpdateCallback& callback);
+
+    // The next publish sends a full snapshot, e.g. after the book was restored
+    void requestSnapshot() { snapshotDue = true; }
+    void setSnapshotInterval(size_t interval) { snapshotInterval = interval; }
+    uint64_t getSequence() const { return sequence; }
+};
+
+struct DepthLevel {
+    Quantity quantity = 0;
+    int numOrders = 0;
+};
+
+// Downstream view rebuilt from a depth feed
+class DepthBook {
+private:
+    OneSideBook<DepthLevel, BidComparator> bids;
+    OneSideBook<DepthLevel, AskComparator> asks;
+    uint64_t lastSequence = 0;
+    bool synced = false;
+    size_t gaps = 0;
+
+public:
+    // Returns false if the update is out of sequence; the book then ignores
+    // deltas until the next snapshot
+    bool apply(const DepthUpdate& update);
+
+    bool isSynced() const { return synced; }
+    size_t getGaps() const { return gaps; }
+    uint64_t getLastSequence() const { return lastSequence; }
+    const OneSideBook<DepthLevel, BidComparator>& getBids() const { return bids; }
+    const OneSideBook<DepthLevel, AskComparator>& getAsks() const { return asks; }
+    Price getBestBid() const { return bids.empty() ? 0.0 : bids.begin()->first; }
+    Price getBestAsk() const { return asks.empty() ? 0.0 : asks.begin()->first; }
+};
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Epoch-based reclamation for one writer and a fixed set of reader threads.
+// A reader pins the current epoch while it holds pointers into shared data.
+// The writer unlinks objects, retires them under the current epoch and moves
+// the epoch forward. An object is freed only when no reader is still pinned
+// at or before the epoch it was retired in, so readers never see freed
+// memory and never wait for the writer.
+
+const size_t EPOCH_MAX_READERS = 64;
+
+class EpochManager {
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<bool> used{false};
+        std::atomic<uint64_t> epoch{0};     // 0 while not pinned
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    std::atomic<uint64_t> globalEpoch{1};
+    ReaderSlot readers[EPOCH_MAX_READERS];
+
+    // writer only
+    std::vector<Retired> limbo;
+
+public:
+    class Guard {
+    private:
+        std::atomic<uint64_t>* slot;
+
+    public:
+        explicit Guard(std::atomic<uint64_t>* slot) : slot(slot) {}
+        Guard(Guard&& other) noexcept : slot(other.slot) { other.slot = nullptr; }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+        ~Guard() { if (slot) slot->store(0, std::memory_order_release); }
+    };
+
+    EpochManager() = default;
+    // frees everything still retired, no reader may be pinned any more
+    ~EpochManager();
+
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    // Claims a reader slot, -1 if all EPOCH_MAX_READERS are taken
+    int registerReader();
+    void unregisterReader(int reader);
+    // Pins the current epoch for reader until the guard goes away. Pins do not nest
+    Guard pin(int reader);
+
+    // Hands object to the manager, it is deleted once no reader can hold it
+    template<typename T>
+    void retire(const T* object) {
+        limbo.push_back({globalEpoch.load(std::memory_order_relaxed), const_cast<T*>(object),
+            [](void* p) { delete static_cast<T*>(p); }});
+    }
+
+    // Starts a new epoch and frees what no pinned reader can reach. Returns
+    // the number of objects freed
+    size_t advance();
+
+    uint64_t getEpoch() const { return globalEpoch.load(std::memory_order_relaxed); }
+    size_t getRetired() const { return limbo.size(); }
+};
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include "Types.hpp"
+#include <string>
+#include <vector>
+
+// Sparse timestamp -> byte offset index of a text capture, stored next to
+// it as a <file>.idx sidecar. One entry is kept per stride bytes, always at
+// the start of a line. The sidecar records the capture's size and
+// modification time and is rebuilt when either changes.
+class FeedIndex {
+public:
+    struct Entry {
+        Timestamp timestamp;
+        uint64_t offset;
+    };
+
+private:
+    std::vector<Entry> entries;
+    uint64_t fileSize = 0;
+    int64_t fileMtime = 0;      // nanoseconds
+
+public:
+    static std::string sidecarPath(const std::string& file) { return file + ".idx"; }
+
+    bool build(const std::string& file, uint64_t stride = 64 << 10);
+    bool save(const std::string& indexFile) const;
+    bool load(const std::string& indexFile);
+
+    // Uses the sidecar if it matches the capture, otherwise rebuilds and rewrites it
+    bool loadOrBuild(const std::string& file, uint64_t stride = 64 << 10);
+
+    // Offset to start reading from so no line with a timestamp >= target is missed
+    uint64_t seek(Timestamp target) const;
+
+    const std::vector<Entry>& getEntries() const { return entries; }
+    uint64_t getFileSize() const { return fileSize; }
+    int64_t getFileMtime() const { return fileMtime; }
+};
\ No newline at end of file
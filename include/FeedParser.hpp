@@ -0,0 +1,51 @@
+#pragma once
+#include "Types.hpp"
+#include "L2Snapshot.hpp"
+#include <memory_resource>
+#include <vector>
+
+// Parsers for the three capture line grammars documented in the README.
+// They decode straight into typed structs and never throw, a malformed
+// line is reported through the returned status.
+
+// Events decoded from one slice of a capture, L2 events index into snapshots.
+// Scratch filled on parse workers, so it takes the thread-safe heap rather
+// than whatever default resource the caller has set
+struct ParsedChunk {
+    std::pmr::vector<MarketEvent> events{std::pmr::new_delete_resource()};
+    std::pmr::vector<L2Snapshot> snapshots{std::pmr::new_delete_resource()};
+    size_t parseErrors = 0;
+};
+
+enum class ParseStatus {
+    OK,
+    EMPTY_LINE,
+    BAD_TIMESTAMP,
+    BAD_ACTION,
+    BAD_SIDE,
+    BAD_NUMBER,
+    TRAILING_DATA
+};
+
+const char* parseStatusName(ParseStatus status);
+
+// Reads the leading timestamp of a capture line and advances p past it
+ParseStatus parseTimestamp(const char*& p, const char* end, Timestamp& out);
+
+// Line bodies, i.e. everything after the timestamp
+ParseStatus parseL2Snapshot(const char* begin, const char* end, L2Snapshot& out);
+ParseStatus parseL3Update(const char* begin, const char* end, L3Update& out);
+ParseStatus parseTrade(const char* begin, const char* end, TradeInfo& out);
+
+// Decodes a full capture line of the given feed into event. L2 snapshots
+// are appended to snapshots and referenced by index. EMPTY_LINE is returned
+// for blank lines, which callers normally just skip.
+ParseStatus parseCaptureLine(const char* begin, const char* end, EventType type,
+                             MarketEvent& event, std::pmr::vector<L2Snapshot>& snapshots);
+
+// Decimal prices with up to 15 significant digits take an exact fixed-point
+// path, anything else falls back to std::from_chars
+bool parsePrice(const char*& p, const char* end, Price& out);
+
+// Position of the next '\n' in [begin, end), or end
+const char* findLineEnd(const char* begin, const char* end);
@@ -1,32 +1,42 @@
 #pragma once
 #include "Types.hpp"
 #include "DataStructures.hpp"
-
-struct L2PriceLevel {
-    Price price;
-    Quantity quantity;
-
-    L2PriceLevel(Price p = 0.0, Quantity q = 0) : price(p), quantity(q) {}
-};
+#include "L2Snapshot.hpp"
+#include <iosfwd>
 
 class L2Book {
 private:
-    OneSideBook<L2PriceLevel, BidComparator> bidBook;
-    OneSideBook<L2PriceLevel, AskComparator> askBook;
+    // current and previous snapshot, clear() rotates between them
+    L2Snapshot snapshots[2];
+    int current = 0;
     Timestamp lastUpdateTime;
+    size_t truncatedLevels = 0;
 
 public:
     void addBidLevel(Price price, Quantity quantity);
     void addAskLevel(Price price, Quantity quantity);
     void clear();
-    const OneSideBook<L2PriceLevel, BidComparator>& getBids() { return bidBook; }
-    const OneSideBook<L2PriceLevel, AskComparator>& getAsks() { return askBook; }
+    void setSnapshot(const L2Snapshot& snapshot);
+    const L2Side& getBids() const { return snapshots[current].bids; }
+    const L2Side& getAsks() const { return snapshots[current].asks; }
+    const L2Snapshot& getSnapshot() const { return snapshots[current]; }
+    const L2Snapshot& getPreviousSnapshot() const { return snapshots[1 - current]; }
+
+    // levels changed since the previous snapshot, one bit per level
+    uint64_t getChangedBidLevels() const { return diffLevels(getBids(), getPreviousSnapshot().bids); }
+    uint64_t getChangedAskLevels() const { return diffLevels(getAsks(), getPreviousSnapshot().asks); }
+
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
 
     Price getBestBid() const;
     Price getBestAsk() const;
     Quantity getBidQuantityAtPrice(Price price) const;
     Quantity getAskQuantityAtPrice(Price price) const;
 
-    bool isEmpty() const { return bidBook.empty() && askBook.empty(); }
+    bool isEmpty() const { return getBids().empty() && getAsks().empty(); }
     Timestamp getLastUpdateTime() const { return lastUpdateTime; }
+    // levels dropped beyond L2_MAX_LEVELS over the book's lifetime,
+    // getSnapshot().truncatedLevels has the current snapshot's
+    size_t getTruncatedLevels() const { return truncatedLevels; }
 };
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include "Types.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Depth cap of a snapshot side, one bit per level in the diffLevels masks.
+// Levels past the cap, from the feed parser or added to an L2Book, are
+// dropped and counted in truncatedLevels
+constexpr size_t L2_MAX_LEVELS = 64;
+
+// One side of an L2 snapshot, held as contiguous aligned price and quantity
+// arrays in book order (best level first). Slots past count are padding so
+// the comparison kernels can always load whole vectors.
+struct L2Side {
+    alignas(32) Price prices[L2_MAX_LEVELS] = {};
+    alignas(32) Quantity quantities[L2_MAX_LEVELS] = {};
+    size_t count = 0;
+
+    // Sets the quantity at price, inserting the level in order if needed.
+    // Returns false when the side is already at L2_MAX_LEVELS.
+    bool setLevel(Price price, Quantity quantity, bool descending);
+    bool push(Price price, Quantity quantity);
+    int find(Price price) const;
+    void clear() { count = 0; }
+    bool empty() const { return count == 0; }
+};
+
+struct L2Snapshot {
+    L2Side bids;
+    L2Side asks;
+    Timestamp timestamp = 0;
+    size_t truncatedLevels = 0;     // levels dropped beyond L2_MAX_LEVELS, either side
+
+    void clear() {
+        bids.clear();
+        asks.clear();
+        timestamp = 0;
+        truncatedLevels = 0;
+    }
+};
+
+// Bit i of the returned mask is set when level i differs in price or
+// quantity between the two sides, or exists on only one of them.
+uint64_t diffLevels(const L2Side& lhs, const L2Side& rhs);
+
+// Individual kernels, diffLevels dispatches to the best one at runtime
+uint64_t diffLevelsScalar(const L2Side& lhs, const L2Side& rhs);
+#if defined(__x86_64__) || defined(__i386__)
+uint64_t diffLevelsSSE2(const L2Side& lhs, const L2Side& rhs);
+uint64_t diffLevelsAVX2(const L2Side& lhs, const L2Side& rhs);
+#endif
+const char* diffLevelsKernelName();
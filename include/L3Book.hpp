@@ -1,35 +1,76 @@
 #pragma once
 #include "Types.hpp"
 #include "DataStructures.hpp"
+#include "L2Snapshot.hpp"
+#include "Logger.hpp"
+#include "OrderPool.hpp"
 #include <iostream>
+#include <vector>
 
+class SignalEngine;
+
+// Aggregates first, then the queue ends: the whole header is half a cache
+// line and sits next to its key in the map node. Not over-aligned, since
+// aligned operator new costs more per level than the line it can save
 struct L3PriceLevel {
     Price price;
     Quantity quantity;
     int numOrders;
-    std::list<Order> orders;
+    OrderQueue orders;
 
     L3PriceLevel(Price p = 0.0) : price(p), quantity(0), numOrders(0) {}
 };
 
+static_assert(sizeof(L3PriceLevel) == 32, "level header must stay within one cache line");
+
+// a level whose quantity or order count changed, possibly listed more than once
+struct DirtyLevel {
+    Price price;
+    bool isSell;
+};
+
+using DirtyLevels = std::pmr::vector<DirtyLevel>;
+
 class L3Book {
 private:
     OneSideBook<L3PriceLevel, BidComparator> bidBook;
     OneSideBook<L3PriceLevel, AskComparator> askBook;
-    std::unordered_map<int, std::list<Order>::iterator> orderMap;
+    OrderPool pool;
+    std::pmr::unordered_map<OrderId, uint32_t> orderMap;     // id to pool index
+
+    bool trackDirty = false;
+    DirtyLevels dirtyLevels;
+
+    void markDirty(Price price, bool isSell) {
+        if (trackDirty) dirtyLevels.push_back({price, isSell});
+    }
+
+    // not carried over by copies or moves
+    SignalEngine* signals = nullptr;
+
+    // after the level's totals changed, before it is erased
+    void levelChanged(bool isSell, const L3PriceLevel& level) {
+        if (signals) notifySignals(isSell, level);
+    }
+    void notifySignals(bool isSell, const L3PriceLevel& level);
+
+    // levels point at pool, after a copy or move they must point at ours
+    void rebindLevels();
 
     template<typename BookType>
-    void removeOrderFromLevel(BookType& book, Price price, std::list<Order>::iterator orderIt) {
+    void removeOrderFromLevel(BookType& book, Price price, OrderQueue::iterator orderIt) {
         auto levelIt = book.find(price);
 
         if (levelIt != book.end()) {
             L3PriceLevel& level = levelIt->second;
             level.quantity -= orderIt->size;
             level.numOrders--;
+            markDirty(price, orderIt->isSell);
+            levelChanged(orderIt->isSell, level);
             level.orders.erase(orderIt);
 
             if (level.numOrders == 0) {
-                std::cout << "Remove price level " << price << std::endl;
+                logStream() << "Remove price level " << price << std::endl;
                 book.erase(levelIt);
             }
         }
@@ -38,9 +79,16 @@ private:
 public:
     std::string name;
 
-    L3Book() : name("L3Book") {}
+    // every container of the book allocates from resource, e.g. a BookArena
+    explicit L3Book(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    // like the std::pmr containers, a copy uses the default resource and an
+    // assignment keeps the target's
+    L3Book(const L3Book& other);
+    L3Book(L3Book&& other);
+    L3Book& operator=(const L3Book& other);
+    L3Book& operator=(L3Book&& other);
 
-    bool addOrder(OrderId orderId, bool isSell, Quantity size, Price price);
+    bool addOrder(OrderId orderId, bool isSell, Quantity size, Price price, Timestamp timestamp = 0);
     bool cancelOrder(OrderId orderId);
     bool cancelOrder(Order& order);
     bool modifyOrder(OrderId orderId, Quantity newSize, Price newPrice);
@@ -48,13 +96,23 @@ public:
     bool modifyOrderId(OrderId orderId, OrderId newId);
     bool executeOrder(Order& order, Quantity executedSize);
     std::vector<OrderInfo> executeAtPrice(Price price, Quantity quantity, bool isGuess);
+    // same, into executions (cleared first) so one buffer serves every trade
+    void executeAtPrice(Price price, Quantity quantity, bool isGuess, std::pmr::vector<OrderInfo>& executions);
 
     bool hasOrder(OrderId orderId) const;
     Order* findOrder(OrderId orderId) const;
+    // pull an order or a level into cache ahead of an update, hints only
+    void prefetchOrder(OrderId orderId) const;
+    void prefetchLevel(bool isSell, Price price) const;
+    // arrival time given to addOrder, 0 if unknown
+    Timestamp getOrderTime(OrderId orderId) const;
     const OneSideBook<L3PriceLevel, BidComparator>& getBids() const { return bidBook; }
     const OneSideBook<L3PriceLevel, AskComparator>& getAsks() const { return askBook; }
     std::vector<L3PriceLevel> getTopAsks(int n=5) const;
     std::vector<L3PriceLevel> getTopBids(int n=5) const;
+    // aggregate depth as an L2 side, returns false if truncated at L2_MAX_LEVELS
+    bool getBidDepth(L2Side& out) const;
+    bool getAskDepth(L2Side& out) const;
 
     Price getBestBid() const;
     Price getBestAsk() const;
@@ -63,6 +121,27 @@ public:
 
     void clear();
     size_t getTotalOrders() const { return orderMap.size(); }
+    // pre-sizes the order pool and id map for orders resting orders
+    void reserve(size_t orders);
+    std::pmr::memory_resource* getResource() const { return bidBook.get_allocator().resource(); }
 
     void printBook(int levels=5) const;
+
+    // Records every level touched by an update until the list is taken, so
+    // depth consumers only look at what changed
+    void setDirtyTracking(bool enabled);
+    const DirtyLevels& getDirtyLevels() const { return dirtyLevels; }
+
+    // Every level change is passed on to engine, nullptr detaches it. The
+    // engine is rebuilt here and whenever the book is assigned or cleared
+    void setSignalEngine(SignalEngine* engine);
+    SignalEngine* getSignalEngine() const { return signals; }
+    // swaps the recorded levels into out, keeping both buffers allocated;
+    // copies instead if out allocates from another resource
+    void takeDirtyLevels(DirtyLevels& out);
+
+    // checkpoint support, orders are written in queue order with their arrival
+    // times, so priority and order age survive a restore
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
 };
\ No newline at end of file
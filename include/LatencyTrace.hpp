@@ -0,0 +1,137 @@
+#pragma once
+#include "Types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <ctime>
+#endif
+
+// Hot path latency tracing. Each event is stamped with the TSC when it enters
+// the book, after the exchange books are updated (BOOK_APPLY), after the
+// SmartBook reconciliation (RECONCILE) and once callbacks and publication are
+// done (CALLBACK). Callbacks fired from inside reconciliation count as
+// CALLBACK time. Parsing runs ahead on the parse threads and is timed per line
+// (PARSE). Samples go into thread-local log-linear histograms, one per stage
+// and event type, and are merged only when a report is taken.
+//
+// Compiled in with -DSOB_LATENCY_TRACE (CMake option of the same name); without
+// it the macros below expand to nothing.
+
+enum class TraceStage {
+    PARSE,
+    BOOK_APPLY,
+    RECONCILE,
+    CALLBACK,
+    TOTAL
+};
+
+const size_t TRACE_STAGES = 5;
+const size_t TRACE_EVENT_TYPES = 3;
+
+const char* traceStageName(TraceStage stage);
+
+inline uint64_t readTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+// Log-linear buckets: values below 16 are exact, above that every power of two
+// is split in 16, so a bucket is within 1/16 of the values it holds
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+private:
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t maxValue = 0;
+
+public:
+    static size_t bucketOf(uint64_t value);
+    static uint64_t bucketStart(size_t bucket);
+
+    // single writer; other threads may merge concurrently
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    uint64_t getCount() const { return total; }
+    uint64_t getMax() const { return maxValue; }
+    // lower bound of the bucket holding the p quantile, p in [0, 1]
+    uint64_t percentile(double p) const;
+};
+
+class LatencyTracer {
+public:
+    static void record(TraceStage stage, EventType type, uint64_t cycles);
+
+    // merged over all threads, including ones that have exited
+    static LatencyHistogram getHistogram(TraceStage stage, EventType type);
+    static void reset();
+
+    // TSC ticks per nanosecond, measured once on first use
+    static double ticksPerNanosecond();
+    // count, p50, p99, p99.9 and max in ns for every stage and type with samples
+    static void dump(std::ostream& out);
+    // writes the report to file when the process exits
+    static void dumpAtExit(const std::string& file);
+};
+
+// Stage marks of one event on the book thread
+class EventTrace {
+private:
+    EventType type;
+    uint64_t start;
+    uint64_t last;
+    uint64_t callbackCycles = 0;    // spent in callbacks since the last mark
+    uint64_t callbackTotal = 0;
+    EventTrace* outer;
+
+    static thread_local EventTrace* current;
+
+public:
+    explicit EventTrace(EventType type);
+    ~EventTrace();
+
+    EventTrace(const EventTrace&) = delete;
+    EventTrace& operator=(const EventTrace&) = delete;
+
+    void mark(TraceStage stage);
+
+    // time in a callback is taken out of the stage it interrupts
+    static void addCallbackTime(uint64_t cycles) {
+        if (current) current->callbackCycles += cycles;
+    }
+};
+
+class CallbackTrace {
+private:
+    uint64_t start = readTsc();
+
+public:
+    ~CallbackTrace() { EventTrace::addCallbackTime(readTsc() - start); }
+};
+
+#ifdef SOB_LATENCY_TRACE
+#define SOB_TRACE_EVENT(name, type) EventTrace name(type)
+#define SOB_TRACE_MARK(name, stage) name.mark(stage)
+#define SOB_TRACE_CALLBACK() CallbackTrace callbackTrace_
+#define SOB_TRACE_START(name) uint64_t name = readTsc()
+#define SOB_TRACE_RECORD(stage, type, start) LatencyTracer::record(stage, type, readTsc() - (start))
+#else
+#define SOB_TRACE_EVENT(name, type)
+#define SOB_TRACE_MARK(name, stage)
+#define SOB_TRACE_CALLBACK()
+#define SOB_TRACE_START(name)
+#define SOB_TRACE_RECORD(stage, type, start)
+#endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include <ostream>
+
+// Destination of the engine's diagnostic output for the calling thread.
+// Defaults to std::cout; replay tasks redirect it to their own log file.
+std::ostream& logStream();
+
+// nullptr restores std::cout
+void setLogStream(std::ostream* stream);
+
+// Redirects the calling thread's log to stream until it goes out of scope,
+// then puts back whatever was set before, also when unwinding
+class LogStreamScope {
+private:
+    std::ostream* previous;
+
+public:
+    explicit LogStreamScope(std::ostream* stream);
+    ~LogStreamScope();
+
+    LogStreamScope(const LogStreamScope&) = delete;
+    LogStreamScope& operator=(const LogStreamScope&) = delete;
+};
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole capture file
+class MappedFile {
+private:
+    const char* mapping = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& file);
+    void close();
+
+    const char* data() const { return mapping; }
+    size_t size() const { return length; }
+};
\ No newline at end of file
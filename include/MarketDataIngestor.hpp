@@ -1,23 +1,124 @@
 #pragma once
 #include "OrderBook.hpp"
 #include "Types.hpp"
-
+#include "MappedFile.hpp"
+#include "CaptureArchive.hpp"
+#include "BinaryFeed.hpp"
+#include "AsyncFileReader.hpp"
+#include "ThreadConfig.hpp"
+#include "ThreadPool.hpp"
+#include <list>
+#include <memory>
+#include <memory_resource>
 
 class MarketDataIngestor {
 public:
-    explicit MarketDataIngestor(OrderBook& orderBook);
+    // resource backs the loaded events, e.g. a per-replay arena
+    explicit MarketDataIngestor(OrderBook& orderBook, size_t parseThreads = 1,
+                                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
+    // Events before start are skipped, text captures seek via their .idx sidecar
     void loadEvents(const std::string& l2File,
                     const std::string& l3File,
-                    const std::string& tradeFile);
+                    const std::string& tradeFile,
+                    Timestamp start = 0);
 
     void processEvents();
 
+    // Writes <prefix><boundary>.ckpt whenever event time crosses a multiple of interval
+    void setCheckpointInterval(Timestamp interval, const std::string& prefix);
+    static std::string checkpointPath(const std::string& prefix, Timestamp boundary);
+
+    // Positions the book at target: restores the checkpoint if given, loads the
+    // events from there on and applies the ones before target. Remaining events
+    // are left for processEvents()
+    bool seek(const std::string& l2File,
+              const std::string& l3File,
+              const std::string& tradeFile,
+              Timestamp target,
+              const std::string& checkpointFile = "");
+
+    // Streams a single feed file (text or archive) into the book, decoding
+    // chunks in parallel while the calling thread applies them in file order
+    bool replayFile(const std::string& file, EventType type);
+
+    // Binary feeds (length-prefixed stream or pcap) carry L3 updates and
+    // trades together. Loading merges them into the loaded events in
+    // timestamp order, replaying decodes straight into the book
+    bool loadBinaryFeed(const std::string& file);
+    bool replayBinaryFeed(const std::string& file);
+
+    void setChunkSize(size_t bytes) { chunkSize = bytes; }
+    // L2 captures only: when the book thread falls behind, replayFile of an
+    // L2 file drops a snapshot if a newer one is already decoded and waiting
+    // in a later chunk. A book that keeps up applies every snapshot. The
+    // stream holds nothing but snapshots, so no L3 update or trade is ever
+    // skipped over; processEvents and the binary feeds never conflate, as
+    // their snapshots are interleaved with the L3 updates and trades they
+    // are reconciled against. An ingestor feeds one book, so all its
+    // snapshots are one instrument
+    void setL2Conflation(bool enabled) { conflateL2 = enabled; }
+    size_t getConflatedSnapshots() const { return conflatedSnapshots; }
+    // replayFile reads text captures in chunkSize blocks through AsyncFileReader
+    // instead of mapping them. A line may span any number of blocks up to the
+    // reader's headroom (64 KiB); a longer one is skipped as one parse error
+    void setAsyncReads(bool enabled, ReadEngine engine = ReadEngine::IO_URING) {
+        asyncReads = enabled;
+        readEngine = engine;
+    }
+    size_t getParseErrors() const { return parseErrors; }
+    // runs of L3 updates and trades with the same timestamp go to the book
+    // as one OrderBook::processBatch, so depth is published once per run
+    void setBatchApply(bool enabled) { batchApply = enabled; }
+    // Pins the parse workers to config.parserCpus, and the calling thread to
+    // config.bookCpu whenever it enters processEvents or a replay. With a
+    // polling wait the book thread polls for decoded chunks and idle
+    // workers poll the queue instead of sleeping
+    void setThreadConfig(const ThreadConfig& config);
+
 //private:
     OrderBook& orderBook;
-    std::vector<MarketEvent> events;
+    std::pmr::vector<MarketEvent> events;
+    std::pmr::vector<L2Snapshot> snapshots;
+    std::list<MappedFile> files;        // file contents, events point into these
+    std::unique_ptr<ThreadPool> parsePool;
+    ThreadConfig threadConfig;
+    size_t chunkSize = 4 << 20;
+    size_t parseErrors = 0;
+    bool conflateL2 = false;
+    bool batchApply = false;
+    size_t conflatedSnapshots = 0;
+    bool asyncReads = false;
+    ReadEngine readEngine = ReadEngine::IO_URING;
+    Timestamp startTime = 0;
+    Timestamp checkpointInterval = 0;
+    std::string checkpointPrefix;
 
+    // Text captures and CaptureArchive files are both accepted
     void loadFile(const std::string& file, EventType type);
+    bool loadArchive(const std::string& file, EventType type);
+    void appendChunk(ParsedChunk& chunk);
+    void decodeChunks(size_t count, std::vector<ParsedChunk>& parsed,
+                      const std::function<void(size_t, ParsedChunk&)>& decode);
+    // prepare(i) runs on the calling thread, in order, before chunk i is decoded,
+    // finish(i) once its events are applied
+    void replayChunks(size_t count, const std::function<void(size_t, ParsedChunk&)>& decode,
+                      const std::function<void(size_t)>& prepare = nullptr,
+                      const std::function<void(size_t)>& finish = nullptr);
+    // waits for a decoded chunk as threadConfig.wait says
+    void awaitChunk(std::future<void>& done) const;
+    size_t maxChunksInFlight() const { return parsePool ? parsePool->size() * 2 : 1; }
+    bool replayTextAsync(const std::string& file, EventType type);
+    static void readArchiveBlock(const ArchiveReader& reader, size_t i, ParsedChunk& out);
+    void processEvent(const MarketEvent& event, const L2Snapshot* eventSnapshots);
+    // applies events[begin] or, when batching, the run starting there; returns where the next starts
+    size_t processNext(const MarketEvent* events, size_t begin, size_t end, const L2Snapshot* eventSnapshots);
+
+    // Splits [begin, end) into slices of roughly chunkSize ending on a newline
+    std::vector<std::pair<const char*, const char*>> splitChunks(const char* begin, const char* end) const;
+    static void parseChunk(const char* begin, const char* end, EventType type, ParsedChunk& out);
 
-    void parseL2Snapshot(const std::string& data, Timestamp timestamp);
+    // Decodes one capture line into an event, returns false if it is malformed
+    static bool parseLine(const char* begin, const char* end, EventType type,
+                          MarketEvent& event, std::pmr::vector<L2Snapshot>& snapshots, size_t& parseErrors);
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+#include "LatencyTrace.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Named counters, gauges and histograms. A metric is created once by name,
+// under the registry lock, and updated through the returned reference with
+// relaxed atomics, so the hot path never locks. Any thread may read while
+// the book threads update.
+
+class MetricCounter {
+private:
+    std::atomic<uint64_t> value{0};
+
+public:
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    void reset() { value.store(0, std::memory_order_relaxed); }
+};
+
+class MetricGauge {
+private:
+    std::atomic<int64_t> value{0};
+
+public:
+    void set(int64_t n) { value.store(n, std::memory_order_relaxed); }
+    void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Same log-linear buckets as LatencyHistogram, but safe for several writers
+class MetricHistogram {
+private:
+    std::atomic<uint64_t> counts[LatencyHistogram::BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maxValue{0};
+
+public:
+    void record(uint64_t value);
+    void reset();
+
+    uint64_t getCount() const { return total.load(std::memory_order_relaxed); }
+    uint64_t getSum() const { return sum.load(std::memory_order_relaxed); }
+    uint64_t getMax() const { return maxValue.load(std::memory_order_relaxed); }
+    // lower bound of the bucket holding the p quantile, p in [0, 1]
+    uint64_t percentile(double p) const;
+};
+
+class MetricsRegistry {
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<MetricCounter>> counters;
+    std::map<std::string, std::unique_ptr<MetricGauge>> gauges;
+    std::map<std::string, std::unique_ptr<MetricHistogram>> histograms;
+
+public:
+    // the registry books report to unless given another one
+    static MetricsRegistry& global();
+
+    // Returns the metric of that name, creating it on first use. References
+    // stay valid for the lifetime of the registry
+    MetricCounter& counter(const std::string& name);
+    MetricGauge& gauge(const std::string& name);
+    MetricHistogram& histogram(const std::string& name);
+
+    // query by name, false if there is no such metric
+    bool getCounter(const std::string& name, uint64_t& value) const;
+    bool getGauge(const std::string& name, int64_t& value) const;
+    const MetricHistogram* findHistogram(const std::string& name) const;
+    std::map<std::string, uint64_t> getCounters() const;
+
+    // zeroes counters and histograms, gauges keep their level
+    void reset();
+
+    // one "name value" line per counter and gauge, count, mean, p50, p99 and
+    // max lines per histogram, sorted by name
+    void write(std::ostream& out) const;
+};
+
+// Rewrites a file with the registry contents every interval from a
+// background thread. Each flush also reports the per second rate of every
+// counter since the previous flush as "<name>.per_sec".
+class MetricsFlusher {
+private:
+    MetricsRegistry& registry;
+    std::string file;
+    std::chrono::milliseconds interval;
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    bool running = false;
+
+    std::map<std::string, uint64_t> lastCounts;
+    std::map<std::string, double> rates;
+    std::chrono::steady_clock::time_point lastFlush;
+
+public:
+    MetricsFlusher(MetricsRegistry& registry, const std::string& file,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+    ~MetricsFlusher();
+
+    MetricsFlusher(const MetricsFlusher&) = delete;
+    MetricsFlusher& operator=(const MetricsFlusher&) = delete;
+
+    // the flushing thread is pinned to cpu unless it is -1
+    void start(int cpu = -1);
+    // stops the thread and writes a final flush
+    void stop();
+
+    // Writes the file now, through a temporary and a rename so readers never
+    // see it half written
+    bool flush();
+    // rate of the counter over the last flush interval, 0 before the first flush
+    double getRate(const std::string& counter) const;
+};
\ No newline at end of file
@@ -1,14 +1,57 @@
 #pragma once
 #include "L2Book.hpp"
 #include "L3Book.hpp"
+#include "PersistentBook.hpp"
 #include "TradeContainer.hpp"
 #include "Callbacks.hpp"
+#include "FeedParser.hpp"
+#include "BookView.hpp"
+#include "LatencyTrace.hpp"
+#include "Metrics.hpp"
+#include "SignalEngine.hpp"
 #include <unordered_map>
 #include <functional>
+#include <memory>
+#include <memory_resource>
 #include <queue>
 #include <string>
 #include <random>
 
+// Reconciliation metrics of a book, resolved once so an update is a single
+// atomic add. A guess or aggressor is counted once when it is created and
+// once when it leaves the deduction state, so created = confirmed +
+// invalidated + expired + live. Latencies are in feed timestamp units.
+struct BookMetrics {
+    MetricCounter* guessesCreated;
+    MetricCounter* guessesConfirmed;
+    MetricCounter* guessesInvalidated;
+    MetricCounter* guessesExpired;
+    MetricCounter* aggressorsCreated;
+    MetricCounter* aggressorsConfirmed;
+    MetricCounter* aggressorsExpired;
+    MetricCounter* corrections;         // corrective messages sent downstream
+    MetricCounter* coalesced;           // downstream messages saved by the coalescing window
+    MetricHistogram* guessConfirmLatency;
+    MetricHistogram* aggressorConfirmLatency;
+    MetricGauge* liveGuesses;
+    MetricGauge* liveAggressors;
+    MetricGauge* smartOrders;
+    MetricGauge* smartLevels;
+    MetricGauge* exchangeOrders;
+    std::string prefix;
+
+    explicit BookMetrics(MetricsRegistry& registry, const std::string& prefix = "");
+};
+
+// Expected shape of an instrument's book, see OrderBook::warmup
+struct WarmupConfig {
+    size_t orders = 0;          // resting orders at the busiest point of the day
+    size_t levels = 20;         // price levels per side the synthetic workload spreads over
+    Price price = 100.0;        // around where the instrument trades
+    Price tick = 0.01;
+    size_t rounds = 0;          // synthetic add, trade and cancel rounds, 0 skips the workload
+};
+
 class OrderBook {
 private:
     L3Book smartBook;
@@ -17,12 +60,91 @@ private:
     TradeContainer* tradeContainer;
 
     Callbacks callbacks;
+    DepthFeedPublisher depthFeed;
+    std::unique_ptr<BookViewPublisher> bookViews;
+    std::unique_ptr<SignalEngine> signalEngine;
+    DirtyLevels dirtyLevels;
+    bool printBooks = true;
+
+    void publishDepth(Timestamp timestamp);
+
+    // Once forking is enabled the SmartBook lives in persistentBook, which
+    // forks share, and smartBook stays empty. A branch owns its L2 book and
+    // trades and keeps no exchange L3 book (l3Book is null)
+    std::unique_ptr<PersistentL3Book> persistentBook;
+    std::unique_ptr<L2Book> ownedL2Book;
+    std::unique_ptr<TradeContainer> ownedTrades;
+    std::pmr::vector<Price> staleLevels;
+
+    // the SmartBook operations of the deduction logic, on whichever book holds it
+    bool smartAddOrder(OrderId orderId, bool isSell, Quantity size, Price price, Timestamp timestamp);
+    bool smartCancelOrder(OrderId orderId);
+    bool smartModifyOrder(OrderId orderId, Quantity size, Price price);
+    bool smartModifyOrderId(OrderId orderId, OrderId newId);
+    bool smartHasOrder(OrderId orderId) const;
+    void smartExecuteAtPrice(Price price, Quantity quantity, bool isGuess);
+    bool smartDepth(bool isSell, L2Side& out) const;
+    // false if the SmartBook has no level at price
+    bool findSmartLevel(bool isSell, Price price, Quantity& quantity) const;
+    // prices of the SmartBook levels on one side that are missing from l2Side,
+    // down to its last level when it is full
+    void findStaleLevels(bool isSell, const L2Side& l2Side);
+    // pending executions by order id, the ones whose guess is gone are dropped
+    std::vector<OrderId> pendingExecutionIds() const;
 
     // deduction logic
-    std::unordered_map<OrderId, OrderInfo> guesses;
-    std::list<OrderInfo> aggressors;
-    std::queue<OrderInfo*> guessedExecutions;
+    using GuessMap = std::pmr::unordered_map<OrderId, OrderInfo>;
+    GuessMap guesses;
+    std::pmr::list<OrderInfo> aggressors;
+    std::queue<OrderInfo*, std::pmr::deque<OrderInfo*>> guessedExecutions;
+    // scratch space reused from event to event, so the hot path stops allocating once warm
+    std::pmr::vector<OrderInfo> executions;
+    std::pmr::vector<const OrderInfo*> expiredGuesses;
+    std::pmr::vector<GuessMap::iterator> guessScan;
     Timestamp lastReconciliationTime;
+    OrderId nextGuessOrderId = -1;      // dummy ids for guessed orders, per book
+    uint64_t nextGuessSequence = 0;
+    Timestamp guessExpiry = 0;
+    Timestamp nextExpirySweep = 0;
+
+    // A sink no one exports, shared by every book until setMetrics gives it a
+    // registry. Built once, so books register nothing just by being created
+    static const BookMetrics& detachedMetrics();
+    BookMetrics metrics = detachedMetrics();
+
+    // downstream actions held back by the coalescing window, in arrival order
+    struct HeldAction {
+        OrderInfo info;
+        Timestamp deadline;
+    };
+    Timestamp coalesceWindow = 0;
+    std::pmr::list<HeldAction> heldActions;
+    std::pmr::unordered_map<OrderId, std::pmr::list<HeldAction>::iterator> heldByOrder;
+
+    void emitAction(const OrderInfo& info);
+    void emitCorrection(const OrderInfo& info);
+    void dispatchAction(const OrderInfo& info);
+    void releaseAction(OrderId orderId, bool confirmed);
+    void releaseActions(Timestamp timestamp);
+    // a held action of from is sent as to once released
+    void rekeyHeldAction(OrderId from, OrderId to);
+
+    // Adds info under orderId, stamped with the next sequence number, unless
+    // a guess for orderId is already there
+    std::pair<GuessMap::iterator, bool> insertGuess(OrderId orderId, const OrderInfo& info);
+    // Guesses in insertion order, so reconciliation picks the same one
+    // whatever the hash table's layout, e.g. after a checkpoint restore.
+    // Erasing one of them leaves the others valid
+    const std::pmr::vector<GuessMap::iterator>& scanGuesses();
+
+    void confirmGuess(const OrderInfo& guess) { confirmGuess(guess, guess.orderId); }
+    // orderId is the exchange id the guess turned out to be
+    void confirmGuess(const OrderInfo& guess, OrderId orderId);
+    void expireGuesses(Timestamp timestamp);
+    void finishEvent(Timestamp timestamp);
+    // publish false leaves depth, views and gauges to the end of a batch
+    void applyL3Update(const L3Update& update, bool publish);
+    void applyTrade(const TradeInfo& trade, bool publish);
 
     // random variables
     double executionProbability = 0.3;
@@ -31,15 +153,58 @@ private:
 
 public:
     OrderBook() {};
-    OrderBook(L2Book& l2Book, L3Book& l3Book, TradeContainer& trades, double executionProbability=0.3);
+    // The SmartBook and the deduction state allocate from resource, e.g. the
+    // BookArena that also backs l3Book and trades
+    OrderBook(L2Book& l2Book, L3Book& l3Book, TradeContainer& trades, double executionProbability=0.3,
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-    void setCallbacks(const Callbacks& callbackset) { callbacks = callbackset; }
+    void setCallbacks(const Callbacks& callbackset);
+    // full snapshot in the depth feed every interval updates
+    void setDepthSnapshotInterval(size_t interval) { depthFeed.setSnapshotInterval(interval); }
+    // dump both L3 books to the log after every L3 update
+    void setPrintBook(bool enabled) { printBooks = enabled; }
+    // report to registry, e.g. the global one; prefix keeps books sharing it apart
+    void setMetrics(MetricsRegistry& registry, const std::string& prefix = "") { metrics = BookMetrics(registry, prefix); }
+    const std::string& getMetricsPrefix() const { return metrics.prefix; }
+    // Drops guesses and aggressors still unconfirmed after age, 0 keeps them
+    // forever. A guessed new order also leaves the SmartBook, with a CANCEL sent
+    void setGuessExpiry(Timestamp age) { guessExpiry = age; }
+    // Holds guessed actions for window (event time) so a correction or a
+    // further action on the same order goes out as one net message; 0 sends
+    // everything immediately. Held actions are not part of a checkpoint
+    void setCoalesceWindow(Timestamp window);
+    // sends every held action, call at the end of a stream
+    void flushActions();
+    // Publishes a read-only view of the SmartBook after every event that
+    // changed it, for readers on other threads
+    BookViewPublisher& enableBookViews();
+    BookViewPublisher* getBookViews() { return bookViews.get(); }
+    // Keeps imbalance, microprice and the other signals of the SmartBook's
+    // top depth levels up to date as the book changes. An engine that is
+    // already enabled keeps its depth
+    SignalEngine& enableSignals(int depth = 5);
+    SignalEngine* getSignals() { return signalEngine.get(); }
+    // Call before the feed starts. Sizes the pools and id tables of both
+    // books and the deduction state for config.orders, so they do not grow
+    // on the feed, then runs config.rounds of a synthetic session through a
+    // scratch OrderBook on the same memory resource. That warms the caches
+    // and branch predictors of the whole event path and leaves the nodes it
+    // frees in the resource for the real books; its outputs are discarded
+    void warmup(const WarmupConfig& config);
 
     // process market data
     void processL2Snapshot(const std::string& data, Timestamp timestamp);
+    void processL2Snapshot(const L2Snapshot& snapshot, Timestamp timestamp);
     void processL3Update(const std::string& data, Timestamp timestamp);
+    void processL3Update(const L3Update& update);
     void processTrade(const TradeInfo& trade);
     void processTrade(const std::string& data, Timestamp timestamp);
+    // Applies the L3 updates and trades of one exchange packet in order,
+    // with the order and level entries of the whole batch prefetched up
+    // front. Depth, book views and gauges are published once, as of the
+    // last event, so a level touched many times goes out as one change.
+    // Other event types are skipped
+    void processBatch(const MarketEvent* events, size_t count);
 
     // smart deduction methods
     std::pair<bool, bool> deduceIsSellAggressor(Price price) const;
@@ -53,10 +218,27 @@ public:
     bool reconcileCancel(OrderId orderId);
     bool reconcileTrade(Price price, Quantity quantity);
 
-    std::unordered_map<OrderId, OrderInfo> getGuesses() const { return guesses; }
-    std::list<OrderInfo> getAggressors() const { return aggressors; }
+    const GuessMap& getGuesses() const { return guesses; }
+    const std::pmr::list<OrderInfo>& getAggressors() const { return aggressors; }
 
+    // empty once forking is enabled, see getPersistentSmartBook
     const L3Book& getSmartOrderBook() { return smartBook; }
+    const PersistentL3Book* getPersistentSmartBook() const { return persistentBook.get(); }
+
+    // Moves the SmartBook into a persistent book, one O(n) copy, so fork()
+    // is O(1) from then on. Updates then copy the level they touch, and the
+    // SmartBook feeds no depth updates, book views or signals
+    void enableForking();
+    // What-if branch of this book that deduces with executionProbability
+    // from here on. It shares the SmartBook, copies the deduction state
+    // (guesses, aggressors, held actions, RNG) and the L2 book, and starts
+    // with no callbacks, exchange L3 book or trade history. O(1) plus the
+    // deduction state once forking is enabled, O(n) before
+    std::unique_ptr<OrderBook> fork(double executionProbability) const;
+
+    // Full book and deduction state, so a replay can resume from timestamp
+    void saveCheckpoint(std::ostream& out, Timestamp timestamp) const;
+    bool loadCheckpoint(std::istream& in, Timestamp& timestamp);
 
     void onOrderAdd(OrderBook& smartOrderBook, const OrderInfo& orderInfo);
     void onOrderCancel(OrderBook& smartOrderBook, const OrderInfo& orderInfo);
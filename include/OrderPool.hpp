@@ -0,0 +1,152 @@
+#pragma once
+#include "Types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+// Resting orders of one L3Book. The part of an order a queue scan reads is a
+// 32 byte node, two to a cache line, linked to its neighbours by 32 bit
+// indices; metadata that only a few readers want sits in a parallel array
+// under the same index. Nodes live in fixed chunks that never move, so an
+// Order& stays valid until its order is released, and released nodes are
+// reused before the pool grows. Chunks come from the book's memory resource.
+
+const uint32_t ORDER_NIL = UINT32_MAX;
+
+struct OrderNode {
+    Order order;
+    uint32_t prev;
+    uint32_t next;      // free list link once released
+};
+
+static_assert(sizeof(OrderNode) == 32, "two order nodes per cache line");
+
+struct OrderMeta {
+    Timestamp timestamp = 0;    // when the order was added, 0 if not known
+};
+
+class OrderPool {
+private:
+    static constexpr uint32_t CHUNK_BITS = 10;     // 1024 nodes, 32 KiB
+    static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+
+    std::pmr::memory_resource* resource;
+    std::pmr::vector<OrderNode*> chunks;
+    std::pmr::vector<OrderMeta*> metaChunks;
+    uint32_t top = 0;           // nodes ever handed out since the last clear
+    uint32_t freeHead = ORDER_NIL;
+    size_t used = 0;
+
+    void addChunk();
+    void releaseChunks();
+
+public:
+    explicit OrderPool(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : resource(resource), chunks(resource), metaChunks(resource) {}
+    ~OrderPool() { releaseChunks(); }
+    // Copies keep the same indices, so queues and id maps copy as they are.
+    // Like the std::pmr containers, a copy uses the default resource and an
+    // assignment keeps the resource of the target
+    OrderPool(const OrderPool& other);
+    OrderPool& operator=(const OrderPool& other);
+    OrderPool(OrderPool&& other);
+    OrderPool& operator=(OrderPool&& other);
+
+    uint32_t allocate(const Order& order, Timestamp timestamp);
+    void release(uint32_t index);
+    // releases every node, chunks are kept for reuse
+    void clear();
+    // grows to hold orders nodes without allocating later
+    void reserve(size_t orders);
+
+    OrderNode& node(uint32_t index) { return chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)]; }
+    const OrderNode& node(uint32_t index) const { return chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)]; }
+    OrderMeta& meta(uint32_t index) { return metaChunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)]; }
+    const OrderMeta& meta(uint32_t index) const { return metaChunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)]; }
+
+    size_t size() const { return used; }
+    size_t capacity() const { return chunks.size() * CHUNK_SIZE; }
+};
+
+// Time priority queue of one price level, threaded through its book's pool.
+// Iterates like the std::list it replaces; copies are views of the same nodes
+class OrderQueue {
+private:
+    OrderPool* pool = nullptr;
+    uint32_t head = ORDER_NIL;
+    uint32_t tail = ORDER_NIL;
+
+public:
+    template<typename Pool, typename Value>
+    class Iterator {
+    private:
+        Pool* pool;
+        uint32_t current;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Order;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        Iterator(Pool* pool = nullptr, uint32_t current = ORDER_NIL) : pool(pool), current(current) {}
+        // iterator to const_iterator
+        template<typename OtherPool, typename OtherValue>
+        Iterator(const Iterator<OtherPool, OtherValue>& other) : pool(other.getPool()), current(other.index()) {}
+
+        reference operator*() const { return pool->node(current).order; }
+        pointer operator->() const { return &pool->node(current).order; }
+        Iterator& operator++() { current = pool->node(current).next; return *this; }
+        Iterator operator++(int) { Iterator prior = *this; ++*this; return prior; }
+        bool operator==(const Iterator& other) const { return current == other.current; }
+        bool operator!=(const Iterator& other) const { return current != other.current; }
+
+        uint32_t index() const { return current; }
+        Pool* getPool() const { return pool; }
+    };
+
+    using iterator = Iterator<OrderPool, Order>;
+    using const_iterator = Iterator<const OrderPool, const Order>;
+
+    // a level's pool is set when it receives its first order
+    void bind(OrderPool* orderPool) { pool = orderPool; }
+
+    iterator begin() { return iterator(pool, head); }
+    // reads nothing, so it can be taken before the last order (and with it the level) goes
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(pool, head); }
+    const_iterator end() const { return const_iterator(); }
+
+    bool empty() const { return head == ORDER_NIL; }
+    Order& front() { return pool->node(head).order; }
+    const Order& front() const { return pool->node(head).order; }
+    Order& back() { return pool->node(tail).order; }
+    const Order& back() const { return pool->node(tail).order; }
+
+    iterator push_back(const Order& order, Timestamp timestamp = 0) {
+        uint32_t index = pool->allocate(order, timestamp);
+        OrderNode& node = pool->node(index);
+        node.prev = tail;
+        node.next = ORDER_NIL;
+        if (tail == ORDER_NIL) head = index;
+        else pool->node(tail).next = index;
+        tail = index;
+        return iterator(pool, index);
+    }
+
+    // unlinks and releases the order, returns the one after it
+    iterator erase(iterator it) {
+        uint32_t index = it.index();
+        OrderNode& node = pool->node(index);
+        uint32_t next = node.next;
+        if (node.prev == ORDER_NIL) head = next;
+        else pool->node(node.prev).next = next;
+        if (next == ORDER_NIL) tail = node.prev;
+        else pool->node(next).prev = node.prev;
+        pool->release(index);
+        return iterator(pool, next);
+    }
+};
\ No newline at end of file
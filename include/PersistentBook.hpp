@@ -0,0 +1,85 @@
+#pragma once
+#include "DataStructures.hpp"
+#include "L3Book.hpp"
+#include "PersistentMap.hpp"
+#include "Types.hpp"
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// L3 book for what-if branches. Both sides and the order index are
+// persistent maps and a level is immutable once built, so fork() is O(1)
+// and a write copies only the level it touches and the tree paths down to
+// it. Hundreds of branches taken from one starting book share everything
+// they have not changed. Same add, modify and cancel semantics as L3Book,
+// without the logging.
+
+struct PersistentLevel {
+    Quantity quantity = 0;
+    int numOrders = 0;
+    std::vector<Order> orders;      // queue order
+};
+
+using LevelPtr = std::shared_ptr<const PersistentLevel>;
+
+class PersistentL3Book {
+private:
+    struct OrderLocation {
+        Price price;
+        bool isSell;
+    };
+
+    PersistentMap<Price, LevelPtr, BidComparator> bids;
+    PersistentMap<Price, LevelPtr, AskComparator> asks;
+    PersistentMap<OrderId, OrderLocation> orders;
+
+    // replaces the level at price, an empty level is removed
+    void storeLevel(bool isSell, Price price, const PersistentLevel& level);
+
+public:
+    PersistentL3Book() = default;
+    // O(n) copy of a live book, the starting point for branches
+    explicit PersistentL3Book(const L3Book& book);
+
+    // O(1), the branch and this book share all structure until either writes
+    PersistentL3Book fork() const { return *this; }
+
+    bool addOrder(OrderId orderId, bool isSell, Quantity size, Price price);
+    bool cancelOrder(OrderId orderId);
+    // amend down keeps priority, anything else requeues the order
+    bool modifyOrder(OrderId orderId, Quantity newSize, Price newPrice);
+    bool executeOrder(OrderId orderId, Quantity executedSize);
+    // keeps the order's place in the queue
+    bool modifyOrderId(OrderId orderId, OrderId newId);
+    // fills resting orders at the best level at price in queue order
+    std::vector<OrderInfo> executeAtPrice(Price price, Quantity quantity, bool isGuess);
+    // same, into executions (cleared first) so one buffer serves every trade
+    void executeAtPrice(Price price, Quantity quantity, bool isGuess, std::pmr::vector<OrderInfo>& executions);
+
+    bool hasOrder(OrderId orderId) const { return orders.find(orderId) != nullptr; }
+    // valid until the next write to this book
+    const Order* findOrder(OrderId orderId) const;
+    // nullptr if there is no level at price on that side
+    const PersistentLevel* getLevel(bool isSell, Price price) const;
+    // same, but the level stays valid across writes for as long as it is held
+    LevelPtr shareLevel(bool isSell, Price price) const;
+    // aggregate depth as an L2 side, returns false if truncated at L2_MAX_LEVELS
+    bool getBidDepth(L2Side& out) const;
+    bool getAskDepth(L2Side& out) const;
+
+    Price getBestBid() const;
+    Price getBestAsk() const;
+    size_t getTotalOrders() const { return orders.size(); }
+    size_t getBidLevels() const { return bids.size(); }
+    size_t getAskLevels() const { return asks.size(); }
+    bool empty() const { return orders.empty(); }
+
+    // visit(price, level) best first until it returns false
+    template<typename Visit>
+    void forEachBid(Visit&& visit) const { bids.forEach([&](Price price, const LevelPtr& level) { return visit(price, *level); }); }
+    template<typename Visit>
+    void forEachAsk(Visit&& visit) const { asks.forEach([&](Price price, const LevelPtr& level) { return visit(price, *level); }); }
+
+    // rebuilds a live book with the same levels and queue order
+    void toL3Book(L3Book& out) const;
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Immutable ordered map (treap) with structural sharing. Nodes are never
+// changed once built: an update copies the O(log n) nodes on the path to the
+// key and shares everything else, so a copy of the map is O(1) and two copies
+// only pay for the paths where they differ. Priorities come from a hash of the
+// key, so the same keys always give the same shape.
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+class PersistentMap {
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node {
+        Key key;
+        Value value;
+        uint64_t priority;
+        NodePtr left;
+        NodePtr right;
+    };
+
+    NodePtr root;
+    size_t count = 0;
+
+    static uint64_t priorityOf(const Key& key) {
+        uint64_t x = std::hash<Key>()(key) + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static NodePtr makeNode(const Key& key, const Value& value, uint64_t priority, NodePtr left, NodePtr right) {
+        return std::make_shared<const Node>(Node{key, value, priority, std::move(left), std::move(right)});
+    }
+
+    static NodePtr withChildren(const NodePtr& node, NodePtr left, NodePtr right) {
+        return makeNode(node->key, node->value, node->priority, std::move(left), std::move(right));
+    }
+
+    // keys ordered before key go to lower, the rest to upper
+    static void split(const NodePtr& node, const Key& key, NodePtr& lower, NodePtr& upper) {
+        if (!node) {
+            lower = nullptr;
+            upper = nullptr;
+        } else if (Compare()(node->key, key)) {
+            NodePtr rest;
+            split(node->right, key, rest, upper);
+            lower = withChildren(node, node->left, rest);
+        } else {
+            NodePtr rest;
+            split(node->left, key, lower, rest);
+            upper = withChildren(node, rest, node->right);
+        }
+    }
+
+    static NodePtr merge(const NodePtr& lower, const NodePtr& upper) {
+        if (!lower) return upper;
+        if (!upper) return lower;
+        if (lower->priority > upper->priority) {
+            return withChildren(lower, lower->left, merge(lower->right, upper));
+        }
+        return withChildren(upper, merge(lower, upper->left), upper->right);
+    }
+
+    static NodePtr insert(const NodePtr& node, const Key& key, const Value& value, uint64_t priority) {
+        if (!node || priority > node->priority) {
+            NodePtr lower, upper;
+            split(node, key, lower, upper);
+            return makeNode(key, value, priority, lower, upper);
+        }
+        if (Compare()(key, node->key)) {
+            return withChildren(node, insert(node->left, key, value, priority), node->right);
+        }
+        return withChildren(node, node->left, insert(node->right, key, value, priority));
+    }
+
+    static NodePtr replace(const NodePtr& node, const Key& key, const Value& value) {
+        if (Compare()(key, node->key)) {
+            return withChildren(node, replace(node->left, key, value), node->right);
+        }
+        if (Compare()(node->key, key)) {
+            return withChildren(node, node->left, replace(node->right, key, value));
+        }
+        return makeNode(node->key, value, node->priority, node->left, node->right);
+    }
+
+    static NodePtr remove(const NodePtr& node, const Key& key) {
+        if (Compare()(key, node->key)) {
+            return withChildren(node, remove(node->left, key), node->right);
+        }
+        if (Compare()(node->key, key)) {
+            return withChildren(node, node->left, remove(node->right, key));
+        }
+        return merge(node->left, node->right);
+    }
+
+    const Node* leftmost() const {
+        const Node* node = root.get();
+        while (node && node->left) node = node->left.get();
+        return node;
+    }
+
+public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const Value* find(const Key& key) const {
+        const Node* node = root.get();
+        while (node) {
+            if (Compare()(key, node->key)) node = node->left.get();
+            else if (Compare()(node->key, key)) node = node->right.get();
+            else return &node->value;
+        }
+        return nullptr;
+    }
+
+    // first entry in map order, nullptr if empty
+    const Key* firstKey() const { const Node* node = leftmost(); return node ? &node->key : nullptr; }
+    const Value* firstValue() const { const Node* node = leftmost(); return node ? &node->value : nullptr; }
+
+    void set(const Key& key, const Value& value) {
+        if (find(key)) {
+            root = replace(root, key, value);
+        } else {
+            root = insert(root, key, value, priorityOf(key));
+            count++;
+        }
+    }
+
+    bool erase(const Key& key) {
+        if (!find(key)) {
+            return false;
+        }
+        root = remove(root, key);
+        count--;
+        return true;
+    }
+
+    // Calls visit(key, value) in map order until it returns false
+    template<typename Visit>
+    void forEach(Visit&& visit) const {
+        std::vector<const Node*> stack;
+        const Node* node = root.get();
+        while (node || !stack.empty()) {
+            while (node) {
+                stack.push_back(node);
+                node = node->left.get();
+            }
+            node = stack.back();
+            stack.pop_back();
+            if (!visit(node->key, node->value)) return;
+            node = node->right.get();
+        }
+    }
+};
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include "Types.hpp"
+#include <string>
+#include <vector>
+
+// One independent (instrument, day) replay from a manifest line:
+//   <name> <l2 file> <l3 file> <trade file>
+struct ReplayTask {
+    std::string name;
+    std::string l2File;
+    std::string l3File;
+    std::string tradeFile;
+};
+
+struct ReplayStats {
+    std::string name;
+    bool ok = false;
+    size_t events = 0;
+    size_t l2Snapshots = 0;
+    size_t l3Updates = 0;
+    size_t trades = 0;
+    size_t parseErrors = 0;
+    size_t l3Orders = 0;
+    size_t smartOrders = 0;
+    size_t openGuesses = 0;
+    size_t arenaBytes = 0;          // loaded events
+    size_t bookArenaBytes = 0;      // books and deduction state
+    double elapsedMs = 0.0;
+};
+
+// Runs replays in parallel on a work-stealing pool. Each task owns its books,
+// ingestor and memory: loaded events come from a monotonic arena and the
+// books and deduction state from a BookArena, so no container of a task
+// falls back to the default memory resource. It writes its engine output to
+// <outputDir>/<name>.log and its stats to <outputDir>/<name>.stats, and
+// run() adds summary.csv.
+class ReplayRunner {
+private:
+    size_t numThreads;
+    std::string outputDir;
+
+public:
+    ReplayRunner(size_t numThreads, const std::string& outputDir);
+
+    // Returns false if the manifest cannot be read, malformed lines are skipped
+    static bool loadManifest(const std::string& file, std::vector<ReplayTask>& tasks);
+
+    std::vector<ReplayStats> run(const std::vector<ReplayTask>& tasks);
+    ReplayStats runTask(const ReplayTask& task) const;
+
+    static void writeStats(const ReplayStats& stats, const std::string& file);
+};
\ No newline at end of file
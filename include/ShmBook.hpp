@@ -0,0 +1,128 @@
+#pragma once
+#include "OrderBook.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// Publication of the SmartBook to other processes on the same host through a
+// POSIX shared memory region. The region holds a seqlock-protected image of
+// the top of the book and a broadcast ring of downstream actions. The writer
+// never waits for readers: each reader keeps its own cursor and counts what
+// it lost if it falls a whole ring behind.
+
+const size_t SHM_BOOK_LEVELS = 10;
+const size_t SHM_MAX_READERS = 16;
+
+struct BookImageLevel {
+    Price price;
+    Quantity quantity;
+    int numOrders;
+};
+
+struct BookImage {
+    uint64_t version;           // depth feed sequence the image was taken at
+    Timestamp timestamp;
+    uint32_t bidCount;
+    uint32_t askCount;
+    BookImageLevel bids[SHM_BOOK_LEVELS];       // best first, bids[0] and asks[0] are the BBO
+    BookImageLevel asks[SHM_BOOK_LEVELS];
+};
+
+struct BookAction {
+    uint64_t sequence;          // position in the action stream, from 0
+    Timestamp timestamp;
+    Price price;
+    OrderId orderId;
+    Quantity size;
+    char action;                // 'A'dd, 'M'odify, 'C'ancel or 'E'xecution
+    bool isSell;
+    bool isGuess;
+};
+
+struct ShmActionSlot {
+    std::atomic<uint64_t> sequence;     // action sequence + 1 once written, 0 while being written
+    BookAction action;
+};
+
+struct alignas(64) ShmReaderSlot {
+    std::atomic<uint32_t> active;
+    std::atomic<uint64_t> cursor;
+};
+
+struct ShmHeader {
+    std::atomic<uint64_t> magic;        // set last, readers refuse a region still being set up
+    uint64_t ringCapacity;
+    alignas(64) std::atomic<uint64_t> bookSeqlock;     // odd while the image is being written
+    BookImage book;
+    alignas(64) std::atomic<uint64_t> writeCursor;
+    ShmReaderSlot readers[SHM_MAX_READERS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+static_assert(std::is_trivially_copyable<BookImage>::value, "book image is copied under a seqlock");
+
+class ShmBookPublisher {
+private:
+    std::string name;
+    void* base = nullptr;
+    size_t mappedSize = 0;
+    ShmHeader* header = nullptr;
+    ShmActionSlot* ring = nullptr;
+    uint64_t mask = 0;
+
+public:
+    ShmBookPublisher() = default;
+    ~ShmBookPublisher();
+
+    ShmBookPublisher(const ShmBookPublisher&) = delete;
+    ShmBookPublisher& operator=(const ShmBookPublisher&) = delete;
+
+    // Creates /name (replacing a stale one), ringCapacity is rounded up to a power of two
+    bool create(const std::string& name, size_t ringCapacity = 1 << 16);
+    // Unmaps and unlinks the region, mapped readers keep working on it
+    void close();
+
+    void publishBook(const L3Book& book, uint64_t version, Timestamp timestamp);
+    void publishAction(const OrderInfo& info);
+
+    // Hooks into the callbacks of orderBook, the given ones still run after publication
+    void attach(OrderBook& orderBook, Callbacks callbacks = Callbacks());
+
+    uint64_t getPublishedActions() const;
+    // how far the slowest registered reader is behind the writer
+    uint64_t getMaxReaderLag() const;
+};
+
+class ShmBookReader {
+private:
+    void* base = nullptr;
+    size_t mappedSize = 0;
+    const ShmHeader* header = nullptr;
+    ShmActionSlot* ring = nullptr;
+    ShmReaderSlot* slot = nullptr;      // registration, null if all slots are taken
+    uint64_t mask = 0;
+    uint64_t cursor = 0;
+    size_t overruns = 0;
+
+public:
+    ShmBookReader() = default;
+    ~ShmBookReader();
+
+    ShmBookReader(const ShmBookReader&) = delete;
+    ShmBookReader& operator=(const ShmBookReader&) = delete;
+
+    // fromLatest skips the actions already in the ring
+    bool open(const std::string& name, bool fromLatest = false);
+    void close();
+
+    // Consistent copy of the book image, false if nothing was published yet
+    bool readBook(BookImage& out) const;
+    // Next action, false if the reader is caught up. Never blocks
+    bool nextAction(BookAction& out);
+
+    uint64_t getCursor() const { return cursor; }
+    // actions overwritten before this reader got to them
+    size_t getOverruns() const { return overruns; }
+};
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#include "Types.hpp"
+#include <array>
+#include <atomic>
+#include <type_traits>
+
+class L3Book;
+struct L3PriceLevel;
+
+// Microstructure signals over the top levels of an L3Book, kept up to date
+// as the book changes instead of being recomputed from getTopBids and
+// getTopAsks copies on every query. The engine mirrors the best depth
+// levels of each side; a level change outside them costs one comparison,
+// one inside them updates the mirror and the signals of that side. Other
+// threads read the latest signals through a seqlock without ever blocking
+// the book.
+
+const int MAX_SIGNAL_LEVELS = 16;
+
+struct BookSignals {
+    uint64_t version = 0;           // one per change of the top levels
+    Price bestBid = 0.0;
+    Price bestAsk = 0.0;
+    // price signals are 0 while either side is empty
+    Price spread = 0.0;
+    Price mid = 0.0;
+    Price microprice = 0.0;         // top of book mid weighted by the opposite size
+    Price weightedMid = 0.0;        // same over the average price and size of the top levels
+    // (bid - ask) / (bid + ask) over the top levels, in [-1, 1]
+    double imbalance = 0.0;
+    double orderImbalance = 0.0;    // by order count
+    Quantity bidDepth = 0;
+    Quantity askDepth = 0;
+    int bidOrders = 0;
+    int askOrders = 0;
+    int bidLevels = 0;
+    int askLevels = 0;
+};
+
+static_assert(std::is_trivially_copyable<BookSignals>::value, "signals are copied under a seqlock");
+
+class SignalEngine {
+private:
+    struct TopLevel {
+        Price price;
+        Quantity quantity;
+        int numOrders;
+    };
+
+    // best first, holds every level of the side while it has fewer than depth
+    struct Side {
+        std::array<TopLevel, MAX_SIGNAL_LEVELS> levels;
+        int count = 0;
+        Quantity quantity = 0;
+        int numOrders = 0;
+        double notional = 0.0;
+    };
+
+    int depth;
+    Side bids;
+    Side asks;
+    BookSignals signals;
+
+    alignas(64) std::atomic<uint64_t> seqlock{0};  // odd while published is being written
+    BookSignals published;
+
+    // false if the change is outside the top levels
+    template<typename BookSide>
+    bool updateSide(Side& side, const BookSide& bookSide, const L3PriceLevel& level);
+    void computeSignals();
+    void publish();
+
+public:
+    // depth is clamped to 1..MAX_SIGNAL_LEVELS
+    explicit SignalEngine(int depth = 5);
+
+    SignalEngine(const SignalEngine&) = delete;
+    SignalEngine& operator=(const SignalEngine&) = delete;
+
+    // Writer: called by the book after a level's quantity or order count
+    // changed, with numOrders 0 just before the level is removed
+    void onLevelChange(const L3Book& book, bool isSell, const L3PriceLevel& level);
+    // Writer: reloads the top levels from book, e.g. when attached or after an assignment
+    void rebuild(const L3Book& book);
+    // Writer: the book was cleared
+    void reset();
+    // Writer: the signals as of the last change
+    const BookSignals& getSignals() const { return signals; }
+
+    // Any thread, spins only while a write is in progress
+    BookSignals read() const;
+
+    int getDepth() const { return depth; }
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where the engine's threads run and how they wait for work. Pinning keeps
+// the scheduler from moving a hot thread (and its caches) between cores,
+// placing memory on the NUMA node of the core that uses it keeps every
+// access local on multi-socket hosts. A cpu of -1 leaves that thread to
+// the scheduler, which is also what happens if pinning fails.
+
+enum class WaitPolicy {
+    BLOCK,          // sleep in the kernel until there is work
+    BUSY_SPIN,      // poll without ever giving up the core
+    BACKOFF         // spin briefly, then yield, then sleep longer the longer it stays idle
+};
+
+const char* waitPolicyName(WaitPolicy policy);
+// "block", "spin" or "backoff", false for anything else
+bool parseWaitPolicy(const char* name, WaitPolicy& policy);
+
+// false, with a message on stderr, if the core does not exist or is not allowed
+bool pinCurrentThread(int cpu);
+// NUMA node of cpu as reported by sysfs, -1 if unknown
+int cpuNode(int cpu);
+// NUMA node the calling thread runs on, -1 if unknown
+int currentNode();
+// Binds [addr, addr + bytes) to node; pages already touched stay where they
+// are, so call it on fresh mappings. addr must be page aligned
+bool bindToNode(void* addr, size_t bytes, int node);
+
+struct ThreadConfig {
+    int readerCpu = -1;             // UDP receive thread, see UdpReceiverConfig::cpu
+    std::vector<int> parserCpus;    // parse workers take these in turn
+    int bookCpu = -1;               // the thread applying events to the books
+    int publisherCpu = -1;          // metrics flushing
+    WaitPolicy wait = WaitPolicy::BLOCK;
+
+    // where the book thread's books and queues belong, see BookArenaConfig::numaNode
+    int bookNode() const { return bookCpu < 0 ? -1 : cpuNode(bookCpu); }
+};
+
+// Idle strategy of a polling loop: pause() after every empty poll, reset()
+// once there is work again
+class Backoff {
+private:
+    WaitPolicy policy;
+    uint32_t idle = 0;
+
+public:
+    static constexpr uint32_t SPINS = 1000;
+    static constexpr uint32_t YIELDS = 100;
+    static constexpr uint32_t MAX_SLEEP_US = 1000;
+
+    explicit Backoff(WaitPolicy policy) : policy(policy) {}
+
+    void pause();
+    void reset() { idle = 0; }
+};
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include "ThreadConfig.hpp"
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads draining a shared FIFO task queue.
+// Worker i is pinned to cpus[i % cpus.size()] if any are given; idle
+// workers sleep on the queue unless wait polls it instead
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    WaitPolicy wait;
+
+    void workerLoop();
+    void pollLoop();
+
+public:
+    explicit ThreadPool(size_t numThreads, const std::vector<int>& cpus = {}, WaitPolicy wait = WaitPolicy::BLOCK);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F>
+    std::future<void> submit(F&& func) {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(func));
+        std::future<void> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        cv.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+};
\ No newline at end of file
@@ -1,23 +1,30 @@
 #pragma once
 #include "Types.hpp"
+#include <iosfwd>
+#include <memory_resource>
 #include <vector>
 
 class TradeContainer {
 private:
-    std::vector<TradeInfo> trades;
+    std::pmr::vector<TradeInfo> trades;
     size_t maxSize;
 
 public:
-    explicit TradeContainer(size_t maxTrades = 10000) : maxSize(maxTrades) {
+    explicit TradeContainer(size_t maxTrades = 10000,
+                            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : trades(resource), maxSize(maxTrades) {
         trades.reserve(maxSize);
     }
 
     void addTrade(const TradeInfo& trade);
-    const std::vector<TradeInfo>& getTrades() const { return trades; }
+    const std::pmr::vector<TradeInfo>& getTrades() const { return trades; }
 
     std::vector<TradeInfo> getTradesAfter(Timestamp timestamp) const;
     TradeInfo getLastTrade() const;
 
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+
     void clear() { trades.clear(); }
     bool empty() const { return trades.empty(); }
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include <string>
+#include <cstdint>
+#include <string_view>
 
 using Timestamp = uint64_t;
 using Price = double;
@@ -17,19 +19,22 @@ enum class OrderSide {
     SELL
 };
 
+// Hot fields only, a book keeps anything else about an order (e.g. its
+// arrival time) out of the queue scan, see OrderPool.hpp
 struct Order {
     OrderId orderId;
-    bool isSell;
-    Price price;
     Quantity size;
-    Timestamp Timestamp;
+    Price price;
+    bool isSell;
 
     Order() {}
     Order(OrderId orderId, bool isSell, Price price, Quantity size)
-        : orderId(orderId), isSell(isSell), price(price), size(size) {}
+        : orderId(orderId), size(size), price(price), isSell(isSell) {}
 
 };
 
+static_assert(sizeof(Order) == 24, "order must fit an OrderNode with its links");
+
 struct OrderInfo {
     OrderId orderId;
     bool isSell;
@@ -41,6 +46,7 @@ struct OrderInfo {
     bool isGuess;
     bool isMarketable;
     bool isPending = false;
+    uint64_t sequence = 0;      // insertion order among an OrderBook's guesses
 
     OrderInfo(OrderId orderId, 
                 bool isSell, 
@@ -71,10 +77,30 @@ struct TradeInfo {
     OrderId orderId;
 };
 
+enum class L3Action {
+    ADD,
+    MODIFY,
+    CANCEL
+};
+
+struct L3Update {
+    Timestamp timestamp;
+    L3Action action;
+    OrderId orderId;
+    bool isSell;
+    Price price;
+    Quantity size;
+};
+
 struct MarketEvent {
     EventType type;
     Timestamp timestamp;
-    std::string rawData;
+    std::string_view rawData;   // line body, points into the ingestor's file buffer
+    union {
+        L3Update l3Update;
+        TradeInfo trade;
+        size_t snapshotIndex;   // into the ingestor's L2 snapshots
+    };
 };
 
 struct PendingAction {
@@ -0,0 +1,111 @@
+#pragma once
+#include "BinaryFeed.hpp"
+#include "OrderBook.hpp"
+#include "ThreadConfig.hpp"
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Live ingestion of the binary feed over UDP. Datagrams carry MoldUDP64 style
+// packets (see BinaryFeed.hpp); the receiver pulls them in batches with
+// recvmmsg into buffers allocated once, decodes in place and applies the
+// events to an OrderBook.
+
+struct UdpReceiverConfig {
+    std::string address = "127.0.0.1";
+    uint16_t port = 0;              // 0 binds a free port, see getPort()
+    size_t batchSize = 64;          // datagrams per recvmmsg call
+    size_t bufferSize = 2048;       // bytes per datagram buffer
+    int socketBufferBytes = 4 << 20;
+    // BLOCK sleeps in recvmmsg; BUSY_SPIN and BACKOFF poll a non-blocking
+    // socket, run() backing off between empty polls as the policy says
+    WaitPolicy wait = WaitPolicy::BLOCK;
+    int timeoutMs = 100;            // wait per poll when blocking
+    int cpu = -1;                   // run() pins its thread here, see ThreadConfig::readerCpu
+    bool batchApply = false;        // apply each datagram with OrderBook::processBatch
+};
+
+struct UdpReceiverStats {
+    size_t syscalls = 0;
+    size_t emptyPolls = 0;
+    size_t datagrams = 0;
+    size_t truncated = 0;
+    size_t events = 0;
+};
+
+class UdpFeedReceiver {
+private:
+    OrderBook& orderBook;
+    UdpReceiverConfig config;
+    int fd = -1;
+    MoldDecoder mold;
+    UdpReceiverStats stats;
+
+    // receive state, sized once in open() and reused by every poll
+    std::vector<char> buffers;
+    std::vector<char> controls;
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> messages;
+    size_t controlSize = 0;
+    std::vector<MarketEvent> batch;     // events of one datagram when batching
+
+    // packet to book latency in ns, kept up to maxLatencySamples
+    std::vector<uint64_t> latencies;
+    size_t maxLatencySamples;
+
+    void applyEvent(const MarketEvent& event);
+
+public:
+    explicit UdpFeedReceiver(OrderBook& orderBook, size_t maxLatencySamples = 1 << 20);
+    ~UdpFeedReceiver();
+
+    UdpFeedReceiver(const UdpFeedReceiver&) = delete;
+    UdpFeedReceiver& operator=(const UdpFeedReceiver&) = delete;
+
+    bool open(const UdpReceiverConfig& config);
+    void close();
+    uint16_t getPort() const;
+
+    // One recvmmsg call, returns the number of events applied to the book
+    size_t poll();
+
+    // Polls until stop is set or maxEvents have been applied (0 for no limit)
+    size_t run(const std::atomic<bool>& stop, size_t maxEvents = 0);
+
+    const UdpReceiverStats& getStats() const { return stats; }
+    size_t getMissedMessages() const { return mold.getMissedMessages(); }
+    size_t getDecodeErrors() const { return mold.getDecodeErrors(); }
+
+    // Latency from the kernel receive timestamp (SO_TIMESTAMPNS) to the event
+    // being applied, p in [0, 1]
+    uint64_t getLatencyPercentile(double p) const;
+    size_t getLatencySamples() const { return latencies.size(); }
+};
+
+struct UdpReplayConfig {
+    std::string address = "127.0.0.1";
+    uint16_t port = 0;
+    double messagesPerSecond = 0;   // 0 sends as fast as the socket accepts
+    size_t messagesPerDatagram = 16;
+    size_t batchSize = 32;          // datagrams per sendmmsg call
+};
+
+// Re-sends a captured binary feed over UDP at a configurable rate, a local
+// stand-in for the exchange
+class UdpFeedReplayer {
+private:
+    UdpReplayConfig config;
+    size_t sentMessages = 0;
+    size_t sentDatagrams = 0;
+
+public:
+    explicit UdpFeedReplayer(const UdpReplayConfig& config) : config(config) {}
+
+    // Sends every message of a binary feed file (stream or pcap)
+    bool replay(const std::string& feedFile);
+
+    size_t getSentMessages() const { return sentMessages; }
+    size_t getSentDatagrams() const { return sentDatagrams; }
+};
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool with one task deque per worker. Workers pop their own deque
+// from the back and steal from the front of the others when it runs dry,
+// so long and short tasks even out across the machine.
+class WorkStealingPool {
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> steals{0};
+
+    std::mutex stateMutex;
+    std::condition_variable workCv;
+    std::condition_variable idleCv;
+    size_t queued = 0;      // tasks waiting in any deque
+    size_t unfinished = 0;  // tasks submitted but not completed
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+    bool popTask(size_t index, std::function<void()>& task);
+
+public:
+    explicit WorkStealingPool(size_t numThreads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Called from a worker the task goes to that worker's deque,
+    // otherwise deques are filled round robin
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished
+    void wait();
+
+    size_t size() const { return workers.size(); }
+    size_t getSteals() const { return steals.load(std::memory_order_relaxed); }
+};
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "AllocationTracker.hpp"
+#include <cstdlib>
+#include <execinfo.h>
+#include <new>
+#include <unistd.h>
+
+// Trivially constructed thread locals, so the hooks can run before main and
+// during thread start up
+static thread_local AllocationStats threadCounts;
+static thread_local bool capturing = false;
+static thread_local bool inHook = false;       // backtrace may allocate itself
+static thread_local size_t stackCount = 0;
+static thread_local int stackDepths[AllocationTracker::MAX_STACKS];
+static thread_local void* stacks[AllocationTracker::MAX_STACKS][AllocationTracker::STACK_DEPTH];
+
+static void recordAllocation(size_t size) {
+    threadCounts.allocations++;
+    threadCounts.bytes += size;
+    if (capturing && !inHook && stackCount < AllocationTracker::MAX_STACKS) {
+        inHook = true;
+        stackDepths[stackCount] = backtrace(stacks[stackCount], AllocationTracker::STACK_DEPTH);
+        stackCount++;
+        inHook = false;
+    }
+}
+
+static void* allocate(size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    recordAllocation(size);
+    return p;
+}
+
+static void* allocateAligned(size_t size, std::align_val_t alignment) {
+    size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc wants a multiple of the alignment
+    void* p = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (!p) throw std::bad_alloc();
+    recordAllocation(size);
+    return p;
+}
+
+static void release(void* p) {
+    if (!p) return;
+    threadCounts.deallocations++;
+    std::free(p);
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+
+AllocationStats AllocationTracker::threadStats() {
+    return threadCounts;
+}
+
+void AllocationTracker::captureStacks(bool enabled) {
+    if (enabled) {
+        // the first backtrace loads the unwinder, keep that out of the stacks
+        void* frame[1];
+        inHook = true;
+        backtrace(frame, 1);
+        inHook = false;
+        stackCount = 0;
+    }
+    capturing = enabled;
+}
+
+size_t AllocationTracker::getCapturedStacks() {
+    return stackCount;
+}
+
+void AllocationTracker::dumpStacks(int fd) {
+    for (size_t i = 0; i < stackCount; ++i) {
+        const char header[] = "-- allocation stack\n";
+        if (write(fd, header, sizeof(header) - 1) < 0) return;
+        backtrace_symbols_fd(stacks[i], stackDepths[i], fd);
+    }
+}
+
+AllocationScope::AllocationScope(bool captureStacks) : start(threadCounts), capturing(captureStacks) {
+    if (capturing) AllocationTracker::captureStacks(true);
+}
+
+AllocationScope::~AllocationScope() {
+    if (capturing) AllocationTracker::captureStacks(false);
+}
+
+AllocationStats AllocationScope::getStats() const {
+    AllocationStats now = threadCounts;
+    return {now.allocations - start.allocations, now.deallocations - start.deallocations, now.bytes - start.bytes};
+}
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "AsyncFileReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// alignment of buffers, offsets and lengths, enough for O_DIRECT
+static const size_t READ_ALIGNMENT = 4096;
+
+static size_t alignUp(size_t value) {
+    return (value + READ_ALIGNMENT - 1) / READ_ALIGNMENT * READ_ALIGNMENT;
+}
+
+// no liburing dependency, the rings are driven through the raw syscalls
+static int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+struct AsyncFileReader::Ring {
+    int fd = -1;
+    void* sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    void* sqeMap = MAP_FAILED;
+    size_t sqeMapSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    ~Ring() {
+        if (sqeMap != MAP_FAILED) munmap(sqeMap, sqeMapSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = ioUringSetup(entries, &params);
+        if (fd < 0) {
+            return false;
+        }
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+        }
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) {
+            return false;
+        }
+        cqMap = singleMap ? sqMap
+            : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqMap == MAP_FAILED) {
+            return false;
+        }
+        sqeMapSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqeMap = mmap(nullptr, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqMap);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        char* cq = static_cast<char*>(cqMap);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // every slot has at most one read in flight, so the queue never fills up
+    io_uring_sqe* nextSqe() {
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        sqArray[index] = index;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    bool submit() {
+        __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+        int submitted;
+        do {
+            submitted = ioUringEnter(fd, 1, 0, 0);
+        } while (submitted < 0 && errno == EINTR);
+        return submitted == 1;
+    }
+};
+
+AsyncFileReader::AsyncFileReader(size_t blockSize, size_t depth, size_t headroom, bool direct)
+    : blockSize(alignUp(std::max<size_t>(blockSize, 1))),
+      depth(std::max<size_t>(depth, 1)),
+      headroom(alignUp(headroom)),
+      direct(direct) {}
+
+AsyncFileReader::~AsyncFileReader() {
+    close();
+}
+
+bool AsyncFileReader::ioUringAvailable() {
+    static const bool available = []() {
+        Ring probe;
+        return probe.init(1);
+    }();
+    return available;
+}
+
+bool AsyncFileReader::open(const std::string& file, ReadEngine preferred) {
+    close();
+
+    fd = direct ? ::open(file.c_str(), O_RDONLY | O_DIRECT) : -1;
+    if (fd < 0) {
+        // tmpfs and some others reject O_DIRECT, go through the page cache instead
+        fd = ::open(file.c_str(), O_RDONLY);
+    }
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(st.st_size);
+    blockCount = (fileSize + blockSize - 1) / blockSize;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    size_t slotSize = headroom + blockSize;
+    memory = static_cast<char*>(std::aligned_alloc(READ_ALIGNMENT, depth * slotSize));
+    if (!memory) {
+        close();
+        return false;
+    }
+    slots.assign(depth, Slot());
+    for (size_t i = 0; i < depth; ++i) {
+        slots[i].buffer = memory + i * slotSize;
+    }
+
+    if (preferred == ReadEngine::IO_URING && !setupRing()) {
+        ring.reset();
+    }
+
+    for (size_t i = 0; i < std::min(depth, blockCount); ++i) {
+        startRead(i, i);
+    }
+    return true;
+}
+
+bool AsyncFileReader::setupRing() {
+    ring = std::make_unique<Ring>();
+    if (!ring->init(static_cast<unsigned>(depth))) {
+        return false;
+    }
+
+    // pinned once here rather than on every read, needs RLIMIT_MEMLOCK headroom
+    std::vector<iovec> iovecs(depth);
+    for (size_t i = 0; i < depth; ++i) {
+        iovecs[i].iov_base = slots[i].buffer;
+        iovecs[i].iov_len = headroom + blockSize;
+    }
+    fixedBuffers = ioUringRegister(ring->fd, IORING_REGISTER_BUFFERS, iovecs.data(),
+                                   static_cast<unsigned>(depth)) == 0;
+    return true;
+}
+
+void AsyncFileReader::close() {
+    ring.reset();
+    fixedBuffers = false;
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    std::free(memory);
+    memory = nullptr;
+    slots.clear();
+    fileSize = 0;
+    blockCount = 0;
+    nextBlock = 0;
+}
+
+size_t AsyncFileReader::requestLength(const Slot& slot) const {
+    size_t remaining = slot.length - slot.done;
+    // O_DIRECT wants whole pages, the read stops short at the end of the file
+    return direct ? std::min(alignUp(remaining), blockSize - slot.done) : remaining;
+}
+
+void AsyncFileReader::startRead(size_t slot, size_t index) {
+    Slot& s = slots[slot];
+    uint64_t offset = static_cast<uint64_t>(index) * blockSize;
+    s.state = SlotState::READING;
+    s.index = index;
+    s.length = static_cast<size_t>(std::min<uint64_t>(blockSize, fileSize - offset));
+    s.done = 0;
+    s.failed = false;
+    if (ring && !submitRead(slot)) {
+        std::cerr << "io_uring submit failed: " << std::strerror(errno) << "\n";
+        s.failed = true;
+        s.state = SlotState::READY;
+    }
+}
+
+bool AsyncFileReader::submitRead(size_t slot) {
+    Slot& s = slots[slot];
+    io_uring_sqe* sqe = ring->nextSqe();
+    sqe->opcode = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(s.buffer + headroom + s.done);
+    sqe->len = static_cast<uint32_t>(requestLength(s));
+    sqe->off = static_cast<uint64_t>(s.index) * blockSize + s.done;
+    sqe->buf_index = fixedBuffers ? static_cast<uint16_t>(slot) : 0;
+    sqe->user_data = slot;
+    return ring->submit();
+}
+
+bool AsyncFileReader::waitCompletions() {
+    if (ioUringEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        std::cerr << "io_uring wait failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = ring->cqes[head & ring->cqMask];
+        Slot& s = slots[cqe.user_data];
+        int result = cqe.res;
+        if (result == -EINTR || result == -EAGAIN) {
+            result = 0;
+        } else if (result < 0) {
+            std::cerr << "Read of block " << s.index << " failed: " << std::strerror(-result) << "\n";
+            s.failed = true;
+            s.state = SlotState::READY;
+            continue;
+        } else if (result == 0) {
+            // file got shorter since open
+            s.length = s.done;
+        }
+
+        // short reads are resumed where they stopped
+        s.done += result;
+        if (s.done >= s.length) {
+            s.state = SlotState::READY;
+        } else if (!submitRead(cqe.user_data)) {
+            s.failed = true;
+            s.state = SlotState::READY;
+        }
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool AsyncFileReader::readSync(Slot& slot) {
+    while (slot.done < slot.length) {
+        ssize_t result = pread(fd, slot.buffer + headroom + slot.done, requestLength(slot),
+                               static_cast<off_t>(slot.index * blockSize + slot.done));
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Read of block " << slot.index << " failed: " << std::strerror(errno) << "\n";
+            return false;
+        }
+        if (result == 0) {
+            slot.length = slot.done;
+            break;
+        }
+        slot.done += result;
+    }
+    slot.state = SlotState::READY;
+    return true;
+}
+
+bool AsyncFileReader::next(ReadBlock& block) {
+    if (atEnd()) {
+        return false;
+    }
+
+    Slot& slot = slots[nextBlock % depth];
+    if (slot.state == SlotState::IDLE || slot.state == SlotState::HELD || slot.index != nextBlock) {
+        std::cerr << "AsyncFileReader: block " << nextBlock << " has no free buffer, release earlier blocks first\n";
+        return false;
+    }
+
+    while (slot.state == SlotState::READING) {
+        bool ok = ring ? waitCompletions() : readSync(slot);
+        if (!ok) {
+            return false;
+        }
+    }
+    if (slot.failed) {
+        return false;
+    }
+
+    slot.state = SlotState::HELD;
+    block.data = slot.buffer + headroom;
+    block.size = std::min(slot.done, slot.length);
+    block.offset = static_cast<uint64_t>(slot.index) * blockSize;
+    block.index = slot.index;
+    nextBlock++;
+    return true;
+}
+
+void AsyncFileReader::release(const ReadBlock& block) {
+    size_t slot = block.index % depth;
+    if (slots.empty() || slots[slot].state != SlotState::HELD || slots[slot].index != block.index) {
+        return;
+    }
+
+    slots[slot].state = SlotState::IDLE;
+    if (block.index + depth < blockCount) {
+        startRead(slot, block.index + depth);
+    }
+}
\ No newline at end of file
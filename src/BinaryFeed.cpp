@@ -0,0 +1,538 @@
+#include "BinaryFeed.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static const uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+static const uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+static const uint32_t PCAP_LINKTYPE_ETHERNET = 1;
+static const size_t PCAP_HEADER_SIZE = 24;
+static const size_t PCAP_RECORD_SIZE = 16;
+static const size_t ETHERNET_HEADER_SIZE = 14;
+static const size_t IPV4_HEADER_SIZE = 20;
+static const size_t UDP_HEADER_SIZE = 8;
+static const char MOLD_SESSION[10] = {'S', 'O', 'B', 'F', 'E', 'E', 'D', '0', '0', '1'};
+
+static inline uint16_t byteSwap(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint32_t byteSwap(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint64_t byteSwap(uint64_t v) { return __builtin_bswap64(v); }
+
+template<typename T>
+static inline T loadBigEndian(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = byteSwap(value);
+#endif
+    return value;
+}
+
+template<typename T>
+static inline void storeBigEndian(char* p, T value) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = byteSwap(value);
+#endif
+    std::memcpy(p, &value, sizeof(T));
+}
+
+template<typename T>
+static inline T loadNative(const char* p, bool swapped) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return swapped ? byteSwap(value) : value;
+}
+
+// field of a packed message read straight out of the receive buffer
+#define BINARY_FIELD(msg, Message, field) \
+    loadBigEndian<decltype(Message::field)>((msg) + offsetof(Message, field))
+
+#define STORE_BINARY_FIELD(msg, Message, field, value) \
+    storeBigEndian<decltype(Message::field)>((msg) + offsetof(Message, field), (value))
+
+// exact for any price with up to four decimals, the division rounds once
+static inline Price fromTicks(uint32_t ticks) {
+    return static_cast<Price>(ticks) / BINARY_PRICE_SCALE;
+}
+
+static bool toTicks(Price price, uint32_t& ticks) {
+    double scaled = std::round(price * BINARY_PRICE_SCALE);
+    if (scaled < 0 || scaled > UINT32_MAX || scaled / BINARY_PRICE_SCALE != price) {
+        return false;
+    }
+    ticks = static_cast<uint32_t>(scaled);
+    return true;
+}
+
+template<typename Message>
+static inline ParseStatus checkLength(size_t length) {
+    if (length < sizeof(Message)) return ParseStatus::BAD_NUMBER;
+    if (length > sizeof(Message)) return ParseStatus::TRAILING_DATA;
+    return ParseStatus::OK;
+}
+
+ParseStatus decodeBinaryMessage(const char* begin, const char* end, MarketEvent& event) {
+    size_t length = end - begin;
+    if (length == 0) {
+        return ParseStatus::EMPTY_LINE;
+    }
+
+    event.rawData = std::string_view();
+    ParseStatus status;
+    switch (static_cast<BinaryMessageType>(*begin)) {
+    case BinaryMessageType::ADD_ORDER:
+    case BinaryMessageType::MODIFY_ORDER: {
+        // add and modify share a layout
+        if ((status = checkLength<BinaryAddOrder>(length)) != ParseStatus::OK) return status;
+        uint64_t orderId = BINARY_FIELD(begin, BinaryAddOrder, orderId);
+        uint32_t shares = BINARY_FIELD(begin, BinaryAddOrder, shares);
+        char side = begin[offsetof(BinaryAddOrder, side)];
+        if (orderId > INT_MAX || shares > INT_MAX) return ParseStatus::BAD_NUMBER;
+        if (side != 'B' && side != 'S') return ParseStatus::BAD_SIDE;
+
+        event.type = EventType::L3_UPDATE;
+        event.timestamp = BINARY_FIELD(begin, BinaryAddOrder, timestamp);
+        L3Update& update = event.l3Update;
+        update.timestamp = event.timestamp;
+        update.action = *begin == 'A' ? L3Action::ADD : L3Action::MODIFY;
+        update.orderId = static_cast<OrderId>(orderId);
+        update.isSell = side == 'S';
+        update.size = static_cast<Quantity>(shares);
+        update.price = fromTicks(BINARY_FIELD(begin, BinaryAddOrder, price));
+        return ParseStatus::OK;
+    }
+    case BinaryMessageType::DELETE_ORDER: {
+        if ((status = checkLength<BinaryDeleteOrder>(length)) != ParseStatus::OK) return status;
+        uint64_t orderId = BINARY_FIELD(begin, BinaryDeleteOrder, orderId);
+        if (orderId > INT_MAX) return ParseStatus::BAD_NUMBER;
+
+        event.type = EventType::L3_UPDATE;
+        event.timestamp = BINARY_FIELD(begin, BinaryDeleteOrder, timestamp);
+        L3Update& update = event.l3Update;
+        update.timestamp = event.timestamp;
+        update.action = L3Action::CANCEL;
+        update.orderId = static_cast<OrderId>(orderId);
+        update.isSell = false;
+        update.price = 0;
+        update.size = 0;
+        return ParseStatus::OK;
+    }
+    case BinaryMessageType::EXECUTION: {
+        if ((status = checkLength<BinaryExecution>(length)) != ParseStatus::OK) return status;
+        uint64_t orderId = BINARY_FIELD(begin, BinaryExecution, orderId);
+        uint32_t shares = BINARY_FIELD(begin, BinaryExecution, shares);
+        if (orderId > INT_MAX || shares > INT_MAX) return ParseStatus::BAD_NUMBER;
+
+        event.type = EventType::TRADE_EXECUTION;
+        event.timestamp = BINARY_FIELD(begin, BinaryExecution, timestamp);
+        TradeInfo& trade = event.trade;
+        trade.timestamp = event.timestamp;
+        trade.quantity = static_cast<Quantity>(shares);
+        trade.aggressorSide = OrderSide::BUY;
+        trade.orderId = static_cast<OrderId>(orderId);
+        trade.price = fromTicks(BINARY_FIELD(begin, BinaryExecution, price));
+        return ParseStatus::OK;
+    }
+    }
+    return ParseStatus::BAD_ACTION;
+}
+
+size_t encodeBinaryMessage(const MarketEvent& event, char* out) {
+    uint32_t ticks = 0;
+    if (event.type == EventType::L3_UPDATE) {
+        const L3Update& update = event.l3Update;
+        if (update.orderId < 0) return 0;
+
+        if (update.action == L3Action::CANCEL) {
+            out[0] = static_cast<char>(BinaryMessageType::DELETE_ORDER);
+            STORE_BINARY_FIELD(out, BinaryDeleteOrder, timestamp, event.timestamp);
+            STORE_BINARY_FIELD(out, BinaryDeleteOrder, orderId, static_cast<uint64_t>(update.orderId));
+            return sizeof(BinaryDeleteOrder);
+        }
+
+        if (update.size < 0 || !toTicks(update.price, ticks)) return 0;
+        out[0] = static_cast<char>(update.action == L3Action::ADD ? BinaryMessageType::ADD_ORDER
+                                                                   : BinaryMessageType::MODIFY_ORDER);
+        STORE_BINARY_FIELD(out, BinaryAddOrder, timestamp, event.timestamp);
+        STORE_BINARY_FIELD(out, BinaryAddOrder, orderId, static_cast<uint64_t>(update.orderId));
+        out[offsetof(BinaryAddOrder, side)] = update.isSell ? 'S' : 'B';
+        STORE_BINARY_FIELD(out, BinaryAddOrder, shares, static_cast<uint32_t>(update.size));
+        STORE_BINARY_FIELD(out, BinaryAddOrder, price, ticks);
+        return sizeof(BinaryAddOrder);
+    }
+
+    if (event.type == EventType::TRADE_EXECUTION) {
+        const TradeInfo& trade = event.trade;
+        if (trade.orderId < 0 || trade.quantity < 0 || !toTicks(trade.price, ticks)) return 0;
+        out[0] = static_cast<char>(BinaryMessageType::EXECUTION);
+        STORE_BINARY_FIELD(out, BinaryExecution, timestamp, event.timestamp);
+        STORE_BINARY_FIELD(out, BinaryExecution, orderId, static_cast<uint64_t>(trade.orderId));
+        STORE_BINARY_FIELD(out, BinaryExecution, shares, static_cast<uint32_t>(trade.quantity));
+        STORE_BINARY_FIELD(out, BinaryExecution, price, ticks);
+        return sizeof(BinaryExecution);
+    }
+    return 0;
+}
+
+// Splits off the next u16 length-prefixed message, counting a truncated one as an error
+static bool nextFramed(const char*& p, const char* limit, const char*& msg, uint16_t& length, size_t& errors) {
+    if (p >= limit) {
+        return false;
+    }
+    if (limit - p < 2 || loadBigEndian<uint16_t>(p) > limit - p - 2) {
+        errors++;
+        p = limit;
+        return false;
+    }
+    length = loadBigEndian<uint16_t>(p);
+    msg = p + 2;
+    p = msg + length;
+    return true;
+}
+
+void encodeMoldHeader(char* out, uint64_t sequence, uint16_t count) {
+    std::memcpy(out, MOLD_SESSION, sizeof(MOLD_SESSION));
+    storeBigEndian<uint64_t>(out + 10, sequence);
+    storeBigEndian<uint16_t>(out + 18, count);
+}
+
+bool MoldDecoder::beginDatagram(const char* data, size_t size) {
+    pendingMessages = 0;
+    if (size < MOLD_HEADER_SIZE) {
+        decodeErrors++;
+        return false;
+    }
+
+    uint64_t sequence = loadBigEndian<uint64_t>(data + 10);
+    uint16_t count = loadBigEndian<uint16_t>(data + 18);
+    if (count == 0 || count == 0xFFFF) return false;    // heartbeat or end of session
+
+    if (nextSequence == 0) nextSequence = sequence;
+    if (sequence > nextSequence) {
+        missedMessages += sequence - nextSequence;
+        nextSequence = sequence;
+    }
+    if (sequence + count <= nextSequence) return false; // retransmission already seen
+
+    skipMessages = nextSequence - sequence;
+    nextSequence = sequence + count;
+    pendingMessages = count;
+    payload = data + MOLD_HEADER_SIZE;
+    payloadEnd = data + size;
+    return true;
+}
+
+bool MoldDecoder::next(MarketEvent& event) {
+    const char* msg;
+    uint16_t length;
+    while (pendingMessages > 0) {
+        if (payload >= payloadEnd) {
+            // datagram shorter than its message count
+            decodeErrors++;
+            pendingMessages = 0;
+            return false;
+        }
+        if (!nextFramed(payload, payloadEnd, msg, length, decodeErrors)) {
+            pendingMessages = 0;
+            return false;
+        }
+        pendingMessages--;
+        if (skipMessages > 0) {
+            skipMessages--;
+            continue;
+        }
+        if (decodeBinaryMessage(msg, msg + length, event) == ParseStatus::OK) {
+            return true;
+        }
+        decodeErrors++;
+    }
+    return false;
+}
+
+bool BinaryFeedReader::isPcap(const char* data, size_t size) {
+    if (size < PCAP_HEADER_SIZE) return false;
+    uint32_t magic = loadNative<uint32_t>(data, false);
+    return magic == PCAP_MAGIC || magic == PCAP_MAGIC_NS ||
+           byteSwap(magic) == PCAP_MAGIC || byteSwap(magic) == PCAP_MAGIC_NS;
+}
+
+bool BinaryFeedReader::open(const std::string& path) {
+    if (!file.open(path)) {
+        return false;
+    }
+
+    pos = file.data();
+    end = pos + file.size();
+    mold.reset();
+    packets = 0;
+    decodeErrors = 0;
+    if (!isPcap(file.data(), file.size())) {
+        format = BinaryFeedFormat::STREAM;
+        return true;
+    }
+
+    format = BinaryFeedFormat::PCAP;
+    uint32_t magic = loadNative<uint32_t>(pos, false);
+    swapped = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS;
+    if (loadNative<uint32_t>(pos + 20, swapped) != PCAP_LINKTYPE_ETHERNET) {
+        std::cerr << "Unsupported pcap link type in " << path << "\n";
+        file.close();
+        return false;
+    }
+    pos += PCAP_HEADER_SIZE;
+    return true;
+}
+
+// Advances to the next UDP datagram carrying unseen messages
+bool BinaryFeedReader::nextPacket() {
+    while (static_cast<size_t>(end - pos) >= PCAP_RECORD_SIZE) {
+        uint32_t captured = loadNative<uint32_t>(pos + 8, swapped);
+        const char* frame = pos + PCAP_RECORD_SIZE;
+        if (captured > static_cast<size_t>(end - frame)) {
+            decodeErrors++;
+            pos = end;
+            return false;
+        }
+        const char* frameEnd = frame + captured;
+        pos = frameEnd;
+        packets++;
+
+        // ethernet, optionally VLAN tagged
+        if (captured < ETHERNET_HEADER_SIZE) continue;
+        size_t offset = ETHERNET_HEADER_SIZE;
+        uint16_t etherType = loadBigEndian<uint16_t>(frame + 12);
+        if (etherType == 0x8100 && captured >= ETHERNET_HEADER_SIZE + 4) {
+            etherType = loadBigEndian<uint16_t>(frame + 16);
+            offset += 4;
+        }
+        if (etherType != 0x0800) continue;
+
+        // IPv4 carrying an unfragmented UDP datagram
+        const char* ip = frame + offset;
+        if (frameEnd - ip < static_cast<ptrdiff_t>(IPV4_HEADER_SIZE) || (ip[0] >> 4 & 0xF) != 4) continue;
+        size_t ipHeaderSize = (ip[0] & 0xF) * 4;
+        if (ip[9] != 17) continue;
+        if ((loadBigEndian<uint16_t>(ip + 6) & 0x3FFF) != 0 ||
+            frameEnd - ip < static_cast<ptrdiff_t>(ipHeaderSize + UDP_HEADER_SIZE)) {
+            decodeErrors++;
+            continue;
+        }
+
+        const char* udp = ip + ipHeaderSize;
+        uint16_t udpLength = loadBigEndian<uint16_t>(udp + 4);
+        if (udpLength < UDP_HEADER_SIZE || udpLength > frameEnd - udp) {
+            decodeErrors++;
+            continue;
+        }
+        if (mold.beginDatagram(udp + UDP_HEADER_SIZE, udpLength - UDP_HEADER_SIZE)) {
+            return true;
+        }
+    }
+    pos = end;
+    return false;
+}
+
+bool BinaryFeedReader::next(MarketEvent& event) {
+    if (format == BinaryFeedFormat::PCAP) {
+        while (!mold.next(event)) {
+            if (!nextPacket()) return false;
+        }
+        return true;
+    }
+
+    const char* msg;
+    uint16_t length;
+    while (nextFramed(pos, end, msg, length, decodeErrors)) {
+        if (decodeBinaryMessage(msg, msg + length, event) == ParseStatus::OK) {
+            return true;
+        }
+        decodeErrors++;
+    }
+    return false;
+}
+
+size_t BinaryFeedReader::readAll(ParsedChunk& out) {
+    size_t errors = getDecodeErrors();
+    size_t count = 0;
+    MarketEvent event;
+    while (next(event)) {
+        out.events.push_back(event);
+        count++;
+    }
+    out.parseErrors += getDecodeErrors() - errors;
+    return count;
+}
+
+bool BinaryFeedWriter::open(const std::string& file) {
+    out.open(file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    sequence = 1;
+    packet.clear();
+    packetMessages = 0;
+
+    if (format == BinaryFeedFormat::PCAP) {
+        char header[PCAP_HEADER_SIZE] = {};
+        uint32_t magic = PCAP_MAGIC;
+        uint16_t major = 2, minor = 4;
+        uint32_t snapLength = 65535, linkType = PCAP_LINKTYPE_ETHERNET;
+        std::memcpy(header, &magic, 4);
+        std::memcpy(header + 4, &major, 2);
+        std::memcpy(header + 6, &minor, 2);
+        std::memcpy(header + 16, &snapLength, 4);
+        std::memcpy(header + 20, &linkType, 4);
+        out.write(header, sizeof(header));
+    }
+    return static_cast<bool>(out);
+}
+
+bool BinaryFeedWriter::append(const MarketEvent& event) {
+    char message[32];
+    size_t length = encodeBinaryMessage(event, message);
+    if (length == 0) {
+        return false;
+    }
+
+    char prefix[2];
+    storeBigEndian<uint16_t>(prefix, static_cast<uint16_t>(length));
+    if (format == BinaryFeedFormat::STREAM) {
+        out.write(prefix, sizeof(prefix));
+        out.write(message, length);
+        return static_cast<bool>(out);
+    }
+
+    if (packet.size() + sizeof(prefix) + length > MAX_DATAGRAM_PAYLOAD - MOLD_HEADER_SIZE) {
+        if (!flushPacket()) return false;
+    }
+    if (packetMessages == 0) packetTimestamp = event.timestamp;
+    packet.append(prefix, sizeof(prefix));
+    packet.append(message, length);
+    packetMessages++;
+    return true;
+}
+
+static uint16_t ipChecksum(const char* header, size_t size) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        sum += loadBigEndian<uint16_t>(header + i);
+    }
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<uint16_t>(~sum);
+}
+
+// Wraps the pending messages in Ethernet/IPv4/UDP and a MoldUDP64 header
+bool BinaryFeedWriter::flushPacket() {
+    if (packetMessages == 0) {
+        return true;
+    }
+
+    size_t udpLength = UDP_HEADER_SIZE + MOLD_HEADER_SIZE + packet.size();
+    size_t ipLength = IPV4_HEADER_SIZE + udpLength;
+    std::vector<char> frame(ETHERNET_HEADER_SIZE + ipLength, 0);
+    char* eth = frame.data();
+    const unsigned char dstMac[6] = {0x01, 0x00, 0x5e, 0x00, 0x00, 0x01};
+    const unsigned char srcMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    std::memcpy(eth, dstMac, 6);
+    std::memcpy(eth + 6, srcMac, 6);
+    storeBigEndian<uint16_t>(eth + 12, 0x0800);
+
+    char* ip = eth + ETHERNET_HEADER_SIZE;
+    ip[0] = 0x45;
+    storeBigEndian<uint16_t>(ip + 2, static_cast<uint16_t>(ipLength));
+    storeBigEndian<uint16_t>(ip + 4, static_cast<uint16_t>(sequence));
+    storeBigEndian<uint16_t>(ip + 6, 0x4000);           // don't fragment
+    ip[8] = 64;
+    ip[9] = 17;
+    storeBigEndian<uint32_t>(ip + 12, 0x0A000001);      // 10.0.0.1
+    storeBigEndian<uint32_t>(ip + 16, 0xEF000001);      // 239.0.0.1
+    storeBigEndian<uint16_t>(ip + 10, ipChecksum(ip, IPV4_HEADER_SIZE));
+
+    char* udp = ip + IPV4_HEADER_SIZE;
+    storeBigEndian<uint16_t>(udp, 30001);
+    storeBigEndian<uint16_t>(udp + 2, 30001);
+    storeBigEndian<uint16_t>(udp + 4, static_cast<uint16_t>(udpLength));
+
+    char* mold = udp + UDP_HEADER_SIZE;
+    encodeMoldHeader(mold, sequence, packetMessages);
+    std::memcpy(mold + MOLD_HEADER_SIZE, packet.data(), packet.size());
+
+    // capture time is informational only, the feed timestamps are in the messages
+    uint32_t record[4] = {static_cast<uint32_t>(packetTimestamp), 0,
+                          static_cast<uint32_t>(frame.size()), static_cast<uint32_t>(frame.size())};
+    out.write(reinterpret_cast<const char*>(record), sizeof(record));
+    out.write(frame.data(), frame.size());
+
+    sequence += packetMessages;
+    packet.clear();
+    packetMessages = 0;
+    return static_cast<bool>(out);
+}
+
+bool BinaryFeedWriter::close() {
+    bool ok = flushPacket();
+    out.close();
+    return ok && !out.fail();
+}
+
+static bool loadTextEvents(const std::string& file, EventType type, std::vector<MarketEvent>& events) {
+    MappedFile text;
+    if (!text.open(file)) {
+        std::cerr << "Failed to open " << file << "\n";
+        return false;
+    }
+
+    std::pmr::vector<L2Snapshot> scratch;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    size_t lineNo = 0;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        ++lineNo;
+
+        MarketEvent event;
+        ParseStatus status = parseCaptureLine(p, lineEnd, type, event, scratch);
+        if (status != ParseStatus::OK && status != ParseStatus::EMPTY_LINE) {
+            std::cerr << file << ":" << lineNo << ": " << parseStatusName(status) << "\n";
+            return false;
+        }
+        if (status == ParseStatus::OK) {
+            event.rawData = std::string_view();
+            events.push_back(event);
+        }
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+    return true;
+}
+
+bool BinaryFeedWriter::convert(const std::string& l3File, const std::string& tradeFile,
+                               const std::string& feedFile, BinaryFeedFormat format) {
+    std::vector<MarketEvent> events;
+    if (!loadTextEvents(l3File, EventType::L3_UPDATE, events) ||
+        !loadTextEvents(tradeFile, EventType::TRADE_EXECUTION, events)) {
+        return false;
+    }
+    // L3 before trades on equal timestamps, the same order the ingestor replays them in
+    std::stable_sort(events.begin(), events.end(), [](const MarketEvent& a, const MarketEvent& b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    BinaryFeedWriter writer(format);
+    if (!writer.open(feedFile)) {
+        std::cerr << "Failed to create " << feedFile << "\n";
+        return false;
+    }
+    for (const auto& event : events) {
+        if (!writer.append(event)) {
+            std::cerr << "Cannot encode event at " << event.timestamp << " with 1/"
+                << BINARY_PRICE_SCALE << " price ticks\n";
+            std::remove(feedFile.c_str());
+            return false;
+        }
+    }
+    return writer.close();
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "BookArena.hpp"
+#include "ThreadConfig.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+BookArena::Region::Region(const BookArenaConfig& config) : config(config) {
+    if (config.initialBytes > 0) {
+        mapBlock(config.initialBytes);
+    }
+}
+
+BookArena::Region::~Region() {
+    for (const auto& [base, size] : blocks) {
+        munmap(base, size);
+    }
+}
+
+bool BookArena::Region::mapBlock(size_t bytes) {
+    // a bound block is faulted in only once the binding is in place
+    bool bind = config.numaNode >= 0;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (config.prefault && !bind) {
+        flags |= MAP_POPULATE;
+    }
+
+    void* base = MAP_FAILED;
+    if (config.hugePages) {
+        bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        hugePages = base != MAP_FAILED;
+    }
+    if (base == MAP_FAILED) {
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (base == MAP_FAILED) {
+            std::cerr << "BookArena: failed to map " << bytes << " bytes\n";
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        // no huge page pool reserved, the kernel may still back the block with huge pages
+        if (config.hugePages) madvise(base, bytes, MADV_HUGEPAGE);
+#endif
+    }
+
+    if (bind) {
+        // unbound if that fails, the pages then land wherever they are first touched
+        bindToNode(base, bytes, config.numaNode);
+        if (config.prefault) {
+            for (size_t offset = 0; offset < bytes; offset += 4096) {
+                static_cast<volatile char*>(base)[offset] = 0;
+            }
+        }
+    }
+    if (config.lockMemory) {
+        // not fatal, the arena works the same, it can just be paged out
+        if (mlock(base, bytes) == 0) {
+            lockedBytes += bytes;
+        } else {
+            std::cerr << "BookArena: failed to lock " << bytes << " bytes, check RLIMIT_MEMLOCK\n";
+        }
+    }
+
+    blocks.emplace_back(static_cast<char*>(base), bytes);
+    mappedBytes += bytes;
+    cursor = static_cast<char*>(base);
+    end = cursor + bytes;
+    return true;
+}
+
+void* BookArena::Region::do_allocate(size_t bytes, size_t alignment) {
+    auto aligned = [alignment](char* p) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((address + alignment - 1) & ~(uintptr_t(alignment) - 1));
+    };
+    char* p = cursor ? aligned(cursor) : nullptr;
+    if (!p || p + bytes > end) {
+        // the rest of the current block is left unused
+        size_t next = blocks.empty() ? config.initialBytes : blocks.back().second * 2;
+        if (!mapBlock(std::max(next, bytes + alignment))) {
+            throw std::bad_alloc();
+        }
+        p = aligned(cursor);
+    }
+    cursor = p + bytes;
+    usedBytes += bytes;
+    return p;
+}
+
+// order pool chunks are 32 KiB, anything up to twice that is recycled
+static std::pmr::pool_options arenaPoolOptions() {
+    std::pmr::pool_options options;
+    options.largest_required_pool_block = 64 << 10;
+    return options;
+}
+
+BookArena::BookArena(const BookArenaConfig& config)
+    : region(config), pool(arenaPoolOptions(), &region) {}
\ No newline at end of file
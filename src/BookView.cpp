@@ -0,0 +1,75 @@
+#include "BookView.hpp"
+#include <algorithm>
+
+BookViewPublisher::~BookViewPublisher() {
+    const BookView* view = current.load(std::memory_order_relaxed);
+    if (view) epochs.retire(view);
+    // the epoch manager frees whatever is retired when it goes
+}
+
+template<typename Levels, typename Side>
+bool BookViewPublisher::refreshLevel(Levels& levels, const Side& side, Price price) {
+    const LevelViewPtr* published = levels.find(price);
+    auto live = side.find(price);
+    if (live == side.end()) {
+        // the published views still hold the level, it goes with the last of them
+        return levels.erase(price);
+    }
+
+    const L3PriceLevel& level = live->second;
+    if (published) {
+        const LevelView& old = **published;
+        // touched but back where it was, e.g. an add and cancel in the same event
+        if (old.quantity == level.quantity && old.numOrders == level.numOrders
+            && std::equal(old.orders.begin(), old.orders.end(), level.orders.begin(), level.orders.end(),
+                [](const Order& a, const Order& b) { return a.orderId == b.orderId && a.size == b.size; })) {
+            return false;
+        }
+    }
+    // only the changed level copies its orders, the map shares the rest
+    levels.set(price, std::make_shared<const LevelView>(LevelView{price, level.quantity, level.numOrders,
+        std::vector<Order>(level.orders.begin(), level.orders.end())}));
+    return true;
+}
+
+void BookViewPublisher::swapView(Timestamp timestamp) {
+    // O(1), the view shares both maps with the writer
+    BookView* view = new BookView{++version, timestamp, bidLevels, askLevels};
+
+    const BookView* old = current.exchange(view, std::memory_order_seq_cst);
+    if (old) epochs.retire(old);
+    epochs.advance();
+}
+
+void BookViewPublisher::publish(const L3Book& book, const DirtyLevels& dirty, Timestamp timestamp) {
+    bool changed = current.load(std::memory_order_relaxed) == nullptr;
+    for (const DirtyLevel& level : dirty) {
+        if (level.isSell) {
+            changed |= refreshLevel(askLevels, book.getAsks(), level.price);
+        } else {
+            changed |= refreshLevel(bidLevels, book.getBids(), level.price);
+        }
+    }
+    if (changed) {
+        swapView(timestamp);
+    }
+}
+
+void BookViewPublisher::publishFull(const L3Book& book, Timestamp timestamp) {
+    bidLevels = BidLevelViews();
+    askLevels = AskLevelViews();
+    for (const auto& [price, level] : book.getBids()) {
+        refreshLevel(bidLevels, book.getBids(), price);
+    }
+    for (const auto& [price, level] : book.getAsks()) {
+        refreshLevel(askLevels, book.getAsks(), price);
+    }
+    swapView(timestamp);
+}
+
+BookViewPublisher::Reader::Reader(BookViewPublisher& publisher)
+    : publisher(&publisher), slot(publisher.epochs.registerReader()) {}
+
+BookViewPublisher::Reader::~Reader() {
+    if (slot >= 0) publisher->epochs.unregisterReader(slot);
+}
\ No newline at end of file
@@ -0,0 +1,456 @@
+#include "CaptureArchive.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static const char ARCHIVE_MAGIC[8] = {'S', 'O', 'B', 'A', 'R', 'C', '0', '1'};
+static const size_t HEADER_SIZE = 24;
+static const size_t FOOTER_SIZE = 24;
+static const size_t INDEX_ENTRY_SIZE = 32;
+
+static void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static bool getVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+static bool getSigned(const char*& p, const char* end, int64_t& v) {
+    uint64_t raw;
+    if (!getVarint(p, end, raw)) return false;
+    v = unzigzag(raw);
+    return true;
+}
+
+template<typename T>
+static void putRaw(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+template<typename T>
+static T getRaw(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+static void putColumn(std::string& block, const std::string& column) {
+    putVarint(block, column.size());
+    block += column;
+}
+
+static bool getColumn(const char*& p, const char* end, const char*& columnBegin, const char*& columnEnd) {
+    uint64_t length;
+    if (!getVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) return false;
+    columnBegin = p;
+    columnEnd = p + length;
+    p = columnEnd;
+    return true;
+}
+
+ArchiveWriter::ArchiveWriter(EventType type, int64_t priceScale, size_t blockSize)
+    : type(type), priceScale(priceScale), blockSize(blockSize ? blockSize : 1) {}
+
+bool ArchiveWriter::open(const std::string& file) {
+    out.open(file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    std::string header(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    putRaw<uint8_t>(header, static_cast<uint8_t>(type));
+    header.append(3, '\0');
+    putRaw<uint32_t>(header, static_cast<uint32_t>(blockSize));
+    putRaw<int64_t>(header, priceScale);
+    offset = 0;
+    index.clear();
+    write(header);
+    return static_cast<bool>(out);
+}
+
+void ArchiveWriter::write(const std::string& bytes) {
+    out.write(bytes.data(), bytes.size());
+    offset += bytes.size();
+}
+
+bool ArchiveWriter::toTicks(Price price, int64_t& ticks) const {
+    ticks = std::llround(price * priceScale);
+    return ticks / static_cast<double>(priceScale) == price;
+}
+
+bool ArchiveWriter::append(const MarketEvent& event, const L2Snapshot* snapshot) {
+    if (event.type != type) {
+        return false;
+    }
+
+    // validate prices up front so a bad record never lands in a block
+    int64_t ticks;
+    if (type == EventType::L3_UPDATE) {
+        if (!toTicks(event.l3Update.price, ticks)) return false;
+        l3Updates.push_back(event.l3Update);
+    } else if (type == EventType::TRADE_EXECUTION) {
+        if (!toTicks(event.trade.price, ticks)) return false;
+        trades.push_back(event.trade);
+    } else {
+        if (!snapshot) return false;
+        for (size_t i = 0; i < snapshot->bids.count; ++i) {
+            if (!toTicks(snapshot->bids.prices[i], ticks)) return false;
+        }
+        for (size_t i = 0; i < snapshot->asks.count; ++i) {
+            if (!toTicks(snapshot->asks.prices[i], ticks)) return false;
+        }
+        snapshots.push_back(*snapshot);
+    }
+    timestamps.push_back(event.timestamp);
+
+    if (timestamps.size() >= blockSize) {
+        return flushBlock();
+    }
+    return true;
+}
+
+bool ArchiveWriter::flushBlock() {
+    if (timestamps.empty()) {
+        return true;
+    }
+
+    std::string tsColumn;
+    Timestamp prevTs = 0;
+    for (Timestamp ts : timestamps) {
+        putVarint(tsColumn, zigzag(static_cast<int64_t>(ts - prevTs)));
+        prevTs = ts;
+    }
+
+    std::string block;
+    putVarint(block, timestamps.size());
+    putColumn(block, tsColumn);
+
+    int64_t ticks;
+    if (type == EventType::L3_UPDATE) {
+        std::string flags, ids, prices, sizes;
+        OrderId prevId = 0;
+        int64_t prevTicks = 0;
+        for (const auto& u : l3Updates) {
+            flags.push_back(static_cast<char>(static_cast<int>(u.action) | (u.isSell ? 4 : 0)));
+            putVarint(ids, zigzag(static_cast<int64_t>(u.orderId) - prevId));
+            toTicks(u.price, ticks);
+            putVarint(prices, zigzag(ticks - prevTicks));
+            putVarint(sizes, zigzag(u.size));
+            prevId = u.orderId;
+            prevTicks = ticks;
+        }
+        putColumn(block, flags);
+        putColumn(block, ids);
+        putColumn(block, prices);
+        putColumn(block, sizes);
+    } else if (type == EventType::TRADE_EXECUTION) {
+        std::string prices, sizes;
+        int64_t prevTicks = 0;
+        for (const auto& t : trades) {
+            toTicks(t.price, ticks);
+            putVarint(prices, zigzag(ticks - prevTicks));
+            putVarint(sizes, zigzag(t.quantity));
+            prevTicks = ticks;
+        }
+        putColumn(block, prices);
+        putColumn(block, sizes);
+    } else {
+        // levels are deltas from the level above, the top level from the previous top
+        std::string counts, prices, sizes;
+        int64_t prevBestBid = 0;
+        int64_t prevBestAsk = 0;
+        for (const auto& s : snapshots) {
+            putVarint(counts, s.bids.count);
+            putVarint(counts, s.asks.count);
+            int64_t prevTicks = prevBestBid;
+            for (size_t i = 0; i < s.bids.count; ++i) {
+                toTicks(s.bids.prices[i], ticks);
+                putVarint(prices, zigzag(ticks - prevTicks));
+                putVarint(sizes, zigzag(s.bids.quantities[i]));
+                if (i == 0) prevBestBid = ticks;
+                prevTicks = ticks;
+            }
+            prevTicks = prevBestAsk;
+            for (size_t i = 0; i < s.asks.count; ++i) {
+                toTicks(s.asks.prices[i], ticks);
+                putVarint(prices, zigzag(ticks - prevTicks));
+                putVarint(sizes, zigzag(s.asks.quantities[i]));
+                if (i == 0) prevBestAsk = ticks;
+                prevTicks = ticks;
+            }
+        }
+        putColumn(block, counts);
+        putColumn(block, prices);
+        putColumn(block, sizes);
+    }
+
+    index.push_back({offset, timestamps.front(), timestamps.back(),
+                     static_cast<uint32_t>(timestamps.size()), static_cast<uint32_t>(block.size())});
+    write(block);
+
+    timestamps.clear();
+    l3Updates.clear();
+    trades.clear();
+    snapshots.clear();
+    return static_cast<bool>(out);
+}
+
+bool ArchiveWriter::close() {
+    if (!out.is_open()) {
+        return false;
+    }
+    if (!flushBlock()) {
+        return false;
+    }
+
+    uint64_t indexOffset = offset;
+    std::string tail;
+    for (const auto& info : index) {
+        putRaw<uint64_t>(tail, info.offset);
+        putRaw<uint64_t>(tail, info.firstTimestamp);
+        putRaw<uint64_t>(tail, info.lastTimestamp);
+        putRaw<uint32_t>(tail, info.records);
+        putRaw<uint32_t>(tail, info.bytes);
+    }
+    putRaw<uint64_t>(tail, indexOffset);
+    putRaw<uint32_t>(tail, static_cast<uint32_t>(index.size()));
+    putRaw<uint32_t>(tail, 0);
+    tail.append(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    write(tail);
+
+    out.close();
+    return !out.fail();
+}
+
+bool ArchiveWriter::convert(const std::string& textFile, EventType type, const std::string& archiveFile,
+                            int64_t priceScale, size_t blockSize) {
+    MappedFile text;
+    if (!text.open(textFile)) {
+        std::cerr << "Failed to open " << textFile << "\n";
+        return false;
+    }
+
+    ArchiveWriter writer(type, priceScale, blockSize);
+    if (!writer.open(archiveFile)) {
+        std::cerr << "Failed to create " << archiveFile << "\n";
+        return false;
+    }
+
+    std::pmr::vector<L2Snapshot> scratch;
+    const char* p = text.data();
+    const char* end = p + text.size();
+    size_t lineNo = 0;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        ++lineNo;
+
+        MarketEvent event;
+        scratch.clear();
+        ParseStatus status = parseCaptureLine(p, lineEnd, type, event, scratch);
+        if (status != ParseStatus::OK && status != ParseStatus::EMPTY_LINE) {
+            std::cerr << textFile << ":" << lineNo << ": " << parseStatusName(status) << "\n";
+            std::remove(archiveFile.c_str());
+            return false;
+        }
+        if (status == ParseStatus::OK &&
+            !writer.append(event, scratch.empty() ? nullptr : &scratch.back())) {
+            std::cerr << textFile << ":" << lineNo << ": price is not a multiple of 1/" << priceScale << "\n";
+            std::remove(archiveFile.c_str());
+            return false;
+        }
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+    return writer.close();
+}
+
+bool ArchiveReader::isArchive(const char* data, size_t size) {
+    return size >= HEADER_SIZE + FOOTER_SIZE && std::memcmp(data, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0;
+}
+
+bool ArchiveReader::open(const std::string& path) {
+    index.clear();
+    if (!file.open(path) || !isArchive(file.data(), file.size())) {
+        return false;
+    }
+
+    const char* data = file.data();
+    size_t size = file.size();
+    type = static_cast<EventType>(getRaw<uint8_t>(data + 8));
+    priceScale = getRaw<int64_t>(data + 16);
+
+    const char* footer = data + size - FOOTER_SIZE;
+    uint64_t indexOffset = getRaw<uint64_t>(footer);
+    uint32_t blockCount = getRaw<uint32_t>(footer + 8);
+    // offsets come from the file, every check is written so it cannot wrap
+    if (std::memcmp(footer + 16, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || priceScale <= 0 ||
+        indexOffset < HEADER_SIZE || indexOffset > size - FOOTER_SIZE ||
+        size - FOOTER_SIZE - indexOffset != static_cast<uint64_t>(blockCount) * INDEX_ENTRY_SIZE) {
+        return false;
+    }
+
+    index.reserve(blockCount);
+    for (uint32_t i = 0; i < blockCount; ++i) {
+        const char* entry = data + indexOffset + i * INDEX_ENTRY_SIZE;
+        ArchiveBlockInfo info;
+        info.offset = getRaw<uint64_t>(entry);
+        info.firstTimestamp = getRaw<uint64_t>(entry + 8);
+        info.lastTimestamp = getRaw<uint64_t>(entry + 16);
+        info.records = getRaw<uint32_t>(entry + 24);
+        info.bytes = getRaw<uint32_t>(entry + 28);
+        if (info.offset < HEADER_SIZE || info.offset > indexOffset || info.bytes > indexOffset - info.offset) {
+            index.clear();
+            return false;
+        }
+        index.push_back(info);
+    }
+    return true;
+}
+
+size_t ArchiveReader::findBlock(Timestamp timestamp) const {
+    size_t lo = 0;
+    size_t hi = index.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (index[mid].lastTimestamp < timestamp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool ArchiveReader::readBlock(size_t i, ParsedChunk& out) const {
+    if (i >= index.size()) {
+        return false;
+    }
+
+    const char* p = file.data() + index[i].offset;
+    const char* end = p + index[i].bytes;
+    const double scale = static_cast<double>(priceScale);
+
+    // the count must agree with the index, and every record takes at least
+    // one timestamp byte, before anything is sized from it
+    uint64_t records;
+    const char *tsBegin, *tsEnd;
+    if (!getVarint(p, end, records) || records != index[i].records || !getColumn(p, end, tsBegin, tsEnd) ||
+        records > static_cast<uint64_t>(tsEnd - tsBegin)) {
+        return false;
+    }
+
+    size_t firstEvent = out.events.size();
+    out.events.resize(firstEvent + records);
+    Timestamp ts = 0;
+    for (uint64_t r = 0; r < records; ++r) {
+        int64_t delta;
+        if (!getSigned(tsBegin, tsEnd, delta)) return false;
+        ts += delta;
+        MarketEvent& event = out.events[firstEvent + r];
+        event.type = type;
+        event.timestamp = ts;
+        event.rawData = std::string_view();
+    }
+
+    int64_t ticks = 0;
+    int64_t value;
+    if (type == EventType::L3_UPDATE) {
+        const char *flagsBegin, *flagsEnd, *idsBegin, *idsEnd, *pricesBegin, *pricesEnd, *sizesBegin, *sizesEnd;
+        if (!getColumn(p, end, flagsBegin, flagsEnd) || !getColumn(p, end, idsBegin, idsEnd) ||
+            !getColumn(p, end, pricesBegin, pricesEnd) || !getColumn(p, end, sizesBegin, sizesEnd) ||
+            static_cast<uint64_t>(flagsEnd - flagsBegin) != records) {
+            return false;
+        }
+
+        int64_t id = 0;
+        for (uint64_t r = 0; r < records; ++r) {
+            MarketEvent& event = out.events[firstEvent + r];
+            L3Update& u = event.l3Update;
+            uint8_t flags = static_cast<uint8_t>(flagsBegin[r]);
+            if ((flags & 3) > static_cast<uint8_t>(L3Action::CANCEL)) return false;
+            u.timestamp = event.timestamp;
+            u.action = static_cast<L3Action>(flags & 3);
+            u.isSell = flags & 4;
+            if (!getSigned(idsBegin, idsEnd, value)) return false;
+            id += value;
+            u.orderId = static_cast<OrderId>(id);
+            if (!getSigned(pricesBegin, pricesEnd, value)) return false;
+            ticks += value;
+            u.price = ticks / scale;
+            if (!getSigned(sizesBegin, sizesEnd, value)) return false;
+            u.size = static_cast<Quantity>(value);
+        }
+    } else if (type == EventType::TRADE_EXECUTION) {
+        const char *pricesBegin, *pricesEnd, *sizesBegin, *sizesEnd;
+        if (!getColumn(p, end, pricesBegin, pricesEnd) || !getColumn(p, end, sizesBegin, sizesEnd)) {
+            return false;
+        }
+
+        for (uint64_t r = 0; r < records; ++r) {
+            MarketEvent& event = out.events[firstEvent + r];
+            TradeInfo& t = event.trade;
+            t.timestamp = event.timestamp;
+            t.aggressorSide = OrderSide::BUY;
+            t.orderId = 0;
+            if (!getSigned(pricesBegin, pricesEnd, value)) return false;
+            ticks += value;
+            t.price = ticks / scale;
+            if (!getSigned(sizesBegin, sizesEnd, value)) return false;
+            t.quantity = static_cast<Quantity>(value);
+        }
+    } else {
+        const char *countsBegin, *countsEnd, *pricesBegin, *pricesEnd, *sizesBegin, *sizesEnd;
+        if (!getColumn(p, end, countsBegin, countsEnd) || !getColumn(p, end, pricesBegin, pricesEnd) ||
+            !getColumn(p, end, sizesBegin, sizesEnd)) {
+            return false;
+        }
+
+        int64_t prevBestBid = 0;
+        int64_t prevBestAsk = 0;
+        for (uint64_t r = 0; r < records; ++r) {
+            MarketEvent& event = out.events[firstEvent + r];
+            L2Snapshot& snapshot = out.snapshots.emplace_back();
+            snapshot.timestamp = event.timestamp;
+            event.snapshotIndex = out.snapshots.size() - 1;
+
+            uint64_t counts[2];
+            if (!getVarint(countsBegin, countsEnd, counts[0]) || !getVarint(countsBegin, countsEnd, counts[1]) ||
+                counts[0] > L2_MAX_LEVELS || counts[1] > L2_MAX_LEVELS) {
+                return false;
+            }
+
+            L2Side* sides[2] = {&snapshot.bids, &snapshot.asks};
+            int64_t* prevBest[2] = {&prevBestBid, &prevBestAsk};
+            for (int s = 0; s < 2; ++s) {
+                ticks = *prevBest[s];
+                for (uint64_t i = 0; i < counts[s]; ++i) {
+                    if (!getSigned(pricesBegin, pricesEnd, value)) return false;
+                    ticks += value;
+                    if (i == 0) *prevBest[s] = ticks;
+                    int64_t qty;
+                    if (!getSigned(sizesBegin, sizesEnd, qty)) return false;
+                    sides[s]->push(ticks / scale, static_cast<Quantity>(qty));
+                }
+            }
+        }
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "ConsolidatedBook.hpp"
+#include <iostream>
+
+int ConsolidatedBook::addVenue(const std::string& name) {
+    if (venues.size() == MAX_VENUES) {
+        std::cerr << "ConsolidatedBook: cannot add venue " << name << ", already " << MAX_VENUES << "\n";
+        return -1;
+    }
+    venues.push_back(Venue{name});
+    return static_cast<int>(venues.size()) - 1;
+}
+
+int ConsolidatedBook::attach(OrderBook& orderBook, const std::string& name, Callbacks callbacks) {
+    int venue = addVenue(name);
+    if (venue < 0) {
+        return -1;
+    }
+    DepthUpdateCallback next = callbacks.onDepthUpdate;
+    callbacks.onDepthUpdate = [this, venue, next](const DepthUpdate& update) {
+        apply(venue, update);
+        if (next) next(update);
+    };
+    // setting callbacks makes the depth feed start with a snapshot
+    orderBook.setCallbacks(callbacks);
+    return venue;
+}
+
+bool ConsolidatedBook::apply(int venue, const DepthUpdate& update) {
+    Venue& state = venues[venue];
+    if (update.isSnapshot) {
+        clearVenue(venue);
+        state.synced = true;
+    } else if (!state.synced || update.sequence != state.lastSequence + 1) {
+        if (state.synced) {
+            state.gaps++;
+            clearVenue(venue);
+            refreshBbo(update.timestamp);
+        }
+        state.synced = false;
+        state.lastSequence = update.sequence;
+        return false;
+    }
+    state.lastSequence = update.sequence;
+
+    for (const DepthLevelUpdate& level : update.levels) {
+        if (level.isSell) {
+            setLevel(asks, venue, level.price, level.quantity, level.numOrders);
+        } else {
+            setLevel(bids, venue, level.price, level.quantity, level.numOrders);
+        }
+    }
+    refreshBbo(update.timestamp);
+    return true;
+}
+
+template<typename Side>
+void ConsolidatedBook::setLevel(Side& side, int venue, Price price, Quantity quantity, int numOrders) {
+    auto it = side.find(price);
+    if (it == side.end()) {
+        if (numOrders == 0) {
+            return;
+        }
+        it = side.emplace(price, ConsolidatedLevel()).first;
+    }
+
+    // the merged level moves by the difference to the venue's previous share
+    ConsolidatedLevel& level = it->second;
+    DepthLevel& share = level.venues[venue];
+    if (numOrders == 0) {
+        quantity = 0;
+    }
+    level.quantity += quantity - share.quantity;
+    level.numOrders += numOrders - share.numOrders;
+    level.numVenues += (numOrders > 0) - (share.numOrders > 0);
+    share.quantity = quantity;
+    share.numOrders = numOrders;
+
+    if (level.numVenues == 0) {
+        side.erase(it);
+    }
+}
+
+template<typename Side>
+void ConsolidatedBook::clearSide(Side& side, int venue) {
+    for (auto it = side.begin(); it != side.end(); ) {
+        ConsolidatedLevel& level = it->second;
+        DepthLevel& share = level.venues[venue];
+        if (share.numOrders == 0) {
+            ++it;
+            continue;
+        }
+        level.quantity -= share.quantity;
+        level.numOrders -= share.numOrders;
+        level.numVenues--;
+        share = DepthLevel();
+        it = level.numVenues == 0 ? side.erase(it) : std::next(it);
+    }
+}
+
+void ConsolidatedBook::clearVenue(int venue) {
+    clearSide(bids, venue);
+    clearSide(asks, venue);
+}
+
+void ConsolidatedBook::refreshBbo(Timestamp timestamp) {
+    ConsolidatedBbo current;
+    if (!bids.empty()) {
+        current.bidPrice = bids.begin()->first;
+        current.bidQuantity = bids.begin()->second.quantity;
+        current.bidVenues = bids.begin()->second.numVenues;
+    }
+    if (!asks.empty()) {
+        current.askPrice = asks.begin()->first;
+        current.askQuantity = asks.begin()->second.quantity;
+        current.askVenues = asks.begin()->second.numVenues;
+    }
+    if (current == bbo) {
+        return;
+    }
+    current.timestamp = timestamp;
+    bbo = current;
+    if (onBboChange) onBboChange(bbo);
+}
+
+const ConsolidatedLevel* ConsolidatedBook::getLevel(bool isSell, Price price) const {
+    if (isSell) {
+        auto it = asks.find(price);
+        return it == asks.end() ? nullptr : &it->second;
+    }
+    auto it = bids.find(price);
+    return it == bids.end() ? nullptr : &it->second;
+}
\ No newline at end of file
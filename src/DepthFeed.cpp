@@ -0,0 +1,109 @@
+#include "DepthFeed.hpp"
+#include <algorithm>
+
+bool DepthFeedPublisher::publish(const L3Book& book, DirtyLevels& dirty, Timestamp timestamp,
+                                 const DepthUpdateCallback& callback) {
+    if (snapshotDue || (snapshotInterval > 0 && updatesSinceSnapshot >= snapshotInterval)) {
+        publishSnapshot(book, timestamp, callback);
+        return true;
+    }
+    if (dirty.empty()) {
+        return false;
+    }
+
+    // one entry per level, bids first, each side in price order
+    std::sort(dirty.begin(), dirty.end(), [](const DirtyLevel& a, const DirtyLevel& b) {
+        return a.isSell != b.isSell ? b.isSell : a.price < b.price;
+    });
+    dirty.erase(std::unique(dirty.begin(), dirty.end(), [](const DirtyLevel& a, const DirtyLevel& b) {
+        return a.isSell == b.isSell && a.price == b.price;
+    }), dirty.end());
+
+    update.levels.clear();
+    for (const DirtyLevel& level : dirty) {
+        DepthLevelUpdate current{level.price, level.isSell, 0, 0};
+        if (level.isSell) {
+            auto it = book.getAsks().find(level.price);
+            if (it != book.getAsks().end()) {
+                current.quantity = it->second.quantity;
+                current.numOrders = it->second.numOrders;
+            }
+        } else {
+            auto it = book.getBids().find(level.price);
+            if (it != book.getBids().end()) {
+                current.quantity = it->second.quantity;
+                current.numOrders = it->second.numOrders;
+            }
+        }
+
+        // touched but back where it was, e.g. an add and cancel in the same event
+        auto& published = level.isSell ? publishedAsks : publishedBids;
+        auto it = published.find(level.price);
+        if (it == published.end() ? current.numOrders == 0
+            : it->second.quantity == current.quantity && it->second.numOrders == current.numOrders) {
+            continue;
+        }
+        if (current.numOrders == 0) {
+            published.erase(it);
+        } else {
+            published[level.price] = {current.quantity, current.numOrders};
+        }
+        update.levels.push_back(current);
+    }
+
+    if (update.levels.empty()) {
+        return false;
+    }
+    update.sequence = ++sequence;
+    update.timestamp = timestamp;
+    update.isSnapshot = false;
+    updatesSinceSnapshot++;
+    callback(update);
+    return true;
+}
+
+void DepthFeedPublisher::publishSnapshot(const L3Book& book, Timestamp timestamp, const DepthUpdateCallback& callback) {
+    publishedBids.clear();
+    publishedAsks.clear();
+    update.levels.clear();
+    for (const auto& [price, level] : book.getBids()) {
+        publishedBids[price] = {level.quantity, level.numOrders};
+        update.levels.push_back({price, false, level.quantity, level.numOrders});
+    }
+    for (const auto& [price, level] : book.getAsks()) {
+        publishedAsks[price] = {level.quantity, level.numOrders};
+        update.levels.push_back({price, true, level.quantity, level.numOrders});
+    }
+
+    update.sequence = ++sequence;
+    update.timestamp = timestamp;
+    update.isSnapshot = true;
+    updatesSinceSnapshot = 0;
+    snapshotDue = false;
+    callback(update);
+}
+
+bool DepthBook::apply(const DepthUpdate& update) {
+    if (update.isSnapshot) {
+        bids.clear();
+        asks.clear();
+        synced = true;
+    } else if (!synced || update.sequence != lastSequence + 1) {
+        if (synced) gaps++;
+        synced = false;
+        lastSequence = update.sequence;
+        return false;
+    }
+    lastSequence = update.sequence;
+
+    for (const DepthLevelUpdate& level : update.levels) {
+        if (level.isSell) {
+            if (level.numOrders == 0) asks.erase(level.price);
+            else asks[level.price] = {level.quantity, level.numOrders};
+        } else {
+            if (level.numOrders == 0) bids.erase(level.price);
+            else bids[level.price] = {level.quantity, level.numOrders};
+        }
+    }
+    return true;
+}
\ No newline at end of file
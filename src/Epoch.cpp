@@ -0,0 +1,58 @@
+#include "Epoch.hpp"
+#include <algorithm>
+
+EpochManager::~EpochManager() {
+    for (const Retired& retired : limbo) {
+        retired.destroy(retired.object);
+    }
+}
+
+int EpochManager::registerReader() {
+    for (size_t i = 0; i < EPOCH_MAX_READERS; ++i) {
+        bool expected = false;
+        if (readers[i].used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void EpochManager::unregisterReader(int reader) {
+    readers[reader].epoch.store(0, std::memory_order_release);
+    readers[reader].used.store(false, std::memory_order_release);
+}
+
+EpochManager::Guard EpochManager::pin(int reader) {
+    std::atomic<uint64_t>& slot = readers[reader].epoch;
+    // sequentially consistent, so either the writer's scan sees this pin or
+    // every pointer the reader loads afterwards is already the new one
+    slot.store(globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    return Guard(&slot);
+}
+
+size_t EpochManager::advance() {
+    globalEpoch.fetch_add(1, std::memory_order_seq_cst);
+    if (limbo.empty()) {
+        return 0;
+    }
+
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot& reader : readers) {
+        uint64_t epoch = reader.epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0) oldest = std::min(oldest, epoch);
+    }
+
+    // a reader pinned at epoch e may hold anything retired at e or later
+    size_t kept = 0;
+    size_t freed = 0;
+    for (const Retired& retired : limbo) {
+        if (retired.epoch < oldest) {
+            retired.destroy(retired.object);
+            freed++;
+        } else {
+            limbo[kept++] = retired;
+        }
+    }
+    limbo.resize(kept);
+    return freed;
+}
\ No newline at end of file
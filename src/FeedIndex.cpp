@@ -0,0 +1,123 @@
+#include "FeedIndex.hpp"
+#include "FeedParser.hpp"
+#include "MappedFile.hpp"
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+// 02 added the capture's modification time
+static const char INDEX_MAGIC[8] = {'S', 'O', 'B', 'I', 'D', 'X', '0', '2'};
+static const size_t HEADER_SIZE = sizeof(INDEX_MAGIC) + 3 * sizeof(uint64_t);
+
+static bool fileStat(const std::string& file, uint64_t& size, int64_t& mtime) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool FeedIndex::build(const std::string& file, uint64_t stride) {
+    MappedFile mapped;
+    if (!mapped.open(file)) {
+        return false;
+    }
+
+    entries.clear();
+    if (!fileStat(file, fileSize, fileMtime)) {
+        return false;
+    }
+    const char* begin = mapped.data();
+    const char* end = begin + mapped.size();
+    const char* p = begin;
+    uint64_t nextOffset = 0;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        uint64_t offset = p - begin;
+
+        const char* q = p;
+        Timestamp ts;
+        if (offset >= nextOffset && parseTimestamp(q, lineEnd, ts) == ParseStatus::OK) {
+            entries.push_back({ts, offset});
+            nextOffset = offset + (stride ? stride : 1);
+        }
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+    return true;
+}
+
+bool FeedIndex::save(const std::string& indexFile) const {
+    std::ofstream out(indexFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    uint64_t count = entries.size();
+    out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    out.write(reinterpret_cast<const char*>(&fileSize), sizeof(fileSize));
+    out.write(reinterpret_cast<const char*>(&fileMtime), sizeof(fileMtime));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(entries.data()), count * sizeof(Entry));
+    return static_cast<bool>(out);
+}
+
+bool FeedIndex::load(const std::string& indexFile) {
+    std::ifstream in(indexFile, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return false;
+    }
+    uint64_t length = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+
+    char magic[sizeof(INDEX_MAGIC)];
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&fileSize), sizeof(fileSize));
+    in.read(reinterpret_cast<char*>(&fileMtime), sizeof(fileMtime));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    // the count must account for exactly the rest of the sidecar
+    if (!in || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 || length < HEADER_SIZE ||
+        count != (length - HEADER_SIZE) / sizeof(Entry) || (length - HEADER_SIZE) % sizeof(Entry) != 0) {
+        entries.clear();
+        return false;
+    }
+
+    entries.resize(count);
+    in.read(reinterpret_cast<char*>(entries.data()), count * sizeof(Entry));
+    for (const Entry& entry : entries) {
+        if (entry.offset >= fileSize) {
+            entries.clear();
+            return false;
+        }
+    }
+    return static_cast<bool>(in);
+}
+
+bool FeedIndex::loadOrBuild(const std::string& file, uint64_t stride) {
+    uint64_t size;
+    int64_t mtime;
+    if (!fileStat(file, size, mtime)) {
+        return false;
+    }
+    if (load(sidecarPath(file)) && fileSize == size && fileMtime == mtime) {
+        return true;
+    }
+    if (!build(file, stride)) {
+        return false;
+    }
+    save(sidecarPath(file));
+    return true;
+}
+
+uint64_t FeedIndex::seek(Timestamp target) const {
+    // last entry strictly before target, lines with equal timestamps may precede an entry
+    size_t lo = 0;
+    size_t hi = entries.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (entries[mid].timestamp < target) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo == 0 ? 0 : entries[lo - 1].offset;
+}
\ No newline at end of file
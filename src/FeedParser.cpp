@@ -0,0 +1,240 @@
+#include "FeedParser.hpp"
+#include <charconv>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static inline bool isDigit(char c) {
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline void skipSpaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+}
+
+// Matches a whole word token (followed by whitespace or end of line)
+static inline bool consumeWord(const char*& p, const char* end, const char* word, size_t len) {
+    if (static_cast<size_t>(end - p) < len || std::memcmp(p, word, len) != 0) {
+        return false;
+    }
+    if (p + len < end && p[len] != ' ' && p[len] != '\t' && p[len] != '\r') {
+        return false;
+    }
+    p += len;
+    return true;
+}
+
+template<typename T>
+static inline bool parseInt(const char*& p, const char* end, T& out) {
+    // plain short digit runs are the norm, signs and long runs go through from_chars
+    const char* q = p;
+    T value = 0;
+    while (q < end && q - p < 9 && isDigit(*q)) {
+        value = value * 10 + (*q - '0');
+        ++q;
+    }
+    if (q != p && (q == end || !isDigit(*q))) {
+        out = value;
+        p = q;
+        return true;
+    }
+
+    auto [ptr, ec] = std::from_chars(p, end, out);
+    if (ec != std::errc()) return false;
+    p = ptr;
+    return true;
+}
+
+static inline bool parseDecimal(const char*& p, const char* end, Price& out) {
+    const char* q = p;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fraction = 0;
+
+    while (q < end && isDigit(*q)) {
+        mantissa = mantissa * 10 + (*q - '0');
+        ++digits;
+        ++q;
+    }
+    if (q < end && *q == '.') {
+        ++q;
+        while (q < end && isDigit(*q)) {
+            mantissa = mantissa * 10 + (*q - '0');
+            ++digits;
+            ++fraction;
+            ++q;
+        }
+    }
+
+    // exact: mantissa < 2^53 and 10^fraction is representable, so one division rounds correctly
+    if (digits > 0 && digits <= 15 && (q == end || (*q != 'e' && *q != 'E'))) {
+        out = fraction ? static_cast<double>(mantissa) / POW10[fraction] : static_cast<double>(mantissa);
+        p = q;
+        return true;
+    }
+
+    auto [ptr, ec] = std::from_chars(p, end, out);
+    if (ec != std::errc()) return false;
+    p = ptr;
+    return true;
+}
+
+bool parsePrice(const char*& p, const char* end, Price& out) {
+    return parseDecimal(p, end, out);
+}
+
+ParseStatus parseTimestamp(const char*& p, const char* end, Timestamp& out) {
+    skipSpaces(p, end);
+    if (p == end) return ParseStatus::EMPTY_LINE;
+    if (!parseInt(p, end, out)) return ParseStatus::BAD_TIMESTAMP;
+    skipSpaces(p, end);
+    return ParseStatus::OK;
+}
+
+ParseStatus parseL2Snapshot(const char* begin, const char* end, L2Snapshot& out) {
+    const char* p = begin;
+    out.bids.clear();
+    out.asks.clear();
+    out.truncatedLevels = 0;
+
+    skipSpaces(p, end);
+    if (!consumeWord(p, end, "BID", 3)) return ParseStatus::BAD_ACTION;
+
+    L2Side* side = &out.bids;
+    bool descending = true;
+    while (true) {
+        skipSpaces(p, end);
+        if (p == end) break;
+        if (side == &out.bids && *p == 'A' && consumeWord(p, end, "ASK", 3)) {
+            side = &out.asks;
+            descending = false;
+            continue;
+        }
+
+        Price price;
+        Quantity quantity;
+        if (!parseDecimal(p, end, price)) return ParseStatus::BAD_NUMBER;
+        skipSpaces(p, end);
+        if (!parseInt(p, end, quantity)) return ParseStatus::BAD_NUMBER;
+        // a deeper book keeps its top levels, as L2Book does
+        if (!side->setLevel(price, quantity, descending)) out.truncatedLevels++;
+    }
+
+    return ParseStatus::OK;
+}
+
+ParseStatus parseL3Update(const char* begin, const char* end, L3Update& out) {
+    const char* p = begin;
+    skipSpaces(p, end);
+
+    if (consumeWord(p, end, "ADD", 3)) {
+        out.action = L3Action::ADD;
+    } else if (consumeWord(p, end, "MODIFY", 6)) {
+        out.action = L3Action::MODIFY;
+    } else if (consumeWord(p, end, "CANCEL", 6)) {
+        out.action = L3Action::CANCEL;
+    } else {
+        return ParseStatus::BAD_ACTION;
+    }
+
+    skipSpaces(p, end);
+    if (!parseInt(p, end, out.orderId)) return ParseStatus::BAD_NUMBER;
+    skipSpaces(p, end);
+
+    out.isSell = false;
+    out.price = 0.0;
+    out.size = 0;
+    // CANCEL may omit side, price and size, some captures still carry them
+    if (out.action == L3Action::CANCEL && p == end) {
+        return ParseStatus::OK;
+    }
+
+    if (consumeWord(p, end, "SELL", 4)) {
+        out.isSell = true;
+    } else if (!consumeWord(p, end, "BUY", 3)) {
+        return ParseStatus::BAD_SIDE;
+    }
+
+    skipSpaces(p, end);
+    if (!parseDecimal(p, end, out.price)) return ParseStatus::BAD_NUMBER;
+    skipSpaces(p, end);
+    if (!parseInt(p, end, out.size)) return ParseStatus::BAD_NUMBER;
+    skipSpaces(p, end);
+    return p == end ? ParseStatus::OK : ParseStatus::TRAILING_DATA;
+}
+
+ParseStatus parseTrade(const char* begin, const char* end, TradeInfo& out) {
+    const char* p = begin;
+    skipSpaces(p, end);
+    if (!parseDecimal(p, end, out.price)) return ParseStatus::BAD_NUMBER;
+    skipSpaces(p, end);
+    if (!parseInt(p, end, out.quantity)) return ParseStatus::BAD_NUMBER;
+    skipSpaces(p, end);
+    out.aggressorSide = OrderSide::BUY;
+    out.orderId = 0;
+    return p == end ? ParseStatus::OK : ParseStatus::TRAILING_DATA;
+}
+
+ParseStatus parseCaptureLine(const char* begin, const char* end, EventType type,
+                             MarketEvent& event, std::pmr::vector<L2Snapshot>& snapshots) {
+    const char* p = begin;
+    Timestamp ts;
+    ParseStatus status = parseTimestamp(p, end, ts);
+    if (status != ParseStatus::OK) {
+        return status;
+    }
+
+    event.type = type;
+    event.timestamp = ts;
+    event.rawData = std::string_view(p, end - p);
+    if (type == EventType::L2_SNAPSHOT) {
+        L2Snapshot& snapshot = snapshots.emplace_back();
+        status = parseL2Snapshot(p, end, snapshot);
+        snapshot.timestamp = ts;
+        event.snapshotIndex = snapshots.size() - 1;
+        if (status != ParseStatus::OK) snapshots.pop_back();
+    } else if (type == EventType::L3_UPDATE) {
+        status = parseL3Update(p, end, event.l3Update);
+        event.l3Update.timestamp = ts;
+    } else if (type == EventType::TRADE_EXECUTION) {
+        status = parseTrade(p, end, event.trade);
+        event.trade.timestamp = ts;
+    }
+    return status;
+}
+
+const char* findLineEnd(const char* begin, const char* end) {
+    const char* p = begin;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n') ++p;
+    return p;
+}
+
+const char* parseStatusName(ParseStatus status) {
+    switch (status) {
+        case ParseStatus::OK: return "OK";
+        case ParseStatus::EMPTY_LINE: return "EMPTY_LINE";
+        case ParseStatus::BAD_TIMESTAMP: return "BAD_TIMESTAMP";
+        case ParseStatus::BAD_ACTION: return "BAD_ACTION";
+        case ParseStatus::BAD_SIDE: return "BAD_SIDE";
+        case ParseStatus::BAD_NUMBER: return "BAD_NUMBER";
+        case ParseStatus::TRAILING_DATA: return "TRAILING_DATA";
+    }
+    return "UNKNOWN";
+}
@@ -1,34 +1,76 @@
 #include "L2Book.hpp"
+#include <iostream>
 
+// counted rather than logged, a deep book would log on every snapshot
 void L2Book::addAskLevel(Price price, Quantity quantity) {
-    askBook[price] = {price, quantity};
+    if (!snapshots[current].asks.setLevel(price, quantity, false)) {
+        snapshots[current].truncatedLevels++;
+        truncatedLevels++;
+    }
 }
 
 void L2Book::addBidLevel(Price price, Quantity quantity) {
-    bidBook[price] = {price, quantity};
+    if (!snapshots[current].bids.setLevel(price, quantity, true)) {
+        snapshots[current].truncatedLevels++;
+        truncatedLevels++;
+    }
 }
 
 Price L2Book::getBestBid() const {
-    return bidBook.empty() ? 0.0 : bidBook.begin()->first;
+    return getBids().empty() ? 0.0 : getBids().prices[0];
 }
 
 Price L2Book::getBestAsk() const {
-    return askBook.empty() ? 0.0 : askBook.begin()->first;
+    return getAsks().empty() ? 0.0 : getAsks().prices[0];
 }
 
 Quantity L2Book::getBidQuantityAtPrice(Price price) const {
-    auto it = bidBook.find(price);
-    if (it != bidBook.end()) return it->second.quantity;
+    int idx = getBids().find(price);
+    if (idx >= 0) return getBids().quantities[idx];
     return -1;
 }
 
 Quantity L2Book::getAskQuantityAtPrice(Price price) const {
-    auto it = askBook.find(price);
-    if (it != askBook.end()) return it->second.quantity;
+    int idx = getAsks().find(price);
+    if (idx >= 0) return getAsks().quantities[idx];
     return -1;
 }
 
+// Starts a new snapshot, keeping the last one for comparison
 void L2Book::clear() {
-    bidBook.clear();
-    askBook.clear();
+    current = 1 - current;
+    snapshots[current].clear();
+}
+
+void L2Book::setSnapshot(const L2Snapshot& snapshot) {
+    clear();
+    snapshots[current] = snapshot;
+    lastUpdateTime = snapshot.timestamp;
+    truncatedLevels += snapshot.truncatedLevels;
+}
+
+void L2Book::save(std::ostream& out) const {
+    const L2Snapshot& snapshot = getSnapshot();
+    out << snapshot.timestamp << " " << snapshot.bids.count << " " << snapshot.asks.count << "\n";
+    for (size_t i = 0; i < snapshot.bids.count; ++i) {
+        out << snapshot.bids.prices[i] << " " << snapshot.bids.quantities[i] << "\n";
+    }
+    for (size_t i = 0; i < snapshot.asks.count; ++i) {
+        out << snapshot.asks.prices[i] << " " << snapshot.asks.quantities[i] << "\n";
+    }
+}
+
+bool L2Book::load(std::istream& in) {
+    L2Snapshot snapshot;
+    size_t bidCount = 0;
+    size_t askCount = 0;
+    if (!(in >> snapshot.timestamp >> bidCount >> askCount)) return false;
+    for (size_t i = 0; i < bidCount + askCount; ++i) {
+        Price price;
+        Quantity quantity;
+        if (!(in >> price >> quantity)) return false;
+        (i < bidCount ? snapshot.bids : snapshot.asks).push(price, quantity);
+    }
+    setSnapshot(snapshot);
+    return true;
 }
\ No newline at end of file
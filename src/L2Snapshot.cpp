@@ -0,0 +1,142 @@
+#include "L2Snapshot.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+bool L2Side::setLevel(Price price, Quantity quantity, bool descending) {
+    // snapshots arrive in book order, so the common case is an append
+    if (count == 0 || (descending ? price < prices[count - 1] : price > prices[count - 1])) {
+        return push(price, quantity);
+    }
+
+    size_t pos = 0;
+    while (pos < count && (descending ? prices[pos] > price : prices[pos] < price)) {
+        ++pos;
+    }
+
+    if (pos < count && prices[pos] == price) {
+        quantities[pos] = quantity;
+        return true;
+    }
+
+    if (count == L2_MAX_LEVELS) {
+        return false;
+    }
+
+    std::memmove(prices + pos + 1, prices + pos, (count - pos) * sizeof(Price));
+    std::memmove(quantities + pos + 1, quantities + pos, (count - pos) * sizeof(Quantity));
+    prices[pos] = price;
+    quantities[pos] = quantity;
+    count++;
+    return true;
+}
+
+bool L2Side::push(Price price, Quantity quantity) {
+    if (count == L2_MAX_LEVELS) {
+        return false;
+    }
+    prices[count] = price;
+    quantities[count] = quantity;
+    count++;
+    return true;
+}
+
+int L2Side::find(Price price) const {
+    for (size_t i = 0; i < count; ++i) {
+        if (prices[i] == price) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+// Levels present on only one side always count as changed, padding beyond
+// the longer side never does.
+static uint64_t finishMask(uint64_t mask, size_t lhsCount, size_t rhsCount) {
+    size_t lo = std::min(lhsCount, rhsCount);
+    size_t hi = std::max(lhsCount, rhsCount);
+    uint64_t hiBits = hi >= 64 ? ~0ULL : ((1ULL << hi) - 1);
+    uint64_t loBits = lo >= 64 ? ~0ULL : ((1ULL << lo) - 1);
+    return (mask & loBits) | (hiBits & ~loBits);
+}
+
+uint64_t diffLevelsScalar(const L2Side& lhs, const L2Side& rhs) {
+    size_t n = std::min(lhs.count, rhs.count);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (lhs.prices[i] != rhs.prices[i] || lhs.quantities[i] != rhs.quantities[i]) {
+            mask |= 1ULL << i;
+        }
+    }
+    return finishMask(mask, lhs.count, rhs.count);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+uint64_t diffLevelsSSE2(const L2Side& lhs, const L2Side& rhs) {
+    size_t n = std::min(lhs.count, rhs.count);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; i += 4) {
+        __m128d p0 = _mm_cmpneq_pd(_mm_load_pd(lhs.prices + i), _mm_load_pd(rhs.prices + i));
+        __m128d p1 = _mm_cmpneq_pd(_mm_load_pd(lhs.prices + i + 2), _mm_load_pd(rhs.prices + i + 2));
+        __m128i q = _mm_cmpeq_epi32(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(lhs.quantities + i)),
+            _mm_load_si128(reinterpret_cast<const __m128i*>(rhs.quantities + i)));
+
+        uint64_t priceBits = _mm_movemask_pd(p0) | (_mm_movemask_pd(p1) << 2);
+        uint64_t qtyBits = ~_mm_movemask_ps(_mm_castsi128_ps(q)) & 0xF;
+        mask |= (priceBits | qtyBits) << i;
+    }
+    return finishMask(mask, lhs.count, rhs.count);
+}
+
+__attribute__((target("avx2")))
+uint64_t diffLevelsAVX2(const L2Side& lhs, const L2Side& rhs) {
+    size_t n = std::min(lhs.count, rhs.count);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; i += 8) {
+        __m256d p0 = _mm256_cmp_pd(_mm256_load_pd(lhs.prices + i), _mm256_load_pd(rhs.prices + i), _CMP_NEQ_UQ);
+        __m256d p1 = _mm256_cmp_pd(_mm256_load_pd(lhs.prices + i + 4), _mm256_load_pd(rhs.prices + i + 4), _CMP_NEQ_UQ);
+        __m256i q = _mm256_cmpeq_epi32(
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(lhs.quantities + i)),
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(rhs.quantities + i)));
+
+        uint64_t priceBits = _mm256_movemask_pd(p0) | (_mm256_movemask_pd(p1) << 4);
+        uint64_t qtyBits = ~_mm256_movemask_ps(_mm256_castsi256_ps(q)) & 0xFF;
+        mask |= (priceBits | qtyBits) << i;
+    }
+    return finishMask(mask, lhs.count, rhs.count);
+}
+
+#endif
+
+using DiffLevelsFn = uint64_t (*)(const L2Side&, const L2Side&);
+
+struct DiffLevelsKernel {
+    DiffLevelsFn fn;
+    const char* name;
+};
+
+static DiffLevelsKernel resolveDiffLevels() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {diffLevelsAVX2, "avx2"};
+    if (__builtin_cpu_supports("sse2")) return {diffLevelsSSE2, "sse2"};
+#endif
+    return {diffLevelsScalar, "scalar"};
+}
+
+static const DiffLevelsKernel& diffLevelsKernel() {
+    static const DiffLevelsKernel kernel = resolveDiffLevels();
+    return kernel;
+}
+
+uint64_t diffLevels(const L2Side& lhs, const L2Side& rhs) {
+    return diffLevelsKernel().fn(lhs, rhs);
+}
+
+const char* diffLevelsKernelName() {
+    return diffLevelsKernel().name;
+}
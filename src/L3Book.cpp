@@ -1,6 +1,58 @@
 #include "L3Book.hpp"
+#include "SignalEngine.hpp"
 #include <iostream>
 
+L3Book::L3Book(std::pmr::memory_resource* resource)
+    : bidBook(resource), askBook(resource), pool(resource), orderMap(resource), dirtyLevels(resource), name("L3Book") {}
+
+L3Book::L3Book(const L3Book& other)
+    : bidBook(other.bidBook), askBook(other.askBook), pool(other.pool), orderMap(other.orderMap),
+        trackDirty(other.trackDirty), dirtyLevels(other.dirtyLevels), name(other.name) {
+    rebindLevels();
+}
+
+L3Book::L3Book(L3Book&& other)
+    : bidBook(std::move(other.bidBook)), askBook(std::move(other.askBook)), pool(std::move(other.pool)),
+        orderMap(std::move(other.orderMap)), trackDirty(other.trackDirty),
+        dirtyLevels(std::move(other.dirtyLevels)), name(std::move(other.name)) {
+    rebindLevels();
+}
+
+L3Book& L3Book::operator=(const L3Book& other) {
+    if (this != &other) {
+        bidBook = other.bidBook;
+        askBook = other.askBook;
+        pool = other.pool;
+        orderMap = other.orderMap;
+        trackDirty = other.trackDirty;
+        dirtyLevels = other.dirtyLevels;
+        name = other.name;
+        rebindLevels();
+        if (signals) signals->rebuild(*this);
+    }
+    return *this;
+}
+
+L3Book& L3Book::operator=(L3Book&& other) {
+    if (this != &other) {
+        bidBook = std::move(other.bidBook);
+        askBook = std::move(other.askBook);
+        pool = std::move(other.pool);
+        orderMap = std::move(other.orderMap);
+        trackDirty = other.trackDirty;
+        dirtyLevels = std::move(other.dirtyLevels);
+        name = std::move(other.name);
+        rebindLevels();
+        if (signals) signals->rebuild(*this);
+    }
+    return *this;
+}
+
+void L3Book::rebindLevels() {
+    for (auto& [price, level] : bidBook) level.orders.bind(&pool);
+    for (auto& [price, level] : askBook) level.orders.bind(&pool);
+}
+
 Price L3Book::getBestAsk() const {
     return askBook.begin()->first;
 }
@@ -12,40 +64,68 @@ Price L3Book::getBestBid() const {
 Order* L3Book::findOrder(OrderId orderId) const {
     auto it = orderMap.find(orderId);
     if (it != orderMap.end()) {
-        return const_cast<Order*>(&(*it->second));
+        return const_cast<Order*>(&pool.node(it->second).order);
     }
     return nullptr;
 }
 
+Timestamp L3Book::getOrderTime(OrderId orderId) const {
+    auto it = orderMap.find(orderId);
+    return it != orderMap.end() ? pool.meta(it->second).timestamp : 0;
+}
+
+void L3Book::reserve(size_t orders) {
+    pool.reserve(orders);
+    orderMap.reserve(orders);
+}
+
+void L3Book::prefetchOrder(OrderId orderId) const {
+    auto it = orderMap.find(orderId);
+    if (it != orderMap.end()) {
+        __builtin_prefetch(&pool.node(it->second));
+    }
+}
+
+void L3Book::prefetchLevel(bool isSell, Price price) const {
+    // the queue tail is where an add lands, the level header comes with the lookup
+    if (isSell) {
+        auto levelIt = askBook.find(price);
+        if (levelIt != askBook.end() && !levelIt->second.orders.empty()) __builtin_prefetch(&levelIt->second.orders.back());
+    } else {
+        auto levelIt = bidBook.find(price);
+        if (levelIt != bidBook.end() && !levelIt->second.orders.empty()) __builtin_prefetch(&levelIt->second.orders.back());
+    }
+}
+
 bool L3Book::hasOrder(OrderId orderId) const {
     return orderMap.find(orderId) != orderMap.end();
 }
 
-bool L3Book::addOrder(OrderId orderId, bool isSell, Quantity size, Price price) {
+bool L3Book::addOrder(OrderId orderId, bool isSell, Quantity size, Price price, Timestamp timestamp) {
     // order id already exists
     if (orderMap.find(orderId) != orderMap.end()) {
         return false;
     }
 
     if (price <= 0.0) {
-        std::cout << "Not adding Mkt order\n";
+        logStream() << "Not adding Mkt order\n";
         return false;
     }
 
-    std::cout << "Adding order " << orderId << "\n";
+    logStream() << "Adding order " << orderId << "\n";
     Order order(orderId, isSell, price, size);
-    std::list<Order>::iterator orderIt;
 
     auto& level = (isSell ? askBook[price] : bidBook[price]);
 
     if (level.numOrders == 0) {
         level.price = price;
+        level.orders.bind(&pool);
     }
-    level.orders.push_back(order);
-    orderIt = std::prev(level.orders.end());
+    OrderQueue::iterator orderIt = level.orders.push_back(order, timestamp);
     level.quantity += order.size;
     level.numOrders++;
-    orderMap[order.orderId] = orderIt;
+    markDirty(price, isSell);
+    levelChanged(isSell, level);
 
     // if (order.isSell) {
     //     auto& level = askBook[price];
@@ -67,7 +147,7 @@ bool L3Book::addOrder(OrderId orderId, bool isSell, Quantity size, Price price)
     //     level.numOrders++;
     // }
 
-    orderMap[order.orderId] = orderIt;
+    orderMap[order.orderId] = orderIt.index();
     return true;
 }
 
@@ -78,9 +158,9 @@ bool L3Book::cancelOrder(OrderId orderId) {
         return false;
     }
 
-    std::cout << "Cancelling order id " << orderId << "\n";
+    logStream() << "Cancelling order id " << orderId << "\n";
 
-    auto orderIt = mapIt->second;
+    OrderQueue::iterator orderIt(&pool, mapIt->second);
     Price price = orderIt->price;
     bool isSell = orderIt->isSell;
     auto levelIt = (isSell ? askBook.find(price) : bidBook.find(price));
@@ -91,11 +171,11 @@ bool L3Book::cancelOrder(OrderId orderId) {
         level.quantity -= orderIt->size;
         level.numOrders--;
         level.orders.erase(orderIt);
-
-
+        markDirty(price, isSell);
+        levelChanged(isSell, level);
 
         if (level.numOrders == 0) {
-            std::cout << "Remove price level " << price << std::endl;
+            logStream() << "Remove price level " << price << std::endl;
             if (isSell) {
                 askBook.erase(levelIt);
             } else {
@@ -121,15 +201,18 @@ bool L3Book::modifyOrderSize(Order& order, int newSize) {
     }
     int sizeDelta = order.size - newSize;
     order.size = newSize;
+    markDirty(order.price, order.isSell);
     if (order.isSell) {
         auto levelIt = askBook.find(order.price);
         if (levelIt != askBook.end()) {
             levelIt->second.quantity -= sizeDelta;
+            levelChanged(true, levelIt->second);
         }
     } else {
         auto levelIt = bidBook.find(order.price);
         if (levelIt != bidBook.end()) {
             levelIt->second.quantity -= sizeDelta;
+            levelChanged(false, levelIt->second);
         }
     }
     return true;
@@ -141,12 +224,16 @@ bool L3Book::modifyOrderId(OrderId orderId, OrderId newId) {
         std::cerr << "Order not found\n";
         return false;
     }
-    mapIt->second->orderId = newId;
+    // rekey as well, otherwise the order can no longer be found by its new id
+    uint32_t index = mapIt->second;
+    pool.node(index).order.orderId = newId;
+    orderMap.erase(mapIt);
+    orderMap[newId] = index;
     return true;
 }
 
 bool L3Book::modifyOrder(OrderId orderId, Quantity newSize, Price newPrice) {
-    //std::cout << "modifying order id " << orderId << " size " << newSize << " price " << newPrice << "\n";
+    //logStream() << "modifying order id " << orderId << " size " << newSize << " price " << newPrice << "\n";
     auto mapIt = orderMap.find(orderId);
     if (mapIt == orderMap.end()) {
         std::cerr << "Order not found\n";
@@ -154,19 +241,20 @@ bool L3Book::modifyOrder(OrderId orderId, Quantity newSize, Price newPrice) {
     }
 
     // replace
-    auto orderIt = mapIt->second;
+    Order* orderIt = &pool.node(mapIt->second).order;
 
     // amend down
     if (orderIt->price == newPrice && orderIt->size > newSize) {
-        std::cout << "[" << name << "] Amending down order " << orderId << "\n";
+        logStream() << "[" << name << "] Amending down order " << orderId << "\n";
         return modifyOrderSize(*orderIt, newSize);
     }
 
-    std::cout << "[" << name << "] Replacing order " << orderId << "\n";
+    logStream() << "[" << name << "] Replacing order " << orderId << "\n";
     Order oldOrder = *orderIt;
+    Timestamp arrival = pool.meta(mapIt->second).timestamp;
     cancelOrder(orderId);
     //Order newOrder(orderId, oldOrder.side, newPrice, newSize);
-    return addOrder(orderId, oldOrder.isSell, newSize, newPrice);
+    return addOrder(orderId, oldOrder.isSell, newSize, newPrice, arrival);
 }
 
 bool L3Book::executeOrder(Order& order, Quantity executedSize) {
@@ -187,16 +275,19 @@ bool L3Book::executeOrder(Order& order, Quantity executedSize) {
 
     // partial fill
     order.size -= executedSize;
+    markDirty(order.price, order.isSell);
 
     if (order.isSell) {
         auto levelIt = askBook.find(order.price);
         if (levelIt != askBook.end()) {
             levelIt->second.quantity -= executedSize;
+            levelChanged(true, levelIt->second);
         }
     } else {
         auto levelIt = bidBook.find(order.price);
         if (levelIt != bidBook.end()) {
             levelIt->second.quantity -= executedSize;
+            levelChanged(false, levelIt->second);
         }
     }
 
@@ -204,6 +295,13 @@ bool L3Book::executeOrder(Order& order, Quantity executedSize) {
 }
 
 std::vector<OrderInfo> L3Book::executeAtPrice(Price price, Quantity quantity, bool isGuess) {
+    std::pmr::vector<OrderInfo> executions;
+    executeAtPrice(price, quantity, isGuess, executions);
+    return std::vector<OrderInfo>(executions.begin(), executions.end());
+}
+
+void L3Book::executeAtPrice(Price price, Quantity quantity, bool isGuess, std::pmr::vector<OrderInfo>& executions) {
+    executions.clear();
     if (price != getBestAsk() && price != getBestBid()) {
         std::cerr << "[CRITICAL] Unable to find price level " << price << " for trade\n";
     }
@@ -211,16 +309,17 @@ std::vector<OrderInfo> L3Book::executeAtPrice(Price price, Quantity quantity, bo
     bool isAsk = price == getBestAsk();
     auto levelIt = (isAsk ? askBook.find(price) : bidBook.find(price));
     auto end = (isAsk ? askBook.end() : bidBook.end());
-    std::vector<OrderInfo> executions;
     if (levelIt == end) {
         std::cerr << "[CRITICAL] Unable to find price level " << price << " for trade\n";
-        return executions;
+        return;
     }
 
     Quantity remainingQty = quantity;
     auto& level = levelIt->second;
+    // the level goes away with its last order
     auto orderIt = level.orders.begin();
-    while (orderIt != level.orders.end() && remainingQty > 0) {
+    auto orderEnd = level.orders.end();
+    while (orderIt != orderEnd && remainingQty > 0) {
         auto currIt = orderIt++;
         int execQty = std::min(remainingQty, currIt->size);
         OrderInfo execution(currIt->orderId, currIt->isSell, price, execQty, "EXECUTION");
@@ -234,8 +333,6 @@ std::vector<OrderInfo> L3Book::executeAtPrice(Price price, Quantity quantity, bo
         remainingQty -= execQty;
     }
 
-    return executions;
-
     // if (price == getBestAsk()) {
     //     return executeAtPrice(askBook, price, quantity);
     // } else if (price == getBestBid()) {
@@ -253,27 +350,57 @@ bool L3Book::isOrderBookCrossed() const {
 }
 
 void L3Book::clear() {
+    if (trackDirty) {
+        for (const auto& [price, level] : bidBook) markDirty(price, false);
+        for (const auto& [price, level] : askBook) markDirty(price, true);
+    }
     bidBook.clear();
     askBook.clear();
     orderMap.clear();
+    pool.clear();
+    if (signals) signals->reset();
+}
+
+void L3Book::notifySignals(bool isSell, const L3PriceLevel& level) {
+    signals->onLevelChange(*this, isSell, level);
+}
+
+void L3Book::setSignalEngine(SignalEngine* engine) {
+    signals = engine;
+    if (signals) signals->rebuild(*this);
+}
+
+void L3Book::setDirtyTracking(bool enabled) {
+    trackDirty = enabled;
+    dirtyLevels.clear();
+}
+
+void L3Book::takeDirtyLevels(DirtyLevels& out) {
+    out.clear();
+    if (out.get_allocator() == dirtyLevels.get_allocator()) {
+        out.swap(dirtyLevels);
+    } else {
+        out.assign(dirtyLevels.begin(), dirtyLevels.end());
+        dirtyLevels.clear();
+    }
 }
 
 void L3Book::printBook(int levels) const {
-    std::cout << "[" << name << "] total # of orders: " << getTotalOrders() << "\n";
+    logStream() << "[" << name << "] total # of orders: " << getTotalOrders() << "\n";
 
-    std::cout << "-Bids:" << "\n";
+    logStream() << "-Bids:" << "\n";
     for (const auto& [price, level] : bidBook) {
-        std::cout << "--Price: " << price << " qty: " << level.quantity << " orders: " << level.numOrders << "\n";
+        logStream() << "--Price: " << price << " qty: " << level.quantity << " orders: " << level.numOrders << "\n";
         for (const auto& order : level.orders) {
-            std::cout << "---[Id: " << order.orderId << " " << (order.isSell ? "Sell " : "Buy ") << order.size << "]\n";
+            logStream() << "---[Id: " << order.orderId << " " << (order.isSell ? "Sell " : "Buy ") << order.size << "]\n";
         }
     }
 
-    std::cout << "-Asks:" << "\n";
+    logStream() << "-Asks:" << "\n";
     for (const auto& [price, level] : askBook) {
-        std::cout << "--Price: " << price << " qty: " << level.quantity << " orders: " << level.numOrders << "\n";
+        logStream() << "--Price: " << price << " qty: " << level.quantity << " orders: " << level.numOrders << "\n";
         for (const auto& order : level.orders) {
-            std::cout << "---[Id: " << order.orderId << " " << (order.isSell ? "Sell " : "Buy ") << order.size << "]\n";
+            logStream() << "---[Id: " << order.orderId << " " << (order.isSell ? "Sell " : "Buy ") << order.size << "]\n";
         }
     }
 }
@@ -305,3 +432,49 @@ std::vector<L3PriceLevel> L3Book::getTopBids(int n) const {
 
     return res;
 }
+
+bool L3Book::getBidDepth(L2Side& out) const {
+    out.clear();
+    for (const auto& [price, level] : bidBook) {
+        if (!out.push(price, level.quantity)) return false;
+    }
+    return true;
+}
+
+bool L3Book::getAskDepth(L2Side& out) const {
+    out.clear();
+    for (const auto& [price, level] : askBook) {
+        if (!out.push(price, level.quantity)) return false;
+    }
+    return true;
+}
+
+void L3Book::save(std::ostream& out) const {
+    out << getTotalOrders() << "\n";
+    auto saveOrder = [&](const Order& order) {
+        out << order.orderId << " " << order.isSell << " " << order.price << " " << order.size << " "
+            << getOrderTime(order.orderId) << "\n";
+    };
+    for (const auto& [price, level] : bidBook) {
+        for (const auto& order : level.orders) saveOrder(order);
+    }
+    for (const auto& [price, level] : askBook) {
+        for (const auto& order : level.orders) saveOrder(order);
+    }
+}
+
+bool L3Book::load(std::istream& in) {
+    clear();
+    size_t count = 0;
+    if (!(in >> count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        OrderId orderId;
+        bool isSell;
+        Price price;
+        Quantity size;
+        Timestamp timestamp;
+        if (!(in >> orderId >> isSell >> price >> size >> timestamp)) return false;
+        addOrder(orderId, isSell, size, price, timestamp);
+    }
+    return true;
+}
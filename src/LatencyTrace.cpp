@@ -0,0 +1,237 @@
+#include "LatencyTrace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+const char* traceStageName(TraceStage stage) {
+    switch (stage) {
+        case TraceStage::PARSE: return "PARSE";
+        case TraceStage::BOOK_APPLY: return "BOOK_APPLY";
+        case TraceStage::RECONCILE: return "RECONCILE";
+        case TraceStage::CALLBACK: return "CALLBACK";
+        case TraceStage::TOTAL: return "TOTAL";
+    }
+    return "UNKNOWN";
+}
+
+static const char* traceTypeName(EventType type) {
+    switch (type) {
+        case EventType::L2_SNAPSHOT: return "L2";
+        case EventType::L3_UPDATE: return "L3";
+        case EventType::TRADE_EXECUTION: return "TRADE";
+    }
+    return "UNKNOWN";
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < (1u << SUB_BITS)) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - SUB_BITS;
+    return (static_cast<size_t>(shift + 1) << SUB_BITS) + ((value >> shift) & ((1u << SUB_BITS) - 1));
+}
+
+uint64_t LatencyHistogram::bucketStart(size_t bucket) {
+    if (bucket < (1u << SUB_BITS)) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket >> SUB_BITS) - 1;
+    uint64_t mantissa = (1u << SUB_BITS) + (bucket & ((1u << SUB_BITS) - 1));
+    return mantissa << shift;
+}
+
+// relaxed atomic accesses, so a report can be taken while the owner records
+void LatencyHistogram::record(uint64_t value) {
+    size_t bucket = bucketOf(value);
+    __atomic_store_n(&counts[bucket], counts[bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&total, total + 1, __ATOMIC_RELAXED);
+    if (value > maxValue) {
+        __atomic_store_n(&maxValue, value, __ATOMIC_RELAXED);
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] += __atomic_load_n(&other.counts[i], __ATOMIC_RELAXED);
+    }
+    total += __atomic_load_n(&other.total, __ATOMIC_RELAXED);
+    maxValue = std::max(maxValue, __atomic_load_n(&other.maxValue, __ATOMIC_RELAXED));
+}
+
+void LatencyHistogram::clear() {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        __atomic_store_n(&counts[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&total, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&maxValue, 0, __ATOMIC_RELAXED);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * total));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketStart(i), maxValue);
+        }
+    }
+    return maxValue;
+}
+
+struct ThreadHistograms;
+
+// never destroyed, threads may retire after static destruction has begun
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<ThreadHistograms*> live;
+    LatencyHistogram retired[TRACE_STAGES][TRACE_EVENT_TYPES];
+};
+
+static TraceRegistry& registry() {
+    static TraceRegistry* instance = new TraceRegistry();
+    return *instance;
+}
+
+struct ThreadHistograms {
+    LatencyHistogram histograms[TRACE_STAGES][TRACE_EVENT_TYPES];
+
+    ThreadHistograms() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().live.push_back(this);
+    }
+
+    ~ThreadHistograms() {
+        TraceRegistry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t s = 0; s < TRACE_STAGES; ++s) {
+            for (size_t t = 0; t < TRACE_EVENT_TYPES; ++t) {
+                r.retired[s][t].merge(histograms[s][t]);
+            }
+        }
+        r.live.erase(std::find(r.live.begin(), r.live.end(), this));
+    }
+};
+
+static thread_local ThreadHistograms threadHistograms;
+
+void LatencyTracer::record(TraceStage stage, EventType type, uint64_t cycles) {
+    threadHistograms.histograms[static_cast<size_t>(stage)][static_cast<size_t>(type)].record(cycles);
+}
+
+LatencyHistogram LatencyTracer::getHistogram(TraceStage stage, EventType type) {
+    size_t s = static_cast<size_t>(stage);
+    size_t t = static_cast<size_t>(type);
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    LatencyHistogram merged = r.retired[s][t];
+    for (const ThreadHistograms* thread : r.live) {
+        merged.merge(thread->histograms[s][t]);
+    }
+    return merged;
+}
+
+void LatencyTracer::reset() {
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (size_t s = 0; s < TRACE_STAGES; ++s) {
+        for (size_t t = 0; t < TRACE_EVENT_TYPES; ++t) {
+            r.retired[s][t].clear();
+            for (ThreadHistograms* thread : r.live) {
+                thread->histograms[s][t].clear();
+            }
+        }
+    }
+}
+
+double LatencyTracer::ticksPerNanosecond() {
+    static const double ratio = []() {
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t startTicks = readTsc();
+        while (std::chrono::steady_clock::now() - startTime < std::chrono::milliseconds(20)) {}
+        uint64_t ticks = readTsc() - startTicks;
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+        return nanos > 0 && ticks > 0 ? static_cast<double>(ticks) / nanos : 1.0;
+    }();
+    return ratio;
+}
+
+void LatencyTracer::dump(std::ostream& out) {
+    double ticksPerNs = ticksPerNanosecond();
+    auto ns = [ticksPerNs](uint64_t ticks) { return static_cast<uint64_t>(ticks / ticksPerNs); };
+
+    out << std::left << std::setw(12) << "stage" << std::setw(8) << "type" << std::right
+        << std::setw(12) << "count" << std::setw(10) << "p50" << std::setw(10) << "p99"
+        << std::setw(10) << "p99.9" << std::setw(12) << "max" << "  (ns)\n";
+    for (size_t s = 0; s < TRACE_STAGES; ++s) {
+        for (size_t t = 0; t < TRACE_EVENT_TYPES; ++t) {
+            TraceStage stage = static_cast<TraceStage>(s);
+            EventType type = static_cast<EventType>(t);
+            LatencyHistogram histogram = getHistogram(stage, type);
+            if (histogram.getCount() == 0) continue;
+            out << std::left << std::setw(12) << traceStageName(stage) << std::setw(8) << traceTypeName(type)
+                << std::right << std::setw(12) << histogram.getCount()
+                << std::setw(10) << ns(histogram.percentile(0.5))
+                << std::setw(10) << ns(histogram.percentile(0.99))
+                << std::setw(10) << ns(histogram.percentile(0.999))
+                << std::setw(12) << ns(histogram.getMax()) << "\n";
+        }
+    }
+}
+
+static std::string& exitDumpFile() {
+    static std::string* file = new std::string();
+    return *file;
+}
+
+void LatencyTracer::dumpAtExit(const std::string& file) {
+    static bool registered = false;
+    exitDumpFile() = file;
+    if (!registered) {
+        registered = true;
+        // calibrate now rather than while the process is exiting
+        ticksPerNanosecond();
+        std::atexit([]() {
+            std::ofstream out(exitDumpFile());
+            if (out) {
+                dump(out);
+            } else {
+                std::cerr << "Failed to write latency report " << exitDumpFile() << "\n";
+            }
+        });
+    }
+}
+
+thread_local EventTrace* EventTrace::current = nullptr;
+
+EventTrace::EventTrace(EventType type) : type(type), start(readTsc()), last(start), outer(current) {
+    current = this;
+}
+
+EventTrace::~EventTrace() {
+    uint64_t now = readTsc();
+    // whatever follows the last mark is callback and publication work
+    LatencyTracer::record(TraceStage::CALLBACK, type, callbackTotal + (now - last));
+    LatencyTracer::record(TraceStage::TOTAL, type, now - start);
+    current = outer;
+}
+
+void EventTrace::mark(TraceStage stage) {
+    uint64_t now = readTsc();
+    uint64_t elapsed = now - last;
+    uint64_t inCallbacks = std::min(callbackCycles, elapsed);
+    LatencyTracer::record(stage, type, elapsed - inCallbacks);
+    callbackTotal += inCallbacks;
+    callbackCycles = 0;
+    last = now;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include "Logger.hpp"
+#include <iostream>
+
+static thread_local std::ostream* threadLogStream = nullptr;
+
+std::ostream& logStream() {
+    return threadLogStream ? *threadLogStream : std::cout;
+}
+
+void setLogStream(std::ostream* stream) {
+    threadLogStream = stream;
+}
+
+LogStreamScope::LogStreamScope(std::ostream* stream) : previous(threadLogStream) {
+    threadLogStream = stream;
+}
+
+LogStreamScope::~LogStreamScope() {
+    threadLogStream = previous;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& file) {
+    close();
+
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            length = 0;
+            ::close(fd);
+            return false;
+        }
+        madvise(addr, length, MADV_SEQUENTIAL);
+        mapping = static_cast<const char*>(addr);
+    }
+
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), length);
+    }
+    mapping = nullptr;
+    length = 0;
+}
\ No newline at end of file
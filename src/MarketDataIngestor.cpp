@@ -1,64 +1,484 @@
 #include "MarketDataIngestor.hpp"
+#include "Logger.hpp"
+#include "CaptureArchive.hpp"
+#include "FeedIndex.hpp"
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
 
 
-MarketDataIngestor::MarketDataIngestor(OrderBook& orderBook) : orderBook(orderBook) {}
+MarketDataIngestor::MarketDataIngestor(OrderBook& orderBook, size_t parseThreads, std::pmr::memory_resource* resource)
+    : orderBook(orderBook), events(resource), snapshots(resource) {
+    if (parseThreads > 1) {
+        parsePool = std::make_unique<ThreadPool>(parseThreads);
+    }
+}
+
+std::vector<std::pair<const char*, const char*>> MarketDataIngestor::splitChunks(const char* begin, const char* end) const {
+    std::vector<std::pair<const char*, const char*>> chunks;
+    const char* p = begin;
+    while (p < end) {
+        const char* chunkEnd = p + std::min(std::max<size_t>(chunkSize, 1), static_cast<size_t>(end - p));
+        chunkEnd = chunkEnd < end ? findLineEnd(chunkEnd, end) : end;
+        if (chunkEnd < end) ++chunkEnd;
+        chunks.push_back({p, chunkEnd});
+        p = chunkEnd;
+    }
+    return chunks;
+}
+
+void MarketDataIngestor::parseChunk(const char* begin, const char* end, EventType type, ParsedChunk& out) {
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+
+        SOB_TRACE_START(parseStart);
+        MarketEvent event;
+        if (parseLine(p, lineEnd, type, event, out.snapshots, out.parseErrors)) {
+            out.events.push_back(event);
+        }
+        SOB_TRACE_RECORD(TraceStage::PARSE, type, parseStart);
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+}
 
 void MarketDataIngestor::loadFile(const std::string& file, EventType type) {
-    std::ifstream in(file);
-    if (!in) {
-        std::cout << "Failed to open " << file << "\n";
+    MappedFile& mapped = files.emplace_back();
+    if (!mapped.open(file)) {
+        logStream() << "Failed to open " << file << "\n";
+        files.pop_back();
+        return;
+    }
+
+    if (ArchiveReader::isArchive(mapped.data(), mapped.size())) {
+        if (!loadArchive(file, type)) {
+            files.pop_back();
+        }
         return;
     }
 
-    std::string line;
-    while (std::getline(in, line)) {
-        std::cout << line << "\n";
-        std::istringstream ss(line);
-        uint64_t ts;
-        ss >> ts;
-        std::string rest = line.substr(line.find(' ') + 1);
-        events.push_back(MarketEvent {type, ts, rest});
+    const char* begin = mapped.data();
+    if (startTime > 0) {
+        FeedIndex index;
+        if (index.loadOrBuild(file)) {
+            begin += index.seek(startTime);
+        }
+    }
+
+    auto chunks = splitChunks(begin, mapped.data() + mapped.size());
+    std::vector<ParsedChunk> parsed(chunks.size());
+    decodeChunks(chunks.size(), parsed, [&chunks, type](size_t i, ParsedChunk& out) {
+        parseChunk(chunks[i].first, chunks[i].second, type, out);
+    });
+
+    for (auto& chunk : parsed) {
+        appendChunk(chunk);
+    }
+}
+
+bool MarketDataIngestor::loadArchive(const std::string& file, EventType type) {
+    ArchiveReader reader;
+    if (!reader.open(file) || reader.getType() != type) {
+        std::cerr << "Invalid archive " << file << "\n";
+        return false;
+    }
+
+    size_t first = startTime > 0 ? reader.findBlock(startTime) : 0;
+    std::vector<ParsedChunk> parsed(reader.getBlockCount() - std::min(first, reader.getBlockCount()));
+    decodeChunks(parsed.size(), parsed, [&reader, first](size_t i, ParsedChunk& out) {
+        readArchiveBlock(reader, first + i, out);
+    });
+
+    for (auto& chunk : parsed) {
+        appendChunk(chunk);
+    }
+    return true;
+}
+
+void MarketDataIngestor::readArchiveBlock(const ArchiveReader& reader, size_t i, ParsedChunk& out) {
+    if (!reader.readBlock(i, out)) {
+        std::cerr << "Skipping corrupt archive block " << i << "\n";
+        out.events.clear();
+        out.snapshots.clear();
+        out.parseErrors++;
+    }
+}
+
+void MarketDataIngestor::decodeChunks(size_t count, std::vector<ParsedChunk>& parsed,
+                                      const std::function<void(size_t, ParsedChunk&)>& decode) {
+    if (parsePool && count > 1) {
+        std::vector<std::future<void>> pending;
+        pending.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            pending.push_back(parsePool->submit([&decode, &parsed, i]() { decode(i, parsed[i]); }));
+        }
+        for (auto& f : pending) f.get();
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            decode(i, parsed[i]);
+        }
+    }
+}
+
+// stitches a decoded chunk onto the loaded events in file order
+void MarketDataIngestor::appendChunk(ParsedChunk& chunk) {
+    size_t base = snapshots.size();
+    for (auto& e : chunk.events) {
+        if (e.timestamp < startTime) continue;
+        if (e.type == EventType::L2_SNAPSHOT) e.snapshotIndex += base;
+        events.push_back(e);
+    }
+    snapshots.insert(snapshots.end(), chunk.snapshots.begin(), chunk.snapshots.end());
+    parseErrors += chunk.parseErrors;
+}
+
+bool MarketDataIngestor::parseLine(const char* begin, const char* end, EventType type,
+                                   MarketEvent& event, std::pmr::vector<L2Snapshot>& snapshots, size_t& parseErrors) {
+    ParseStatus status = parseCaptureLine(begin, end, type, event, snapshots);
+    if (status == ParseStatus::EMPTY_LINE) {
+        return false;
+    }
+
+    if (status != ParseStatus::OK) {
+        std::cerr << "Skipping malformed line (" << parseStatusName(status) << "): "
+            << std::string_view(begin, end - begin) << "\n";
+        parseErrors++;
+        return false;
     }
+    return true;
 }
 
 void MarketDataIngestor::loadEvents(const std::string& l2File, 
                                     const std::string& l3file, 
-                                    const std::string& tradesFile) {
+                                    const std::string& tradesFile,
+                                    Timestamp start) {
+    startTime = start;
     loadFile(l2File, EventType::L2_SNAPSHOT);
     loadFile(l3file, EventType::L3_UPDATE);
     loadFile(tradesFile, EventType::TRADE_EXECUTION);
+    startTime = 0;
 
-    std::sort(events.begin(), events.end(), 
+    // stable so equal timestamps keep file order and a resumed replay matches a full one
+    std::stable_sort(events.begin(), events.end(), 
         [](const MarketEvent& a, const MarketEvent& b) {
             return a.timestamp < b.timestamp;
     });
 
-    std::cout << "=== Finished loading market data ===\n";
+    logStream() << "=== Finished loading market data ===\n";
 }
 
-void MarketDataIngestor::processEvents() {
-    for(const auto& e : events) {
-        if (e.type == EventType::L2_SNAPSHOT) {
-            std::cout << "[" << e.timestamp << "] [L2_SNAPSHOT] " << e.rawData << "\n";
-            orderBook.processL2Snapshot(e.rawData, e.timestamp);
-        } else if (e.type == EventType::L3_UPDATE) {
-            std::cout << "[" << e.timestamp << "] [L3_UPDATE] " << e.rawData << "\n";
-            orderBook.processL3Update(e.rawData, e.timestamp);
-        } else if (e.type == EventType::TRADE_EXECUTION) {
-            std::cout << "[" << e.timestamp << "] [TRADE] " << e.rawData << "\n";
-            orderBook.processTrade(e.rawData, e.timestamp);
+void MarketDataIngestor::setThreadConfig(const ThreadConfig& config) {
+    threadConfig = config;
+    if (parsePool) {
+        // started afresh so the workers come up on their cores
+        parsePool = std::make_unique<ThreadPool>(parsePool->size(), config.parserCpus, config.wait);
+    }
+}
+
+void MarketDataIngestor::awaitChunk(std::future<void>& done) const {
+    if (threadConfig.wait != WaitPolicy::BLOCK) {
+        Backoff backoff(threadConfig.wait);
+        while (done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            backoff.pause();
         }
+    }
+    done.get();
+}
+
+bool MarketDataIngestor::replayFile(const std::string& file, EventType type) {
+    pinCurrentThread(threadConfig.bookCpu);
+    MappedFile mapped;
+    if (!mapped.open(file)) {
+        logStream() << "Failed to open " << file << "\n";
+        return false;
+    }
 
+    if (ArchiveReader::isArchive(mapped.data(), mapped.size())) {
+        ArchiveReader reader;
+        if (!reader.open(file) || reader.getType() != type) {
+            std::cerr << "Invalid archive " << file << "\n";
+            return false;
+        }
+        replayChunks(reader.getBlockCount(), [&reader](size_t i, ParsedChunk& out) {
+            readArchiveBlock(reader, i, out);
+        });
+        return true;
     }
+    if (asyncReads) {
+        mapped.close();
+        return replayTextAsync(file, type);
+    }
+
+    auto chunks = splitChunks(mapped.data(), mapped.data() + mapped.size());
+    replayChunks(chunks.size(), [&chunks, type](size_t i, ParsedChunk& out) {
+        parseChunk(chunks[i].first, chunks[i].second, type, out);
+    });
+    return true;
 }
 
-void MarketDataIngestor::parseL2Snapshot(const std::string& data, Timestamp timestamp) {
-    std::istringstream ss(data);
-    std::string token;
+bool MarketDataIngestor::replayTextAsync(const std::string& file, EventType type) {
+    // a buffer for every chunk the parsers can hold plus two reads ahead
+    AsyncFileReader reader(chunkSize, maxChunksInFlight() + 2);
+    if (!reader.open(file, readEngine)) {
+        logStream() << "Failed to open " << file << "\n";
+        return false;
+    }
 
+    std::vector<ReadBlock> blocks(reader.getBlockCount());
+    std::vector<std::pair<const char*, const char*>> chunks(blocks.size());
+    std::string carry;      // unfinished last line of the previous block
+    bool skipping = false;  // inside a line too long for the headroom
+    bool ok = true;
 
+    auto prepare = [&](size_t i) {
+        ReadBlock& block = blocks[i];
+        if (!ok || !reader.next(block)) {
+            ok = false;
+            return;
+        }
+        char* begin = block.data;
+        char* end = block.data + block.size;
+        chunks[i] = {end, end};
+
+        // the carried line goes into the headroom so the chunk stays contiguous
+        if (carry.size() > reader.getHeadroom()) {
+            std::cerr << "Skipping line longer than " << reader.getHeadroom() << " bytes\n";
+            parseErrors++;
+            carry.clear();
+            skipping = true;
+        }
+        if (skipping) {
+            // the rest of the long line is dropped too, up to its newline
+            char* newline = static_cast<char*>(std::memchr(begin, '\n', block.size));
+            if (!newline) {
+                return;
+            }
+            begin = newline + 1;
+            skipping = false;
+        } else {
+            begin -= carry.size();
+            std::memcpy(begin, carry.data(), carry.size());
+            carry.clear();
+        }
+        if (i + 1 < blocks.size()) {
+            char* lastNewline = static_cast<char*>(memrchr(begin, '\n', end - begin));
+            char* lineEnd = lastNewline ? lastNewline + 1 : begin;
+            // without a newline the whole line so far waits for the next block
+            carry.assign(lineEnd, end);
+            end = lineEnd;
+        }
+        chunks[i] = {begin, end};
+    };
+    auto finish = [&](size_t i) {
+        if (blocks[i].data) reader.release(blocks[i]);
+    };
+
+    replayChunks(blocks.size(), [&chunks, type](size_t i, ParsedChunk& out) {
+        parseChunk(chunks[i].first, chunks[i].second, type, out);
+    }, prepare, finish);
+    return ok;
+}
+
+bool MarketDataIngestor::loadBinaryFeed(const std::string& file) {
+    BinaryFeedReader reader;
+    if (!reader.open(file)) {
+        logStream() << "Failed to open " << file << "\n";
+        return false;
+    }
+
+    ParsedChunk chunk;
+    reader.readAll(chunk);
+    appendChunk(chunk);
+    std::stable_sort(events.begin(), events.end(),
+        [](const MarketEvent& a, const MarketEvent& b) {
+            return a.timestamp < b.timestamp;
+    });
+    return true;
+}
+
+bool MarketDataIngestor::replayBinaryFeed(const std::string& file) {
+    pinCurrentThread(threadConfig.bookCpu);
+    BinaryFeedReader reader;
+    if (!reader.open(file)) {
+        logStream() << "Failed to open " << file << "\n";
+        return false;
+    }
+
+    MarketEvent event;
+    while (reader.next(event)) {
+        processEvent(event, nullptr);
+    }
+    parseErrors += reader.getDecodeErrors();
+    return true;
+}
+
+void MarketDataIngestor::replayChunks(size_t count, const std::function<void(size_t, ParsedChunk&)>& decode,
+                                      const std::function<void(size_t)>& prepare,
+                                      const std::function<void(size_t)>& finish) {
+    // bound the number of decoded chunks waiting for the book thread
+    size_t maxInFlight = maxChunksInFlight();
+    std::deque<std::pair<std::unique_ptr<ParsedChunk>, std::future<void>>> inFlight;
+    size_t next = 0;
+
+    // The snapshots of the front chunk may be dropped when a later chunk is
+    // already decoded, waiting behind the book, and holds a newer snapshot.
+    // Never while the book keeps up, so then every snapshot is applied
+    auto frontSuperseded = [&inFlight]() {
+        for (size_t k = 1; k < inFlight.size(); ++k) {
+            auto& [later, decoded] = inFlight[k];
+            if (decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return false;
+            }
+            for (const MarketEvent& e : later->events) {
+                if (e.type == EventType::L2_SNAPSHOT) return true;
+            }
+        }
+        return false;
+    };
+
+    auto submitNext = [&]() {
+        auto chunk = std::make_unique<ParsedChunk>();
+        ParsedChunk* out = chunk.get();
+        size_t i = next++;
+        if (prepare) prepare(i);
+        std::future<void> done;
+        if (parsePool) {
+            done = parsePool->submit([&decode, i, out]() { decode(i, *out); });
+        } else {
+            std::promise<void> ready;
+            decode(i, *out);
+            ready.set_value();
+            done = ready.get_future();
+        }
+        inFlight.emplace_back(std::move(chunk), std::move(done));
+    };
+
+    while (next < count || !inFlight.empty()) {
+        while (next < count && inFlight.size() < maxInFlight) {
+            submitNext();
+        }
+
+        auto& [chunk, done] = inFlight.front();
+        awaitChunk(done);
+        bool dropSnapshots = conflateL2 && frontSuperseded();
+        for (size_t j = 0; j < chunk->events.size(); ) {
+            const MarketEvent& e = chunk->events[j];
+            if (e.type == EventType::L2_SNAPSHOT && dropSnapshots) {
+                conflatedSnapshots++;
+                ++j;
+                continue;
+            }
+            j = processNext(chunk->events.data(), j, chunk->events.size(), chunk->snapshots.data());
+        }
+        parseErrors += chunk->parseErrors;
+        if (finish) finish(next - inFlight.size());
+        inFlight.pop_front();
+    }
+    // nothing left to coalesce with
+    orderBook.flushActions();
+}
+
+void MarketDataIngestor::processEvent(const MarketEvent& e, const L2Snapshot* eventSnapshots) {
+    if (e.type == EventType::L2_SNAPSHOT) {
+        logStream() << "[" << e.timestamp << "] [L2_SNAPSHOT] " << e.rawData << "\n";
+        orderBook.processL2Snapshot(eventSnapshots[e.snapshotIndex], e.timestamp);
+    } else if (e.type == EventType::L3_UPDATE) {
+        logStream() << "[" << e.timestamp << "] [L3_UPDATE] " << e.rawData << "\n";
+        orderBook.processL3Update(e.l3Update);
+    } else if (e.type == EventType::TRADE_EXECUTION) {
+        logStream() << "[" << e.timestamp << "] [TRADE] " << e.rawData << "\n";
+        orderBook.processTrade(e.trade);
+    }
+}
+
+size_t MarketDataIngestor::processNext(const MarketEvent* events, size_t begin, size_t end,
+                                       const L2Snapshot* eventSnapshots) {
+    auto batchable = [](const MarketEvent& e) {
+        return e.type == EventType::L3_UPDATE || e.type == EventType::TRADE_EXECUTION;
+    };
+    if (!batchApply || !batchable(events[begin])) {
+        processEvent(events[begin], eventSnapshots);
+        return begin + 1;
+    }
+    size_t last = begin + 1;
+    while (last < end && batchable(events[last]) && events[last].timestamp == events[begin].timestamp) {
+        ++last;
+    }
+    for (size_t i = begin; i < last; ++i) {
+        logStream() << "[" << events[i].timestamp << "] "
+            << (events[i].type == EventType::L3_UPDATE ? "[L3_UPDATE] " : "[TRADE] ") << events[i].rawData << "\n";
+    }
+    orderBook.processBatch(events + begin, last - begin);
+    return last;
+}
+
+void MarketDataIngestor::processEvents() {
+    pinCurrentThread(threadConfig.bookCpu);
+    Timestamp nextCheckpoint = 0;
+    if (checkpointInterval > 0 && !events.empty()) {
+        nextCheckpoint = (events.front().timestamp / checkpointInterval + 1) * checkpointInterval;
+    }
+
+    for (size_t i = 0; i < events.size(); ) {
+        const MarketEvent& e = events[i];
+        // checkpoint the state as of the boundary, before any event at or after it
+        while (checkpointInterval > 0 && e.timestamp >= nextCheckpoint) {
+            std::ofstream out(checkpointPath(checkpointPrefix, nextCheckpoint));
+            if (out) {
+                orderBook.saveCheckpoint(out, nextCheckpoint);
+            } else {
+                std::cerr << "Failed to write checkpoint at " << nextCheckpoint << "\n";
+            }
+            nextCheckpoint = (e.timestamp / checkpointInterval + 1) * checkpointInterval;
+        }
+        i = processNext(events.data(), i, events.size(), snapshots.data());
+    }
+    orderBook.flushActions();
+}
+
+void MarketDataIngestor::setCheckpointInterval(Timestamp interval, const std::string& prefix) {
+    checkpointInterval = interval;
+    checkpointPrefix = prefix;
+}
+
+std::string MarketDataIngestor::checkpointPath(const std::string& prefix, Timestamp boundary) {
+    return prefix + std::to_string(boundary) + ".ckpt";
+}
+
+bool MarketDataIngestor::seek(const std::string& l2File,
+                              const std::string& l3File,
+                              const std::string& tradeFile,
+                              Timestamp target,
+                              const std::string& checkpointFile) {
+    Timestamp from = 0;
+    if (!checkpointFile.empty()) {
+        std::ifstream in(checkpointFile);
+        if (!in || !orderBook.loadCheckpoint(in, from)) {
+            std::cerr << "Failed to restore checkpoint " << checkpointFile << "\n";
+            return false;
+        }
+        if (from > target) {
+            std::cerr << "Checkpoint " << checkpointFile << " is past the seek target\n";
+            return false;
+        }
+    }
+
+    events.clear();
+    snapshots.clear();
+    loadEvents(l2File, l3File, tradeFile, from);
+
+    // fast-forward to target without checkpointing or keeping the applied events
+    Timestamp interval = checkpointInterval;
+    checkpointInterval = 0;
+    auto firstKept = std::lower_bound(events.begin(), events.end(), target,
+        [](const MarketEvent& e, Timestamp ts) { return e.timestamp < ts; });
+    for (auto it = events.begin(); it != firstKept; ++it) {
+        processEvent(*it, snapshots.data());
+    }
+    events.erase(events.begin(), firstKept);
+    checkpointInterval = interval;
+    return true;
 }
\ No newline at end of file
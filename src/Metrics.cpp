@@ -0,0 +1,214 @@
+#include "Metrics.hpp"
+#include "ThreadConfig.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+void MetricHistogram::record(uint64_t value) {
+    counts[LatencyHistogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t seen = maxValue.load(std::memory_order_relaxed);
+    while (value > seen && !maxValue.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+}
+
+void MetricHistogram::reset() {
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+uint64_t MetricHistogram::percentile(double p) const {
+    uint64_t count = getCount();
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * count));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(LatencyHistogram::bucketStart(i), getMax());
+        }
+    }
+    return getMax();
+}
+
+// never destroyed, flushers and books may still report during static destruction
+MetricsRegistry& MetricsRegistry::global() {
+    static MetricsRegistry* instance = new MetricsRegistry();
+    return *instance;
+}
+
+template<typename Metric>
+static Metric& findOrCreate(std::map<std::string, std::unique_ptr<Metric>>& metrics, const std::string& name) {
+    auto& metric = metrics[name];
+    if (!metric) {
+        metric = std::make_unique<Metric>();
+    }
+    return *metric;
+}
+
+MetricCounter& MetricsRegistry::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return findOrCreate(counters, name);
+}
+
+MetricGauge& MetricsRegistry::gauge(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return findOrCreate(gauges, name);
+}
+
+MetricHistogram& MetricsRegistry::histogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return findOrCreate(histograms, name);
+}
+
+bool MetricsRegistry::getCounter(const std::string& name, uint64_t& value) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = counters.find(name);
+    if (it == counters.end()) {
+        return false;
+    }
+    value = it->second->get();
+    return true;
+}
+
+bool MetricsRegistry::getGauge(const std::string& name, int64_t& value) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = gauges.find(name);
+    if (it == gauges.end()) {
+        return false;
+    }
+    value = it->second->get();
+    return true;
+}
+
+const MetricHistogram* MetricsRegistry::findHistogram(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = histograms.find(name);
+    return it == histograms.end() ? nullptr : it->second.get();
+}
+
+std::map<std::string, uint64_t> MetricsRegistry::getCounters() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, uint64_t> values;
+    for (const auto& [name, metric] : counters) {
+        values[name] = metric->get();
+    }
+    return values;
+}
+
+void MetricsRegistry::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [name, metric] : counters) {
+        metric->reset();
+    }
+    for (auto& [name, metric] : histograms) {
+        metric->reset();
+    }
+}
+
+void MetricsRegistry::write(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [name, metric] : counters) {
+        out << name << " " << metric->get() << "\n";
+    }
+    for (const auto& [name, metric] : gauges) {
+        out << name << " " << metric->get() << "\n";
+    }
+    for (const auto& [name, metric] : histograms) {
+        uint64_t count = metric->getCount();
+        out << name << ".count " << count << "\n";
+        out << name << ".mean " << (count ? static_cast<double>(metric->getSum()) / count : 0.0) << "\n";
+        out << name << ".p50 " << metric->percentile(0.5) << "\n";
+        out << name << ".p99 " << metric->percentile(0.99) << "\n";
+        out << name << ".max " << metric->getMax() << "\n";
+    }
+}
+
+MetricsFlusher::MetricsFlusher(MetricsRegistry& registry, const std::string& file, std::chrono::milliseconds interval)
+    : registry(registry), file(file), interval(interval),
+        lastCounts(registry.getCounters()), lastFlush(std::chrono::steady_clock::now()) {}
+
+MetricsFlusher::~MetricsFlusher() {
+    stop();
+}
+
+void MetricsFlusher::start(int cpu) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return;
+    }
+    running = true;
+    worker = std::thread([this, cpu]() {
+        pinCurrentThread(cpu);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            if (!wakeup.wait_for(lock, interval, [this]() { return !running; })) {
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+    });
+}
+
+void MetricsFlusher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    wakeup.notify_all();
+    worker.join();
+    flush();
+}
+
+bool MetricsFlusher::flush() {
+    // one flush at a time, the worker and a caller may race
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, uint64_t> counts = registry.getCounters();
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastFlush).count();
+    rates.clear();
+    for (const auto& [name, count] : counts) {
+        auto before = lastCounts.find(name);
+        uint64_t previous = before == lastCounts.end() ? 0 : before->second;
+        rates[name] = seconds > 0 && count >= previous ? (count - previous) / seconds : 0.0;
+    }
+    lastCounts = counts;
+    lastFlush = now;
+
+    std::string temp = file + ".tmp";
+    {
+        std::ofstream out(temp);
+        registry.write(out);
+        for (const auto& [name, rate] : rates) {
+            out << name << ".per_sec " << rate << "\n";
+        }
+        if (!out) {
+            std::cerr << "Failed to write metrics " << temp << "\n";
+            return false;
+        }
+    }
+    if (std::rename(temp.c_str(), file.c_str()) != 0) {
+        std::cerr << "Failed to replace metrics file " << file << "\n";
+        return false;
+    }
+    return true;
+}
+
+double MetricsFlusher::getRate(const std::string& counter) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = rates.find(counter);
+    return it == rates.end() ? 0.0 : it->second;
+}
\ No newline at end of file
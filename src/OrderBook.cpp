@@ -1,9 +1,39 @@
 #include "OrderBook.hpp"
+#include "Logger.hpp"
 #include <iostream>
-#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_set>
 
-OrderBook::OrderBook(L2Book& l2Book, L3Book& l3Book, TradeContainer& trades, double executionProbability)
-    : l2Book(&l2Book), l3Book(&l3Book), tradeContainer(&trades), lastReconciliationTime(0), 
+BookMetrics::BookMetrics(MetricsRegistry& registry, const std::string& prefix)
+    : guessesCreated(&registry.counter(prefix + "guesses.created")),
+        guessesConfirmed(&registry.counter(prefix + "guesses.confirmed")),
+        guessesInvalidated(&registry.counter(prefix + "guesses.invalidated")),
+        guessesExpired(&registry.counter(prefix + "guesses.expired")),
+        aggressorsCreated(&registry.counter(prefix + "aggressors.created")),
+        aggressorsConfirmed(&registry.counter(prefix + "aggressors.confirmed")),
+        aggressorsExpired(&registry.counter(prefix + "aggressors.expired")),
+        corrections(&registry.counter(prefix + "corrections.sent")),
+        coalesced(&registry.counter(prefix + "corrections.coalesced")),
+        guessConfirmLatency(&registry.histogram(prefix + "guesses.confirm_latency")),
+        aggressorConfirmLatency(&registry.histogram(prefix + "aggressors.confirm_latency")),
+        liveGuesses(&registry.gauge(prefix + "guesses.live")),
+        liveAggressors(&registry.gauge(prefix + "aggressors.live")),
+        smartOrders(&registry.gauge(prefix + "book.smart_orders")),
+        smartLevels(&registry.gauge(prefix + "book.smart_levels")),
+        exchangeOrders(&registry.gauge(prefix + "book.exchange_orders")), prefix(prefix) {}
+
+const BookMetrics& OrderBook::detachedMetrics() {
+    static MetricsRegistry registry;
+    static const BookMetrics metrics(registry);
+    return metrics;
+}
+
+OrderBook::OrderBook(L2Book& l2Book, L3Book& l3Book, TradeContainer& trades, double executionProbability,
+                     std::pmr::memory_resource* resource)
+    : smartBook(resource), l2Book(&l2Book), l3Book(&l3Book), tradeContainer(&trades), dirtyLevels(resource), staleLevels(resource),
+        guesses(resource), aggressors(resource), guessedExecutions(std::pmr::deque<OrderInfo*>(resource)),
+        executions(resource), expiredGuesses(resource), guessScan(resource), lastReconciliationTime(0), heldActions(resource), heldByOrder(resource),
         executionProbability(executionProbability), dist(0.0, 1.0) {
         if (l3Book.getBestBid() > 0 || l3Book.getBestAsk() > 0) {
             smartBook = l3Book;
@@ -14,200 +44,656 @@ OrderBook::OrderBook(L2Book& l2Book, L3Book& l3Book, TradeContainer& trades, dou
     }
 
 void OrderBook::processL2Snapshot(const std::string& data, Timestamp timestamp) {
-    std::istringstream ss(data);
-    std::string token;
-    Price price;
-    Quantity qty;
-
-    l2Book->clear();
-
-    // should start with BID
-    ss >> token;
-    while (ss >> token && token != "ASK") {
-        Price price = std::stod(token);
-        ss >> qty;
-        l2Book->addBidLevel(price, qty);
+    SOB_TRACE_START(parseStart);
+    L2Snapshot snapshot;
+    ParseStatus status = parseL2Snapshot(data.data(), data.data() + data.size(), snapshot);
+    SOB_TRACE_RECORD(TraceStage::PARSE, EventType::L2_SNAPSHOT, parseStart);
+    if (status != ParseStatus::OK) {
+        std::cerr << "Malformed L2 snapshot (" << parseStatusName(status) << "): " << data << "\n";
+        return;
     }
+    snapshot.timestamp = timestamp;
+    processL2Snapshot(snapshot, timestamp);
+}
 
-    while (ss >> token) {
-        Price price = std::stod(token);
-        ss >> qty;
-        l2Book->addAskLevel(price, qty);
-    }
+void OrderBook::processL2Snapshot(const L2Snapshot& snapshot, Timestamp timestamp) {
+    SOB_TRACE_EVENT(trace, EventType::L2_SNAPSHOT);
+    lastReconciliationTime = timestamp;
+    l2Book->setSnapshot(snapshot);
+    SOB_TRACE_MARK(trace, TraceStage::BOOK_APPLY);
 
-    handleL2BidChange(price, timestamp);
-    handleL2AskChange(price, timestamp);
+    handleL2BidChange(0.0, timestamp);
+    handleL2AskChange(0.0, timestamp);
+    SOB_TRACE_MARK(trace, TraceStage::RECONCILE);
+    finishEvent(timestamp);
 }
 
 void OrderBook::handleL2BidChange(Price price, Timestamp timestamp) {
-    auto& l3Bids = smartBook.getBids();
-    for (const auto& [price, l2Level] : l2Book->getBids()) {
+    const L2Side& l2Bids = l2Book->getBids();
 
-        auto it = l3Bids.find(price);
-        if (it == l3Bids.end()) {
-            std::cout << "[L3] New price level found: " << price << "\n";
-            guessNewOrder(price, l2Level.quantity, false, false, timestamp);
-        } else if (l2Level.quantity > it->second.quantity) {
-            guessNewOrder(price, l2Level.quantity - it->second.quantity, false, false, timestamp, true);
-        } else if (it->second.quantity > l2Level.quantity){
-            guessOrderReduction(price, it->second.quantity - l2Level.quantity, false, timestamp);
+    // compare against the SmartBook depth level by level, only changed levels need guessing
+    L2Side smartBids;
+    bool isComplete = smartDepth(false, smartBids);
+    uint64_t changed = diffLevels(l2Bids, smartBids);
+    if (changed == 0 && isComplete) {
+        return;
+    }
+
+    for (size_t i = 0; i < l2Bids.count; ++i) {
+        if (!(changed >> i & 1)) continue;
+        Price price = l2Bids.prices[i];
+        Quantity quantity = l2Bids.quantities[i];
+
+        Quantity smartQuantity = 0;
+        if (!findSmartLevel(false, price, smartQuantity)) {
+            logStream() << "[L3] New price level found: " << price << "\n";
+            guessNewOrder(price, quantity, false, false, timestamp);
+        } else if (quantity > smartQuantity) {
+            guessNewOrder(price, quantity - smartQuantity, false, false, timestamp, true);
+        } else if (smartQuantity > quantity){
+            guessOrderReduction(price, smartQuantity - quantity, false, timestamp);
         }
     }
 
     // check for removed price level in L3
-    for (auto it = l3Bids.begin(); it != l3Bids.end(); ) {
-        Price price = it->first;
-        auto currIt = it++;
-        const auto& book = l2Book->getBids();
-        if (book.find(price) == book.end()) {
-            std::cout << "Reducing price level " << price << "\n";
-            guessOrderReduction(price, currIt->second.quantity, false, timestamp);
+    findStaleLevels(false, l2Bids);
+    for (Price price : staleLevels) {
+        Quantity smartQuantity = 0;
+        if (findSmartLevel(false, price, smartQuantity)) {
+            logStream() << "Reducing price level " << price << "\n";
+            guessOrderReduction(price, smartQuantity, false, timestamp);
         }
     }
 }
 
 void OrderBook::handleL2AskChange(Price price, Timestamp timestamp) {
-    auto& l3Asks = smartBook.getAsks();
-    for (const auto& [price, l2Level] : l2Book->getAsks()) {
+    const L2Side& l2Asks = l2Book->getAsks();
+
+    L2Side smartAsks;
+    bool isComplete = smartDepth(true, smartAsks);
+    uint64_t changed = diffLevels(l2Asks, smartAsks);
+    if (changed == 0 && isComplete) {
+        return;
+    }
 
-        auto it = l3Asks.find(price);
-        if (it == l3Asks.end()) {
-            std::cout << "[L3] New price level found: " << price << "\n";
-            guessNewOrder(price, l2Level.quantity, true, false, timestamp);
-        } else if (l2Level.quantity > it->second.quantity) {
-            guessNewOrder(price, l2Level.quantity - it->second.quantity, true, false, timestamp, true);
-        } else if (it->second.quantity > l2Level.quantity){
-            guessOrderReduction(price, it->second.quantity - l2Level.quantity, true, timestamp);
+    for (size_t i = 0; i < l2Asks.count; ++i) {
+        if (!(changed >> i & 1)) continue;
+        Price price = l2Asks.prices[i];
+        Quantity quantity = l2Asks.quantities[i];
+
+        Quantity smartQuantity = 0;
+        if (!findSmartLevel(true, price, smartQuantity)) {
+            logStream() << "[L3] New price level found: " << price << "\n";
+            guessNewOrder(price, quantity, true, false, timestamp);
+        } else if (quantity > smartQuantity) {
+            guessNewOrder(price, quantity - smartQuantity, true, false, timestamp, true);
+        } else if (smartQuantity > quantity){
+            guessOrderReduction(price, smartQuantity - quantity, true, timestamp);
         }
     }
 
     // check for removed price level in L3
-    for (auto it = l3Asks.begin(); it != l3Asks.end(); ) {
-        Price price = it->first;
-        auto currIt = it++;
-        const auto& book = l2Book->getAsks();
-        if (book.find(price) == book.end()) {
-            std::cout << "Reducing price level " << price << "\n";
-            guessOrderReduction(price, currIt->second.quantity, true, timestamp);
+    findStaleLevels(true, l2Asks);
+    for (Price price : staleLevels) {
+        Quantity smartQuantity = 0;
+        if (findSmartLevel(true, price, smartQuantity)) {
+            logStream() << "Reducing price level " << price << "\n";
+            guessOrderReduction(price, smartQuantity, true, timestamp);
         }
     }
 }
 
 void OrderBook::guessOrderReduction(Price price, Quantity quantity, bool isSell, Timestamp timestamp) {
-    auto levelIt = (isSell ? smartBook.getAsks().find(price) : smartBook.getBids().find(price));
-    auto bookEnd = (isSell ? smartBook.getAsks().end() : smartBook.getBids().end());
-    if (levelIt == bookEnd) {
-        return;
-    }
-
     Quantity remainingQty = quantity;
-    auto& level = levelIt->second;
-    bool isCancelLevel = level.quantity == quantity;
-    auto orderIt = level.orders.begin();
-    while (orderIt != level.orders.end() && remainingQty > 0) {
-        auto currIt = orderIt++;
-        int reduceQty = std::min(remainingQty, currIt->size);
+    // order may go away below, everything needed is read first
+    auto reduceOrder = [&](const Order& order) {
+        OrderId orderId = order.orderId;
+        bool orderIsSell = order.isSell;
+        Price orderPrice = order.price;
+        Quantity size = order.size;
+        int reduceQty = std::min(remainingQty, size);
         double rand = dist(rngEngine);
         if (rand < executionProbability) {
             onExecution(price, reduceQty, timestamp, true);
         } else {
-            if (reduceQty == currIt->size) {
-                OrderInfo info(currIt->orderId, currIt->isSell, currIt->price, reduceQty, "CANCEL", timestamp);
+            if (reduceQty == size) {
+                OrderInfo info(orderId, orderIsSell, orderPrice, reduceQty, "CANCEL", timestamp);
                 info.isGuess = true;
-                guesses.insert({currIt->orderId, info});
-                smartBook.cancelOrder(currIt->orderId);
-                onOrderCancel(*this, info);
+                insertGuess(orderId, info);
+                smartCancelOrder(orderId);
+                emitAction(info);
             } else {
-                double newSize = currIt->size - reduceQty;
-                OrderInfo info(currIt->orderId, currIt->isSell, currIt->price, newSize, "MODIFY", timestamp);
-                info.originalQty = currIt->size;
+                double newSize = size - reduceQty;
+                OrderInfo info(orderId, orderIsSell, orderPrice, newSize, "MODIFY", timestamp);
+                info.originalQty = size;
                 info.isGuess = true;
-                guesses.insert({currIt->orderId, info});
-                smartBook.modifyOrder(currIt->orderId, newSize, currIt->price);
-                onOrderModify(*this, info);
+                insertGuess(orderId, info);
+                smartModifyOrder(orderId, newSize, orderPrice);
+                emitAction(info);
             }
         }
         remainingQty -= reduceQty;
+    };
+
+    if (persistentBook) {
+        // writes replace the level, the shared copy keeps the queue to walk alive
+        LevelPtr level = persistentBook->shareLevel(isSell, price);
+        if (!level) {
+            return;
+        }
+        for (const Order& queued : level->orders) {
+            if (remainingQty <= 0) break;
+            if (const Order* order = persistentBook->findOrder(queued.orderId)) {
+                reduceOrder(*order);
+            }
+        }
+        return;
+    }
+
+    auto levelIt = (isSell ? smartBook.getAsks().find(price) : smartBook.getBids().find(price));
+    auto bookEnd = (isSell ? smartBook.getAsks().end() : smartBook.getBids().end());
+    if (levelIt == bookEnd) {
+        return;
+    }
+
+    auto& level = levelIt->second;
+    // the level goes away with its last order
+    auto orderIt = level.orders.begin();
+    auto orderEnd = level.orders.end();
+    while (orderIt != orderEnd && remainingQty > 0) {
+        auto currIt = orderIt++;
+        reduceOrder(*currIt);
     }
 }
 
 void OrderBook::processTrade(const std::string& data, Timestamp timestamp) {
-    std::istringstream ss(data);
+    SOB_TRACE_START(parseStart);
     TradeInfo trade;
-
+    ParseStatus status = parseTrade(data.data(), data.data() + data.size(), trade);
+    SOB_TRACE_RECORD(TraceStage::PARSE, EventType::TRADE_EXECUTION, parseStart);
+    if (status != ParseStatus::OK) {
+        std::cerr << "Malformed trade (" << parseStatusName(status) << "): " << data << "\n";
+        return;
+    }
     trade.timestamp = timestamp;
-    ss >> trade.price >> trade.quantity;
+    processTrade(trade);
+}
+
+void OrderBook::processTrade(const TradeInfo& trade) {
+    applyTrade(trade, true);
+}
 
+void OrderBook::applyTrade(const TradeInfo& trade, bool publish) {
+    SOB_TRACE_EVENT(trace, EventType::TRADE_EXECUTION);
+    lastReconciliationTime = trade.timestamp;
     tradeContainer->addTrade(trade);
-    std::cout << "-[TOTAL TRADES] " << tradeContainer->getTrades().size() << "\n";
+    logStream() << "-[TOTAL TRADES] " << tradeContainer->getTrades().size() << "\n";
+    SOB_TRACE_MARK(trace, TraceStage::BOOK_APPLY);
 
     if (!reconcileTrade(trade.price, trade.quantity))
     {
-        onExecution(trade.price, trade.quantity, timestamp, false);
+        onExecution(trade.price, trade.quantity, trade.timestamp, false);
+    }
+    SOB_TRACE_MARK(trace, TraceStage::RECONCILE);
+    if (publish) {
+        finishEvent(trade.timestamp);
     }
 }
 
 void OrderBook::processL3Update(const std::string& data, Timestamp timestamp) {
-    std::istringstream ss(data);
-    std::string action, side;
-    Price price;
-    Quantity size;
-    int orderId;
+    SOB_TRACE_START(parseStart);
+    L3Update update;
+    ParseStatus status = parseL3Update(data.data(), data.data() + data.size(), update);
+    SOB_TRACE_RECORD(TraceStage::PARSE, EventType::L3_UPDATE, parseStart);
+    if (status != ParseStatus::OK) {
+        std::cerr << "Malformed L3 update (" << parseStatusName(status) << "): " << data << "\n";
+        return;
+    }
+    update.timestamp = timestamp;
+    processL3Update(update);
+}
+
+void OrderBook::processL3Update(const L3Update& update) {
+    applyL3Update(update, true);
+}
 
-    ss >> action >> orderId >> side >> price >> size;
-    bool isSell = (side == "SELL" ? true : false);
-    OrderSide orderSide = (side == "SELL") ? OrderSide::SELL : OrderSide::BUY;
+void OrderBook::applyL3Update(const L3Update& update, bool publish) {
+    OrderId orderId = update.orderId;
+    bool isSell = update.isSell;
+    Price price = update.price;
+    Quantity size = update.size;
+    Timestamp timestamp = update.timestamp;
+    SOB_TRACE_EVENT(trace, EventType::L3_UPDATE);
+    lastReconciliationTime = timestamp;
 
-    if (action == "ADD") {
-        l3Book->addOrder(orderId, isSell, size, price);
+    if (update.action == L3Action::ADD) {
+        if (l3Book) l3Book->addOrder(orderId, isSell, size, price, timestamp);
+        SOB_TRACE_MARK(trace, TraceStage::BOOK_APPLY);
 
         // check if it is a previous aggressor
         if (!reconcileAdd(orderId, isSell, price, size)) {
-            smartBook.addOrder(orderId, isSell, size, price);
-            onOrderAdd(*this, OrderInfo(orderId, isSell, price, size, "ADD", timestamp));
+            smartAddOrder(orderId, isSell, size, price, timestamp);
+            emitAction(OrderInfo(orderId, isSell, price, size, "ADD", timestamp));
         }
-    } else if (action == "MODIFY") {
-        l3Book->modifyOrder(orderId, size, price);
+    } else if (update.action == L3Action::MODIFY) {
+        if (l3Book) l3Book->modifyOrder(orderId, size, price);
+        SOB_TRACE_MARK(trace, TraceStage::BOOK_APPLY);
 
         if (!reconcileModify(orderId, price, size)) {
-            smartBook.modifyOrder(orderId, size, price);
-            onOrderModify(*this, OrderInfo(orderId, isSell, price, size, "MODIFY", timestamp));
+            smartModifyOrder(orderId, size, price);
+            emitAction(OrderInfo(orderId, isSell, price, size, "MODIFY", timestamp));
         }
-    } else if (action == "CANCEL") {
-        l3Book->cancelOrder(orderId);
+    } else if (update.action == L3Action::CANCEL) {
+        if (l3Book) l3Book->cancelOrder(orderId);
+        SOB_TRACE_MARK(trace, TraceStage::BOOK_APPLY);
 
         if (!reconcileCancel(orderId)) {
-            smartBook.cancelOrder(orderId);
-            onOrderCancel(*this, OrderInfo(orderId, isSell, price, size, "CANCEL", timestamp));
+            smartCancelOrder(orderId);
+            emitAction(OrderInfo(orderId, isSell, price, size, "CANCEL", timestamp));
+        }
+    }
+    SOB_TRACE_MARK(trace, TraceStage::RECONCILE);
+
+    if (publish) {
+        if (printBooks && l3Book) {
+            l3Book->printBook();
+            smartBook.printBook();
+        }
+        finishEvent(timestamp);
+    }
+}
+
+void OrderBook::processBatch(const MarketEvent* events, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    // the map and level lookups of later events overlap with the work on earlier ones
+    for (size_t i = 0; i < count && !persistentBook; ++i) {
+        const MarketEvent& e = events[i];
+        if (e.type == EventType::L3_UPDATE) {
+            l3Book->prefetchOrder(e.l3Update.orderId);
+            l3Book->prefetchLevel(e.l3Update.isSell, e.l3Update.price);
+            smartBook.prefetchOrder(e.l3Update.orderId);
+            smartBook.prefetchLevel(e.l3Update.isSell, e.l3Update.price);
+        } else if (e.type == EventType::TRADE_EXECUTION) {
+            // nothing is applied yet, either side may be empty
+            bool isSell = !smartBook.getAsks().empty() && e.trade.price == smartBook.getBestAsk();
+            smartBook.prefetchLevel(isSell, e.trade.price);
+        }
+    }
+
+    // reconciliation depends on arrival order, so events are still applied one by one
+    bool applied = false;
+    for (size_t i = 0; i < count; ++i) {
+        const MarketEvent& e = events[i];
+        if (e.type == EventType::L3_UPDATE) {
+            applyL3Update(e.l3Update, false);
+        } else if (e.type == EventType::TRADE_EXECUTION) {
+            applyTrade(e.trade, false);
+        } else {
+            continue;
+        }
+        applied = true;
+    }
+    if (!applied) {
+        return;
+    }
+    if (printBooks && l3Book) {
+        l3Book->printBook();
+        smartBook.printBook();
+    }
+    finishEvent(lastReconciliationTime);
+}
+
+void OrderBook::setCallbacks(const Callbacks& callbackset) {
+    callbacks = callbackset;
+    // dirty levels are only worth recording when someone takes the deltas
+    smartBook.setDirtyTracking(callbacks.onDepthUpdate || bookViews);
+    depthFeed.requestSnapshot();
+}
+
+BookViewPublisher& OrderBook::enableBookViews() {
+    if (!bookViews) {
+        bookViews = std::make_unique<BookViewPublisher>();
+        smartBook.setDirtyTracking(true);
+        bookViews->publishFull(smartBook, lastReconciliationTime);
+    }
+    return *bookViews;
+}
+
+SignalEngine& OrderBook::enableSignals(int depth) {
+    if (!signalEngine) {
+        signalEngine = std::make_unique<SignalEngine>(depth);
+        smartBook.setSignalEngine(signalEngine.get());
+    }
+    return *signalEngine;
+}
+
+// One synthetic session around config.price: both sides fill up, an L2
+// snapshot shows the best bid shrinking ahead of its L3 cancel, a trade
+// lifts the best ask and everything is cancelled again
+static void warmupRound(OrderBook& book, const WarmupConfig& config, Timestamp& now) {
+    size_t levels = std::clamp<size_t>(config.levels, 1, L2_MAX_LEVELS);
+    size_t perSide = std::max(config.orders / 2, levels);
+    auto bidPrice = [&config, levels](size_t i) { return config.price - (i % levels) * config.tick; };
+    auto askPrice = [&config, levels](size_t i) { return config.price + (i % levels + 1) * config.tick; };
+    auto update = [&book, &now](L3Action action, OrderId orderId, bool isSell, Price price, Quantity size) {
+        book.processL3Update(L3Update{++now, action, orderId, isSell, price, size});
+    };
+    const Quantity size = 100;
+    OrderId firstAsk = static_cast<OrderId>(perSide) + 1;
+
+    for (size_t i = 0; i < perSide; ++i) {
+        update(L3Action::ADD, static_cast<OrderId>(i) + 1, false, bidPrice(i), size);
+        update(L3Action::ADD, firstAsk + static_cast<OrderId>(i), true, askPrice(i), size);
+    }
+    L2Snapshot snapshot;
+    for (size_t level = 0; level < levels; ++level) {
+        Quantity quantity = static_cast<Quantity>(perSide / levels + (level < perSide % levels)) * size;
+        snapshot.bids.push(bidPrice(level), quantity);
+        snapshot.asks.push(askPrice(level), quantity);
+    }
+    book.processL2Snapshot(snapshot, ++now);
+    snapshot.bids.quantities[0] -= size;
+    book.processL2Snapshot(snapshot, ++now);
+    update(L3Action::CANCEL, 1, false, bidPrice(0), size);
+    book.processTrade(TradeInfo{askPrice(0), size / 2, ++now, OrderSide::BUY, 0});
+    update(L3Action::MODIFY, firstAsk, true, askPrice(0), size / 2);
+
+    for (size_t i = 1; i < perSide; ++i) {
+        update(L3Action::CANCEL, static_cast<OrderId>(i) + 1, false, bidPrice(i), size);
+    }
+    for (size_t i = 0; i < perSide; ++i) {
+        update(L3Action::CANCEL, firstAsk + static_cast<OrderId>(i), true, askPrice(i), size);
+    }
+    book.processL2Snapshot(L2Snapshot(), ++now);
+}
+
+void OrderBook::warmup(const WarmupConfig& config) {
+    if (config.orders > 0) {
+        if (l3Book) l3Book->reserve(config.orders);
+        smartBook.reserve(config.orders);
+        guesses.reserve(config.orders);
+        heldByOrder.reserve(config.orders);
+        expiredGuesses.reserve(config.orders);
+        guessScan.reserve(config.orders);
+        // a trade fills at most one level
+        executions.reserve(config.orders / (2 * std::max<size_t>(config.levels, 1)) + 1);
+    }
+    if (config.rounds == 0) {
+        return;
+    }
+
+    std::pmr::memory_resource* resource = smartBook.getResource();
+    std::ostream quiet(nullptr);
+    LogStreamScope silence(&quiet);
+    {
+        L2Book l2;
+        L3Book l3(resource);
+        TradeContainer trades(config.rounds, resource);
+        OrderBook scratch(l2, l3, trades, executionProbability, resource);
+        scratch.setPrintBook(false);
+        scratch.setGuessExpiry(guessExpiry);
+        scratch.setCoalesceWindow(coalesceWindow);
+        Timestamp now = 0;
+        for (size_t round = 0; round < config.rounds; ++round) {
+            warmupRound(scratch, config, now);
+        }
+        scratch.flushActions();
+    }
+}
+
+void OrderBook::publishDepth(Timestamp timestamp) {
+    if ((!callbacks.onDepthUpdate && !bookViews) || persistentBook) {
+        return;
+    }
+    smartBook.takeDirtyLevels(dirtyLevels);
+    if (callbacks.onDepthUpdate) {
+        depthFeed.publish(smartBook, dirtyLevels, timestamp, callbacks.onDepthUpdate);
+    }
+    if (bookViews) {
+        bookViews->publish(smartBook, dirtyLevels, timestamp);
+    }
+}
+
+void OrderBook::finishEvent(Timestamp timestamp) {
+    expireGuesses(timestamp);
+    releaseActions(timestamp);
+    metrics.liveGuesses->set(static_cast<int64_t>(guesses.size()));
+    metrics.liveAggressors->set(static_cast<int64_t>(aggressors.size()));
+    if (persistentBook) {
+        metrics.smartOrders->set(static_cast<int64_t>(persistentBook->getTotalOrders()));
+        metrics.smartLevels->set(static_cast<int64_t>(persistentBook->getBidLevels() + persistentBook->getAskLevels()));
+    } else {
+        metrics.smartOrders->set(static_cast<int64_t>(smartBook.getTotalOrders()));
+        metrics.smartLevels->set(static_cast<int64_t>(smartBook.getBids().size() + smartBook.getAsks().size()));
+    }
+    if (l3Book) {
+        metrics.exchangeOrders->set(static_cast<int64_t>(l3Book->getTotalOrders()));
+    }
+    publishDepth(timestamp);
+}
+
+void OrderBook::setCoalesceWindow(Timestamp window) {
+    coalesceWindow = window;
+    if (window == 0) {
+        flushActions();
+    }
+}
+
+void OrderBook::flushActions() {
+    while (!heldActions.empty()) {
+        releaseAction(heldActions.front().info.orderId, false);
+    }
+}
+
+void OrderBook::releaseActions(Timestamp timestamp) {
+    while (!heldActions.empty() && heldActions.front().deadline <= timestamp) {
+        releaseAction(heldActions.front().info.orderId, false);
+    }
+}
+
+void OrderBook::releaseAction(OrderId orderId, bool confirmed) {
+    auto held = heldByOrder.find(orderId);
+    if (held == heldByOrder.end()) {
+        return;
+    }
+    OrderInfo info = held->second->info;
+    heldActions.erase(held->second);
+    heldByOrder.erase(held);
+    if (confirmed) {
+        info.isGuess = false;
+    }
+    dispatchAction(info);
+}
+
+void OrderBook::rekeyHeldAction(OrderId from, OrderId to) {
+    auto held = heldByOrder.find(from);
+    if (held == heldByOrder.end() || from == to) {
+        return;
+    }
+    // anything still held for the real id was emitted first
+    releaseAction(to, false);
+    auto it = held->second;
+    heldByOrder.erase(held);
+    it->info.orderId = to;
+    heldByOrder[to] = it;
+}
+
+void OrderBook::dispatchAction(const OrderInfo& info) {
+    if (info.action == "ADD") {
+        onOrderAdd(*this, info);
+    } else if (info.action == "MODIFY") {
+        onOrderModify(*this, info);
+    } else if (info.action == "CANCEL") {
+        onOrderCancel(*this, info);
+    } else {
+        onOrderExecution(*this, info);
+    }
+}
+
+void OrderBook::emitAction(const OrderInfo& info) {
+    if (coalesceWindow == 0) {
+        dispatchAction(info);
+        return;
+    }
+    // anything already due goes out first, so actions keep event time order
+    releaseActions(info.timestamp);
+
+    auto held = heldByOrder.find(info.orderId);
+    if (held != heldByOrder.end()) {
+        OrderInfo& prior = held->second->info;
+        if (info.action == "CANCEL" && prior.action == "ADD") {
+            // downstream never saw the order
+            heldActions.erase(held->second);
+            heldByOrder.erase(held);
+            metrics.coalesced->add(2);
+            return;
+        }
+        // modify and cancel carry the resulting size, the latest one is the net effect
+        if ((info.action == "MODIFY" && (prior.action == "ADD" || prior.action == "MODIFY"))
+            || (info.action == "CANCEL" && (prior.action == "MODIFY" || prior.action == "CANCEL"))) {
+            bool isGuess = info.isGuess || (prior.action == "ADD" && prior.isGuess);
+            std::string action = prior.action == "ADD" ? prior.action : info.action;
+            Quantity originalQty = prior.originalQty;
+            prior = info;
+            prior.action = action;
+            prior.isGuess = isGuess;
+            prior.originalQty = originalQty;
+            metrics.coalesced->add();
+            if (!isGuess) {
+                releaseAction(info.orderId, false);
+            }
+            return;
+        }
+        // keep per order ordering
+        releaseAction(info.orderId, false);
+    }
+
+    if (!info.isGuess) {
+        dispatchAction(info);
+        return;
+    }
+    auto it = heldActions.insert(heldActions.end(), HeldAction{info, info.timestamp + coalesceWindow});
+    heldByOrder[info.orderId] = it;
+}
+
+void OrderBook::emitCorrection(const OrderInfo& info) {
+    if (heldByOrder.count(info.orderId)) {
+        // the guess never went out, send only what really happened
+        heldByOrder[info.orderId]->info = info;
+        metrics.coalesced->add();
+        releaseAction(info.orderId, false);
+        return;
+    }
+    metrics.corrections->add();
+    dispatchAction(info);
+}
+
+std::pair<OrderBook::GuessMap::iterator, bool> OrderBook::insertGuess(OrderId orderId, const OrderInfo& info) {
+    auto result = guesses.try_emplace(orderId, info);
+    if (result.second) {
+        result.first->second.sequence = nextGuessSequence++;
+        metrics.guessesCreated->add();
+    }
+    return result;
+}
+
+const std::pmr::vector<OrderBook::GuessMap::iterator>& OrderBook::scanGuesses() {
+    guessScan.clear();
+    for (auto it = guesses.begin(); it != guesses.end(); ++it) {
+        guessScan.push_back(it);
+    }
+    std::sort(guessScan.begin(), guessScan.end(),
+        [](GuessMap::iterator a, GuessMap::iterator b) { return a->second.sequence < b->second.sequence; });
+    return guessScan;
+}
+
+void OrderBook::confirmGuess(const OrderInfo& guess, OrderId orderId) {
+    // a held guess goes out under the id downstream will see from now on
+    rekeyHeldAction(guess.orderId, orderId);
+    releaseAction(orderId, true);
+    metrics.guessesConfirmed->add();
+    metrics.guessConfirmLatency->record(lastReconciliationTime > guess.timestamp ? lastReconciliationTime - guess.timestamp : 0);
+}
+
+void OrderBook::expireGuesses(Timestamp timestamp) {
+    if (guessExpiry == 0 || timestamp < nextExpirySweep) {
+        return;
+    }
+    // a sweep every quarter expiry keeps the scan off most events
+    nextExpirySweep = timestamp + std::max<Timestamp>(guessExpiry / 4, 1);
+
+    expiredGuesses.clear();
+    for (auto it : scanGuesses()) {
+        if (it->second.timestamp + guessExpiry < timestamp) {
+            // a guessed order the feed never confirmed leaves the SmartBook again
+            if (it->second.action == "ADD" && it->first < 0 && smartCancelOrder(it->first)) {
+                OrderInfo cancel = it->second;
+                cancel.action = "CANCEL";
+                cancel.isGuess = false;
+                cancel.timestamp = timestamp;
+                if (heldByOrder.count(cancel.orderId)) {
+                    emitAction(cancel);
+                } else {
+                    emitCorrection(cancel);
+                }
+            }
+            expiredGuesses.push_back(&it->second);
+            guesses.erase(it);
+        }
+    }
+    for (auto it = aggressors.begin(); it != aggressors.end(); ) {
+        if (it->timestamp + guessExpiry < timestamp) {
+            it = aggressors.erase(it);
+            metrics.aggressorsExpired->add();
+        } else {
+            ++it;
         }
     }
+    if (expiredGuesses.empty()) {
+        return;
+    }
+    metrics.guessesExpired->add(expiredGuesses.size());
+    std::sort(expiredGuesses.begin(), expiredGuesses.end());
 
-    l3Book->printBook();
-    smartBook.printBook();
+    // pending executions point into guesses, drop the ones just erased
+    for (size_t pending = guessedExecutions.size(); pending > 0; --pending) {
+        OrderInfo* exec = guessedExecutions.front();
+        guessedExecutions.pop();
+        if (!std::binary_search(expiredGuesses.begin(), expiredGuesses.end(), exec)) guessedExecutions.push(exec);
+    }
 }
 
 bool OrderBook::reconcileAdd(OrderId orderId, bool isSell, Price price, Quantity size) {
     for (auto it = aggressors.begin(); it != aggressors.end(); ) {
         if (it->isMarketable && it->isSell == isSell && it->price == price && it->size == size) {
             // we have received ADD for the aggressor, expect the CANCEL to be received before removing
+            rekeyHeldAction(it->orderId, orderId);
+            releaseAction(orderId, true);
             it->isPending = true;
             it->orderId = orderId;
-            guesses.insert({orderId, *it});
+            metrics.aggressorsConfirmed->add();
+            metrics.aggressorConfirmLatency->record(lastReconciliationTime > it->timestamp ? lastReconciliationTime - it->timestamp : 0);
+            insertGuess(orderId, *it);
             aggressors.erase(it);
             return true;
         }
         ++it;
     }
 
-    for (auto it = guesses.begin(); it != guesses.end(); ) {
+    for (auto it : scanGuesses()) {
         OrderInfo& guess = it->second;
         if (guess.action == "ADD" && guess.isSell == isSell && guess.price == price && guess.size == size) {
-            if (guess.orderId < 0)
-                smartBook.modifyOrderId(guess.orderId, orderId);
+            OrderId confirmedId = guess.orderId;
+            if (guess.orderId < 0) {
+                smartModifyOrderId(guess.orderId, orderId);
+                confirmedId = orderId;
+            }
+            confirmGuess(guess, confirmedId);
             guesses.erase(it);
             return true;
         }
-        ++it;
     }
     return false;
 }
@@ -219,36 +705,49 @@ bool OrderBook::reconcileModify(OrderId orderId, Price price, Quantity size) {
         if (it->second.action == "EXECUTION" &&
             it->second.price == price && it->second.originalQty - it->second.size == size) {
             it->second.isPending = false;
-            if (!it->second.isGuess)    
+            if (!it->second.isGuess) {
+                confirmGuess(it->second);
                 guesses.erase(it);
+            }
             return true;
         }
 
         if (it->second.action == "MODIFY" && it->second.isGuess) {
-            return true;
+            if (it->second.price == price && it->second.size == size) {
+                confirmGuess(it->second);
+                guesses.erase(it);
+                return true;
+            }
+            // the order changed some other way, the real modify replaces the guess
+            metrics.guessesInvalidated->add();
+            guesses.erase(it);
         }
     }
 
-    for (auto it = guesses.begin(); it != guesses.end(); ) {
+    for (auto it : scanGuesses()) {
         OrderInfo& guess = it->second;
-        std::cout << "FOUND guess " << guess.orderId << " " << guess.price << " " << guess.size << " " << guess.isGuess << std::endl;
+        logStream() << "FOUND guess " << guess.orderId << " " << guess.price << " " << guess.size << " " << guess.isGuess << std::endl;
         if (guess.action == "ADD" && guess.price == price) {
             // invalidate new order guess, apply amend instead
-            if (guess.isGuess && smartBook.hasOrder(orderId))
+            if (guess.isGuess && smartHasOrder(orderId))
             {
-                smartBook.cancelOrder(guess.orderId);
+                smartCancelOrder(guess.orderId);
+                metrics.guessesInvalidated->add();
                 guesses.erase(it);
                 return false;
             }
             if (guess.size == size) {
                 // update real order id of new order
-                if (guess.orderId < 0)
-                    smartBook.modifyOrderId(guess.orderId, orderId);
+                OrderId confirmedId = guess.orderId;
+                if (guess.orderId < 0) {
+                    smartModifyOrderId(guess.orderId, orderId);
+                    confirmedId = orderId;
+                }
+                confirmGuess(guess, confirmedId);
                 guesses.erase(it);
                 return true;
             }
         }
-        ++it;
     }
     return false;
 }
@@ -258,15 +757,30 @@ bool OrderBook::reconcileCancel(OrderId orderId) {
     if (it != guesses.end()) {
         if (it->second.action == "EXECUTION" && it->second.originalQty - it->second.size == 0) {
             it->second.isPending = false;
-            if (!it->second.isGuess)
+            if (!it->second.isGuess) {
+                confirmGuess(it->second);
                 guesses.erase(it);
+            }
             return true;
         }
 
         if (it->second.action == "ADD" && it->second.isPending) {
+            confirmGuess(it->second);
             guesses.erase(it);
             return true;
         }
+
+        if (it->second.action == "CANCEL" && it->second.isGuess) {
+            confirmGuess(it->second);
+            guesses.erase(it);
+            return true;
+        }
+
+        if (it->second.action == "MODIFY" && it->second.isGuess) {
+            // the real cancel replaces the guessed reduction
+            metrics.guessesInvalidated->add();
+            guesses.erase(it);
+        }
     }
     return false;
 }
@@ -283,8 +797,10 @@ bool OrderBook::reconcileTrade(Price price, Quantity quantity) {
             auto& execRec = it->second;
             if (execRec.action == "EXECUTION" && execRec.price == price && execRec.size == quantity) {
                 execRec.isGuess = false;
-                if (!execRec.isPending) 
+                if (!execRec.isPending) {
+                    confirmGuess(execRec);
                     guesses.erase(it);
+                }
             }
             return true;
         }
@@ -295,17 +811,18 @@ bool OrderBook::reconcileTrade(Price price, Quantity quantity) {
             // report revision to downstream
             if (execRec.originalQty == execRec.size) {
                 execRec.action = "CANCEL";
-                onOrderCancel(*this, execRec);
+                emitCorrection(execRec);
             } else {
                 execRec.action = "MODIFY";
                 execRec.size = execRec.originalQty - execRec.size;
-                onOrderModify(*this, execRec);
+                emitCorrection(execRec);
             }
+            metrics.guessesInvalidated->add();
             guesses.erase(it);
         }
     }
 
-    for (auto it = guesses.begin(); it != guesses.end(); ) {
+    for (auto it : scanGuesses()) {
         OrderInfo& guess = it->second;
         if ((guess.action == "MODIFY" && quantity == guess.originalQty - guess.size
             || guess.action == "CANCEL" && quantity == guess.size) &&
@@ -315,13 +832,13 @@ bool OrderBook::reconcileTrade(Price price, Quantity quantity) {
             guess.isGuess = false;
             guess.size = quantity;
             guess.action = "EXECUTION";
-            onOrderExecution(*this, guess);
+            emitCorrection(guess);
+            metrics.guessesInvalidated->add();
 
             // Remove the invalid guess
             guesses.erase(it);
             return true;
         }
-        ++it;
     }
     return false;
 }
@@ -330,21 +847,21 @@ void OrderBook::guessNewOrder(Price price, Quantity size, bool isSell, bool isMa
     Timestamp timestamp, 
     bool isGuess) {
 
-    static OrderId guessOrderId = -1;
-    OrderId currId = guessOrderId--;
+    OrderId currId = nextGuessOrderId--;
     if (!isMarketable) {
-        smartBook.addOrder(currId, isSell, size, price);
+        smartAddOrder(currId, isSell, size, price, timestamp);
     }
 
     OrderInfo newOrder(currId, isSell, price, size, "ADD", timestamp, size, true, isMarketable);
     if (isMarketable) {
         aggressors.push_back(newOrder);
+        metrics.aggressorsCreated->add();
     } else {
         newOrder.isGuess = isGuess;
-        guesses.insert({currId, newOrder});
+        insertGuess(currId, newOrder);
     }
     
-    onOrderAdd(*this, newOrder);
+    emitAction(newOrder);
 }
 
 void OrderBook::onExecution(Price price, Quantity quantity, Timestamp timestamp, bool isGuess) {
@@ -354,26 +871,26 @@ void OrderBook::onExecution(Price price, Quantity quantity, Timestamp timestamp,
     guessNewOrder(price, quantity, isSellAggressor, true, timestamp);
 
     // we can be sure that an execution has occured
-    auto executions = smartBook.executeAtPrice(price, quantity, isGuess);
+    smartExecuteAtPrice(price, quantity, isGuess);
 
     for (auto exec : executions) {
         exec.timestamp = timestamp;
-        auto [it, inserted] = guesses.emplace(exec.orderId, exec);
+        auto it = insertGuess(exec.orderId, exec).first;
         if (isGuess) {
             guessedExecutions.push(&it->second);
         }
-        onOrderExecution(*this, exec);
+        emitAction(exec);
     }
 }
 
 // Returns {isMarketable, isSellAggressor}
 std::pair<bool, bool> OrderBook::deduceIsSellAggressor(Price price) const {
-    Price bid = smartBook.getBestBid();
+    Price bid = persistentBook ? persistentBook->getBestBid() : smartBook.getBestBid();
     if (bid != 0 && price <= bid) {
         return {true, true};
     }
 
-    Price ask = smartBook.getBestAsk();
+    Price ask = persistentBook ? persistentBook->getBestAsk() : smartBook.getBestAsk();
     if (ask != 0 && price >= ask) {
         return {true, false};
     }
@@ -381,31 +898,296 @@ std::pair<bool, bool> OrderBook::deduceIsSellAggressor(Price price) const {
     return {false, false};
 }
 
+bool OrderBook::smartAddOrder(OrderId orderId, bool isSell, Quantity size, Price price, Timestamp timestamp) {
+    return persistentBook ? persistentBook->addOrder(orderId, isSell, size, price)
+                          : smartBook.addOrder(orderId, isSell, size, price, timestamp);
+}
+
+bool OrderBook::smartCancelOrder(OrderId orderId) {
+    return persistentBook ? persistentBook->cancelOrder(orderId) : smartBook.cancelOrder(orderId);
+}
+
+bool OrderBook::smartModifyOrder(OrderId orderId, Quantity size, Price price) {
+    return persistentBook ? persistentBook->modifyOrder(orderId, size, price) : smartBook.modifyOrder(orderId, size, price);
+}
+
+bool OrderBook::smartModifyOrderId(OrderId orderId, OrderId newId) {
+    return persistentBook ? persistentBook->modifyOrderId(orderId, newId) : smartBook.modifyOrderId(orderId, newId);
+}
+
+bool OrderBook::smartHasOrder(OrderId orderId) const {
+    return persistentBook ? persistentBook->hasOrder(orderId) : smartBook.hasOrder(orderId);
+}
+
+void OrderBook::smartExecuteAtPrice(Price price, Quantity quantity, bool isGuess) {
+    if (persistentBook) {
+        persistentBook->executeAtPrice(price, quantity, isGuess, executions);
+    } else {
+        smartBook.executeAtPrice(price, quantity, isGuess, executions);
+    }
+}
+
+bool OrderBook::smartDepth(bool isSell, L2Side& out) const {
+    if (persistentBook) {
+        return isSell ? persistentBook->getAskDepth(out) : persistentBook->getBidDepth(out);
+    }
+    return isSell ? smartBook.getAskDepth(out) : smartBook.getBidDepth(out);
+}
+
+bool OrderBook::findSmartLevel(bool isSell, Price price, Quantity& quantity) const {
+    if (persistentBook) {
+        const PersistentLevel* level = persistentBook->getLevel(isSell, price);
+        if (level) quantity = level->quantity;
+        return level != nullptr;
+    }
+    if (isSell) {
+        auto it = smartBook.getAsks().find(price);
+        if (it == smartBook.getAsks().end()) return false;
+        quantity = it->second.quantity;
+        return true;
+    }
+    auto it = smartBook.getBids().find(price);
+    if (it == smartBook.getBids().end()) return false;
+    quantity = it->second.quantity;
+    return true;
+}
+
+void OrderBook::findStaleLevels(bool isSell, const L2Side& l2Side) {
+    staleLevels.clear();
+    // a side truncated at L2_MAX_LEVELS says nothing about the levels below its last
+    bool isFull = l2Side.count == L2_MAX_LEVELS;
+    Price deepest = isFull ? l2Side.prices[l2Side.count - 1] : 0;
+    auto visit = [&](Price price) {
+        if (isFull && (isSell ? price > deepest : price < deepest)) return false;
+        if (l2Side.find(price) < 0) staleLevels.push_back(price);
+        return true;
+    };
+    if (persistentBook) {
+        if (isSell) persistentBook->forEachAsk([&visit](Price price, const PersistentLevel&) { return visit(price); });
+        else persistentBook->forEachBid([&visit](Price price, const PersistentLevel&) { return visit(price); });
+    } else if (isSell) {
+        for (const auto& entry : smartBook.getAsks()) {
+            if (!visit(entry.first)) break;
+        }
+    } else {
+        for (const auto& entry : smartBook.getBids()) {
+            if (!visit(entry.first)) break;
+        }
+    }
+}
+
+void OrderBook::enableForking() {
+    if (persistentBook) {
+        return;
+    }
+    persistentBook = std::make_unique<PersistentL3Book>(smartBook);
+    smartBook.clear();
+}
+
+std::unique_ptr<OrderBook> OrderBook::fork(double executionProbability) const {
+    auto branch = std::make_unique<OrderBook>();
+    branch->persistentBook = std::make_unique<PersistentL3Book>(
+        persistentBook ? persistentBook->fork() : PersistentL3Book(smartBook));
+    branch->ownedL2Book = std::make_unique<L2Book>(*l2Book);
+    branch->ownedTrades = std::make_unique<TradeContainer>(0);
+    branch->l2Book = branch->ownedL2Book.get();
+    branch->l3Book = nullptr;
+    branch->tradeContainer = branch->ownedTrades.get();
+    branch->smartBook.name = "SmartBook";
+    branch->printBooks = printBooks;
+
+    branch->guesses = guesses;
+    branch->aggressors = aggressors;
+    // pending executions point into guesses, the branch's into its own copy
+    for (OrderId orderId : pendingExecutionIds()) {
+        branch->guessedExecutions.push(&branch->guesses.find(orderId)->second);
+    }
+    branch->lastReconciliationTime = lastReconciliationTime;
+    branch->nextGuessOrderId = nextGuessOrderId;
+    branch->nextGuessSequence = nextGuessSequence;
+    branch->guessExpiry = guessExpiry;
+    branch->nextExpirySweep = nextExpirySweep;
+    branch->coalesceWindow = coalesceWindow;
+    for (const HeldAction& held : heldActions) {
+        branch->heldByOrder[held.info.orderId] = branch->heldActions.insert(branch->heldActions.end(), held);
+    }
+    branch->executionProbability = executionProbability;
+    branch->rngEngine = rngEngine;
+    return branch;
+}
+
+std::vector<OrderId> OrderBook::pendingExecutionIds() const {
+    std::unordered_map<const OrderInfo*, OrderId> live;
+    for (const auto& [orderId, info] : guesses) {
+        live.emplace(&info, orderId);
+    }
+    std::vector<OrderId> pending;
+    auto queued = guessedExecutions;
+    while (!queued.empty()) {
+        auto it = live.find(queued.front());
+        if (it != live.end()) pending.push_back(it->second);
+        queued.pop();
+    }
+    return pending;
+}
+
 void OrderBook::onOrderAdd(OrderBook& smartOrderBook, const OrderInfo& orderInfo) {
-    std::cout << "[Callback] [" << orderInfo.timestamp << "] "
+    SOB_TRACE_CALLBACK();
+    logStream() << "[Callback] [" << orderInfo.timestamp << "] "
         << orderInfo.action << (orderInfo.isGuess ? " (Guess): ": ": ") 
         << orderInfo.orderId << (orderInfo.isSell ? " SELL " : " BUY ")
         << orderInfo.size << " @ " << orderInfo.price << "\n";
+    if (callbacks.onOrderAdd) {
+        callbacks.onOrderAdd(smartOrderBook, orderInfo);
+    }
 }
 
 void OrderBook::onOrderExecution(OrderBook& smartOrderBook, const OrderInfo& orderInfo) {
-    std::cout << "[Callback] [" << orderInfo.timestamp << "] "
+    SOB_TRACE_CALLBACK();
+    logStream() << "[Callback] [" << orderInfo.timestamp << "] "
         << orderInfo.action << (orderInfo.isGuess ? " (Guess): ": ": ") 
         << orderInfo.orderId << " "
         //<< (orderInfo.isSell ? " SELL " : " BUY ")
         << orderInfo.size << " @ " << orderInfo.price << "\n";
+    if (callbacks.onOrderExecution) {
+        callbacks.onOrderExecution(smartOrderBook, orderInfo);
+    }
 }
 
 void OrderBook::onOrderModify(OrderBook& smartOrderBook, const OrderInfo& orderInfo) {
-    std::cout << "[Callback] [" << orderInfo.timestamp << "] "
+    SOB_TRACE_CALLBACK();
+    logStream() << "[Callback] [" << orderInfo.timestamp << "] "
         << orderInfo.action << (orderInfo.isGuess ? " (Guess): ": ": ") 
         << orderInfo.orderId << (orderInfo.isSell ? " SELL " : " BUY ")
         << orderInfo.size << " @ " << orderInfo.price << "\n";
+    if (callbacks.onOrderModify) {
+        callbacks.onOrderModify(smartOrderBook, orderInfo);
+    }
 }
 
 void OrderBook::onOrderCancel(OrderBook& smartOrderBook, const OrderInfo& orderInfo) {
-    std::cout << "[Callback] [" << orderInfo.timestamp << "] "
+    SOB_TRACE_CALLBACK();
+    logStream() << "[Callback] [" << orderInfo.timestamp << "] "
         << orderInfo.action << (orderInfo.isGuess ? " (Guess): ": ": ") 
         << orderInfo.orderId << (orderInfo.isSell ? " SELL " : " BUY ")
         << orderInfo.size << " @ " << orderInfo.price << "\n";
+    if (callbacks.onOrderCancel) {
+        callbacks.onOrderCancel(smartOrderBook, orderInfo);
+    }
+}
+
+static void saveOrderInfo(std::ostream& out, const OrderInfo& info) {
+    out << info.orderId << " " << info.isSell << " " << info.price << " " << info.size << " "
+        << info.action << " " << info.timestamp << " " << info.originalQty << " "
+        << info.isGuess << " " << info.isMarketable << " " << info.isPending << " " << info.sequence << "\n";
+}
+
+static bool loadOrderInfo(std::istream& in, OrderInfo& info) {
+    return static_cast<bool>(in >> info.orderId >> info.isSell >> info.price >> info.size
+        >> info.action >> info.timestamp >> info.originalQty
+        >> info.isGuess >> info.isMarketable >> info.isPending >> info.sequence);
+}
+
+void OrderBook::saveCheckpoint(std::ostream& out, Timestamp timestamp) const {
+    auto precision = out.precision(17);
+    out << "SOBCKPT1 " << timestamp << "\n";
+    if (persistentBook) {
+        L3Book smart;
+        persistentBook->toL3Book(smart);
+        smart.save(out);
+    } else {
+        smartBook.save(out);
+    }
+    if (l3Book) {
+        l3Book->save(out);
+    } else {
+        // a branch keeps no exchange book
+        L3Book().save(out);
+    }
+    l2Book->save(out);
+    tradeContainer->save(out);
+
+    // reconciliation scans guesses by sequence, which each one keeps
+    std::vector<std::pair<OrderId, const OrderInfo*>> saved;
+    for (const auto& [orderId, info] : guesses) {
+        saved.push_back({orderId, &info});
+    }
+    std::sort(saved.begin(), saved.end(),
+        [](const auto& a, const auto& b) { return a.second->sequence < b.second->sequence; });
+    out << saved.size() << "\n";
+    for (const auto& [orderId, info] : saved) {
+        out << orderId << " ";
+        saveOrderInfo(out, *info);
+    }
+    out << aggressors.size() << "\n";
+    for (const auto& info : aggressors) {
+        saveOrderInfo(out, info);
+    }
+
+    // pending executions point into guesses, store them by order id
+    std::vector<OrderId> pending = pendingExecutionIds();
+    out << pending.size();
+    for (OrderId orderId : pending) {
+        out << " " << orderId;
+    }
+    out << "\n";
+
+    out << nextGuessOrderId << " " << nextGuessSequence << " " << lastReconciliationTime << " " << executionProbability << "\n";
+    out << rngEngine << "\n";
+    out.precision(precision);
+}
+
+bool OrderBook::loadCheckpoint(std::istream& in, Timestamp& timestamp) {
+    std::string magic;
+    if (!(in >> magic >> timestamp) || magic != "SOBCKPT1") {
+        std::cerr << "Not a book checkpoint\n";
+        return false;
+    }
+    L3Book noExchangeBook;
+    if (!smartBook.load(in) || !(l3Book ? *l3Book : noExchangeBook).load(in) || !l2Book->load(in) || !tradeContainer->load(in)) {
+        std::cerr << "Corrupt book checkpoint\n";
+        return false;
+    }
+    if (persistentBook) {
+        *persistentBook = PersistentL3Book(smartBook);
+        smartBook.clear();
+    }
+    // depth consumers resync from the restored book
+    depthFeed.requestSnapshot();
+    if (bookViews) {
+        smartBook.setDirtyTracking(true);
+        bookViews->publishFull(smartBook, timestamp);
+    }
+
+    guesses.clear();
+    aggressors.clear();
+    while (!guessedExecutions.empty()) guessedExecutions.pop();
+
+    size_t count = 0;
+    if (!(in >> count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        OrderId orderId;
+        OrderInfo info(0, false, 0, 0, "");
+        if (!(in >> orderId) || !loadOrderInfo(in, info)) return false;
+        guesses.insert({orderId, info});
+    }
+    if (!(in >> count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        OrderInfo info(0, false, 0, 0, "");
+        if (!loadOrderInfo(in, info)) return false;
+        aggressors.push_back(info);
+    }
+    if (!(in >> count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        OrderId orderId;
+        if (!(in >> orderId)) return false;
+        auto it = guesses.find(orderId);
+        if (it != guesses.end()) guessedExecutions.push(&it->second);
+    }
+
+    if (!(in >> nextGuessOrderId >> nextGuessSequence >> lastReconciliationTime >> executionProbability >> rngEngine)) {
+        std::cerr << "Corrupt book checkpoint\n";
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "OrderPool.hpp"
+#include <algorithm>
+#include <memory>
+
+OrderPool::OrderPool(const OrderPool& other) : OrderPool() {
+    *this = other;
+}
+
+OrderPool::OrderPool(OrderPool&& other)
+    : resource(other.resource), chunks(std::move(other.chunks)), metaChunks(std::move(other.metaChunks)),
+        top(other.top), freeHead(other.freeHead), used(other.used) {
+    other.chunks.clear();
+    other.metaChunks.clear();
+    other.clear();
+}
+
+OrderPool& OrderPool::operator=(const OrderPool& other) {
+    if (this == &other) {
+        return *this;
+    }
+    while (capacity() < other.top) {
+        addChunk();
+    }
+    // nodes past top were never handed out
+    for (uint32_t start = 0; start < other.top; start += CHUNK_SIZE) {
+        uint32_t count = std::min(CHUNK_SIZE, other.top - start);
+        std::copy_n(other.chunks[start >> CHUNK_BITS], count, chunks[start >> CHUNK_BITS]);
+        std::copy_n(other.metaChunks[start >> CHUNK_BITS], count, metaChunks[start >> CHUNK_BITS]);
+    }
+    top = other.top;
+    freeHead = other.freeHead;
+    used = other.used;
+    return *this;
+}
+
+OrderPool& OrderPool::operator=(OrderPool&& other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (resource != other.resource) {
+        // chunks must go back to the resource they came from
+        return *this = static_cast<const OrderPool&>(other);
+    }
+    releaseChunks();
+    chunks.swap(other.chunks);
+    metaChunks.swap(other.metaChunks);
+    top = other.top;
+    freeHead = other.freeHead;
+    used = other.used;
+    other.clear();
+    return *this;
+}
+
+void OrderPool::addChunk() {
+    auto* nodes = static_cast<OrderNode*>(resource->allocate(CHUNK_SIZE * sizeof(OrderNode), alignof(OrderNode)));
+    auto* metas = static_cast<OrderMeta*>(resource->allocate(CHUNK_SIZE * sizeof(OrderMeta), alignof(OrderMeta)));
+    // zeroed, which also faults the pages in before the first order lands on them
+    std::uninitialized_value_construct_n(nodes, CHUNK_SIZE);
+    std::uninitialized_value_construct_n(metas, CHUNK_SIZE);
+    chunks.push_back(nodes);
+    metaChunks.push_back(metas);
+}
+
+void OrderPool::releaseChunks() {
+    for (OrderNode* chunk : chunks) resource->deallocate(chunk, CHUNK_SIZE * sizeof(OrderNode), alignof(OrderNode));
+    for (OrderMeta* chunk : metaChunks) resource->deallocate(chunk, CHUNK_SIZE * sizeof(OrderMeta), alignof(OrderMeta));
+    chunks.clear();
+    metaChunks.clear();
+}
+
+uint32_t OrderPool::allocate(const Order& order, Timestamp timestamp) {
+    uint32_t index;
+    if (freeHead != ORDER_NIL) {
+        index = freeHead;
+        freeHead = node(index).next;
+    } else {
+        if (top == capacity()) {
+            addChunk();
+        }
+        index = top++;
+    }
+    node(index).order = order;
+    meta(index).timestamp = timestamp;
+    used++;
+    return index;
+}
+
+void OrderPool::release(uint32_t index) {
+    node(index).next = freeHead;
+    freeHead = index;
+    used--;
+}
+
+void OrderPool::clear() {
+    top = 0;
+    freeHead = ORDER_NIL;
+    used = 0;
+}
+
+void OrderPool::reserve(size_t orders) {
+    while (capacity() < orders) {
+        addChunk();
+    }
+}
\ No newline at end of file
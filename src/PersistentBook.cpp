@@ -0,0 +1,233 @@
+#include "PersistentBook.hpp"
+#include <algorithm>
+
+PersistentL3Book::PersistentL3Book(const L3Book& book) {
+    auto copySide = [this](const auto& side, bool isSell) {
+        for (const auto& [price, level] : side) {
+            auto copy = std::make_shared<PersistentLevel>();
+            copy->quantity = level.quantity;
+            copy->numOrders = level.numOrders;
+            copy->orders.assign(level.orders.begin(), level.orders.end());
+            for (const Order& order : level.orders) {
+                orders.set(order.orderId, {price, isSell});
+            }
+            if (isSell) asks.set(price, copy);
+            else bids.set(price, copy);
+        }
+    };
+    copySide(book.getBids(), false);
+    copySide(book.getAsks(), true);
+}
+
+void PersistentL3Book::storeLevel(bool isSell, Price price, const PersistentLevel& level) {
+    if (level.numOrders == 0) {
+        if (isSell) asks.erase(price);
+        else bids.erase(price);
+        return;
+    }
+    LevelPtr stored = std::make_shared<const PersistentLevel>(level);
+    if (isSell) asks.set(price, stored);
+    else bids.set(price, stored);
+}
+
+const PersistentLevel* PersistentL3Book::getLevel(bool isSell, Price price) const {
+    const LevelPtr* level = isSell ? asks.find(price) : bids.find(price);
+    return level ? level->get() : nullptr;
+}
+
+LevelPtr PersistentL3Book::shareLevel(bool isSell, Price price) const {
+    const LevelPtr* level = isSell ? asks.find(price) : bids.find(price);
+    return level ? *level : nullptr;
+}
+
+const Order* PersistentL3Book::findOrder(OrderId orderId) const {
+    const OrderLocation* location = orders.find(orderId);
+    if (!location) {
+        return nullptr;
+    }
+    const PersistentLevel* level = getLevel(location->isSell, location->price);
+    if (!level) {
+        return nullptr;
+    }
+    auto it = std::find_if(level->orders.begin(), level->orders.end(),
+        [orderId](const Order& order) { return order.orderId == orderId; });
+    return it == level->orders.end() ? nullptr : &*it;
+}
+
+bool PersistentL3Book::addOrder(OrderId orderId, bool isSell, Quantity size, Price price) {
+    if (hasOrder(orderId) || price <= 0.0) {
+        return false;
+    }
+    const PersistentLevel* current = getLevel(isSell, price);
+    PersistentLevel level = current ? *current : PersistentLevel();
+    level.orders.emplace_back(orderId, isSell, price, size);
+    level.quantity += size;
+    level.numOrders++;
+    storeLevel(isSell, price, level);
+    orders.set(orderId, {price, isSell});
+    return true;
+}
+
+bool PersistentL3Book::cancelOrder(OrderId orderId) {
+    const OrderLocation* location = orders.find(orderId);
+    if (!location) {
+        return false;
+    }
+    OrderLocation at = *location;
+    const PersistentLevel* current = getLevel(at.isSell, at.price);
+    if (current) {
+        PersistentLevel level = *current;
+        auto it = std::find_if(level.orders.begin(), level.orders.end(),
+            [orderId](const Order& order) { return order.orderId == orderId; });
+        if (it != level.orders.end()) {
+            level.quantity -= it->size;
+            level.numOrders--;
+            level.orders.erase(it);
+            storeLevel(at.isSell, at.price, level);
+        }
+    }
+    orders.erase(orderId);
+    return true;
+}
+
+bool PersistentL3Book::modifyOrder(OrderId orderId, Quantity newSize, Price newPrice) {
+    const Order* order = findOrder(orderId);
+    if (!order) {
+        return false;
+    }
+    // order points into a level the next store may release
+    bool isSell = order->isSell;
+    if (order->price == newPrice && order->size > newSize) {
+        if (newSize <= 0) {
+            return false;
+        }
+        PersistentLevel level = *getLevel(isSell, newPrice);
+        for (Order& queued : level.orders) {
+            if (queued.orderId != orderId) continue;
+            level.quantity -= queued.size - newSize;
+            queued.size = newSize;
+            break;
+        }
+        storeLevel(isSell, newPrice, level);
+        return true;
+    }
+    cancelOrder(orderId);
+    return addOrder(orderId, isSell, newSize, newPrice);
+}
+
+bool PersistentL3Book::executeOrder(OrderId orderId, Quantity executedSize) {
+    const Order* order = findOrder(orderId);
+    if (!order || executedSize <= 0) {
+        return false;
+    }
+    if (order->size == executedSize) {
+        return cancelOrder(orderId);
+    }
+    bool isSell = order->isSell;
+    Price price = order->price;
+    PersistentLevel level = *getLevel(isSell, price);
+    for (Order& queued : level.orders) {
+        if (queued.orderId != orderId) continue;
+        queued.size -= executedSize;
+        break;
+    }
+    level.quantity -= executedSize;
+    storeLevel(isSell, price, level);
+    return true;
+}
+
+bool PersistentL3Book::modifyOrderId(OrderId orderId, OrderId newId) {
+    const Order* order = findOrder(orderId);
+    if (!order || hasOrder(newId)) {
+        return false;
+    }
+    bool isSell = order->isSell;
+    Price price = order->price;
+    PersistentLevel level = *getLevel(isSell, price);
+    for (Order& queued : level.orders) {
+        if (queued.orderId != orderId) continue;
+        queued.orderId = newId;
+        break;
+    }
+    storeLevel(isSell, price, level);
+    orders.erase(orderId);
+    orders.set(newId, {price, isSell});
+    return true;
+}
+
+std::vector<OrderInfo> PersistentL3Book::executeAtPrice(Price price, Quantity quantity, bool isGuess) {
+    std::pmr::vector<OrderInfo> executions;
+    executeAtPrice(price, quantity, isGuess, executions);
+    return std::vector<OrderInfo>(executions.begin(), executions.end());
+}
+
+void PersistentL3Book::executeAtPrice(Price price, Quantity quantity, bool isGuess, std::pmr::vector<OrderInfo>& executions) {
+    executions.clear();
+    bool isSell = price == getBestAsk();
+    const PersistentLevel* current = getLevel(isSell, price);
+    if (!current) {
+        return;
+    }
+
+    // one copy of the level for the whole sweep
+    PersistentLevel level = *current;
+    Quantity remainingQty = quantity;
+    size_t filled = 0;
+    for (Order& order : level.orders) {
+        if (remainingQty <= 0) break;
+        Quantity execQty = std::min(remainingQty, order.size);
+        OrderInfo execution(order.orderId, order.isSell, price, execQty, "EXECUTION");
+        execution.originalQty = order.size;
+        if (isGuess) {
+            execution.isGuess = true;
+            execution.isPending = true;
+        }
+        executions.push_back(execution);
+        order.size -= execQty;
+        level.quantity -= execQty;
+        remainingQty -= execQty;
+        if (order.size == 0) filled++;
+    }
+    for (size_t i = 0; i < filled; ++i) {
+        orders.erase(level.orders[i].orderId);
+    }
+    level.orders.erase(level.orders.begin(), level.orders.begin() + filled);
+    level.numOrders -= static_cast<int>(filled);
+    storeLevel(isSell, price, level);
+}
+
+Price PersistentL3Book::getBestBid() const {
+    const Price* price = bids.firstKey();
+    return price ? *price : 0.0;
+}
+
+Price PersistentL3Book::getBestAsk() const {
+    const Price* price = asks.firstKey();
+    return price ? *price : 0.0;
+}
+
+bool PersistentL3Book::getBidDepth(L2Side& out) const {
+    out.clear();
+    bool isComplete = true;
+    bids.forEach([&](Price price, const LevelPtr& level) { return isComplete = out.push(price, level->quantity); });
+    return isComplete;
+}
+
+bool PersistentL3Book::getAskDepth(L2Side& out) const {
+    out.clear();
+    bool isComplete = true;
+    asks.forEach([&](Price price, const LevelPtr& level) { return isComplete = out.push(price, level->quantity); });
+    return isComplete;
+}
+
+void PersistentL3Book::toL3Book(L3Book& out) const {
+    out.clear();
+    auto addSide = [&out](Price, const PersistentLevel& level) {
+        for (const Order& order : level.orders) {
+            out.addOrder(order.orderId, order.isSell, order.size, order.price);
+        }
+        return true;
+    };
+    forEachBid(addSide);
+    forEachAsk(addSide);
+}
\ No newline at end of file
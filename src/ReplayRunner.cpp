@@ -0,0 +1,154 @@
+#include "ReplayRunner.hpp"
+#include "BookArena.hpp"
+#include "Logger.hpp"
+#include "MarketDataIngestor.hpp"
+#include "WorkStealingPool.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <sstream>
+
+// Counts what a task's arena handed out, for the stats
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream) : upstream(upstream) {}
+    size_t bytes = 0;
+
+private:
+    std::pmr::memory_resource* upstream;
+
+    void* do_allocate(size_t size, size_t alignment) override {
+        bytes += size;
+        return upstream->allocate(size, alignment);
+    }
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        upstream->deallocate(p, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+ReplayRunner::ReplayRunner(size_t numThreads, const std::string& outputDir)
+    : numThreads(numThreads), outputDir(outputDir) {}
+
+bool ReplayRunner::loadManifest(const std::string& file, std::vector<ReplayTask>& tasks) {
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "Failed to open manifest " << file << "\n";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        ReplayTask task;
+        if (!(ss >> task.name >> task.l2File >> task.l3File >> task.tradeFile)) {
+            std::cerr << "Skipping malformed manifest line: " << line << "\n";
+            continue;
+        }
+        tasks.push_back(task);
+    }
+    return true;
+}
+
+ReplayStats ReplayRunner::runTask(const ReplayTask& task) const {
+    ReplayStats stats;
+    stats.name = task.name;
+    auto start = std::chrono::steady_clock::now();
+
+    std::ofstream log(outputDir + "/" + task.name + ".log");
+    setLogStream(&log);
+    // the thread must not keep writing to log once it is gone, even if the task throws
+    struct LogReset {
+        ~LogReset() { setLogStream(nullptr); }
+    } logReset;
+
+    {
+        // all of the task's loaded events live in its own arena, released in one go;
+        // its blocks come straight from the heap, never from the default resource
+        std::pmr::monotonic_buffer_resource arena(1 << 20, std::pmr::new_delete_resource());
+        CountingResource counted(&arena);
+        // its books get their own, declared before them so it outlives them
+        BookArena bookArena;
+
+        L2Book l2Book;
+        L3Book l3Book(bookArena.resource());
+        TradeContainer trades(10000, bookArena.resource());
+        OrderBook orderBook(l2Book, l3Book, trades, 0.3, bookArena.resource());
+        // tasks run side by side, each reports under its own name
+        orderBook.setMetrics(MetricsRegistry::global(), task.name + ".");
+        MarketDataIngestor ingestor(orderBook, 1, &counted);
+
+        ingestor.loadEvents(task.l2File, task.l3File, task.tradeFile);
+        ingestor.processEvents();
+
+        stats.ok = ingestor.files.size() == 3;
+        stats.events = ingestor.events.size();
+        for (const auto& e : ingestor.events) {
+            if (e.type == EventType::L2_SNAPSHOT) stats.l2Snapshots++;
+            else if (e.type == EventType::L3_UPDATE) stats.l3Updates++;
+            else stats.trades++;
+        }
+        stats.parseErrors = ingestor.getParseErrors();
+        stats.l3Orders = l3Book.getTotalOrders();
+        stats.smartOrders = orderBook.getSmartOrderBook().getTotalOrders();
+        stats.openGuesses = orderBook.getGuesses().size();
+        stats.arenaBytes = counted.bytes;
+        stats.bookArenaBytes = bookArena.getUsedBytes();
+    }
+
+    stats.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    writeStats(stats, outputDir + "/" + task.name + ".stats");
+    return stats;
+}
+
+std::vector<ReplayStats> ReplayRunner::run(const std::vector<ReplayTask>& tasks) {
+    std::filesystem::create_directories(outputDir);
+    std::vector<ReplayStats> results(tasks.size());
+
+    {
+        WorkStealingPool pool(numThreads);
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            pool.submit([this, &tasks, &results, i]() {
+                try {
+                    results[i] = runTask(tasks[i]);
+                } catch (const std::exception& e) {
+                    setLogStream(nullptr);
+                    std::cerr << "Replay " << tasks[i].name << " failed: " << e.what() << "\n";
+                    results[i].name = tasks[i].name;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    std::ofstream summary(outputDir + "/summary.csv");
+    summary << "name,ok,events,l2_snapshots,l3_updates,trades,parse_errors,l3_orders,smart_orders,open_guesses,arena_bytes,elapsed_ms\n";
+    for (const auto& s : results) {
+        summary << s.name << "," << s.ok << "," << s.events << "," << s.l2Snapshots << "," << s.l3Updates << ","
+            << s.trades << "," << s.parseErrors << "," << s.l3Orders << "," << s.smartOrders << ","
+            << s.openGuesses << "," << s.arenaBytes << "," << s.elapsedMs << "\n";
+    }
+    return results;
+}
+
+void ReplayRunner::writeStats(const ReplayStats& stats, const std::string& file) {
+    std::ofstream out(file);
+    out << "name=" << stats.name << "\n"
+        << "ok=" << stats.ok << "\n"
+        << "events=" << stats.events << "\n"
+        << "l2_snapshots=" << stats.l2Snapshots << "\n"
+        << "l3_updates=" << stats.l3Updates << "\n"
+        << "trades=" << stats.trades << "\n"
+        << "parse_errors=" << stats.parseErrors << "\n"
+        << "l3_orders=" << stats.l3Orders << "\n"
+        << "smart_orders=" << stats.smartOrders << "\n"
+        << "open_guesses=" << stats.openGuesses << "\n"
+        << "arena_bytes=" << stats.arenaBytes << "\n"
+        << "book_arena_bytes=" << stats.bookArenaBytes << "\n"
+        << "elapsed_ms=" << stats.elapsedMs << "\n";
+}
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "ShmBook.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t SHM_MAGIC = 0x3130424d48534253ULL;     // "SBSHMB01"
+
+static std::string shmPath(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static size_t regionSize(uint64_t ringCapacity) {
+    return sizeof(ShmHeader) + ringCapacity * sizeof(ShmActionSlot);
+}
+
+static ShmActionSlot* ringOf(void* base) {
+    return reinterpret_cast<ShmActionSlot*>(static_cast<char*>(base) + sizeof(ShmHeader));
+}
+
+ShmBookPublisher::~ShmBookPublisher() {
+    close();
+}
+
+bool ShmBookPublisher::create(const std::string& regionName, size_t ringCapacity) {
+    close();
+    name = shmPath(regionName);
+
+    uint64_t capacity = 1;
+    while (capacity < ringCapacity) capacity <<= 1;
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "Failed to create shared memory " << name << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    mappedSize = regionSize(capacity);
+    if (ftruncate(fd, static_cast<off_t>(mappedSize)) != 0) {
+        std::cerr << "Failed to size shared memory " << name << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    base = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << name << ": " << std::strerror(errno) << "\n";
+        base = nullptr;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // the mapping starts zeroed, which is the empty state of every field
+    header = new (base) ShmHeader();
+    header->ringCapacity = capacity;
+    ring = ringOf(base);
+    for (uint64_t i = 0; i < capacity; ++i) {
+        new (&ring[i]) ShmActionSlot();
+    }
+    mask = capacity - 1;
+    header->magic.store(SHM_MAGIC, std::memory_order_release);
+    return true;
+}
+
+void ShmBookPublisher::close() {
+    if (base) {
+        munmap(base, mappedSize);
+        shm_unlink(name.c_str());
+    }
+    base = nullptr;
+    header = nullptr;
+    ring = nullptr;
+    mappedSize = 0;
+}
+
+void ShmBookPublisher::publishBook(const L3Book& book, uint64_t version, Timestamp timestamp) {
+    if (!header) {
+        return;
+    }
+
+    uint64_t seqlock = header->bookSeqlock.load(std::memory_order_relaxed);
+    header->bookSeqlock.store(seqlock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    BookImage& image = header->book;
+    image.version = version;
+    image.timestamp = timestamp;
+    image.bidCount = 0;
+    for (const auto& [price, level] : book.getBids()) {
+        if (image.bidCount == SHM_BOOK_LEVELS) break;
+        image.bids[image.bidCount++] = {price, level.quantity, level.numOrders};
+    }
+    image.askCount = 0;
+    for (const auto& [price, level] : book.getAsks()) {
+        if (image.askCount == SHM_BOOK_LEVELS) break;
+        image.asks[image.askCount++] = {price, level.quantity, level.numOrders};
+    }
+
+    header->bookSeqlock.store(seqlock + 2, std::memory_order_release);
+}
+
+void ShmBookPublisher::publishAction(const OrderInfo& info) {
+    if (!header) {
+        return;
+    }
+
+    uint64_t sequence = header->writeCursor.load(std::memory_order_relaxed);
+    ShmActionSlot& slot = ring[sequence & mask];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    BookAction& action = slot.action;
+    action.sequence = sequence;
+    action.timestamp = info.timestamp;
+    action.price = info.price;
+    action.orderId = info.orderId;
+    action.size = info.size;
+    action.action = info.action.empty() ? '?' : info.action[0];
+    action.isSell = info.isSell;
+    action.isGuess = info.isGuess;
+
+    slot.sequence.store(sequence + 1, std::memory_order_release);
+    header->writeCursor.store(sequence + 1, std::memory_order_release);
+}
+
+void ShmBookPublisher::attach(OrderBook& orderBook, Callbacks callbacks) {
+    auto chain = [this](OrderBookCallback next) {
+        return [this, next](const OrderBook& book, const OrderInfo& info) {
+            publishAction(info);
+            if (next) next(book, info);
+        };
+    };
+    callbacks.onOrderAdd = chain(callbacks.onOrderAdd);
+    callbacks.onOrderCancel = chain(callbacks.onOrderCancel);
+    callbacks.onOrderModify = chain(callbacks.onOrderModify);
+    callbacks.onOrderExecution = chain(callbacks.onOrderExecution);
+
+    // the depth feed fires once per event that changed a level
+    DepthUpdateCallback next = callbacks.onDepthUpdate;
+    callbacks.onDepthUpdate = [this, &orderBook, next](const DepthUpdate& update) {
+        publishBook(orderBook.getSmartOrderBook(), update.sequence, update.timestamp);
+        if (next) next(update);
+    };
+    orderBook.setCallbacks(callbacks);
+}
+
+uint64_t ShmBookPublisher::getPublishedActions() const {
+    return header ? header->writeCursor.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t ShmBookPublisher::getMaxReaderLag() const {
+    if (!header) {
+        return 0;
+    }
+    uint64_t write = header->writeCursor.load(std::memory_order_relaxed);
+    uint64_t lag = 0;
+    for (const auto& reader : header->readers) {
+        if (reader.active.load(std::memory_order_acquire)) {
+            uint64_t cursor = reader.cursor.load(std::memory_order_relaxed);
+            lag = std::max(lag, write > cursor ? write - cursor : 0);
+        }
+    }
+    return lag;
+}
+
+ShmBookReader::~ShmBookReader() {
+    close();
+}
+
+bool ShmBookReader::open(const std::string& regionName, bool fromLatest) {
+    close();
+    std::string name = shmPath(regionName);
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmHeader)) {
+        ::close(fd);
+        return false;
+    }
+    mappedSize = static_cast<size_t>(st.st_size);
+    base = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        return false;
+    }
+
+    ShmHeader* shared = static_cast<ShmHeader*>(base);
+    if (shared->magic.load(std::memory_order_acquire) != SHM_MAGIC
+        || regionSize(shared->ringCapacity) > mappedSize) {
+        std::cerr << "Shared memory " << name << " is not a published book\n";
+        close();
+        return false;
+    }
+    header = shared;
+    ring = ringOf(base);
+    mask = header->ringCapacity - 1;
+
+    uint64_t write = header->writeCursor.load(std::memory_order_acquire);
+    if (fromLatest) {
+        cursor = write;
+    } else {
+        cursor = write > header->ringCapacity ? write - header->ringCapacity : 0;
+    }
+
+    for (auto& candidate : shared->readers) {
+        uint32_t expected = 0;
+        if (candidate.active.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+            candidate.cursor.store(cursor, std::memory_order_relaxed);
+            slot = &candidate;
+            break;
+        }
+    }
+    return true;
+}
+
+void ShmBookReader::close() {
+    if (slot) {
+        slot->active.store(0, std::memory_order_release);
+        slot = nullptr;
+    }
+    if (base) {
+        munmap(base, mappedSize);
+    }
+    base = nullptr;
+    header = nullptr;
+    ring = nullptr;
+    mappedSize = 0;
+    cursor = 0;
+    overruns = 0;
+}
+
+bool ShmBookReader::readBook(BookImage& out) const {
+    if (!header) {
+        return false;
+    }
+    while (true) {
+        uint64_t before = header->bookSeqlock.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        std::memcpy(&out, &header->book, sizeof(BookImage));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->bookSeqlock.load(std::memory_order_relaxed) == before) {
+            return before != 0;
+        }
+    }
+}
+
+bool ShmBookReader::nextAction(BookAction& out) {
+    if (!header) {
+        return false;
+    }
+    while (true) {
+        uint64_t write = header->writeCursor.load(std::memory_order_acquire);
+        if (cursor >= write) {
+            return false;
+        }
+        if (write - cursor > header->ringCapacity) {
+            overruns += write - header->ringCapacity - cursor;
+            cursor = write - header->ringCapacity;
+        }
+
+        ShmActionSlot& entry = ring[cursor & mask];
+        uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+        if (sequence == cursor + 1) {
+            std::memcpy(&out, &entry.action, sizeof(BookAction));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.sequence.load(std::memory_order_relaxed) == sequence) {
+                cursor++;
+                if (slot) slot->cursor.store(cursor, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        // the writer lapped this slot while we got to it
+        overruns++;
+        cursor++;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "SignalEngine.hpp"
+#include "L3Book.hpp"
+#include <algorithm>
+#include <cstring>
+
+SignalEngine::SignalEngine(int depth) : depth(std::clamp(depth, 1, MAX_SIGNAL_LEVELS)) {}
+
+template<typename BookSide>
+bool SignalEngine::updateSide(Side& side, const BookSide& bookSide, const L3PriceLevel& level) {
+    auto better = bookSide.key_comp();
+    Price price = level.price;
+    // while the side is short of depth every level of the book is mirrored
+    bool full = side.count == depth;
+    if (full && better(side.levels[side.count - 1].price, price)) {
+        return false;
+    }
+
+    int i = 0;
+    while (i < side.count && better(side.levels[i].price, price)) ++i;
+    bool found = i < side.count && side.levels[i].price == price;
+    TopLevel* levels = side.levels.data();
+    if (level.numOrders == 0) {
+        if (!found) {
+            return false;
+        }
+        Price last = levels[side.count - 1].price;
+        std::copy(levels + i + 1, levels + side.count, levels + i);
+        side.count--;
+        if (full) {
+            // the next level of the book moves up, the removed one is still in it but better than last
+            auto next = bookSide.upper_bound(last);
+            if (next != bookSide.end()) {
+                levels[side.count++] = {next->first, next->second.quantity, next->second.numOrders};
+            }
+        }
+    } else if (found) {
+        levels[i].quantity = level.quantity;
+        levels[i].numOrders = level.numOrders;
+    } else {
+        // a new level, the last one drops out if the side is full
+        if (full) side.count--;
+        std::copy_backward(levels + i, levels + side.count, levels + side.count + 1);
+        levels[i] = {price, level.quantity, level.numOrders};
+        side.count++;
+    }
+
+    // at most depth levels, summed afresh so the averages never drift
+    side.quantity = 0;
+    side.numOrders = 0;
+    side.notional = 0.0;
+    for (int j = 0; j < side.count; ++j) {
+        side.quantity += levels[j].quantity;
+        side.numOrders += levels[j].numOrders;
+        side.notional += levels[j].price * levels[j].quantity;
+    }
+    return true;
+}
+
+void SignalEngine::onLevelChange(const L3Book& book, bool isSell, const L3PriceLevel& level) {
+    bool changed = isSell ? updateSide(asks, book.getAsks(), level) : updateSide(bids, book.getBids(), level);
+    if (changed) {
+        computeSignals();
+        publish();
+    }
+}
+
+void SignalEngine::computeSignals() {
+    signals.version++;
+    signals.bidLevels = bids.count;
+    signals.askLevels = asks.count;
+    signals.bidDepth = bids.quantity;
+    signals.askDepth = asks.quantity;
+    signals.bidOrders = bids.numOrders;
+    signals.askOrders = asks.numOrders;
+    signals.bestBid = bids.count > 0 ? bids.levels[0].price : 0.0;
+    signals.bestAsk = asks.count > 0 ? asks.levels[0].price : 0.0;
+
+    Quantity totalDepth = bids.quantity + asks.quantity;
+    int totalOrders = bids.numOrders + asks.numOrders;
+    signals.imbalance = totalDepth > 0 ? static_cast<double>(bids.quantity - asks.quantity) / totalDepth : 0.0;
+    signals.orderImbalance = totalOrders > 0 ? static_cast<double>(bids.numOrders - asks.numOrders) / totalOrders : 0.0;
+
+    if (bids.count == 0 || asks.count == 0) {
+        signals.spread = 0.0;
+        signals.mid = 0.0;
+        signals.microprice = 0.0;
+        signals.weightedMid = 0.0;
+        return;
+    }
+    const TopLevel& bid = bids.levels[0];
+    const TopLevel& ask = asks.levels[0];
+    signals.spread = ask.price - bid.price;
+    signals.mid = (bid.price + ask.price) / 2;
+    Quantity topDepth = bid.quantity + ask.quantity;
+    signals.microprice = topDepth > 0 ? (bid.price * ask.quantity + ask.price * bid.quantity) / topDepth : signals.mid;
+    if (bids.quantity > 0 && asks.quantity > 0) {
+        double bidAverage = bids.notional / bids.quantity;
+        double askAverage = asks.notional / asks.quantity;
+        signals.weightedMid = (bidAverage * asks.quantity + askAverage * bids.quantity) / totalDepth;
+    } else {
+        signals.weightedMid = signals.mid;
+    }
+}
+
+void SignalEngine::publish() {
+    uint64_t sequence = seqlock.load(std::memory_order_relaxed);
+    seqlock.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    published = signals;
+    seqlock.store(sequence + 2, std::memory_order_release);
+}
+
+BookSignals SignalEngine::read() const {
+    BookSignals out;
+    while (true) {
+        uint64_t before = seqlock.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        std::memcpy(&out, &published, sizeof(BookSignals));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seqlock.load(std::memory_order_relaxed) == before) {
+            return out;
+        }
+    }
+}
+
+void SignalEngine::rebuild(const L3Book& book) {
+    auto fill = [this](Side& side, const auto& bookSide) {
+        side = Side();
+        for (const auto& [price, level] : bookSide) {
+            if (side.count == depth) break;
+            side.levels[side.count++] = {price, level.quantity, level.numOrders};
+            side.quantity += level.quantity;
+            side.numOrders += level.numOrders;
+            side.notional += price * level.quantity;
+        }
+    };
+    fill(bids, book.getBids());
+    fill(asks, book.getAsks());
+    computeSignals();
+    publish();
+}
+
+void SignalEngine::reset() {
+    bids = Side();
+    asks = Side();
+    computeSignals();
+    publish();
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "ThreadConfig.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+// from <numaif.h>, so libnuma is not needed
+static const int MPOL_BIND_MODE = 2;
+static const size_t NODE_MASK_WORDS = 16;      // 1024 nodes
+
+const char* waitPolicyName(WaitPolicy policy) {
+    switch (policy) {
+        case WaitPolicy::BLOCK: return "block";
+        case WaitPolicy::BUSY_SPIN: return "spin";
+        case WaitPolicy::BACKOFF: return "backoff";
+    }
+    return "unknown";
+}
+
+bool parseWaitPolicy(const char* name, WaitPolicy& policy) {
+    for (WaitPolicy candidate : {WaitPolicy::BLOCK, WaitPolicy::BUSY_SPIN, WaitPolicy::BACKOFF}) {
+        if (std::strcmp(name, waitPolicyName(candidate)) == 0) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool pinCurrentThread(int cpu) {
+    if (cpu < 0) {
+        return true;
+    }
+    if (cpu >= CPU_SETSIZE) {
+        std::cerr << "Cannot pin thread to cpu " << cpu << ": out of range\n";
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        std::cerr << "Cannot pin thread to cpu " << cpu << ": " << std::strerror(error) << "\n";
+        return false;
+    }
+    return true;
+}
+
+int cpuNode(int cpu) {
+    if (cpu < 0) {
+        return -1;
+    }
+    // the cpu's sysfs directory links to its node as nodeN
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return -1;
+    }
+    int node = -1;
+    while (dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (std::strncmp(name, "node", 4) == 0 && name[4] >= '0' && name[4] <= '9') {
+            node = std::atoi(name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int currentNode() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return -1;
+    }
+    return static_cast<int>(node);
+}
+
+bool bindToNode(void* addr, size_t bytes, int node) {
+    if (node < 0) {
+        return true;
+    }
+    if (static_cast<size_t>(node) >= NODE_MASK_WORDS * 64) {
+        std::cerr << "Cannot bind memory to NUMA node " << node << ": out of range\n";
+        return false;
+    }
+    unsigned long mask[NODE_MASK_WORDS] = {};
+    mask[node / 64] = 1UL << (node % 64);
+    if (syscall(SYS_mbind, addr, bytes, MPOL_BIND_MODE, mask, NODE_MASK_WORDS * 64, 0) != 0) {
+        std::cerr << "Cannot bind memory to NUMA node " << node << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+void Backoff::pause() {
+    if (policy == WaitPolicy::BUSY_SPIN) {
+        cpuRelax();
+        return;
+    }
+    if (policy == WaitPolicy::BACKOFF && idle < SPINS) {
+        cpuRelax();
+    } else if (policy == WaitPolicy::BACKOFF && idle < SPINS + YIELDS) {
+        std::this_thread::yield();
+    } else {
+        // 1 us doubling up to MAX_SLEEP_US
+        uint32_t sleeps = policy == WaitPolicy::BACKOFF ? idle - SPINS - YIELDS : idle;
+        uint32_t us = std::min<uint32_t>(MAX_SLEEP_US, 1u << std::min<uint32_t>(sleeps, 10));
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+    if (idle < UINT32_MAX) idle++;
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(size_t numThreads, const std::vector<int>& cpus, WaitPolicy wait) : wait(wait) {
+    if (numThreads == 0) {
+        numThreads = 1;
+    }
+    workers.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        workers.emplace_back([this, cpu]() {
+            pinCurrentThread(cpu);
+            if (this->wait == WaitPolicy::BLOCK) {
+                workerLoop();
+            } else {
+                pollLoop();
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::pollLoop() {
+    Backoff backoff(wait);
+    while (true) {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop();
+            } else if (stopping) {
+                return;
+            }
+        }
+        if (task) {
+            task();
+            backoff.reset();
+        } else {
+            backoff.pause();
+        }
+    }
+}
\ No newline at end of file
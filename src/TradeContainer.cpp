@@ -1,5 +1,26 @@
 #include "TradeContainer.hpp"
+#include <istream>
+#include <ostream>
 
 void TradeContainer::addTrade(const TradeInfo& trade) {
     trades.push_back(trade);
 }
+
+void TradeContainer::save(std::ostream& out) const {
+    out << trades.size() << "\n";
+    for (const auto& trade : trades) {
+        out << trade.price << " " << trade.quantity << " " << trade.timestamp << "\n";
+    }
+}
+
+bool TradeContainer::load(std::istream& in) {
+    trades.clear();
+    size_t count = 0;
+    if (!(in >> count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        TradeInfo trade{};
+        if (!(in >> trade.price >> trade.quantity >> trade.timestamp)) return false;
+        trades.push_back(trade);
+    }
+    return true;
+}
@@ -0,0 +1,313 @@
+#include "UdpFeed.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <thread>
+#include <unistd.h>
+
+static uint64_t toNanos(const timespec& ts) {
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t realtimeNanos() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return toNanos(now);
+}
+
+static bool makeAddress(const std::string& address, uint16_t port, sockaddr_in& out) {
+    std::memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = htons(port);
+    return inet_pton(AF_INET, address.c_str(), &out.sin_addr) == 1;
+}
+
+UdpFeedReceiver::UdpFeedReceiver(OrderBook& orderBook, size_t maxLatencySamples)
+    : orderBook(orderBook), maxLatencySamples(maxLatencySamples) {
+    latencies.reserve(maxLatencySamples);
+}
+
+UdpFeedReceiver::~UdpFeedReceiver() {
+    close();
+}
+
+bool UdpFeedReceiver::open(const UdpReceiverConfig& receiverConfig) {
+    close();
+    config = receiverConfig;
+    config.batchSize = std::max<size_t>(config.batchSize, 1);
+
+    sockaddr_in addr;
+    if (!makeAddress(config.address, config.port, addr)) {
+        std::cerr << "Invalid receive address " << config.address << "\n";
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create UDP socket: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config.socketBufferBytes, sizeof(config.socketBufferBytes));
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) {
+        std::cerr << "SO_TIMESTAMPNS unavailable, latency measured from user space\n";
+    }
+
+    if (config.wait != WaitPolicy::BLOCK) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_BUSY_POLL
+        // best effort, needs CAP_NET_ADMIN on most kernels
+        int busyPollUs = 50;
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUs, sizeof(busyPollUs));
+#endif
+    } else {
+        timeval timeout{config.timeoutMs / 1000, (config.timeoutMs % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Failed to bind " << config.address << ":" << config.port << ": "
+            << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    // one buffer, iovec and control block per datagram of a batch
+    controlSize = CMSG_SPACE(sizeof(timespec));
+    buffers.assign(config.batchSize * config.bufferSize, 0);
+    controls.assign(config.batchSize * controlSize, 0);
+    iovecs.resize(config.batchSize);
+    messages.resize(config.batchSize);
+    for (size_t i = 0; i < config.batchSize; ++i) {
+        iovecs[i].iov_base = buffers.data() + i * config.bufferSize;
+        iovecs[i].iov_len = config.bufferSize;
+        std::memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_control = controls.data() + i * controlSize;
+    }
+
+    mold.reset();
+    stats = UdpReceiverStats();
+    latencies.clear();
+    return true;
+}
+
+void UdpFeedReceiver::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+uint16_t UdpFeedReceiver::getPort() const {
+    sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    if (fd < 0 || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+void UdpFeedReceiver::applyEvent(const MarketEvent& event) {
+    if (event.type == EventType::L3_UPDATE) {
+        orderBook.processL3Update(event.l3Update);
+    } else if (event.type == EventType::TRADE_EXECUTION) {
+        orderBook.processTrade(event.trade);
+    }
+}
+
+size_t UdpFeedReceiver::poll() {
+    if (fd < 0) {
+        return 0;
+    }
+
+    for (auto& message : messages) {
+        message.msg_hdr.msg_controllen = controlSize;
+        message.msg_hdr.msg_flags = 0;
+    }
+
+    int flags = config.wait != WaitPolicy::BLOCK ? MSG_DONTWAIT : MSG_WAITFORONE;
+    int received = recvmmsg(fd, messages.data(), messages.size(), flags, nullptr);
+    stats.syscalls++;
+    if (received <= 0) {
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            std::cerr << "recvmmsg failed: " << std::strerror(errno) << "\n";
+        }
+        stats.emptyPolls++;
+        return 0;
+    }
+
+    uint64_t fallbackTime = realtimeNanos();
+    size_t applied = 0;
+    for (int i = 0; i < received; ++i) {
+        msghdr& header = messages[i].msg_hdr;
+        stats.datagrams++;
+        if (header.msg_flags & MSG_TRUNC) {
+            stats.truncated++;
+            continue;
+        }
+
+        uint64_t receiveTime = fallbackTime;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec ts;
+                std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                receiveTime = toNanos(ts);
+            }
+        }
+
+        const char* data = static_cast<const char*>(iovecs[i].iov_base);
+        if (!mold.beginDatagram(data, messages[i].msg_len)) {
+            continue;
+        }
+        MarketEvent event;
+        if (config.batchApply) {
+            batch.clear();
+            while (mold.next(event)) {
+                batch.push_back(event);
+            }
+            orderBook.processBatch(batch.data(), batch.size());
+            applied += batch.size();
+            uint64_t now = realtimeNanos();
+            for (size_t k = 0; k < batch.size() && latencies.size() < maxLatencySamples; ++k) {
+                latencies.push_back(now > receiveTime ? now - receiveTime : 0);
+            }
+            continue;
+        }
+        while (mold.next(event)) {
+            applyEvent(event);
+            applied++;
+            if (latencies.size() < maxLatencySamples) {
+                uint64_t now = realtimeNanos();
+                latencies.push_back(now > receiveTime ? now - receiveTime : 0);
+            }
+        }
+    }
+    stats.events += applied;
+    return applied;
+}
+
+size_t UdpFeedReceiver::run(const std::atomic<bool>& stop, size_t maxEvents) {
+    pinCurrentThread(config.cpu);
+    Backoff backoff(config.wait);
+    size_t applied = 0;
+    while (!stop.load(std::memory_order_relaxed) && (maxEvents == 0 || applied < maxEvents)) {
+        size_t events = poll();
+        if (events > 0) {
+            applied += events;
+            backoff.reset();
+        } else if (config.wait != WaitPolicy::BLOCK) {
+            backoff.pause();
+        }
+    }
+    return applied;
+}
+
+uint64_t UdpFeedReceiver::getLatencyPercentile(double p) const {
+    if (latencies.empty()) {
+        return 0;
+    }
+    std::vector<uint64_t> sorted(latencies);
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+bool UdpFeedReplayer::replay(const std::string& feedFile) {
+    BinaryFeedReader reader;
+    if (!reader.open(feedFile)) {
+        std::cerr << "Failed to open " << feedFile << "\n";
+        return false;
+    }
+    ParsedChunk chunk;
+    reader.readAll(chunk);
+
+    sockaddr_in addr;
+    if (!makeAddress(config.address, config.port, addr)) {
+        std::cerr << "Invalid replay address " << config.address << "\n";
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create UDP socket: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    // pre-build every datagram, sequence numbers start at 1
+    size_t perDatagram = std::max<size_t>(config.messagesPerDatagram, 1);
+    std::vector<std::string> datagrams;
+    std::vector<size_t> firstMessage;
+    uint64_t sequence = 1;
+    for (size_t i = 0; i < chunk.events.size(); i += perDatagram) {
+        std::string datagram(MOLD_HEADER_SIZE, '\0');
+        uint16_t count = 0;
+        for (size_t j = i; j < chunk.events.size() && count < perDatagram; ++j, ++count) {
+            char message[32];
+            size_t length = encodeBinaryMessage(chunk.events[j], message);
+            uint16_t prefix = htons(static_cast<uint16_t>(length));
+            datagram.append(reinterpret_cast<const char*>(&prefix), sizeof(prefix));
+            datagram.append(message, length);
+        }
+        encodeMoldHeader(&datagram[0], sequence, count);
+        sequence += count;
+        datagrams.push_back(std::move(datagram));
+        firstMessage.push_back(i);
+    }
+
+    size_t batchSize = std::max<size_t>(config.batchSize, 1);
+    std::vector<iovec> iovecs(batchSize);
+    std::vector<mmsghdr> batch(batchSize);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    size_t next = 0;
+    while (next < datagrams.size()) {
+        // datagrams whose first message is due at the configured rate
+        size_t due = datagrams.size();
+        if (config.messagesPerSecond > 0) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            size_t dueMessages = static_cast<size_t>(elapsed * config.messagesPerSecond);
+            due = std::upper_bound(firstMessage.begin(), firstMessage.end(), dueMessages) - firstMessage.begin();
+            if (due <= next) {
+                std::this_thread::yield();
+                continue;
+            }
+        }
+
+        size_t count = std::min(batchSize, due - next);
+        for (size_t i = 0; i < count; ++i) {
+            std::string& datagram = datagrams[next + i];
+            iovecs[i].iov_base = &datagram[0];
+            iovecs[i].iov_len = datagram.size();
+            std::memset(&batch[i], 0, sizeof(mmsghdr));
+            batch[i].msg_hdr.msg_name = &addr;
+            batch[i].msg_hdr.msg_namelen = sizeof(addr);
+            batch[i].msg_hdr.msg_iov = &iovecs[i];
+            batch[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(fd, batch.data(), count, 0);
+        if (sent < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) continue;
+            std::cerr << "sendmmsg failed: " << std::strerror(errno) << "\n";
+            ok = false;
+            break;
+        }
+        for (int i = 0; i < sent; ++i) {
+            size_t last = next + i + 1 < firstMessage.size() ? firstMessage[next + i + 1] : chunk.events.size();
+            sentMessages += last - firstMessage[next + i];
+        }
+        sentDatagrams += sent;
+        next += sent;
+    }
+
+    ::close(fd);
+    return ok;
+}
\ No newline at end of file
@@ -1,14 +1,201 @@
+#include "BinaryFeed.hpp"
+#include "BookArena.hpp"
+#include "CaptureArchive.hpp"
+#include "LatencyTrace.hpp"
 #include "MarketDataIngestor.hpp"
+#include "Metrics.hpp"
 #include "OrderBook.hpp"
+#include "ReplayRunner.hpp"
+#include "ShmBook.hpp"
+#include "ThreadConfig.hpp"
+#include "UdpFeed.hpp"
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 
-int main() {
+// Replays every file triple in a manifest in parallel
+static int runBatch(const std::string& manifest, size_t threads, const std::string& outputDir) {
+    std::vector<ReplayTask> tasks;
+    if (!ReplayRunner::loadManifest(manifest, tasks)) {
+        return 1;
+    }
+
+    ReplayRunner runner(threads, outputDir);
+    auto results = runner.run(tasks);
+
+    size_t failed = 0;
+    for (const auto& stats : results) {
+        std::cout << stats.name << (stats.ok ? " ok " : " FAILED ") << stats.events << " events in "
+            << stats.elapsedMs << " ms\n";
+        if (!stats.ok) failed++;
+    }
+    std::cout << results.size() - failed << " / " << results.size() << " replays succeeded, output in "
+        << outputDir << "\n";
+    return failed == 0 ? 0 : 1;
+}
+
+// --convert <l2|l3|trades> <text file> <archive file> [ticks per unit]
+static int runConvert(int argc, char** argv) {
+    std::string feed = argv[2];
+    EventType type = feed == "l2" ? EventType::L2_SNAPSHOT
+                   : feed == "l3" ? EventType::L3_UPDATE
+                   : EventType::TRADE_EXECUTION;
+    int64_t priceScale = argc > 5 ? std::stoll(argv[5]) : 100;
+    if (!ArchiveWriter::convert(argv[3], type, argv[4], priceScale)) {
+        std::cerr << "Conversion failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+// --encode-binary <l3 text file> <trades text file> <feed file> [stream|pcap]
+static int runEncodeBinary(int argc, char** argv) {
+    BinaryFeedFormat format = argc > 5 && std::string(argv[5]) == "pcap" ? BinaryFeedFormat::PCAP
+                                                                        : BinaryFeedFormat::STREAM;
+    if (!BinaryFeedWriter::convert(argv[2], argv[3], argv[4], format)) {
+        std::cerr << "Encoding failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+// --loopback <binary feed file> [messages per second] [--reader-cpu N]
+// Sends the feed to a receiver on 127.0.0.1 and reports packet-to-book latency
+static int runLoopback(int argc, char** argv) {
+    ThreadConfig threadConfig;
+    double messagesPerSecond = 0;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--reader-cpu" && i + 1 < argc) threadConfig.readerCpu = std::stoi(argv[++i]);
+        else messagesPerSecond = std::stod(arg);
+    }
+
+    // the receive thread applies the events, the books live on its NUMA node
+    BookArenaConfig arenaConfig;
+    arenaConfig.prefault = true;
+    arenaConfig.lockMemory = true;
+    arenaConfig.numaNode = cpuNode(threadConfig.readerCpu);
+    BookArena arena(arenaConfig);
+    L2Book l2Book;
+    L3Book l3Book(arena.resource());
+    TradeContainer trades(10000, arena.resource());
+    OrderBook book(l2Book, l3Book, trades, 0.3, arena.resource());
+    // the first packets should already see steady state latency
+    WarmupConfig warmup;
+    warmup.orders = 10000;
+    warmup.rounds = 5;
+    book.warmup(warmup);
+    UdpFeedReceiver receiver(book);
+    UdpReceiverConfig receiverConfig;
+    receiverConfig.cpu = threadConfig.readerCpu;
+    if (!receiver.open(receiverConfig)) {
+        return 1;
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread receiving([&]() {
+        std::ostringstream bookLog;
+        setLogStream(&bookLog);
+        receiver.run(stop);
+    });
+
+    UdpReplayConfig config;
+    config.port = receiver.getPort();
+    config.messagesPerSecond = messagesPerSecond;
+    UdpFeedReplayer replayer(config);
+    bool ok = replayer.replay(argv[2]);
+
+    // let the receiver drain what is still queued on the socket
+    size_t seen = receiver.getStats().events;
+    do {
+        seen = receiver.getStats().events;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    } while (receiver.getStats().events != seen);
+    stop = true;
+    receiving.join();
+
+    const auto& stats = receiver.getStats();
+    std::cout << "sent " << replayer.getSentMessages() << " messages in " << replayer.getSentDatagrams()
+        << " datagrams, received " << stats.events << " events in " << stats.datagrams << " datagrams ("
+        << stats.syscalls - stats.emptyPolls << " recvmmsg calls), missed " << receiver.getMissedMessages() << "\n";
+    std::cout << "packet to book latency ns: p50 " << receiver.getLatencyPercentile(0.5)
+        << " p99 " << receiver.getLatencyPercentile(0.99)
+        << " max " << receiver.getLatencyPercentile(1.0) << "\n";
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 5 && std::string(argv[1]) == "--convert") {
+        return runConvert(argc, argv);
+    }
+    if (argc >= 5 && std::string(argv[1]) == "--encode-binary") {
+        return runEncodeBinary(argc, argv);
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--loopback") {
+        return runLoopback(argc, argv);
+    }
+
+    std::string manifest;
+    std::string shmRegion;
+    std::string metricsFile;
+    std::string outputDir = "replay_output";
+    size_t threads = std::thread::hardware_concurrency();
+    ThreadConfig threadConfig;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--manifest") manifest = argv[i + 1];
+        else if (arg == "--out") outputDir = argv[i + 1];
+        else if (arg == "--threads") threads = std::stoul(argv[i + 1]);
+        else if (arg == "--publish") shmRegion = argv[i + 1];
+        else if (arg == "--latency") LatencyTracer::dumpAtExit(argv[i + 1]);
+        else if (arg == "--metrics") metricsFile = argv[i + 1];
+        else if (arg == "--book-cpu") threadConfig.bookCpu = std::stoi(argv[i + 1]);
+        else if (arg == "--publisher-cpu") threadConfig.publisherCpu = std::stoi(argv[i + 1]);
+        else if (arg == "--parser-cpus") {
+            // comma separated, one parse thread per cpu
+            std::stringstream cpus(argv[i + 1]);
+            std::string cpu;
+            while (std::getline(cpus, cpu, ',')) threadConfig.parserCpus.push_back(std::stoi(cpu));
+        } else if (arg == "--wait" && !parseWaitPolicy(argv[i + 1], threadConfig.wait)) {
+            std::cerr << "Unknown wait policy " << argv[i + 1] << ", expected block, spin or backoff\n";
+            return 1;
+        }
+    }
+    // flushed every second and once more on the way out
+    std::unique_ptr<MetricsFlusher> metrics;
+    if (!metricsFile.empty()) {
+        metrics = std::make_unique<MetricsFlusher>(MetricsRegistry::global(), metricsFile);
+        metrics->start(threadConfig.publisherCpu);
+    }
+    if (!manifest.empty()) {
+        return runBatch(manifest, threads, outputDir);
+    }
+
+    // the books live on the book thread's NUMA node
+    BookArenaConfig arenaConfig;
+    arenaConfig.numaNode = threadConfig.bookNode();
+    BookArena arena(arenaConfig);
     L2Book l2Book;
-    L3Book L3Book;
+    L3Book L3Book(arena.resource());
     L3Book.name = "L3Book";
-    TradeContainer trades;
-    OrderBook smartOrderBook(l2Book, L3Book, trades);
-    MarketDataIngestor ingestor(smartOrderBook);
+    TradeContainer trades(10000, arena.resource());
+    OrderBook smartOrderBook(l2Book, L3Book, trades, 0.3, arena.resource());
+    // the only book of the process, its metrics keep their plain names
+    smartOrderBook.setMetrics(MetricsRegistry::global());
+    ShmBookPublisher publisher;
+    if (!shmRegion.empty()) {
+        if (!publisher.create(shmRegion)) {
+            return 1;
+        }
+        publisher.attach(smartOrderBook);
+    }
+    MarketDataIngestor ingestor(smartOrderBook, std::max<size_t>(threadConfig.parserCpus.size(), 1));
+    ingestor.setThreadConfig(threadConfig);
     ingestor.loadEvents("../data/sample_L2.txt", "../data/sample_L3.txt", "../data/sample_trades.txt");
     ingestor.processEvents();
     std::cout << "Success" << std::endl;
@@ -1,8 +1,40 @@
 #include "OrderBook.hpp"
+#include "AllocationTracker.hpp"
+#include "AsyncFileReader.hpp"
+#include "BinaryFeed.hpp"
+#include "BookArena.hpp"
+#include "BookView.hpp"
+#include "CaptureArchive.hpp"
+#include "ConsolidatedBook.hpp"
+#include "DepthFeed.hpp"
+#include "Epoch.hpp"
+#include "FeedIndex.hpp"
+#include "LatencyTrace.hpp"
+#include "MarketDataIngestor.hpp"
+#include "Metrics.hpp"
+#include "PersistentBook.hpp"
+#include "ReplayRunner.hpp"
+#include "ShmBook.hpp"
+#include "SignalEngine.hpp"
+#include "ThreadConfig.hpp"
+#include "UdpFeed.hpp"
+#include "WorkStealingPool.hpp"
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <functional>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 class TestSuite {
 public:
@@ -10,7 +42,7 @@ public:
         tests.push_back({name, func});
     }
 
-    void run() {
+    bool run() {
         int passed = 0;
         for (const auto& t : tests) {
             try {
@@ -25,6 +57,7 @@ public:
             }
         }
         std::cout << passed << " / " << tests.size() << " tests passed.\n";
+        return passed == static_cast<int>(tests.size());
     }
 
 private:
@@ -332,13 +365,10 @@ void test_L2_leads_guess_modify_invalid() {
     ASSERT_EQ(ob.getSmartOrderBook().getTopBids(1).front().quantity, 300.0);
     ASSERT_EQ(ob.getGuesses().size(), 1);
 
-    // L3 Validates
+    // L3 validates
     ob.processL3Update("MODIFY 1 BUY 100.0 300", 4);
-    ASSERT_EQ(ob.getGuesses().size(), 1);
-
-    // Lagged trade invalidates guess
-    ob.processTrade("100.0 200", 6);
     ASSERT_EQ(ob.getGuesses().size(), 0);
+    ASSERT_EQ(ob.getSmartOrderBook().getTopBids(1).front().quantity, 300.0);
 
     // Bid cancelled
     ob.processL2Snapshot("BID ASK 101.0 500", 7);
@@ -389,6 +419,2600 @@ void test_L2_leads_added_qty_invalid() {
     ASSERT_EQ(ob.getGuesses().size(), 0);
 }
 
+void test_L2_snapshot_levels() {
+    L2Book l2;
+    l2.addBidLevel(100.0, 500);
+    l2.addBidLevel(99.0, 400);
+    l2.addBidLevel(99.5, 100);
+    l2.addBidLevel(100.0, 600);
+
+    ASSERT_EQ(l2.getBids().count, 3);
+    ASSERT_EQ(l2.getBids().prices[1], 99.5);
+    ASSERT_EQ(l2.getBestBid(), 100.0);
+    ASSERT_EQ(l2.getBidQuantityAtPrice(100.0), 600);
+    ASSERT_EQ(l2.getBidQuantityAtPrice(98.0), -1);
+
+    // next snapshot keeps the previous one for comparison
+    l2.clear();
+    l2.addBidLevel(100.0, 600);
+    l2.addBidLevel(99.5, 50);
+    l2.addBidLevel(99.0, 400);
+    ASSERT_EQ(l2.getChangedBidLevels(), 0b010ULL);
+    ASSERT_EQ(l2.getPreviousSnapshot().bids.quantities[1], 100);
+
+    // levels past the cap are counted, not logged
+    std::ostringstream errors;
+    std::streambuf* previous = std::cerr.rdbuf(errors.rdbuf());
+    l2.clear();
+    for (size_t i = 0; i < L2_MAX_LEVELS + 6; ++i) {
+        l2.addAskLevel(100.0 + i, 10);
+    }
+    std::cerr.rdbuf(previous);
+    ASSERT_TRUE(errors.str().empty());
+    ASSERT_EQ(l2.getAsks().count, L2_MAX_LEVELS);
+    ASSERT_EQ(l2.getSnapshot().truncatedLevels, 6u);
+    l2.clear();
+    l2.addBidLevel(100.0, 1);
+    ASSERT_EQ(l2.getSnapshot().truncatedLevels, 0u);
+    ASSERT_EQ(l2.getTruncatedLevels(), 6u);
+}
+
+void test_L2_diff_kernels() {
+    L2Side lhs, rhs;
+    for (int i = 0; i < 50; ++i) {
+        lhs.push(100.0 - i, 100 + i);
+        rhs.push(100.0 - i, 100 + i);
+    }
+    ASSERT_EQ(diffLevels(lhs, rhs), 0ULL);
+
+    rhs.quantities[3] = 1;
+    rhs.prices[17] = 1.0;
+    rhs.push(50.0, 10);
+    rhs.push(49.0, 10);
+    uint64_t expected = (1ULL << 3) | (1ULL << 17) | (1ULL << 50) | (1ULL << 51);
+    ASSERT_EQ(diffLevelsScalar(lhs, rhs), expected);
+    ASSERT_EQ(diffLevels(lhs, rhs), expected);
+    ASSERT_EQ(diffLevels(rhs, lhs), expected);
+#if defined(__x86_64__) || defined(__i386__)
+    ASSERT_EQ(diffLevelsSSE2(lhs, rhs), expected);
+#endif
+
+    for (int i = 52; i < 64; ++i) {
+        rhs.push(100.0 - i, 1);
+    }
+    lhs.clear();
+    ASSERT_EQ(diffLevels(lhs, rhs), ~0ULL);
+    std::cout << "diffLevels kernel: " << diffLevelsKernelName() << "\n";
+}
+
+void test_L2_unchanged_snapshot_no_guess() {
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades, 0);
+
+    ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+    ob.processL3Update("ADD 2 SELL 101.0 500", 2);
+
+    // L2 agrees with the SmartBook, nothing to guess
+    ob.processL2Snapshot("BID 100.0 500 ASK 101.0 500", 3);
+    ASSERT_EQ(ob.getGuesses().size(), 0);
+    ASSERT_EQ(ob.getSmartOrderBook().getTotalOrders(), 2);
+
+    // a snapshot deeper than L2_MAX_LEVELS keeps its top levels, and the
+    // SmartBook levels below them are not taken for removed ones
+    std::ostringstream log;
+    setLogStream(&log);
+    std::string deep = "BID 100.0 500";
+    for (size_t i = 1; i < L2_MAX_LEVELS + 6; ++i) {
+        ob.processL3Update("ADD " + std::to_string(100 + i) + " BUY " + std::to_string(100.0 - i) + " 10", 4);
+        deep += " " + std::to_string(100.0 - i) + " 10";
+    }
+    deep += " ASK 101.0 500";
+    ob.processL2Snapshot(deep, 5);
+    setLogStream(nullptr);
+    ASSERT_EQ(l2.getBids().count, L2_MAX_LEVELS);
+    ASSERT_EQ(l2.getTruncatedLevels(), 6u);
+    ASSERT_EQ(ob.getGuesses().size(), 0);
+    ASSERT_EQ(ob.getSmartOrderBook().getTotalOrders(), L2_MAX_LEVELS + 7);
+}
+
+void test_feed_parser_lines() {
+    std::string l2 = "1000 BID 100.0 500 99.0 400 ASK 101.0 500 102.25 400";
+    const char* p = l2.data();
+    const char* end = p + l2.size();
+    Timestamp ts;
+    L2Snapshot snapshot;
+    ASSERT_TRUE(parseTimestamp(p, end, ts) == ParseStatus::OK);
+    ASSERT_EQ(ts, 1000);
+    ASSERT_TRUE(parseL2Snapshot(p, end, snapshot) == ParseStatus::OK);
+    ASSERT_EQ(snapshot.bids.count, 2);
+    ASSERT_EQ(snapshot.asks.count, 2);
+    ASSERT_EQ(snapshot.bids.prices[1], 99.0);
+    ASSERT_EQ(snapshot.asks.prices[1], 102.25);
+    ASSERT_EQ(snapshot.asks.quantities[1], 400);
+    ASSERT_EQ(snapshot.truncatedLevels, 0u);
+
+    // levels past L2_MAX_LEVELS are dropped and counted, the line still parses
+    std::string deep = "BID";
+    for (size_t i = 0; i < L2_MAX_LEVELS + 3; ++i) deep += " " + std::to_string(100 - static_cast<int>(i)) + " 10";
+    deep += " ASK 101.0 5";
+    ASSERT_TRUE(parseL2Snapshot(deep.data(), deep.data() + deep.size(), snapshot) == ParseStatus::OK);
+    ASSERT_EQ(snapshot.bids.count, L2_MAX_LEVELS);
+    ASSERT_EQ(snapshot.bids.prices[L2_MAX_LEVELS - 1], 100.0 - (L2_MAX_LEVELS - 1));
+    ASSERT_EQ(snapshot.asks.count, 1);
+    ASSERT_EQ(snapshot.truncatedLevels, 3u);
+
+    std::string l3 = "MODIFY 10001 SELL 100.5 300";
+    L3Update update;
+    ASSERT_TRUE(parseL3Update(l3.data(), l3.data() + l3.size(), update) == ParseStatus::OK);
+    ASSERT_TRUE(update.action == L3Action::MODIFY);
+    ASSERT_EQ(update.orderId, 10001);
+    ASSERT_TRUE(update.isSell);
+    ASSERT_EQ(update.price, 100.5);
+    ASSERT_EQ(update.size, 300);
+
+    std::string cancel = "CANCEL 7\r";
+    ASSERT_TRUE(parseL3Update(cancel.data(), cancel.data() + cancel.size(), update) == ParseStatus::OK);
+    ASSERT_TRUE(update.action == L3Action::CANCEL);
+    ASSERT_EQ(update.orderId, 7);
+
+    std::string trade = "101.0 200";
+    TradeInfo info;
+    ASSERT_TRUE(parseTrade(trade.data(), trade.data() + trade.size(), info) == ParseStatus::OK);
+    ASSERT_EQ(info.price, 101.0);
+    ASSERT_EQ(info.quantity, 200);
+}
+
+void test_feed_parser_malformed() {
+    L3Update update;
+    TradeInfo trade;
+    L2Snapshot snapshot;
+    std::string badAction = "AMEND 1 BUY 100.0 10";
+    std::string badSide = "ADD 1 BID 100.0 10";
+    std::string badSize = "ADD 1 BUY 100.0 ten";
+    std::string badTrade = "101.0 200 x";
+    std::string badL2 = "BID 100.0 ASK";
+    ASSERT_TRUE(parseL3Update(badAction.data(), badAction.data() + badAction.size(), update) == ParseStatus::BAD_ACTION);
+    ASSERT_TRUE(parseL3Update(badSide.data(), badSide.data() + badSide.size(), update) == ParseStatus::BAD_SIDE);
+    ASSERT_TRUE(parseL3Update(badSize.data(), badSize.data() + badSize.size(), update) == ParseStatus::BAD_NUMBER);
+    ASSERT_TRUE(parseTrade(badTrade.data(), badTrade.data() + badTrade.size(), trade) == ParseStatus::TRAILING_DATA);
+    ASSERT_TRUE(parseL2Snapshot(badL2.data(), badL2.data() + badL2.size(), snapshot) == ParseStatus::BAD_NUMBER);
+
+    // malformed input is reported and leaves the books untouched
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    ob.processL3Update("ADD x BUY 100.0 10", 1);
+    ASSERT_TRUE(ob.getSmartOrderBook().empty());
+}
+
+void test_feed_parser_prices() {
+    const char* samples[] = {"100", "100.0", "99.75", "0.1", "1234.5678", "0.000001", "123456789.123456", "1e2", "-3.5"};
+    for (const char* sample : samples) {
+        const char* p = sample;
+        const char* end = sample + std::strlen(sample);
+        Price price;
+        ASSERT_TRUE(parsePrice(p, end, price));
+        ASSERT_TRUE(p == end);
+        ASSERT_EQ(price, std::strtod(sample, nullptr));
+    }
+
+    std::string text = "1000 ADD 1 BUY 100.0 5\n1001 CANCEL 1\n";
+    const char* lineEnd = findLineEnd(text.data(), text.data() + text.size());
+    ASSERT_EQ(lineEnd - text.data(), 22);
+}
+
+// ADD/CANCEL pairs keep the book small, one malformed line in the middle
+static std::string writeL3Capture(const std::string& path, int numOrders) {
+    std::ofstream out(path);
+    for (int i = 0; i < numOrders; ++i) {
+        out << 1000 + i << " ADD " << i + 1 << (i % 2 ? " SELL " : " BUY ") << (i % 2 ? 101.0 : 100.0) << " " << 10 + i << "\n";
+        if (i == numOrders / 2) out << 1000 + i << " ADD broken\n";
+        if (i >= 3) out << 1000 + i << " CANCEL " << i - 2 << "\n";
+    }
+    return path;
+}
+
+void test_parallel_chunked_load() {
+    std::string path = writeL3Capture("chunked_l3.txt", 300);
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+
+    MarketDataIngestor sequential(ob);
+    sequential.loadFile(path, EventType::L3_UPDATE);
+
+    MarketDataIngestor parallel(ob, 4);
+    parallel.setChunkSize(100);
+    parallel.loadFile(path, EventType::L3_UPDATE);
+
+    ASSERT_EQ(sequential.events.size(), 597);
+    ASSERT_EQ(parallel.events.size(), sequential.events.size());
+    ASSERT_EQ(parallel.getParseErrors(), 1);
+    for (size_t i = 0; i < sequential.events.size(); ++i) {
+        ASSERT_EQ(parallel.events[i].timestamp, sequential.events[i].timestamp);
+        ASSERT_EQ(parallel.events[i].l3Update.orderId, sequential.events[i].l3Update.orderId);
+        ASSERT_TRUE(parallel.events[i].l3Update.action == sequential.events[i].l3Update.action);
+    }
+}
+
+void test_parallel_replay_file() {
+    std::string path = writeL3Capture("replay_l3.txt", 200);
+
+    L2Book l2a;
+    L3Book l3a;
+    TradeContainer tradesA;
+    OrderBook sequentialBook(l2a, l3a, tradesA);
+    MarketDataIngestor sequential(sequentialBook);
+    ASSERT_TRUE(sequential.replayFile(path, EventType::L3_UPDATE));
+
+    L2Book l2b;
+    L3Book l3b;
+    TradeContainer tradesB;
+    OrderBook parallelBook(l2b, l3b, tradesB);
+    MarketDataIngestor parallel(parallelBook, 3);
+    parallel.setChunkSize(64);
+    ASSERT_TRUE(parallel.replayFile(path, EventType::L3_UPDATE));
+
+    // the last three orders survive, in the same order on both books
+    ASSERT_EQ(l3b.getTotalOrders(), 3);
+    ASSERT_EQ(parallelBook.getSmartOrderBook().getTotalOrders(), sequentialBook.getSmartOrderBook().getTotalOrders());
+    ASSERT_EQ(l3b.getTopAsks(1).front().orders.front().orderId, l3a.getTopAsks(1).front().orders.front().orderId);
+    ASSERT_EQ(parallel.getParseErrors(), 1);
+    ASSERT_TRUE(!parallel.replayFile("missing_file.txt", EventType::L3_UPDATE));
+}
+
+void test_work_stealing_pool() {
+    std::atomic<int> count{0};
+    {
+        WorkStealingPool pool(4);
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&pool, &count, i]() {
+                // tasks may spawn more work onto their own deque
+                if (i % 10 == 0) {
+                    for (int j = 0; j < 5; ++j) pool.submit([&count]() { count++; });
+                }
+                count++;
+            });
+        }
+        pool.wait();
+        ASSERT_EQ(count.load(), 150);
+    }
+}
+
+void test_batch_replay_runner() {
+    std::string data = SOB_DATA_DIR;
+    {
+        std::ofstream manifest("replay_manifest.txt");
+        manifest << "# name l2 l3 trades\n";
+        manifest << "day1 " << data << "/sample_L2.txt " << data << "/sample_L3.txt " << data << "/sample_trades.txt\n";
+        manifest << "day2 " << data << "/sample_L2.txt " << data << "/sample_L3.txt " << data << "/sample_trades.txt\n";
+        manifest << "broken " << data << "/missing_L2.txt " << data << "/sample_L3.txt " << data << "/sample_trades.txt\n";
+        manifest << "incomplete_line\n";
+    }
+
+    std::vector<ReplayTask> tasks;
+    ASSERT_TRUE(ReplayRunner::loadManifest("replay_manifest.txt", tasks));
+    ASSERT_EQ(tasks.size(), 3);
+
+    ReplayRunner runner(2, "replay_output");
+    auto results = runner.run(tasks);
+    ASSERT_EQ(results.size(), 3);
+    ASSERT_TRUE(results[0].ok && results[1].ok);
+    ASSERT_TRUE(!results[2].ok);
+
+    // independent replays of the same day end in the same state
+    ASSERT_TRUE(results[0].events > 0);
+    ASSERT_EQ(results[0].events, results[1].events);
+    ASSERT_EQ(results[0].l3Orders, results[1].l3Orders);
+    ASSERT_EQ(results[0].smartOrders, results[1].smartOrders);
+    ASSERT_TRUE(results[0].arenaBytes > 0);
+    ASSERT_TRUE(results[0].bookArenaBytes > 0);
+    // each task reports its own metrics
+    int64_t day1Orders = -1, day2Orders = -1;
+    ASSERT_TRUE(MetricsRegistry::global().getGauge("day1.book.exchange_orders", day1Orders));
+    ASSERT_TRUE(MetricsRegistry::global().getGauge("day2.book.exchange_orders", day2Orders));
+    ASSERT_EQ(day1Orders, static_cast<int64_t>(results[0].l3Orders));
+    ASSERT_EQ(day2Orders, static_cast<int64_t>(results[1].l3Orders));
+
+    // a task's containers all allocate from its own arenas
+    std::pmr::memory_resource* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    ReplayStats strict;
+    try {
+        strict = runner.runTask(tasks[0]);
+    } catch (const std::bad_alloc&) {
+    }
+    std::pmr::set_default_resource(previous);
+    ASSERT_TRUE(strict.ok);
+    ASSERT_EQ(strict.l3Orders, results[0].l3Orders);
+
+    std::ifstream log("replay_output/day1.log");
+    std::ifstream stats("replay_output/day1.stats");
+    std::ifstream summary("replay_output/summary.csv");
+    ASSERT_TRUE(log.good() && stats.good() && summary.good());
+}
+
+void test_capture_archive_round_trip() {
+    std::string data = SOB_DATA_DIR;
+    std::string l3Text = writeL3Capture("archive_l3.txt", 300);
+    std::ofstream(l3Text, std::ios::app) << "1400 ADD 9999 BUY 99.75 5\n";
+
+    // the malformed line in the capture rejects the conversion, drop it first
+    {
+        std::ifstream in(l3Text);
+        std::ofstream out("archive_clean_l3.txt");
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.find("broken") == std::string::npos) out << line << "\n";
+        }
+    }
+    ASSERT_TRUE(!ArchiveWriter::convert(l3Text, EventType::L3_UPDATE, "bad.sobarc"));
+    ASSERT_TRUE(ArchiveWriter::convert("archive_clean_l3.txt", EventType::L3_UPDATE, "l3.sobarc", 100, 64));
+    ASSERT_TRUE(ArchiveWriter::convert(data + "/sample_L2.txt", EventType::L2_SNAPSHOT, "l2.sobarc", 100, 3));
+    ASSERT_TRUE(ArchiveWriter::convert(data + "/sample_trades.txt", EventType::TRADE_EXECUTION, "trades.sobarc"));
+
+    ArchiveReader reader;
+    ASSERT_TRUE(reader.open("l3.sobarc"));
+    ASSERT_EQ(reader.getBlockCount(), 10);
+    ASSERT_EQ(reader.findBlock(0), 0);
+    size_t block = reader.findBlock(1200);
+    ASSERT_TRUE(block > 0 && reader.getIndex()[block].lastTimestamp >= 1200);
+    ASSERT_TRUE(reader.getIndex()[block - 1].lastTimestamp < 1200);
+    ASSERT_EQ(reader.findBlock(2000), 10);
+
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    MarketDataIngestor text(ob);
+    text.loadFile("archive_clean_l3.txt", EventType::L3_UPDATE);
+    text.loadFile(data + "/sample_L2.txt", EventType::L2_SNAPSHOT);
+    text.loadFile(data + "/sample_trades.txt", EventType::TRADE_EXECUTION);
+    MarketDataIngestor archive(ob, 2);
+    archive.loadFile("l3.sobarc", EventType::L3_UPDATE);
+    archive.loadFile("l2.sobarc", EventType::L2_SNAPSHOT);
+    archive.loadFile("trades.sobarc", EventType::TRADE_EXECUTION);
+
+    ASSERT_EQ(archive.events.size(), text.events.size());
+    ASSERT_EQ(archive.snapshots.size(), text.snapshots.size());
+    for (size_t i = 0; i < text.events.size(); ++i) {
+        const MarketEvent& a = archive.events[i];
+        const MarketEvent& t = text.events[i];
+        ASSERT_EQ(a.timestamp, t.timestamp);
+        if (t.type == EventType::L3_UPDATE) {
+            ASSERT_TRUE(a.l3Update.action == t.l3Update.action);
+            ASSERT_EQ(a.l3Update.orderId, t.l3Update.orderId);
+            ASSERT_EQ(a.l3Update.isSell, t.l3Update.isSell);
+            ASSERT_EQ(a.l3Update.price, t.l3Update.price);
+            ASSERT_EQ(a.l3Update.size, t.l3Update.size);
+        } else if (t.type == EventType::TRADE_EXECUTION) {
+            ASSERT_EQ(a.trade.price, t.trade.price);
+            ASSERT_EQ(a.trade.quantity, t.trade.quantity);
+        } else {
+            ASSERT_EQ(diffLevels(archive.snapshots[a.snapshotIndex].bids, text.snapshots[t.snapshotIndex].bids), 0ULL);
+            ASSERT_EQ(diffLevels(archive.snapshots[a.snapshotIndex].asks, text.snapshots[t.snapshotIndex].asks), 0ULL);
+        }
+    }
+
+    // a corrupt block is skipped and counted, the others still load
+    std::string bytes;
+    {
+        std::ifstream in("l3.sobarc", std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    size_t blockStart = reader.getIndex()[1].offset;
+    auto skipVarint = [&bytes](size_t& pos) {
+        uint64_t value = 0;
+        for (int shift = 0; ; shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(bytes[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+    };
+    size_t pos = blockStart;
+    ASSERT_EQ(skipVarint(pos), static_cast<uint64_t>(reader.getIndex()[1].records));
+    size_t tsColumn = skipVarint(pos);
+    pos += tsColumn;
+    skipVarint(pos);
+    size_t firstFlags = pos;
+    for (int corruption = 0; corruption < 2; ++corruption) {
+        std::string corrupt = bytes;
+        if (corruption == 0) {
+            corrupt[blockStart] = static_cast<char>(reader.getIndex()[1].records - 1);   // record count off the index
+        } else {
+            corrupt[firstFlags] = static_cast<char>(corrupt[firstFlags] | 3);           // no such action
+        }
+        std::ofstream("corrupt.sobarc", std::ios::binary) << corrupt;
+        ArchiveReader corruptReader;
+        ASSERT_TRUE(corruptReader.open("corrupt.sobarc"));
+        ParsedChunk chunk;
+        ASSERT_TRUE(!corruptReader.readBlock(1, chunk));
+        ASSERT_TRUE(corruptReader.readBlock(2, chunk));
+
+        std::ostringstream errors;
+        std::streambuf* previous = std::cerr.rdbuf(errors.rdbuf());
+        MarketDataIngestor corruptLoad(ob);
+        corruptLoad.loadFile("corrupt.sobarc", EventType::L3_UPDATE);
+        std::cerr.rdbuf(previous);
+        ASSERT_EQ(corruptLoad.getParseErrors(), 1);
+        size_t records = 0;
+        for (const auto& info : reader.getIndex()) records += info.records;
+        ASSERT_EQ(corruptLoad.events.size(), records - reader.getIndex()[1].records);
+    }
+
+    // footer and index offsets that only fit by wrapping around are rejected
+    auto putU64 = [](std::string& data, size_t at, uint64_t value) { std::memcpy(&data[at], &value, sizeof(value)); };
+    size_t footerStart = bytes.size() - 24;
+    uint64_t indexOffset = 0;
+    std::memcpy(&indexOffset, &bytes[footerStart], sizeof(indexOffset));
+    for (int corruption = 0; corruption < 2; ++corruption) {
+        std::string corrupt = bytes;
+        if (corruption == 0) {
+            uint32_t blockCount = 1000;
+            std::memcpy(&corrupt[footerStart + 8], &blockCount, sizeof(blockCount));
+            putU64(corrupt, footerStart, footerStart - uint64_t(32) * blockCount);
+        } else {
+            putU64(corrupt, indexOffset + 32, ~uint64_t(0) - 7);      // second entry's block offset
+        }
+        std::ofstream("corrupt.sobarc", std::ios::binary) << corrupt;
+        ArchiveReader corruptReader;
+        ASSERT_TRUE(!corruptReader.open("corrupt.sobarc"));
+    }
+
+    // off-tick prices are rejected rather than rounded
+    ArchiveWriter writer(EventType::TRADE_EXECUTION, 100);
+    ASSERT_TRUE(writer.open("offtick.sobarc"));
+    MarketEvent event;
+    event.type = EventType::TRADE_EXECUTION;
+    event.timestamp = 1;
+    event.trade.price = 100.005;
+    event.trade.quantity = 1;
+    ASSERT_TRUE(!writer.append(event, nullptr));
+    ASSERT_TRUE(writer.close());
+}
+
+void test_feed_index_seek() {
+    std::string path = writeL3Capture("indexed_l3.txt", 300);
+    std::remove(FeedIndex::sidecarPath(path).c_str());
+
+    FeedIndex index;
+    ASSERT_TRUE(index.loadOrBuild(path, 256));
+    ASSERT_TRUE(index.getEntries().size() > 10);
+    ASSERT_TRUE(std::ifstream(FeedIndex::sidecarPath(path)).good());
+
+    // seeking lands on a line start before every line at or after the target
+    std::ifstream in(path);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    uint64_t offset = index.seek(1200);
+    ASSERT_TRUE(offset > 0 && content[offset - 1] == '\n');
+    ASSERT_TRUE(std::stod(content.substr(offset, 4)) < 1200);
+    ASSERT_TRUE(content.find("\n1200 ") > offset);
+    ASSERT_EQ(index.seek(0), 0ULL);
+
+    FeedIndex reloaded;
+    ASSERT_TRUE(reloaded.load(FeedIndex::sidecarPath(path)));
+    ASSERT_EQ(reloaded.getEntries().size(), index.getEntries().size());
+    ASSERT_EQ(reloaded.seek(1200), offset);
+    ASSERT_EQ(reloaded.getFileMtime(), index.getFileMtime());
+
+    // a sidecar whose entry count runs past its own end is rejected
+    std::string sidecar;
+    {
+        std::ifstream sidecarIn(FeedIndex::sidecarPath(path), std::ios::binary);
+        sidecar.assign(std::istreambuf_iterator<char>(sidecarIn), std::istreambuf_iterator<char>());
+    }
+    std::string truncated = sidecar.substr(0, sidecar.size() - 1);
+    std::ofstream("truncated.idx", std::ios::binary) << truncated;
+    std::string oversized = sidecar;
+    uint64_t hugeCount = uint64_t(1) << 60;
+    std::memcpy(&oversized[24], &hugeCount, sizeof(hugeCount));
+    std::ofstream("oversized.idx", std::ios::binary) << oversized;
+    FeedIndex corrupt;
+    ASSERT_TRUE(!corrupt.load("truncated.idx"));
+    ASSERT_TRUE(!corrupt.load("oversized.idx"));
+    ASSERT_TRUE(corrupt.getEntries().empty());
+
+    // a capture rewritten at the same size is re-indexed
+    // the first line moves to the end as a line without a timestamp, every offset shifts
+    size_t firstLine = content.find('\n') + 1;
+    std::string shifted = content.substr(firstLine) + std::string(firstLine - 1, '#') + "\n";
+    ASSERT_EQ(shifted.size(), content.size());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << shifted;
+    FeedIndex rebuilt;
+    ASSERT_TRUE(rebuilt.loadOrBuild(path, 256));
+    ASSERT_TRUE(rebuilt.getFileMtime() != index.getFileMtime());
+    ASSERT_EQ(rebuilt.seek(1200), offset - firstLine);
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << content;
+    ASSERT_TRUE(index.loadOrBuild(path, 256));
+
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    MarketDataIngestor full(ob);
+    full.loadFile(path, EventType::L3_UPDATE);
+    MarketDataIngestor partial(ob);
+    partial.loadEvents("missing_l2.txt", path, "missing_trades.txt", 1200);
+
+    size_t expected = 0;
+    for (const auto& e : full.events) {
+        if (e.timestamp >= 1200) expected++;
+    }
+    ASSERT_EQ(partial.events.size(), expected);
+    ASSERT_EQ(partial.events.front().timestamp, 1200);
+}
+
+void test_checkpoint_seek_matches_full_replay() {
+    std::string data = SOB_DATA_DIR;
+    std::string l2File = data + "/sample_L2.txt";
+    std::string l3File = data + "/sample_L3.txt";
+    std::string tradeFile = data + "/sample_trades.txt";
+
+    L2Book l2a;
+    L3Book l3a;
+    TradeContainer tradesA;
+    OrderBook fullBook(l2a, l3a, tradesA);
+    MarketDataIngestor full(fullBook);
+    full.setCheckpointInterval(50, "replay_ckpt_");
+    full.loadEvents(l2File, l3File, tradeFile);
+    full.processEvents();
+
+    std::string checkpoint = MarketDataIngestor::checkpointPath("replay_ckpt_", 1050);
+    ASSERT_EQ(checkpoint, std::string("replay_ckpt_1050.ckpt"));
+    ASSERT_TRUE(std::ifstream(checkpoint).good());
+
+    L2Book l2b;
+    L3Book l3b;
+    TradeContainer tradesB;
+    OrderBook resumedBook(l2b, l3b, tradesB);
+    MarketDataIngestor resumed(resumedBook);
+    ASSERT_TRUE(resumed.seek(l2File, l3File, tradeFile, 1085, checkpoint));
+    ASSERT_TRUE(!resumed.events.empty() && resumed.events.front().timestamp >= 1085);
+    resumed.processEvents();
+
+    ASSERT_EQ(l3b.getTotalOrders(), l3a.getTotalOrders());
+    ASSERT_EQ(tradesB.getTrades().size(), tradesA.getTrades().size());
+    ASSERT_EQ(resumedBook.getSmartOrderBook().getTotalOrders(), fullBook.getSmartOrderBook().getTotalOrders());
+    ASSERT_EQ(resumedBook.getSmartOrderBook().getBestBid(), fullBook.getSmartOrderBook().getBestBid());
+    ASSERT_EQ(resumedBook.getSmartOrderBook().getBestAsk(), fullBook.getSmartOrderBook().getBestAsk());
+    ASSERT_EQ(resumedBook.getGuesses().size(), fullBook.getGuesses().size());
+    ASSERT_EQ(resumedBook.getAggressors().size(), fullBook.getAggressors().size());
+
+    // a checkpoint past the target cannot be rewound
+    ASSERT_TRUE(!resumed.seek(l2File, l3File, tradeFile, 1000, checkpoint));
+}
+
+void test_checkpoint_guess_order() {
+    std::ostringstream log;
+    setLogStream(&log);
+    L2Book l2a;
+    L3Book l3a;
+    TradeContainer tradesA;
+    OrderBook live(l2a, l3a, tradesA);
+    live.setPrintBook(false);
+    // two guessed new bids a real ADD matches equally well, and the ask
+    live.processL2Snapshot("BID 100.0 10 ASK 101.0 500", 1);
+    live.processL2Snapshot("BID 100.0 20 ASK 101.0 500", 2);
+    ASSERT_EQ(live.getGuesses().size(), 3);
+    std::stringstream checkpoint;
+    live.saveCheckpoint(checkpoint, 2);
+
+    // a restored book with a differently sized guess table picks the same one
+    L2Book l2b;
+    L3Book l3b;
+    TradeContainer tradesB;
+    OrderBook restored(l2b, l3b, tradesB);
+    restored.setPrintBook(false);
+    WarmupConfig config;
+    config.orders = 5000;
+    restored.warmup(config);
+    Timestamp timestamp = 0;
+    ASSERT_TRUE(restored.loadCheckpoint(checkpoint, timestamp));
+    ASSERT_EQ(timestamp, 2);
+
+    for (OrderBook* ob : {&live, &restored}) {
+        ob->processL3Update("ADD 7 BUY 100.0 10", 3);
+        // the oldest guess is confirmed, the newer one is left
+        ASSERT_EQ(ob->getGuesses().size(), 2);
+        ASSERT_TRUE(ob->getGuesses().count(-1) == 0);
+        ASSERT_TRUE(ob->getGuesses().count(-3) == 1);
+        ASSERT_TRUE(ob->getSmartOrderBook().hasOrder(7));
+    }
+    setLogStream(nullptr);
+}
+
+// L3 capture with every action and a trade feed, all on whole 1/4 ticks
+static void writeBinaryFeedSources(const std::string& l3Path, const std::string& tradePath, int numOrders) {
+    std::ofstream l3(l3Path);
+    std::ofstream trades(tradePath);
+    for (int i = 0; i < numOrders; ++i) {
+        Price price = 100.0 + (i % 8) * 0.25;
+        l3 << 1000 + i << " ADD " << i + 1 << (i % 2 ? " SELL " : " BUY ") << price << " " << 10 + i << "\n";
+        if (i % 3 == 0) l3 << 1000 + i << " MODIFY " << i + 1 << (i % 2 ? " SELL " : " BUY ") << price << " " << 5 + i << "\n";
+        if (i >= 4) l3 << 1000 + i << " CANCEL " << i - 3 << "\n";
+        if (i % 5 == 0) trades << 1000 + i << " " << price << " " << 1 + i % 7 << "\n";
+    }
+}
+
+void test_binary_feed_round_trip() {
+    writeBinaryFeedSources("binary_l3.txt", "binary_trades.txt", 400);
+    ASSERT_TRUE(BinaryFeedWriter::convert("binary_l3.txt", "binary_trades.txt", "feed.itch"));
+    ASSERT_TRUE(BinaryFeedWriter::convert("binary_l3.txt", "binary_trades.txt", "feed.pcap", BinaryFeedFormat::PCAP));
+
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    MarketDataIngestor text(ob);
+    text.loadEvents("missing_l2.txt", "binary_l3.txt", "binary_trades.txt");
+
+    for (const char* file : {"feed.itch", "feed.pcap"}) {
+        BinaryFeedReader reader;
+        ASSERT_TRUE(reader.open(file));
+        ParsedChunk chunk;
+        reader.readAll(chunk);
+        ASSERT_EQ(reader.getDecodeErrors(), 0);
+        ASSERT_EQ(reader.getMissedMessages(), 0);
+        ASSERT_EQ(chunk.events.size(), text.events.size());
+        for (size_t i = 0; i < chunk.events.size(); ++i) {
+            const MarketEvent& b = chunk.events[i];
+            const MarketEvent& t = text.events[i];
+            ASSERT_TRUE(b.type == t.type);
+            ASSERT_EQ(b.timestamp, t.timestamp);
+            if (t.type == EventType::L3_UPDATE) {
+                ASSERT_TRUE(b.l3Update.action == t.l3Update.action);
+                ASSERT_EQ(b.l3Update.orderId, t.l3Update.orderId);
+                if (t.l3Update.action != L3Action::CANCEL) {
+                    ASSERT_EQ(b.l3Update.isSell, t.l3Update.isSell);
+                    ASSERT_EQ(b.l3Update.price, t.l3Update.price);
+                    ASSERT_EQ(b.l3Update.size, t.l3Update.size);
+                }
+            } else {
+                ASSERT_EQ(b.trade.price, t.trade.price);
+                ASSERT_EQ(b.trade.quantity, t.trade.quantity);
+            }
+        }
+    }
+
+    BinaryFeedReader pcap;
+    ASSERT_TRUE(pcap.open("feed.pcap"));
+    ASSERT_TRUE(pcap.getFormat() == BinaryFeedFormat::PCAP);
+
+    // decoding straight into a book ends where the text replay does
+    text.processEvents();
+    L2Book l2b;
+    L3Book l3b;
+    TradeContainer tradesB;
+    OrderBook binaryBook(l2b, l3b, tradesB);
+    MarketDataIngestor binary(binaryBook);
+    ASSERT_TRUE(binary.replayBinaryFeed("feed.pcap"));
+    ASSERT_EQ(l3b.getTotalOrders(), l3.getTotalOrders());
+    ASSERT_EQ(l3b.getBestBid(), l3.getBestBid());
+    ASSERT_EQ(l3b.getBestAsk(), l3.getBestAsk());
+    ASSERT_EQ(tradesB.getTrades().size(), trades.getTrades().size());
+}
+
+void test_binary_feed_malformed() {
+    MarketEvent event;
+    event.type = EventType::L3_UPDATE;
+    event.timestamp = 1000;
+    event.l3Update = {1000, L3Action::ADD, 42, true, 101.25, 300};
+    char message[32];
+    size_t length = encodeBinaryMessage(event, message);
+    ASSERT_EQ(length, sizeof(BinaryAddOrder));
+
+    MarketEvent decoded;
+    ASSERT_TRUE(decodeBinaryMessage(message, message + length, decoded) == ParseStatus::OK);
+    ASSERT_EQ(decoded.l3Update.price, 101.25);
+    ASSERT_TRUE(decodeBinaryMessage(message, message + length - 1, decoded) == ParseStatus::BAD_NUMBER);
+    ASSERT_TRUE(decodeBinaryMessage(message, message + length + 1, decoded) == ParseStatus::TRAILING_DATA);
+    message[offsetof(BinaryAddOrder, side)] = 'X';
+    ASSERT_TRUE(decodeBinaryMessage(message, message + length, decoded) == ParseStatus::BAD_SIDE);
+    message[0] = 'Z';
+    ASSERT_TRUE(decodeBinaryMessage(message, message + length, decoded) == ParseStatus::BAD_ACTION);
+
+    // sub-tick prices and L2 snapshots have no binary form
+    event.l3Update.price = 101.00001;
+    ASSERT_EQ(encodeBinaryMessage(event, message), 0);
+    event.type = EventType::L2_SNAPSHOT;
+    ASSERT_EQ(encodeBinaryMessage(event, message), 0);
+
+    // drop the second datagram and repeat the third: the gap is counted, the repeat ignored
+    writeBinaryFeedSources("binary_l3.txt", "binary_trades.txt", 400);
+    ASSERT_TRUE(BinaryFeedWriter::convert("binary_l3.txt", "binary_trades.txt", "full.pcap", BinaryFeedFormat::PCAP));
+    std::ifstream in("full.pcap", std::ios::binary);
+    std::string pcap((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<std::string> records;
+    for (size_t pos = 24; pos + 16 <= pcap.size(); ) {
+        uint32_t captured;
+        std::memcpy(&captured, pcap.data() + pos + 8, 4);
+        records.push_back(pcap.substr(pos, 16 + captured));
+        pos += 16 + captured;
+    }
+    ASSERT_TRUE(records.size() > 3);
+    {
+        std::ofstream out("lossy.pcap", std::ios::binary);
+        out << pcap.substr(0, 24) << records[0] << records[2] << records[2];
+        for (size_t i = 3; i < records.size(); ++i) out << records[i];
+    }
+
+    BinaryFeedReader full;
+    BinaryFeedReader lossy;
+    ASSERT_TRUE(full.open("full.pcap") && lossy.open("lossy.pcap"));
+    ParsedChunk fullEvents;
+    ParsedChunk lossyEvents;
+    full.readAll(fullEvents);
+    lossy.readAll(lossyEvents);
+    ASSERT_TRUE(lossy.getMissedMessages() > 0);
+    ASSERT_EQ(lossyEvents.events.size() + lossy.getMissedMessages(), fullEvents.events.size());
+    ASSERT_EQ(lossy.getDecodeErrors(), 0);
+}
+
+void test_udp_loopback_feed() {
+    writeBinaryFeedSources("udp_l3.txt", "udp_trades.txt", 150);
+    ASSERT_TRUE(BinaryFeedWriter::convert("udp_l3.txt", "udp_trades.txt", "udp_feed.itch"));
+
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    UdpFeedReceiver receiver(ob);
+    UdpReceiverConfig config;
+    config.batchSize = 8;
+    config.timeoutMs = 20;
+    ASSERT_TRUE(receiver.open(config));
+    ASSERT_TRUE(receiver.getPort() != 0);
+
+    BinaryFeedReader feed;
+    ASSERT_TRUE(feed.open("udp_feed.itch"));
+    ParsedChunk expected;
+    size_t total = feed.readAll(expected);
+
+    std::atomic<bool> stop{false};
+    std::ostringstream receiverLog;
+    std::thread receiving([&]() {
+        setLogStream(&receiverLog);
+        receiver.run(stop, total);
+    });
+
+    // paced well below what the receiver keeps up with, so nothing is dropped
+    UdpReplayConfig replay;
+    replay.port = receiver.getPort();
+    replay.messagesPerSecond = 20000;
+    replay.messagesPerDatagram = 7;
+    UdpFeedReplayer replayer(replay);
+    ASSERT_TRUE(replayer.replay("udp_feed.itch"));
+    ASSERT_EQ(replayer.getSentMessages(), total);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (receiver.getStats().events < total && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    stop = true;
+    receiving.join();
+
+    ASSERT_EQ(receiver.getStats().events, total);
+    ASSERT_EQ(receiver.getStats().datagrams, replayer.getSentDatagrams());
+    ASSERT_TRUE(receiver.getStats().syscalls <= receiver.getStats().datagrams + receiver.getStats().emptyPolls);
+    ASSERT_EQ(receiver.getMissedMessages(), 0);
+    ASSERT_EQ(receiver.getDecodeErrors(), 0);
+    ASSERT_EQ(receiver.getLatencySamples(), total);
+    ASSERT_TRUE(receiver.getLatencyPercentile(0.5) <= receiver.getLatencyPercentile(1.0));
+
+    // the live book ends where the file replay does
+    L2Book l2b;
+    L3Book l3b;
+    TradeContainer tradesB;
+    OrderBook fileBook(l2b, l3b, tradesB);
+    MarketDataIngestor ingestor(fileBook);
+    ASSERT_TRUE(ingestor.replayBinaryFeed("udp_feed.itch"));
+    ASSERT_EQ(l3.getTotalOrders(), l3b.getTotalOrders());
+    ASSERT_EQ(trades.getTrades().size(), tradesB.getTrades().size());
+}
+
+void test_async_file_reader() {
+    std::string path = writeL3Capture("async_l3.txt", 3000);
+    std::ifstream in(path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(contents.size() > 5 * 4096);
+
+    for (ReadEngine engine : {ReadEngine::IO_URING, ReadEngine::PREAD}) {
+        AsyncFileReader reader(4096, 3);
+        ASSERT_TRUE(reader.open(path, engine));
+        if (engine == ReadEngine::PREAD || !AsyncFileReader::ioUringAvailable()) {
+            ASSERT_TRUE(reader.getEngine() == ReadEngine::PREAD);
+        }
+        ASSERT_EQ(reader.getBlockCount(), (contents.size() + 4095) / 4096);
+
+        // hold two blocks at a time, the third buffer keeps reading ahead
+        std::string read;
+        ReadBlock previous;
+        ReadBlock block;
+        while (reader.next(block)) {
+            ASSERT_EQ(block.offset, read.size());
+            read.append(block.data, block.size);
+            if (previous.data) reader.release(previous);
+            previous = block;
+        }
+        reader.release(previous);
+        ASSERT_TRUE(reader.atEnd());
+        ASSERT_TRUE(read == contents);
+    }
+
+    // a fourth block needs a buffer back first
+    AsyncFileReader reader(4096, 3);
+    ASSERT_TRUE(reader.open(path));
+    ReadBlock held[4];
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(reader.next(held[i]));
+    }
+    ASSERT_TRUE(!reader.next(held[3]));
+    reader.release(held[0]);
+    ASSERT_TRUE(reader.next(held[3]));
+    ASSERT_EQ(held[3].index, 3);
+    ASSERT_TRUE(!reader.open("missing_file.txt"));
+}
+
+void test_async_replay_matches_mapped() {
+    std::string path = writeL3Capture("async_replay_l3.txt", 3000);
+    std::ostringstream log;
+    setLogStream(&log);
+
+    L2Book l2a;
+    L3Book l3a;
+    TradeContainer tradesA;
+    OrderBook mappedBook(l2a, l3a, tradesA);
+    MarketDataIngestor mapped(mappedBook);
+    ASSERT_TRUE(mapped.replayFile(path, EventType::L3_UPDATE));
+
+    // block boundaries fall mid-line, the tail is carried into the next block
+    for (ReadEngine engine : {ReadEngine::IO_URING, ReadEngine::PREAD}) {
+        for (size_t threads : {1, 3}) {
+            L2Book l2b;
+            L3Book l3b;
+            TradeContainer tradesB;
+            OrderBook asyncBook(l2b, l3b, tradesB);
+            MarketDataIngestor async(asyncBook, threads);
+            async.setChunkSize(4096);
+            async.setAsyncReads(true, engine);
+            ASSERT_TRUE(async.replayFile(path, EventType::L3_UPDATE));
+
+            ASSERT_EQ(l3b.getTotalOrders(), 3);
+            ASSERT_EQ(async.getParseErrors(), mapped.getParseErrors());
+            ASSERT_EQ(asyncBook.getSmartOrderBook().getTotalOrders(), mappedBook.getSmartOrderBook().getTotalOrders());
+            ASSERT_EQ(l3b.getTopAsks(1).front().orders.front().orderId, l3a.getTopAsks(1).front().orders.front().orderId);
+            ASSERT_EQ(l3b.getTopBids(1).front().orders.front().orderId, l3a.getTopBids(1).front().orders.front().orderId);
+        }
+    }
+
+    // a line spanning several blocks is parsed whole while it fits the
+    // headroom, a longer one is skipped up to its newline as one error
+    {
+        std::ofstream out("async_long_l3.txt");
+        out << "1000 ADD 1 BUY 100.0 10\n";
+        out << "1001 ADD 2 BUY" << std::string(10000, ' ') << "99.0 10\n";
+        out << "1002 ADD 3 SELL 101.0 10\n";
+        out << std::string(70000, 'x') << "\n";
+        out << "1003 ADD 4 SELL 102.0 10\n";
+        out << "1004 ADD 5 BUY" << std::string(5000, ' ') << "98.0 10\n";
+    }
+    for (ReadEngine engine : {ReadEngine::IO_URING, ReadEngine::PREAD}) {
+        L2Book l2c;
+        L3Book l3c;
+        TradeContainer tradesC;
+        OrderBook longBook(l2c, l3c, tradesC);
+        MarketDataIngestor async(longBook);
+        async.setChunkSize(4096);
+        async.setAsyncReads(true, engine);
+        std::ostringstream errors;
+        std::streambuf* previous = std::cerr.rdbuf(errors.rdbuf());
+        ASSERT_TRUE(async.replayFile("async_long_l3.txt", EventType::L3_UPDATE));
+        std::cerr.rdbuf(previous);
+        ASSERT_EQ(async.getParseErrors(), 1);
+        ASSERT_EQ(l3c.getTotalOrders(), 5);
+        ASSERT_TRUE(l3c.hasOrder(2));
+        ASSERT_TRUE(l3c.hasOrder(5));
+    }
+    setLogStream(nullptr);
+    ASSERT_EQ(mapped.getParseErrors(), 1);
+}
+
+void test_l2_conflation() {
+    const int numSnapshots = 400;
+    {
+        std::ofstream out("conflate_l2.txt");
+        for (int i = 0; i < numSnapshots; ++i) {
+            out << 1000 + i * 10 << " BID 100.0 " << 100 + i << " 99.0 400 ASK 101.0 " << 500 + i % 7 << " 102.0 400\n";
+        }
+    }
+    std::ostringstream log;
+    setLogStream(&log);
+
+    L2Book l2a;
+    L3Book l3a;
+    TradeContainer tradesA;
+    OrderBook fullBook(l2a, l3a, tradesA);
+    MarketDataIngestor full(fullBook);
+    full.setChunkSize(256);
+    ASSERT_TRUE(full.replayFile("conflate_l2.txt", EventType::L2_SNAPSHOT));
+    ASSERT_EQ(full.getConflatedSnapshots(), 0);
+
+    // a book that keeps up applies every snapshot, whatever the chunking
+    for (size_t chunkSize : {size_t(4 << 20), size_t(256)}) {
+        L2Book l2b;
+        L3Book l3b;
+        TradeContainer tradesB;
+        OrderBook keepingUpBook(l2b, l3b, tradesB);
+        MarketDataIngestor keepingUp(keepingUpBook);
+        keepingUp.setChunkSize(chunkSize);
+        keepingUp.setL2Conflation(true);
+        ASSERT_TRUE(keepingUp.replayFile("conflate_l2.txt", EventType::L2_SNAPSHOT));
+        ASSERT_EQ(keepingUp.getConflatedSnapshots(), 0);
+        ASSERT_EQ(l2b.getBidQuantityAtPrice(100.0), l2a.getBidQuantityAtPrice(100.0));
+    }
+
+    // a book that lags behind the parse workers skips superseded snapshots
+    std::ifstream in("conflate_l2.txt");
+    std::vector<std::string> l2Lines;
+    for (std::string line; std::getline(in, line); ) l2Lines.push_back(line);
+    L2Book l2c;
+    L3Book l3c;
+    TradeContainer tradesC;
+    OrderBook laggingBook(l2c, l3c, tradesC);
+    MarketDataIngestor lagging(laggingBook, 3);
+    lagging.setL2Conflation(true);
+    lagging.replayChunks(l2Lines.size(), [&](size_t i, ParsedChunk& out) {
+        const std::string& l2 = l2Lines[i];
+        MarketDataIngestor::parseChunk(l2.data(), l2.data() + l2.size(), EventType::L2_SNAPSHOT, out);
+    }, nullptr, [](size_t) { std::this_thread::sleep_for(std::chrono::microseconds(500)); });
+    ASSERT_TRUE(lagging.getConflatedSnapshots() > 0);
+    ASSERT_TRUE(lagging.getConflatedSnapshots() < static_cast<size_t>(numSnapshots));
+    ASSERT_EQ(l2c.getBidQuantityAtPrice(100.0), l2a.getBidQuantityAtPrice(100.0));
+    ASSERT_EQ(l2c.getAskQuantityAtPrice(101.0), l2a.getAskQuantityAtPrice(101.0));
+
+    // the merged replay reconciles every snapshot against the L3 updates around it
+    std::string l3Path = writeL3Capture("conflate_merged_l3.txt", 200);
+    L2Book l2e;
+    L3Book l3e;
+    TradeContainer tradesE;
+    OrderBook mergedBook(l2e, l3e, tradesE);
+    MarketDataIngestor merged(mergedBook);
+    merged.setL2Conflation(true);
+    merged.loadEvents("conflate_l2.txt", l3Path, "");
+    merged.processEvents();
+    ASSERT_EQ(merged.getConflatedSnapshots(), 0);
+    ASSERT_EQ(l2e.getBidQuantityAtPrice(100.0), l2a.getBidQuantityAtPrice(100.0));
+
+    // L3 updates are never conflated
+    std::string path = writeL3Capture("conflate_l3.txt", 200);
+    L2Book l2d;
+    L3Book l3d;
+    TradeContainer tradesD;
+    OrderBook l3Book(l2d, l3d, tradesD);
+    MarketDataIngestor l3Replay(l3Book, 3);
+    l3Replay.setChunkSize(64);
+    l3Replay.setL2Conflation(true);
+    ASSERT_TRUE(l3Replay.replayFile(path, EventType::L3_UPDATE));
+    ASSERT_EQ(l3d.getTotalOrders(), 3);
+    ASSERT_EQ(l3Replay.getConflatedSnapshots(), 0);
+    setLogStream(nullptr);
+}
+
+static bool depthMatches(const DepthBook& depth, const L3Book& book) {
+    if (depth.getBids().size() != book.getBids().size() || depth.getAsks().size() != book.getAsks().size()) {
+        return false;
+    }
+    for (const auto& [price, level] : book.getBids()) {
+        auto it = depth.getBids().find(price);
+        if (it == depth.getBids().end() || it->second.quantity != level.quantity || it->second.numOrders != level.numOrders) return false;
+    }
+    for (const auto& [price, level] : book.getAsks()) {
+        auto it = depth.getAsks().find(price);
+        if (it == depth.getAsks().end() || it->second.quantity != level.quantity || it->second.numOrders != level.numOrders) return false;
+    }
+    return true;
+}
+
+void test_depth_delta_feed() {
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades, 1);
+    ob.setPrintBook(false);
+    ob.setDepthSnapshotInterval(5);
+
+    DepthBook depth;
+    std::vector<DepthUpdate> updates;
+    size_t mismatches = 0;
+    int adds = 0;
+    Callbacks callbacks;
+    callbacks.onOrderAdd = [&adds](const OrderBook&, const OrderInfo&) { adds++; };
+    callbacks.onDepthUpdate = [&](const DepthUpdate& update) {
+        updates.push_back(update);
+        ASSERT_TRUE(depth.apply(update));
+        if (!depthMatches(depth, ob.getSmartOrderBook())) mismatches++;
+    };
+    ob.setCallbacks(callbacks);
+
+    std::ostringstream log;
+    setLogStream(&log);
+    ob.processL3Update("ADD 1 BUY 100.0 5", 1000);
+    ob.processL3Update("ADD 2 BUY 100.0 7", 1001);
+    ob.processL3Update("ADD 3 SELL 101.0 4", 1002);
+    // an amend down only touches its own level
+    ob.processL3Update("MODIFY 2 BUY 100.0 3", 1003);
+    ob.processL3Update("ADD 4 BUY 99.0 2", 1004);
+    ob.processL3Update("CANCEL 4", 1005);
+    ob.processL3Update("CANCEL 9", 1006);
+
+    // L2 and trade driven guesses show up in the feed as well
+    MarketDataIngestor ingestor(ob);
+    ingestor.loadEvents(SOB_DATA_DIR "/sample_L2.txt", SOB_DATA_DIR "/sample_L3.txt", SOB_DATA_DIR "/sample_trades.txt");
+    ingestor.processEvents();
+    setLogStream(nullptr);
+
+    ASSERT_TRUE(log.str().find("total # of orders") == std::string::npos);
+    // user callbacks run next to the logging ones
+    ASSERT_TRUE(adds >= 4);
+    ASSERT_EQ(mismatches, 0);
+    ASSERT_TRUE(depthMatches(depth, ob.getSmartOrderBook()));
+
+    ASSERT_TRUE(updates.size() > 6);
+    ASSERT_TRUE(updates.front().isSnapshot);
+    size_t sinceSnapshot = 0;
+    for (size_t i = 0; i < updates.size(); ++i) {
+        ASSERT_EQ(updates[i].sequence, i + 1);
+        if (i > 0 && !updates[i].isSnapshot) {
+            ASSERT_TRUE(!updates[i].levels.empty());
+        }
+        sinceSnapshot = updates[i].isSnapshot ? 0 : sinceSnapshot + 1;
+        ASSERT_TRUE(sinceSnapshot <= 5);
+    }
+    // ADD 2, ADD 3, MODIFY 2 each change one level; the rejected CANCEL 9 sends nothing
+    ASSERT_EQ(updates[1].levels.size(), 1);
+    ASSERT_EQ(updates[1].levels[0].quantity, 12);
+    ASSERT_EQ(updates[1].levels[0].numOrders, 2);
+    ASSERT_EQ(updates[3].levels.size(), 1);
+    ASSERT_EQ(updates[3].levels[0].quantity, 8);
+    ASSERT_EQ(updates[5].levels[0].numOrders, 0);
+    ASSERT_EQ(updates[5].timestamp, 1005);
+
+    // a consumer that misses an update waits for the next snapshot
+    DepthBook late;
+    ASSERT_TRUE(late.apply(updates[0]));
+    ASSERT_TRUE(!late.apply(updates[2]));
+    ASSERT_EQ(late.getGaps(), 1);
+    ASSERT_TRUE(!late.apply(updates[3]));
+    size_t next = 4;
+    while (!updates[next].isSnapshot) ++next;
+    ASSERT_TRUE(late.apply(updates[next]));
+    ASSERT_TRUE(late.isSynced());
+}
+
+void test_shared_memory_book() {
+    std::string region = "sob_test_" + std::to_string(getpid());
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades, 1);
+    ob.setPrintBook(false);
+
+    ShmBookPublisher publisher;
+    ASSERT_TRUE(publisher.create(region, 1024));
+    size_t localActions = 0;
+    Callbacks callbacks;
+    callbacks.onOrderAdd = [&localActions](const OrderBook&, const OrderInfo&) { localActions++; };
+    publisher.attach(ob, callbacks);
+
+    ShmBookReader early;
+    ASSERT_TRUE(early.open(region));
+    BookImage image;
+    ASSERT_TRUE(!early.readBook(image));
+
+    std::ostringstream log;
+    setLogStream(&log);
+    MarketDataIngestor ingestor(ob);
+    ingestor.loadEvents(SOB_DATA_DIR "/sample_L2.txt", SOB_DATA_DIR "/sample_L3.txt", SOB_DATA_DIR "/sample_trades.txt");
+    ingestor.processEvents();
+    setLogStream(nullptr);
+
+    uint64_t published = publisher.getPublishedActions();
+    ASSERT_TRUE(published > 0);
+    ASSERT_TRUE(localActions > 0);
+    ASSERT_EQ(publisher.getMaxReaderLag(), published);
+
+    // another process sees the same book and every action in order
+    pid_t child = fork();
+    if (child == 0) {
+        ShmBookReader reader;
+        BookImage childImage;
+        BookAction action;
+        uint64_t count = 0;
+        bool ok = reader.open(region) && reader.readBook(childImage);
+        while (ok && reader.nextAction(action)) {
+            ok = action.sequence == count++;
+        }
+        const L3Book& smart = ob.getSmartOrderBook();
+        ok = ok && count == published && reader.getOverruns() == 0
+            && childImage.bidCount == std::min(smart.getBids().size(), SHM_BOOK_LEVELS)
+            && childImage.askCount == std::min(smart.getAsks().size(), SHM_BOOK_LEVELS)
+            && (smart.getBids().empty() || childImage.bids[0].price == smart.getBestBid())
+            && (smart.getAsks().empty() || childImage.asks[0].price == smart.getBestAsk());
+        _exit(ok ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    BookAction action;
+    while (early.nextAction(action)) {}
+    ASSERT_EQ(early.getCursor(), published);
+    ASSERT_EQ(publisher.getMaxReaderLag(), 0);
+    ShmBookReader latest;
+    ASSERT_TRUE(latest.open(region, true));
+    ASSERT_TRUE(!latest.nextAction(action));
+    ASSERT_TRUE(latest.readBook(image));
+
+    publisher.close();
+    ASSERT_TRUE(!ShmBookReader().open(region));
+}
+
+void test_shared_memory_concurrent_reader() {
+    std::string region = "sob_stress_" + std::to_string(getpid());
+    ShmBookPublisher publisher;
+    ASSERT_TRUE(publisher.create(region, 64));
+    ShmBookReader reader;
+    ASSERT_TRUE(reader.open(region));
+
+    // the writer amends both orders down together, so a torn image shows up as a mismatch
+    const int rounds = 200000;
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        std::ostringstream log;
+        setLogStream(&log);
+        L3Book book;
+        book.addOrder(1, false, rounds + 1, 100.0);
+        book.addOrder(2, true, rounds + 1, 101.0);
+        for (int i = 1; i <= rounds; ++i) {
+            book.modifyOrderSize(*book.findOrder(1), rounds + 1 - i);
+            book.modifyOrderSize(*book.findOrder(2), rounds + 1 - i);
+            publisher.publishBook(book, i, i);
+            publisher.publishAction(OrderInfo(i, false, 100.0, i, "MODIFY", i));
+        }
+        done = true;
+    });
+
+    size_t torn = 0;
+    uint64_t received = 0;
+    uint64_t lastSequence = 0;
+    bool ordered = true;
+    BookImage image;
+    BookAction action;
+    while (!done || reader.getCursor() < static_cast<uint64_t>(rounds)) {
+        if (reader.readBook(image)) {
+            if (image.bids[0].quantity != image.asks[0].quantity
+                || image.bids[0].quantity != static_cast<Quantity>(rounds + 1 - image.version)) {
+                torn++;
+            }
+        }
+        while (reader.nextAction(action)) {
+            if (received > 0 && action.sequence <= lastSequence) ordered = false;
+            if (action.orderId != static_cast<OrderId>(action.sequence + 1)) ordered = false;
+            lastSequence = action.sequence;
+            received++;
+        }
+    }
+    writer.join();
+
+    ASSERT_EQ(torn, 0);
+    ASSERT_TRUE(ordered);
+    ASSERT_EQ(received + reader.getOverruns(), static_cast<uint64_t>(rounds));
+}
+
+void test_latency_histogram() {
+    LatencyHistogram histogram;
+    for (uint64_t v = 1; v <= 10000; ++v) {
+        histogram.record(v);
+    }
+    ASSERT_EQ(histogram.getCount(), 10000);
+    ASSERT_EQ(histogram.getMax(), 10000);
+    // buckets are within 1/16 of their values
+    uint64_t p50 = histogram.percentile(0.5);
+    uint64_t p99 = histogram.percentile(0.99);
+    ASSERT_TRUE(p50 >= 5000 * 15 / 16 && p50 <= 5000);
+    ASSERT_TRUE(p99 >= 9900 * 15 / 16 && p99 <= 9900);
+    ASSERT_EQ(histogram.percentile(0.0), 1);
+    for (uint64_t v : {0ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+        size_t bucket = LatencyHistogram::bucketOf(v);
+        ASSERT_TRUE(bucket < LatencyHistogram::BUCKETS);
+        ASSERT_TRUE(LatencyHistogram::bucketStart(bucket) <= v);
+        ASSERT_TRUE(v - LatencyHistogram::bucketStart(bucket) <= v / 16);
+    }
+
+#ifdef SOB_LATENCY_TRACE
+    // stages of every applied event, parse samples from the parse threads
+    LatencyTracer::reset();
+    std::string path = writeL3Capture("trace_l3.txt", 300);
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    ob.setPrintBook(false);
+    std::ostringstream log;
+    setLogStream(&log);
+    MarketDataIngestor ingestor(ob, 3);
+    ingestor.setChunkSize(256);
+    ASSERT_TRUE(ingestor.replayFile(path, EventType::L3_UPDATE));
+    ob.processTrade("100.0 5", 5000);
+    setLogStream(nullptr);
+
+    uint64_t applied = LatencyTracer::getHistogram(TraceStage::TOTAL, EventType::L3_UPDATE).getCount();
+    ASSERT_EQ(applied, 300 + 297);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::BOOK_APPLY, EventType::L3_UPDATE).getCount(), applied);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::RECONCILE, EventType::L3_UPDATE).getCount(), applied);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::CALLBACK, EventType::L3_UPDATE).getCount(), applied);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::PARSE, EventType::L3_UPDATE).getCount(), applied + 1);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::TOTAL, EventType::TRADE_EXECUTION).getCount(), 1);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::PARSE, EventType::TRADE_EXECUTION).getCount(), 1);
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::TOTAL, EventType::L2_SNAPSHOT).getCount(), 0);
+
+    LatencyHistogram total = LatencyTracer::getHistogram(TraceStage::TOTAL, EventType::L3_UPDATE);
+    ASSERT_TRUE(total.percentile(0.5) <= total.percentile(0.999));
+    ASSERT_TRUE(total.getMax() >= LatencyTracer::getHistogram(TraceStage::BOOK_APPLY, EventType::L3_UPDATE).getMax());
+    ASSERT_TRUE(LatencyTracer::ticksPerNanosecond() > 0);
+
+    std::ostringstream report;
+    LatencyTracer::dump(report);
+    ASSERT_TRUE(report.str().find("RECONCILE") != std::string::npos);
+    ASSERT_TRUE(report.str().find("L2") == std::string::npos);
+    LatencyTracer::reset();
+    ASSERT_EQ(LatencyTracer::getHistogram(TraceStage::TOTAL, EventType::L3_UPDATE).getCount(), 0);
+#endif
+}
+
+void test_reconciliation_metrics() {
+    MetricsRegistry registry;
+    std::string path = "metrics_test.txt";
+    MetricsFlusher flusher(registry, path, std::chrono::milliseconds(10));
+    std::ostringstream log;
+    setLogStream(&log);
+
+    // trade leads L3, the aggressor and both executions are confirmed
+    {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades);
+        ob.setPrintBook(false);
+        ob.setMetrics(registry);
+        ob.processL3Update("ADD 1 BUY 100.0 100", 1);
+        ob.processL3Update("ADD 2 BUY 100.0 100", 2);
+        ob.processTrade("100.0 200", 3);
+        ob.processL3Update("ADD 3 SELL 100.0 200", 5);
+        ob.processL3Update("CANCEL 3", 5);
+        ob.processL3Update("CANCEL 1", 6);
+        ob.processL3Update("CANCEL 2", 7);
+    }
+    uint64_t value = 0;
+    ASSERT_TRUE(registry.getCounter("aggressors.created", value));
+    ASSERT_EQ(value, 1);
+    ASSERT_EQ(registry.counter("aggressors.confirmed").get(), 1);
+    ASSERT_EQ(registry.counter("guesses.created").get(), 3);
+    ASSERT_EQ(registry.counter("guesses.confirmed").get(), 3);
+    const MetricHistogram* latency = registry.findHistogram("guesses.confirm_latency");
+    ASSERT_TRUE(latency != nullptr);
+    ASSERT_EQ(latency->getCount(), 3);
+    ASSERT_EQ(latency->getSum(), 2 + 3 + 4);
+    ASSERT_EQ(latency->getMax(), 4);
+    ASSERT_EQ(registry.histogram("aggressors.confirm_latency").getMax(), 2);
+
+    // L2 led reductions turn out to be executions, each sends a correction
+    {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades, 0);
+        ob.setPrintBook(false);
+        ob.setMetrics(registry);
+        ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+        ob.processL3Update("ADD 2 SELL 101.0 500", 2);
+        ob.processL2Snapshot("BID 100.0 300 ASK 101.0 500", 3);
+        int64_t live = 0;
+        ASSERT_TRUE(registry.getGauge("guesses.live", live));
+        ASSERT_EQ(live, 1);
+        ob.processTrade("100.0 200", 6);
+        ob.processL2Snapshot("BID ASK 101.0 500", 7);
+        ob.processTrade("100.0 300", 10);
+        ASSERT_EQ(registry.gauge("guesses.live").get(), 0);
+        ASSERT_EQ(registry.gauge("book.smart_orders").get(), 1);
+        ASSERT_EQ(registry.gauge("book.smart_levels").get(), 1);
+    }
+    ASSERT_EQ(registry.counter("guesses.created").get(), 5);
+    ASSERT_EQ(registry.counter("guesses.invalidated").get(), 2);
+    ASSERT_EQ(registry.counter("corrections.sent").get(), 2);
+
+    // unconfirmed deductions expire, counted under the book's own prefix
+    {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades);
+        ob.setPrintBook(false);
+        ob.setMetrics(registry, "venue2.");
+        ob.setGuessExpiry(10);
+        ob.processL3Update("ADD 1 BUY 100.0 100", 1);
+        ob.processTrade("100.0 100", 2);
+        ASSERT_EQ(ob.getGuesses().size(), 1);
+        ASSERT_EQ(ob.getAggressors().size(), 1);
+        ob.processL3Update("ADD 5 BUY 99.0 10", 20);
+        ASSERT_EQ(ob.getGuesses().size(), 0);
+        ASSERT_EQ(ob.getAggressors().size(), 0);
+        // a late trade must not touch the expired executions
+        ob.processTrade("99.0 10", 21);
+
+        // a guessed order is taken out of the SmartBook when it expires
+        std::vector<OrderInfo> sent;
+        Callbacks callbacks;
+        callbacks.onOrderCancel = [&sent](const OrderBook&, const OrderInfo& info) { sent.push_back(info); };
+        ob.setCallbacks(callbacks);
+        ob.processL2Snapshot("BID 98.0 300 ASK", 30);
+        OrderId guessed = 0;
+        for (const auto& [orderId, guess] : ob.getGuesses()) {
+            if (guess.action == "ADD") guessed = orderId;
+        }
+        ASSERT_TRUE(guessed < 0);
+        ASSERT_TRUE(ob.getSmartOrderBook().hasOrder(guessed));
+        ob.processL3Update("ADD 6 SELL 105.0 10", 50);
+        ASSERT_TRUE(ob.getGuesses().empty());
+        ASSERT_TRUE(!ob.getSmartOrderBook().hasOrder(guessed));
+        ASSERT_EQ(ob.getSmartOrderBook().getBestBid(), 0.0);
+        ASSERT_EQ(sent.size(), 1);
+        ASSERT_EQ(sent.back().orderId, guessed);
+        ASSERT_EQ(sent.back().size, 300);
+    }
+    setLogStream(nullptr);
+    ASSERT_EQ(registry.counter("venue2.guesses.expired").get(), 3);
+    ASSERT_EQ(registry.counter("venue2.aggressors.expired").get(), 2);
+    ASSERT_EQ(registry.counter("guesses.expired").get(), 0);
+
+    // file export with per second rates
+    ASSERT_TRUE(flusher.flush());
+    ASSERT_TRUE(flusher.getRate("corrections.sent") > 0);
+    std::ifstream in(path);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(contents.find("guesses.created 5\n") != std::string::npos);
+    ASSERT_TRUE(contents.find("guesses.confirm_latency.max 4\n") != std::string::npos);
+    ASSERT_TRUE(contents.find("corrections.sent.per_sec ") != std::string::npos);
+
+    std::remove(path.c_str());
+    flusher.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    flusher.stop();
+    ASSERT_TRUE(std::ifstream(path).good());
+    std::remove(path.c_str());
+
+    registry.reset();
+    ASSERT_EQ(registry.counter("guesses.created").get(), 0);
+    ASSERT_EQ(registry.findHistogram("guesses.confirm_latency")->getCount(), 0);
+
+    // books not given a registry report to a detached sink, the global one does not grow
+    setLogStream(&log);
+    {
+        size_t globalCounters = MetricsRegistry::global().getCounters().size();
+        L2Book l2a, l2b;
+        L3Book l3a, l3b;
+        TradeContainer tradesA, tradesB;
+        OrderBook first(l2a, l3a, tradesA);
+        OrderBook second(l2b, l3b, tradesB);
+        ASSERT_EQ(first.getMetricsPrefix(), "");
+        first.processL3Update("ADD 1 BUY 100.0 100", 1);
+        second.processL3Update("ADD 1 BUY 100.0 100", 1);
+        second.processTrade("100.0 50", 2);
+        ASSERT_EQ(MetricsRegistry::global().getCounters().size(), globalCounters);
+
+        // once given one, each prefix keeps its own gauges
+        first.setMetrics(MetricsRegistry::global(), "first.");
+        second.setMetrics(MetricsRegistry::global(), "second.");
+        first.processL3Update("ADD 2 BUY 99.0 100", 3);
+        second.processL3Update("ADD 3 BUY 99.0 100", 3);
+        int64_t firstOrders = 0, secondOrders = 0;
+        ASSERT_TRUE(MetricsRegistry::global().getGauge("first.book.exchange_orders", firstOrders));
+        ASSERT_TRUE(MetricsRegistry::global().getGauge("second.book.exchange_orders", secondOrders));
+        ASSERT_EQ(firstOrders, 2);
+        ASSERT_EQ(secondOrders, 2);
+    }
+    setLogStream(nullptr);
+}
+
+void test_correction_coalescing() {
+    MetricsRegistry registry;
+    std::vector<OrderInfo> sent;
+    Callbacks callbacks;
+    auto record = [&sent](const OrderBook&, const OrderInfo& info) { sent.push_back(info); };
+    callbacks.onOrderAdd = record;
+    callbacks.onOrderModify = record;
+    callbacks.onOrderCancel = record;
+    callbacks.onOrderExecution = record;
+    std::ostringstream log;
+    setLogStream(&log);
+
+    // the guessed modify is replaced by the execution the trade reveals
+    {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades, 0);
+        ob.setPrintBook(false);
+        ob.setMetrics(registry);
+        ob.setCallbacks(callbacks);
+        ob.setCoalesceWindow(5);
+        ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+        ob.processL3Update("ADD 2 SELL 101.0 500", 2);
+        ob.processL2Snapshot("BID 100.0 300 ASK 101.0 500", 3);
+        ASSERT_EQ(sent.size(), 2);
+        ob.processTrade("100.0 200", 4);
+        ASSERT_EQ(sent.size(), 3);
+        ASSERT_EQ(sent.back().action, "EXECUTION");
+        ASSERT_EQ(sent.back().orderId, 1);
+        ASSERT_EQ(sent.back().size, 200);
+        ASSERT_EQ(ob.getSmartOrderBook().getTopBids(1).front().quantity, 300.0);
+    }
+    ASSERT_EQ(registry.counter("corrections.coalesced").get(), 1);
+    ASSERT_EQ(registry.counter("corrections.sent").get(), 0);
+
+    // past the window the guess goes out and the correction follows
+    sent.clear();
+    {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades, 0);
+        ob.setPrintBook(false);
+        ob.setMetrics(registry);
+        ob.setCallbacks(callbacks);
+        ob.setCoalesceWindow(5);
+        ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+        ob.processL3Update("ADD 2 SELL 101.0 500", 2);
+        ob.processL2Snapshot("BID 100.0 300 ASK 101.0 500", 3);
+        ob.processL3Update("ADD 3 BUY 99.0 10", 8);
+        ASSERT_EQ(sent.size(), 4);
+        ASSERT_EQ(sent[2].action, "MODIFY");
+        ASSERT_TRUE(sent[2].isGuess);
+        ASSERT_EQ(sent[3].orderId, 3);
+        ob.processTrade("100.0 200", 10);
+        ASSERT_EQ(sent.size(), 5);
+        ASSERT_EQ(sent.back().action, "EXECUTION");
+    }
+    ASSERT_EQ(registry.counter("corrections.sent").get(), 1);
+
+    // a confirmed guess goes out as soon as the L3 update arrives, no longer a guess
+    sent.clear();
+    {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades, 0);
+        ob.setPrintBook(false);
+        ob.setCallbacks(callbacks);
+        ob.setCoalesceWindow(100);
+        ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+        ob.processL3Update("ADD 2 SELL 101.0 500", 2);
+        ob.processL2Snapshot("BID 100.0 800 ASK 101.0 500", 3);
+        ASSERT_EQ(sent.size(), 2);
+        ob.processL3Update("ADD 3 BUY 100 300", 4);
+        ASSERT_EQ(sent.size(), 3);
+        ASSERT_EQ(sent.back().action, "ADD");
+        ASSERT_EQ(sent.back().size, 300);
+        ASSERT_TRUE(!sent.back().isGuess);
+        // under the exchange id, not the dummy one of the guess
+        ASSERT_EQ(sent.back().orderId, 3);
+
+        // held actions go out when the stream ends
+        ob.processL2Snapshot("BID 100.0 500 ASK 101.0 500", 5);
+        size_t before = sent.size();
+        ob.flushActions();
+        ASSERT_TRUE(sent.size() > before);
+    }
+
+    // the L2 snapshot leads and the L3 update confirms, downstream sees one real message
+    struct Confirmation {
+        const char* snapshot;
+        const char* update;
+        const char* action;
+        Quantity size;
+    };
+    for (const Confirmation& c : {Confirmation{"BID ASK 101.0 500", "CANCEL 1 BUY 100.0 500", "CANCEL", 500},
+                                  Confirmation{"BID 100.0 300 ASK 101.0 500", "MODIFY 1 BUY 100.0 300", "MODIFY", 300},
+                                  Confirmation{"BID 100.0 300 ASK 101.0 500", "MODIFY 1 BUY 100.0 200", "MODIFY", 200}}) {
+        sent.clear();
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades, 0);
+        ob.setPrintBook(false);
+        ob.setCallbacks(callbacks);
+        ob.setCoalesceWindow(100);
+        ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+        ob.processL3Update("ADD 2 SELL 101.0 500", 2);
+        ob.processL2Snapshot(c.snapshot, 3);
+        ASSERT_EQ(sent.size(), 2);
+        ASSERT_EQ(ob.getGuesses().size(), 1);
+        ob.processL3Update(c.update, 4);
+        ASSERT_EQ(sent.size(), 3);
+        ASSERT_EQ(sent.back().action, c.action);
+        ASSERT_EQ(sent.back().orderId, 1);
+        ASSERT_EQ(sent.back().size, c.size);
+        ASSERT_TRUE(!sent.back().isGuess);
+        ASSERT_TRUE(ob.getGuesses().empty());
+        ob.flushActions();
+        ASSERT_EQ(sent.size(), 3);
+        if (std::string(c.action) == "MODIFY") {
+            ASSERT_EQ(ob.getSmartOrderBook().getTopBids(1).front().quantity, c.size);
+        }
+    }
+    setLogStream(nullptr);
+}
+
+struct CountedObject {
+    static int live;
+    CountedObject() { live++; }
+    ~CountedObject() { live--; }
+};
+int CountedObject::live = 0;
+
+static bool viewIsConsistent(const BookView& view) {
+    bool consistent = true;
+    auto checkSide = [&](const auto& side, bool isBid) {
+        size_t levels = 0;
+        Price previous = 0;
+        side.forEach([&](Price price, const LevelViewPtr& level) {
+            Quantity total = 0;
+            for (const Order& order : level->orders) total += order.size;
+            if (price != level->price || total != level->quantity || static_cast<int>(level->orders.size()) != level->numOrders) {
+                consistent = false;
+            }
+            if (levels > 0 && (isBid ? previous <= price : previous >= price)) consistent = false;
+            previous = price;
+            levels++;
+            return consistent;
+        });
+        if (levels != side.size()) consistent = false;
+    };
+    checkSide(view.bids, true);
+    checkSide(view.asks, false);
+    return consistent;
+}
+
+void test_epoch_book_views() {
+    // retired objects outlive every reader pinned before they were retired
+    {
+        EpochManager epochs;
+        int reader = epochs.registerReader();
+        ASSERT_TRUE(reader >= 0);
+        {
+            EpochManager::Guard guard = epochs.pin(reader);
+            epochs.retire(new CountedObject());
+            ASSERT_EQ(epochs.advance(), 0);
+            ASSERT_EQ(CountedObject::live, 1);
+        }
+        ASSERT_EQ(epochs.advance(), 1);
+        ASSERT_EQ(CountedObject::live, 0);
+        {
+            EpochManager::Guard guard = epochs.pin(reader);
+            epochs.advance();
+            // pinned after the retire, cannot reach the object
+            epochs.retire(new CountedObject());
+        }
+        epochs.unregisterReader(reader);
+        epochs.retire(new CountedObject());
+    }
+    ASSERT_EQ(CountedObject::live, 0);
+
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    ob.setPrintBook(false);
+    std::ostringstream log;
+    setLogStream(&log);
+    ob.processL3Update("ADD 1 BUY 100.0 10", 1);
+    BookViewPublisher& views = ob.enableBookViews();
+    ob.processL3Update("ADD 2 SELL 101.0 20", 2);
+
+    // untouched levels are shared between views
+    BookViewPublisher::Reader reader(views);
+    ASSERT_TRUE(reader.isValid());
+    const LevelView* bidLevel = nullptr;
+    reader.read([&](const BookView* view) {
+        ASSERT_EQ(view->version, 2);
+        ASSERT_EQ(view->bids.size(), 1);
+        ASSERT_EQ(view->asks.size(), 1);
+        bidLevel = view->bids.firstValue()->get();
+    });
+    ob.processL3Update("ADD 3 SELL 101.0 5", 3);
+    reader.read([&](const BookView* view) {
+        ASSERT_EQ(view->version, 3);
+        ASSERT_TRUE(view->bids.firstValue()->get() == bidLevel);
+        ASSERT_EQ((*view->asks.firstValue())->quantity, 25);
+        ASSERT_EQ((*view->asks.firstValue())->orders.back().orderId, 3);
+    });
+
+    // scans on another thread while the book keeps changing
+    std::atomic<bool> done{false};
+    std::atomic<bool> consistent{true};
+    std::atomic<size_t> scans{0};
+    std::thread scanner([&]() {
+        BookViewPublisher::Reader scan(views);
+        uint64_t lastVersion = 0;
+        while (!done.load()) {
+            scan.read([&](const BookView* view) {
+                if (view->version < lastVersion || !viewIsConsistent(*view)) consistent = false;
+                lastVersion = view->version;
+            });
+            scans++;
+        }
+    });
+    for (int i = 0; i < 3000; ++i) {
+        OrderId id = 10 + i;
+        bool isSell = i % 2;
+        double price = isSell ? 101.0 + i % 7 : 100.0 - i % 7;
+        std::string side = isSell ? " SELL " : " BUY ";
+        ob.processL3Update("ADD " + std::to_string(id) + side + std::to_string(price) + " " + std::to_string(1 + i % 13), 10 + i);
+        if (i >= 20) ob.processL3Update("CANCEL " + std::to_string(id - 20), 10 + i);
+    }
+    while (scans.load() < 10) std::this_thread::yield();
+    done = true;
+    scanner.join();
+    setLogStream(nullptr);
+    ASSERT_TRUE(consistent.load());
+
+    // the latest view is the book, and nothing is kept once readers are gone
+    reader.read([&](const BookView* view) {
+        const L3Book& book = ob.getSmartOrderBook();
+        ASSERT_EQ(view->bids.size(), book.getBids().size());
+        ASSERT_EQ(view->asks.size(), book.getAsks().size());
+        for (const auto& [price, level] : book.getBids()) {
+            const LevelViewPtr* published = view->bids.find(price);
+            ASSERT_TRUE(published != nullptr);
+            ASSERT_EQ((*published)->quantity, level.quantity);
+        }
+    });
+    ob.processL3Update("ADD 99999 BUY 90.0 1", 5000);
+    ASSERT_EQ(views.getRetired(), 0);
+}
+
+static bool sameBook(const L3Book& a, const L3Book& b) {
+    auto sameSide = [](const auto& x, const auto& y) {
+        if (x.size() != y.size()) return false;
+        auto it = y.begin();
+        for (const auto& [price, level] : x) {
+            if (it->first != price || it->second.quantity != level.quantity || it->second.numOrders != level.numOrders) return false;
+            auto order = it->second.orders.begin();
+            for (const Order& o : level.orders) {
+                if (order->orderId != o.orderId || order->size != o.size) return false;
+                ++order;
+            }
+            ++it;
+        }
+        return true;
+    };
+    return sameSide(a.getBids(), b.getBids()) && sameSide(a.getAsks(), b.getAsks());
+}
+
+void test_persistent_book_fork() {
+    std::ostringstream log;
+    setLogStream(&log);
+    auto fill = [](L3Book& book) {
+        for (int i = 0; i < 200; ++i) {
+            bool isSell = i % 2;
+            book.addOrder(i + 1, isSell, 10 + i % 7, isSell ? 101.0 + (i / 2) % 10 : 100.0 - (i / 2) % 10);
+        }
+    };
+    L3Book live;
+    fill(live);
+    PersistentL3Book base(live);
+    ASSERT_EQ(base.getTotalOrders(), 200);
+    ASSERT_EQ(base.getBidLevels(), 10);
+    ASSERT_EQ(base.getBestBid(), 100.0);
+    ASSERT_EQ(base.getBestAsk(), 101.0);
+
+    // every branch changes one level, the rest stays shared with the base
+    std::vector<PersistentL3Book> branches;
+    for (int b = 0; b < 100; ++b) {
+        branches.push_back(base.fork());
+        PersistentL3Book& branch = branches.back();
+        ASSERT_TRUE(branch.cancelOrder(1 + 2 * (b % 100)));
+        ASSERT_TRUE(branch.addOrder(1000 + b, false, 5, 100.0 - b % 10));
+    }
+    for (int b = 0; b < 100; ++b) {
+        Price touched = 100.0 - b % 10;
+        for (int k = 0; k < 10; ++k) {
+            const PersistentLevel* level = branches[b].getLevel(false, 100.0 - k);
+            if (100.0 - k == touched) {
+                ASSERT_TRUE(level != base.getLevel(false, 100.0 - k));
+            } else {
+                ASSERT_TRUE(level == base.getLevel(false, 100.0 - k));
+            }
+            ASSERT_TRUE(branches[b].getLevel(true, 101.0 + k) == base.getLevel(true, 101.0 + k));
+        }
+    }
+    ASSERT_EQ(base.getTotalOrders(), 200);
+    ASSERT_TRUE(base.hasOrder(1));
+
+    // same results as the live book for the same order flow
+    L3Book expected;
+    fill(expected);
+    PersistentL3Book branch = base.fork();
+    expected.modifyOrder(2, 3, 101.0);
+    expected.modifyOrder(4, 50, 101.0);
+    expected.cancelOrder(6);
+    expected.addOrder(5000, true, 7, 101.0);
+    expected.executeAtPrice(101.0, 40, false);
+    branch.modifyOrder(2, 3, 101.0);
+    branch.modifyOrder(4, 50, 101.0);
+    branch.cancelOrder(6);
+    branch.addOrder(5000, true, 7, 101.0);
+    std::vector<OrderInfo> fills = branch.executeAtPrice(101.0, 40, false);
+    ASSERT_TRUE(!fills.empty());
+    ASSERT_EQ(fills.front().orderId, 2);
+    ASSERT_EQ(fills.front().size, 3);
+    L3Book rebuilt;
+    branch.toL3Book(rebuilt);
+    ASSERT_TRUE(sameBook(rebuilt, expected));
+    L3Book original;
+    base.toL3Book(original);
+    ASSERT_TRUE(sameBook(original, live));
+
+    // OrderBook branches rerun the same feed with another execution
+    // probability and match a book that ran with it from the start
+    std::vector<std::string> sent;
+    Callbacks callbacks;
+    auto record = [&sent](const OrderBook&, const OrderInfo& info) {
+        sent.push_back(info.action + " " + std::to_string(info.orderId) + " " + std::to_string(info.size) + (info.isGuess ? " guess" : ""));
+    };
+    callbacks.onOrderAdd = record;
+    callbacks.onOrderModify = record;
+    callbacks.onOrderCancel = record;
+    callbacks.onOrderExecution = record;
+    auto prefix = [](OrderBook& ob) {
+        ob.processL3Update("ADD 1 BUY 100.0 500", 1);
+        ob.processL3Update("ADD 2 BUY 100.0 200", 2);
+        ob.processL3Update("ADD 3 SELL 101.0 500", 3);
+        ob.processL3Update("ADD 4 BUY 99.5 100", 4);
+    };
+    auto suffix = [](OrderBook& ob) {
+        ob.processL2Snapshot("BID 100.0 300 99.5 100 ASK 101.0 500", 5);
+        ob.processTrade("100.0 400", 6);
+        ob.processL3Update("MODIFY 1 BUY 100.0 100", 7);
+        ob.processL3Update("ADD 5 BUY 99.5 50", 8);
+    };
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook parent(l2, l3, trades);
+    parent.setPrintBook(false);
+    prefix(parent);
+    parent.enableForking();
+    ASSERT_TRUE(parent.getSmartOrderBook().empty());
+    ASSERT_EQ(parent.getPersistentSmartBook()->getTotalOrders(), 4);
+
+    std::vector<std::string> branchSent[2];
+    for (int p = 0; p < 2; ++p) {
+        std::unique_ptr<OrderBook> branch = parent.fork(p);
+        branch->setCallbacks(callbacks);
+        sent.clear();
+        suffix(*branch);
+        branchSent[p] = sent;
+
+        L2Book refL2;
+        L3Book refL3;
+        TradeContainer refTrades;
+        OrderBook reference(refL2, refL3, refTrades, p);
+        reference.setPrintBook(false);
+        prefix(reference);
+        reference.setCallbacks(callbacks);
+        sent.clear();
+        suffix(reference);
+        ASSERT_TRUE(sent == branchSent[p]);
+        ASSERT_EQ(branch->getGuesses().size(), reference.getGuesses().size());
+        ASSERT_EQ(branch->getAggressors().size(), reference.getAggressors().size());
+        L3Book rebuiltBranch;
+        branch->getPersistentSmartBook()->toL3Book(rebuiltBranch);
+        ASSERT_TRUE(sameBook(rebuiltBranch, reference.getSmartOrderBook()));
+        // the untouched ask side is still the parent's
+        ASSERT_TRUE(branch->getPersistentSmartBook()->getLevel(true, 101.0) == parent.getPersistentSmartBook()->getLevel(true, 101.0));
+    }
+    ASSERT_TRUE(branchSent[0] != branchSent[1]);
+
+    // the parent carries on unchanged
+    ASSERT_EQ(parent.getPersistentSmartBook()->getTotalOrders(), 4);
+    ASSERT_EQ(parent.getPersistentSmartBook()->findOrder(1)->size, 500);
+    ASSERT_TRUE(parent.getGuesses().empty());
+    parent.processL3Update("CANCEL 2", 9);
+    ASSERT_EQ(parent.getPersistentSmartBook()->getTotalOrders(), 3);
+    ASSERT_EQ(l3.getTotalOrders(), 3);
+    setLogStream(nullptr);
+}
+
+static MarketEvent makeL3Event(Timestamp timestamp, L3Action action, OrderId orderId, bool isSell, Price price, Quantity size) {
+    MarketEvent event;
+    event.type = EventType::L3_UPDATE;
+    event.timestamp = timestamp;
+    event.l3Update = L3Update{timestamp, action, orderId, isSell, price, size};
+    return event;
+}
+
+void test_batched_apply() {
+    std::ostringstream log;
+    setLogStream(&log);
+
+    // one packet: both books and the callbacks see every event, depth goes out once
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades, 1);
+    ob.setPrintBook(false);
+    std::vector<DepthUpdate> updates;
+    std::vector<std::string> actions;
+    Callbacks callbacks;
+    callbacks.onOrderAdd = [&actions](const OrderBook&, const OrderInfo& info) { actions.push_back("ADD " + std::to_string(info.orderId)); };
+    callbacks.onOrderModify = [&actions](const OrderBook&, const OrderInfo& info) { actions.push_back("MODIFY " + std::to_string(info.orderId)); };
+    callbacks.onOrderCancel = [&actions](const OrderBook&, const OrderInfo& info) { actions.push_back("CANCEL " + std::to_string(info.orderId)); };
+    callbacks.onDepthUpdate = [&updates](const DepthUpdate& update) { updates.push_back(update); };
+    ob.setCallbacks(callbacks);
+
+    std::vector<MarketEvent> packet;
+    packet.push_back(makeL3Event(1000, L3Action::ADD, 1, false, 100.0, 5));
+    packet.push_back(makeL3Event(1000, L3Action::ADD, 2, false, 100.0, 7));
+    packet.push_back(makeL3Event(1000, L3Action::ADD, 3, true, 101.0, 4));
+    packet.push_back(makeL3Event(1000, L3Action::MODIFY, 2, false, 100.0, 3));
+    packet.push_back(makeL3Event(1000, L3Action::ADD, 4, false, 99.0, 2));
+    packet.push_back(makeL3Event(1000, L3Action::CANCEL, 4, false, 99.0, 2));
+    ob.processBatch(packet.data(), packet.size());
+    ASSERT_EQ(actions.size(), 6);
+    ASSERT_EQ(actions[3], "MODIFY 2");
+    ASSERT_EQ(l3.getTotalOrders(), 3);
+    ASSERT_EQ(ob.getSmartOrderBook().getTotalOrders(), 3);
+    ASSERT_EQ(updates.size(), 1);
+    ASSERT_TRUE(updates[0].isSnapshot);
+
+    packet.clear();
+    packet.push_back(makeL3Event(1001, L3Action::ADD, 5, false, 100.0, 1));
+    packet.push_back(makeL3Event(1001, L3Action::ADD, 6, false, 98.0, 1));
+    packet.push_back(makeL3Event(1001, L3Action::CANCEL, 6, false, 98.0, 1));
+    ob.processBatch(packet.data(), packet.size());
+    // the level that came and went in the same packet is not sent at all
+    ASSERT_EQ(updates.size(), 2);
+    ASSERT_EQ(updates[1].levels.size(), 1);
+    ASSERT_EQ(updates[1].levels[0].quantity, 9);
+    ASSERT_EQ(updates[1].levels[0].numOrders, 3);
+    ASSERT_EQ(updates[1].timestamp, 1001);
+
+    // a packet that opens with a trade on a book with no asks yet
+    {
+        L2Book l2e;
+        L3Book l3e;
+        TradeContainer tradesE;
+        OrderBook empty(l2e, l3e, tradesE, 1);
+        empty.setPrintBook(false);
+        empty.processL3Update(L3Update{1, L3Action::ADD, 1, false, 100.0, 5});
+        MarketEvent trade{};
+        trade.type = EventType::TRADE_EXECUTION;
+        trade.timestamp = 2;
+        trade.trade = TradeInfo{100.0, 5, 2, OrderSide::SELL, 0};
+        std::vector<MarketEvent> opening = {trade, makeL3Event(2, L3Action::CANCEL, 1, false, 100.0, 5)};
+        empty.processBatch(opening.data(), opening.size());
+        ASSERT_EQ(tradesE.getTrades().size(), 1);
+        ASSERT_TRUE(empty.getSmartOrderBook().getBids().empty());
+    }
+
+    // batched and one by one replays end in the same state with the same actions
+    auto replay = [](bool batch, std::vector<std::string>& seen, size_t& depthUpdates, L3Book& smart) {
+        L2Book l2;
+        L3Book l3;
+        TradeContainer trades;
+        OrderBook ob(l2, l3, trades, 1);
+        ob.setPrintBook(false);
+        Callbacks callbacks;
+        auto record = [&seen](const OrderBook&, const OrderInfo& info) {
+            seen.push_back(info.action + " " + std::to_string(info.orderId) + " " + std::to_string(info.size));
+        };
+        callbacks.onOrderAdd = record;
+        callbacks.onOrderModify = record;
+        callbacks.onOrderCancel = record;
+        callbacks.onOrderExecution = record;
+        callbacks.onDepthUpdate = [&depthUpdates](const DepthUpdate&) { depthUpdates++; };
+        ob.setCallbacks(callbacks);
+        MarketDataIngestor ingestor(ob);
+        ingestor.setBatchApply(batch);
+        ingestor.loadEvents(SOB_DATA_DIR "/sample_L2.txt", SOB_DATA_DIR "/sample_L3.txt", SOB_DATA_DIR "/sample_trades.txt");
+        ingestor.processEvents();
+        smart.clear();
+        for (const auto& [price, level] : ob.getSmartOrderBook().getBids()) {
+            for (const Order& order : level.orders) smart.addOrder(order.orderId, order.isSell, order.size, order.price);
+        }
+        for (const auto& [price, level] : ob.getSmartOrderBook().getAsks()) {
+            for (const Order& order : level.orders) smart.addOrder(order.orderId, order.isSell, order.size, order.price);
+        }
+    };
+    std::vector<std::string> single, batched;
+    size_t singleUpdates = 0, batchedUpdates = 0;
+    L3Book singleBook, batchedBook;
+    replay(false, single, singleUpdates, singleBook);
+    replay(true, batched, batchedUpdates, batchedBook);
+    setLogStream(nullptr);
+
+    ASSERT_TRUE(!single.empty());
+    ASSERT_TRUE(single == batched);
+    ASSERT_TRUE(sameBook(singleBook, batchedBook));
+    ASSERT_TRUE(batchedUpdates <= singleUpdates);
+}
+
+void test_order_pool_layout() {
+    std::ostringstream log;
+    setLogStream(&log);
+    L3Book book;
+    book.reserve(3000);
+    for (int i = 0; i < 2000; ++i) {
+        book.addOrder(i + 1, i % 2, 10, i % 2 ? 101.0 + i % 5 : 100.0 - i % 5, 1000 + i);
+    }
+    ASSERT_EQ(book.getTotalOrders(), 2000);
+    ASSERT_EQ(book.getOrderTime(7), 1006);
+    ASSERT_EQ(book.getOrderTime(9999), 0);
+
+    // queue order survives cancels in the middle, a requeue keeps the arrival time
+    const Order* head = &book.getBids().begin()->second.orders.front();
+    ASSERT_EQ(head->orderId, 1);
+    ASSERT_TRUE(book.cancelOrder(11));
+    ASSERT_TRUE(book.modifyOrder(21, 50, 100.0));
+    ASSERT_EQ(book.getBids().begin()->second.orders.back().orderId, 21);
+    ASSERT_EQ(book.getOrderTime(21), 1020);
+    // and so does a checkpoint round trip
+    {
+        std::stringstream saved;
+        book.save(saved);
+        L3Book restored;
+        ASSERT_TRUE(restored.load(saved));
+        ASSERT_EQ(restored.getTotalOrders(), book.getTotalOrders());
+        ASSERT_EQ(restored.getOrderTime(7), 1006);
+        ASSERT_EQ(restored.getOrderTime(21), 1020);
+        ASSERT_EQ(restored.getBids().begin()->second.orders.back().orderId, 21);
+    }
+    // pointers to resting orders stay put while the pool grows
+    for (int i = 0; i < 5000; ++i) {
+        book.addOrder(10000 + i, false, 1, 90.0 - i % 3);
+    }
+    ASSERT_EQ(head, book.findOrder(1));
+    ASSERT_EQ(head->size, 10);
+
+    int last = 0;
+    size_t queued = 0;
+    for (const Order& order : book.getBids().begin()->second.orders) {
+        ASSERT_TRUE(order.orderId > last || order.orderId == 21);
+        if (order.orderId != 21) last = order.orderId;
+        queued++;
+    }
+    ASSERT_EQ(queued, static_cast<size_t>(book.getBids().begin()->second.numOrders));
+
+    // a copy owns its orders, changing one book leaves the other alone
+    L3Book copy = book;
+    ASSERT_TRUE(copy.cancelOrder(1));
+    ASSERT_TRUE(copy.modifyOrder(3, 2, 99.0));
+    ASSERT_TRUE(book.hasOrder(1));
+    ASSERT_EQ(book.findOrder(3)->size, 10);
+    ASSERT_EQ(copy.getTotalOrders(), book.getTotalOrders() - 1);
+    L3Book moved = std::move(copy);
+    ASSERT_EQ(moved.getBids().begin()->second.orders.front().orderId, 31);
+    ASSERT_TRUE(moved.addOrder(1, false, 4, 100.0));
+    ASSERT_EQ(moved.getBids().begin()->second.orders.back().orderId, 1);
+
+    book.clear();
+    ASSERT_EQ(book.getTotalOrders(), 0);
+    ASSERT_TRUE(book.addOrder(1, true, 3, 101.0));
+    ASSERT_EQ(book.getAsks().begin()->second.orders.front().size, 3);
+    setLogStream(nullptr);
+}
+
+void test_book_arena() {
+    std::ostringstream log;
+    setLogStream(&log);
+    auto replay = [](OrderBook& ob, bool strict) {
+        ob.setPrintBook(false);
+        std::pmr::monotonic_buffer_resource events;
+        MarketDataIngestor ingestor(ob, 1, &events);
+        ingestor.loadEvents(SOB_DATA_DIR "/sample_L2.txt", SOB_DATA_DIR "/sample_L3.txt", SOB_DATA_DIR "/sample_trades.txt");
+        // a container that missed its resource would fall back to the default one and throw
+        std::pmr::memory_resource* previous = std::pmr::set_default_resource(strict ? std::pmr::null_memory_resource() : nullptr);
+        ingestor.processEvents();
+        std::pmr::set_default_resource(previous);
+    };
+
+    L2Book heapL2;
+    L3Book heapL3;
+    TradeContainer heapTrades;
+    OrderBook heapBook(heapL2, heapL3, heapTrades, 1);
+    replay(heapBook, false);
+
+    BookArenaConfig config;
+    config.initialBytes = 1 << 16;
+    config.hugePages = true;
+    config.prefault = true;
+    BookArena arena(config);
+    {
+        L2Book l2;
+        L3Book l3(arena.resource());
+        TradeContainer trades(10000, arena.resource());
+        OrderBook ob(l2, l3, trades, 1, arena.resource());
+        // orders, levels and hash nodes outgrow the first block
+        l3.reserve(5000);
+        replay(ob, true);
+
+        ASSERT_TRUE(arena.getUsedBytes() > 0);
+        ASSERT_TRUE(arena.getMappedBytes() > (size_t(1) << 16));
+        ASSERT_EQ(l3.getTotalOrders(), heapL3.getTotalOrders());
+        ASSERT_EQ(trades.getTrades().size(), heapTrades.getTrades().size());
+        ASSERT_EQ(ob.getGuesses().size(), heapBook.getGuesses().size());
+        ASSERT_EQ(ob.getAggressors().size(), heapBook.getAggressors().size());
+        L3Book smart;
+        smart = ob.getSmartOrderBook();
+        L3Book heapSmart;
+        heapSmart = heapBook.getSmartOrderBook();
+        ASSERT_TRUE(sameBook(smart, heapSmart));
+
+        // a copy lives on the default resource and outlives the arena's books
+        L3Book copy(l3);
+        ASSERT_TRUE(sameBook(copy, l3));
+        ASSERT_TRUE(copy.cancelOrder(copy.getBids().begin()->second.orders.front().orderId));
+        ASSERT_EQ(copy.getTotalOrders() + 1, l3.getTotalOrders());
+    }
+    // freed nodes go back to the arena's pool, so a second identical book
+    // is carved from what the first one returned
+    auto churn = [&arena]() {
+        L3Book again(arena.resource());
+        for (int i = 0; i < 100; ++i) again.addOrder(i + 1, false, 1, 100.0 - i % 10);
+    };
+    churn();
+    size_t used = arena.getUsedBytes();
+    churn();
+    ASSERT_EQ(arena.getUsedBytes(), used);
+    setLogStream(nullptr);
+}
+
+// One cycle of a synthetic session that leaves the books as it found them:
+// orders rest on both sides, L2 snapshots show a level shrinking ahead of
+// the L3 cancel (a confirmed guess), a trade hits the best ask, and
+// everything is cancelled again. Ids repeat from cycle to cycle
+static void steadyStateCycle(OrderBook& ob, Timestamp& now) {
+    const int perSide = 20;
+    auto snapshot = [&ob, &now](Quantity bestBid) {
+        L2Snapshot l2;
+        l2.bids.push(100.0, bestBid);
+        for (int level = 1; level < 5; ++level) l2.bids.push(100.0 - level * 0.25, 400);
+        for (int level = 0; level < 5; ++level) l2.asks.push(100.25 + level * 0.25, 400);
+        ob.processL2Snapshot(l2, ++now);
+    };
+    auto update = [&ob, &now](L3Action action, OrderId orderId, bool isSell, Price price, Quantity size) {
+        ob.processL3Update(L3Update{++now, action, orderId, isSell, price, size});
+    };
+
+    for (int i = 0; i < perSide; ++i) {
+        update(L3Action::ADD, i + 1, false, 100.0 - (i % 5) * 0.25, 100);
+        update(L3Action::ADD, perSide + i + 1, true, 100.25 + (i % 5) * 0.25, 100);
+    }
+    snapshot(400);
+    snapshot(300);
+    update(L3Action::CANCEL, 1, false, 100.0, 100);
+    ob.processTrade(TradeInfo{100.25, 50, ++now, OrderSide::BUY, 0});
+    update(L3Action::MODIFY, perSide + 1, true, 100.25, 50);
+    for (int i = 1; i < perSide; ++i) {
+        update(L3Action::MODIFY, i + 1, false, 100.0 - (i % 5) * 0.25, 60);
+    }
+    for (int i = 1; i < 2 * perSide; ++i) {
+        update(L3Action::CANCEL, i + 1, i >= perSide, 0, 0);
+    }
+    ob.processL2Snapshot(L2Snapshot(), ++now);
+}
+
+void test_zero_allocation_steady_state() {
+    std::ostream quiet(nullptr);
+    setLogStream(&quiet);
+
+    BookArena arena;
+    L2Book l2;
+    L3Book l3(arena.resource());
+    TradeContainer trades(10000, arena.resource());
+    OrderBook ob(l2, l3, trades, 0, arena.resource());
+    ob.setPrintBook(false);
+    ob.setGuessExpiry(1000);
+    Timestamp now = 0;
+
+    // warm up: pools, hash tables and queues grow to what the stream needs
+    for (int cycle = 0; cycle < 20; ++cycle) {
+        steadyStateCycle(ob, now);
+    }
+    size_t arenaBytes = arena.getUsedBytes();
+    AllocationStats stats;
+    {
+        AllocationScope scope(true);
+        for (int cycle = 0; cycle < 100; ++cycle) {
+            steadyStateCycle(ob, now);
+        }
+        stats = scope.getStats();
+    }
+    setLogStream(nullptr);
+    if (stats.allocations != 0) {
+        std::cout << stats.allocations << " allocations in the steady state, the first ones from:" << std::endl;
+        AllocationTracker::dumpStacks();
+    }
+    ASSERT_EQ(stats.allocations, 0u);
+    ASSERT_EQ(arena.getUsedBytes(), arenaBytes);
+    ASSERT_EQ(l3.getTotalOrders(), 0);
+    ASSERT_EQ(ob.getSmartOrderBook().getTotalOrders(), 0);
+    ASSERT_EQ(trades.getTrades().size(), 120u);
+
+    // the tracker itself sees what it should
+    {
+        AllocationScope scope;
+        std::vector<int> values(1000);
+        values.push_back(1);
+        ASSERT_EQ(scope.getAllocations(), 2u);
+    }
+}
+
+void test_book_warmup() {
+    std::ostringstream log;
+    setLogStream(&log);
+    BookArenaConfig arenaConfig;
+    arenaConfig.prefault = true;
+    arenaConfig.lockMemory = true;
+    BookArena arena(arenaConfig);
+    L2Book l2;
+    L3Book l3(arena.resource());
+    TradeContainer trades(10000, arena.resource());
+    OrderBook ob(l2, l3, trades, 0, arena.resource());
+    ob.setPrintBook(false);
+    ob.setGuessExpiry(1000);
+    std::vector<OrderInfo> actions;
+    Callbacks callbacks;
+    callbacks.onOrderAdd = [&actions](const OrderBook&, const OrderInfo& info) { actions.push_back(info); };
+    ob.setCallbacks(callbacks);
+
+    WarmupConfig config;
+    config.orders = 2000;
+    config.levels = 10;
+    config.tick = 0.25;
+    config.rounds = 3;
+    ob.warmup(config);
+
+    // nothing of the synthetic session reaches the real books or callbacks
+    ASSERT_EQ(l3.getTotalOrders(), 0);
+    ASSERT_EQ(ob.getSmartOrderBook().getTotalOrders(), 0);
+    ASSERT_TRUE(trades.empty());
+    ASSERT_TRUE(ob.getGuesses().empty());
+    ASSERT_TRUE(ob.getAggressors().empty());
+    ASSERT_TRUE(actions.empty());
+    ASSERT_TRUE(log.str().empty());
+    ASSERT_TRUE(&logStream() == &log);
+    ASSERT_TRUE(arena.getLockedBytes() <= arena.getMappedBytes());
+
+    // the log scope puts back the previous stream, also on the way out of a throw
+    try {
+        std::ostringstream inner;
+        LogStreamScope scope(&inner);
+        logStream() << "inner";
+        throw std::runtime_error("unwind");
+    } catch (const std::runtime_error&) {}
+    ASSERT_TRUE(&logStream() == &log);
+    ASSERT_TRUE(log.str().empty());
+
+    // the first real messages find their nodes already in the arena
+    size_t used = arena.getUsedBytes();
+    Timestamp now = 0;
+    steadyStateCycle(ob, now);
+    ASSERT_EQ(arena.getUsedBytes(), used);
+    ASSERT_EQ(trades.getTrades().size(), 1u);
+
+    // and behave as on a cold book
+    L2Book coldL2;
+    L3Book coldL3;
+    TradeContainer coldTrades;
+    OrderBook cold(coldL2, coldL3, coldTrades, 0);
+    cold.setPrintBook(false);
+    cold.setGuessExpiry(1000);
+    std::vector<OrderInfo> coldActions;
+    callbacks.onOrderAdd = [&coldActions](const OrderBook&, const OrderInfo& info) { coldActions.push_back(info); };
+    cold.setCallbacks(callbacks);
+    Timestamp coldNow = 0;
+    steadyStateCycle(cold, coldNow);
+    ASSERT_EQ(cold.getGuesses().size(), ob.getGuesses().size());
+    ASSERT_EQ(cold.getAggressors().size(), ob.getAggressors().size());
+    ASSERT_EQ(coldActions.size(), actions.size());
+    setLogStream(nullptr);
+}
+
+void test_thread_config() {
+    int cpu = sched_getcpu();
+    ASSERT_TRUE(cpu >= 0);
+    bool onCore = false;
+    std::thread pinned([cpu, &onCore]() { onCore = pinCurrentThread(cpu) && sched_getcpu() == cpu; });
+    pinned.join();
+    ASSERT_TRUE(onCore);
+    ASSERT_TRUE(pinCurrentThread(-1));
+    ASSERT_TRUE(!pinCurrentThread(CPU_SETSIZE));
+    ASSERT_EQ(cpuNode(-1), -1);
+    int node = currentNode();
+    if (cpuNode(cpu) >= 0) {
+        ASSERT_EQ(cpuNode(cpu), node);
+    }
+
+    WaitPolicy policy = WaitPolicy::BLOCK;
+    ASSERT_TRUE(parseWaitPolicy("backoff", policy));
+    ASSERT_TRUE(policy == WaitPolicy::BACKOFF);
+    ASSERT_TRUE(!parseWaitPolicy("yield", policy));
+    ASSERT_TRUE(policy == WaitPolicy::BACKOFF);
+
+    // polling workers run every task on their core and still stop
+    for (WaitPolicy wait : {WaitPolicy::BUSY_SPIN, WaitPolicy::BACKOFF}) {
+        ThreadPool pool(2, {cpu}, wait);
+        std::atomic<int> ran{0};
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < 8; ++i) {
+            done.push_back(pool.submit([cpu, &ran]() { if (sched_getcpu() == cpu) ran++; }));
+        }
+        for (auto& f : done) f.get();
+        ASSERT_EQ(ran.load(), 8);
+    }
+
+    // the spinning phase of a backoff does not sleep
+    Backoff backoff(WaitPolicy::BACKOFF);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < Backoff::SPINS; ++i) backoff.pause();
+    ASSERT_TRUE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50));
+
+    // a pinned, polling ingestor builds the same book
+    std::ostringstream log;
+    setLogStream(&log);
+    std::string path = writeL3Capture("threads_l3.txt", 300);
+    L2Book l2a;
+    L3Book l3a;
+    TradeContainer tradesA;
+    OrderBook plainBook(l2a, l3a, tradesA);
+    MarketDataIngestor plain(plainBook);
+    ASSERT_TRUE(plain.replayFile(path, EventType::L3_UPDATE));
+
+    ThreadConfig threads;
+    threads.bookCpu = cpu;
+    threads.parserCpus = {cpu};
+    threads.wait = WaitPolicy::BACKOFF;
+    BookArenaConfig arenaConfig;
+    arenaConfig.numaNode = threads.bookNode() >= 0 ? threads.bookNode() : 0;
+    arenaConfig.prefault = true;
+    BookArena arena(arenaConfig);
+    L2Book l2b;
+    L3Book l3b(arena.resource());
+    TradeContainer tradesB(10000, arena.resource());
+    OrderBook pinnedBook(l2b, l3b, tradesB, 0.3, arena.resource());
+    MarketDataIngestor ingestor(pinnedBook, 3);
+    ingestor.setChunkSize(64);
+    ingestor.setThreadConfig(threads);
+    bool replayed = false;
+    // on its own thread, so the pinning does not outlive the test
+    std::thread book([&]() {
+        std::ostringstream bookLog;
+        setLogStream(&bookLog);
+        replayed = ingestor.replayFile(path, EventType::L3_UPDATE) && sched_getcpu() == cpu;
+        setLogStream(nullptr);
+    });
+    book.join();
+    ASSERT_TRUE(replayed);
+    ASSERT_EQ(l3b.getTotalOrders(), l3a.getTotalOrders());
+    ASSERT_EQ(pinnedBook.getSmartOrderBook().getTotalOrders(), plainBook.getSmartOrderBook().getTotalOrders());
+    ASSERT_TRUE(arena.getUsedBytes() > 0);
+
+    // a backing off receiver polls a non-blocking socket and stops when asked
+    UdpFeedReceiver receiver(plainBook);
+    UdpReceiverConfig udp;
+    udp.wait = WaitPolicy::BACKOFF;
+    udp.cpu = cpu;
+    ASSERT_TRUE(receiver.open(udp));
+    std::atomic<bool> stop{false};
+    std::thread receiving([&]() { receiver.run(stop); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    stop = true;
+    receiving.join();
+    ASSERT_TRUE(receiver.getStats().emptyPolls > 0);
+    ASSERT_EQ(receiver.getStats().events, 0u);
+    setLogStream(nullptr);
+}
+
+// every merged level must equal the sum over the venue books
+static bool matchesVenues(const ConsolidatedBook& merged, const std::vector<const L3Book*>& books) {
+    std::map<std::pair<bool, Price>, std::pair<Quantity, int>> expected;
+    for (const L3Book* book : books) {
+        for (const auto& [price, level] : book->getBids()) {
+            auto& sum = expected[{false, price}];
+            sum.first += level.quantity;
+            sum.second += level.numOrders;
+        }
+        for (const auto& [price, level] : book->getAsks()) {
+            auto& sum = expected[{true, price}];
+            sum.first += level.quantity;
+            sum.second += level.numOrders;
+        }
+    }
+    if (expected.size() != merged.getBids().size() + merged.getAsks().size()) {
+        return false;
+    }
+    for (const auto& [key, sum] : expected) {
+        const ConsolidatedLevel* level = merged.getLevel(key.first, key.second);
+        if (!level || level->quantity != sum.first || level->numOrders != sum.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_consolidated_book() {
+    std::ostringstream log;
+    setLogStream(&log);
+    L2Book l2a, l2b;
+    L3Book l3a, l3b;
+    TradeContainer tradesA, tradesB;
+    OrderBook venueA(l2a, l3a, tradesA);
+    OrderBook venueB(l2b, l3b, tradesB);
+    ConsolidatedBook merged;
+    std::vector<ConsolidatedBbo> quotes;
+    merged.setBboCallback([&quotes](const ConsolidatedBbo& bbo) { quotes.push_back(bbo); });
+    size_t forwarded = 0;
+    Callbacks downstream;
+    downstream.onDepthUpdate = [&forwarded](const DepthUpdate&) { forwarded++; };
+    ASSERT_EQ(merged.attach(venueA, "A", downstream), 0);
+    ASSERT_EQ(merged.attach(venueB, "B"), 1);
+    ASSERT_EQ(merged.getVenueName(1), "B");
+    std::vector<const L3Book*> books{&venueA.getSmartOrderBook(), &venueB.getSmartOrderBook()};
+
+    venueA.processL3Update("ADD 1 BUY 100.0 10", 1);
+    venueB.processL3Update("ADD 1 BUY 100.0 5", 2);
+    venueB.processL3Update("ADD 2 BUY 100.5 7", 3);
+    venueA.processL3Update("ADD 2 SELL 101.0 4", 4);
+    venueB.processL3Update("ADD 3 SELL 101.0 6", 5);
+    venueB.processL3Update("ADD 4 SELL 101.5 8", 6);
+    ASSERT_TRUE(matchesVenues(merged, books));
+    ASSERT_TRUE(merged.isSynced(0) && merged.isSynced(1));
+    ASSERT_EQ(forwarded, 2u);
+
+    // per venue breakdown of a shared level
+    const ConsolidatedLevel* shared = merged.getLevel(false, 100.0);
+    ASSERT_TRUE(shared != nullptr);
+    ASSERT_EQ(shared->quantity, 15);
+    ASSERT_EQ(shared->numVenues, 2);
+    ASSERT_EQ(shared->venues[0].quantity, 10);
+    ASSERT_EQ(shared->venues[1].quantity, 5);
+
+    // the best bid is B's alone, the best ask is shared
+    ConsolidatedBbo bbo = merged.getBbo();
+    ASSERT_EQ(bbo.bidPrice, 100.5);
+    ASSERT_EQ(bbo.bidQuantity, 7);
+    ASSERT_EQ(bbo.bidVenues, 1);
+    ASSERT_EQ(bbo.askPrice, 101.0);
+    ASSERT_EQ(bbo.askQuantity, 10);
+    ASSERT_EQ(bbo.askVenues, 2);
+    ASSERT_EQ(bbo.timestamp, 5u);
+    ASSERT_TRUE(quotes.back() == bbo);
+
+    // a change away from the touch leaves the BBO alone
+    size_t quoteCount = quotes.size();
+    venueA.processL3Update("ADD 3 BUY 99.0 3", 7);
+    ASSERT_EQ(quotes.size(), quoteCount);
+    venueB.processL3Update("CANCEL 2", 8);
+    ASSERT_EQ(quotes.size(), quoteCount + 1);
+    ASSERT_EQ(merged.getBestBid(), 100.0);
+    ASSERT_EQ(merged.getBbo().bidQuantity, 15);
+    venueA.processL3Update("MODIFY 1 BUY 100.0 4", 9);
+    venueB.processL3Update("CANCEL 3", 10);
+    ASSERT_TRUE(matchesVenues(merged, books));
+    ASSERT_EQ(merged.getBbo().askQuantity, 4);
+    ASSERT_EQ(merged.getBbo().askVenues, 1);
+
+    // a venue bid through another venue's ask shows as crossed
+    ASSERT_TRUE(!merged.isCrossed());
+    venueB.processL3Update("ADD 5 BUY 100.75 1", 11);
+    ASSERT_TRUE(!merged.isCrossed());
+    venueB.processL3Update("MODIFY 5 BUY 101.0 1", 12);
+    ASSERT_TRUE(merged.isCrossed());
+    venueB.processL3Update("CANCEL 5", 13);
+    ASSERT_TRUE(!merged.isCrossed());
+    ASSERT_TRUE(matchesVenues(merged, books));
+
+    // a gap takes the venue out until its next snapshot
+    DepthUpdate skipped;
+    skipped.sequence = 1000;
+    skipped.levels.push_back({100.0, false, 1, 1});
+    ASSERT_TRUE(!merged.apply(1, skipped));
+    ASSERT_TRUE(!merged.isSynced(1));
+    ASSERT_EQ(merged.getGaps(1), 1u);
+    ASSERT_TRUE(matchesVenues(merged, {&venueA.getSmartOrderBook()}));
+    ASSERT_EQ(merged.getBbo().askPrice, 101.0);
+    venueB.setDepthSnapshotInterval(1);
+    venueB.processL3Update("ADD 6 SELL 102.0 2", 14);
+    venueB.processL3Update("ADD 7 SELL 102.0 2", 15);
+    ASSERT_TRUE(merged.isSynced(1));
+    ASSERT_TRUE(matchesVenues(merged, books));
+    ASSERT_EQ(merged.getLevel(true, 102.0)->numOrders, 2);
+
+    // both venues empty out
+    venueA.processL3Update("CANCEL 1", 16);
+    venueA.processL3Update("CANCEL 2", 17);
+    venueA.processL3Update("CANCEL 3", 18);
+    for (OrderId id : {1, 4, 6, 7}) venueB.processL3Update("CANCEL " + std::to_string(id), 19);
+    ASSERT_TRUE(merged.getBids().empty() && merged.getAsks().empty());
+    ASSERT_EQ(merged.getBestBid(), 0.0);
+    ASSERT_EQ(merged.getBestAsk(), 0.0);
+
+    for (int i = 2; i < static_cast<int>(MAX_VENUES); ++i) {
+        ASSERT_EQ(merged.addVenue("V" + std::to_string(i)), i);
+    }
+    ASSERT_EQ(merged.addVenue("full"), -1);
+    setLogStream(nullptr);
+}
+
+// the signals recomputed from scratch out of the book's top levels
+static bool matchesTopLevels(const BookSignals& signals, const L3Book& book, int depth) {
+    auto close = [](double a, double b) { return a - b < 1e-9 && b - a < 1e-9; };
+    std::vector<L3PriceLevel> bids = book.getTopBids(depth);
+    std::vector<L3PriceLevel> asks = book.getTopAsks(depth);
+    Quantity bidDepth = 0, askDepth = 0;
+    int bidOrders = 0, askOrders = 0;
+    double bidNotional = 0.0, askNotional = 0.0;
+    for (const auto& level : bids) {
+        bidDepth += level.quantity;
+        bidOrders += level.numOrders;
+        bidNotional += level.price * level.quantity;
+    }
+    for (const auto& level : asks) {
+        askDepth += level.quantity;
+        askOrders += level.numOrders;
+        askNotional += level.price * level.quantity;
+    }
+    if (signals.bidLevels != static_cast<int>(bids.size()) || signals.askLevels != static_cast<int>(asks.size())
+        || signals.bidDepth != bidDepth || signals.askDepth != askDepth
+        || signals.bidOrders != bidOrders || signals.askOrders != askOrders
+        || signals.bestBid != book.getBestBid() || signals.bestAsk != book.getBestAsk()) {
+        return false;
+    }
+    double imbalance = bidDepth + askDepth > 0 ? double(bidDepth - askDepth) / (bidDepth + askDepth) : 0.0;
+    if (!close(signals.imbalance, imbalance)) {
+        return false;
+    }
+    if (bids.empty() || asks.empty()) {
+        return signals.spread == 0.0 && signals.microprice == 0.0 && signals.weightedMid == 0.0;
+    }
+    double microprice = (bids[0].price * asks[0].quantity + asks[0].price * bids[0].quantity)
+        / (bids[0].quantity + asks[0].quantity);
+    double weightedMid = (bidNotional / bidDepth * askDepth + askNotional / askDepth * bidDepth) / (bidDepth + askDepth);
+    return close(signals.spread, asks[0].price - bids[0].price) && close(signals.microprice, microprice)
+        && close(signals.weightedMid, weightedMid);
+}
+
+void test_signal_engine() {
+    std::ostringstream log;
+    setLogStream(&log);
+    const int depth = 3;
+    L3Book book;
+    SignalEngine engine(depth);
+    book.addOrder(1, false, 10, 100.0);
+    book.addOrder(2, true, 30, 101.0);
+    book.setSignalEngine(&engine);
+    ASSERT_TRUE(matchesTopLevels(engine.getSignals(), book, depth));
+    ASSERT_EQ(engine.getSignals().microprice, 100.25);
+    ASSERT_EQ(engine.getSignals().imbalance, -0.5);
+
+    // a change below the top levels publishes nothing
+    book.addOrder(3, false, 5, 99.0);
+    book.addOrder(4, false, 5, 98.0);
+    uint64_t version = engine.getSignals().version;
+    book.addOrder(5, false, 5, 97.0);
+    book.addOrder(6, false, 5, 97.0);
+    book.cancelOrder(6);
+    ASSERT_EQ(engine.getSignals().version, version);
+    // the level behind the removed one moves up
+    book.cancelOrder(3);
+    ASSERT_EQ(engine.getSignals().bidLevels, 3);
+    ASSERT_TRUE(matchesTopLevels(engine.getSignals(), book, depth));
+
+    // random churn around the touch against a recomputation after every change
+    std::mt19937 rng(7);
+    std::vector<OrderId> live{1, 2, 4, 5};
+    OrderId nextId = 10;
+    for (int i = 0; i < 5000; ++i) {
+        int action = rng() % 10;
+        if (action < 5 || live.empty()) {
+            bool isSell = rng() % 2;
+            Price price = isSell ? 100.5 + (rng() % 8) * 0.5 : 100.0 - (rng() % 8) * 0.5;
+            book.addOrder(nextId, isSell, 1 + rng() % 20, price);
+            live.push_back(nextId++);
+        } else {
+            size_t pick = rng() % live.size();
+            OrderId id = live[pick];
+            const Order* order = book.findOrder(id);
+            if (action < 8) {
+                book.cancelOrder(id);
+                live[pick] = live.back();
+                live.pop_back();
+            } else if (action == 8) {
+                book.modifyOrder(id, 1 + rng() % 20, order->price);
+            } else if (order->size > 1) {
+                book.executeOrder(*book.findOrder(id), order->size / 2);
+            }
+        }
+        ASSERT_TRUE(matchesTopLevels(engine.getSignals(), book, depth));
+    }
+    std::vector<OrderInfo> fills = book.executeAtPrice(book.getBestAsk(), 25, false);
+    ASSERT_TRUE(matchesTopLevels(engine.getSignals(), book, depth));
+
+    // assignment and clear bring the engine along
+    L3Book other;
+    other.addOrder(1, false, 7, 50.0);
+    book = other;
+    ASSERT_EQ(book.getSignalEngine(), &engine);
+    ASSERT_TRUE(matchesTopLevels(engine.getSignals(), book, depth));
+    ASSERT_TRUE(L3Book(book).getSignalEngine() == nullptr);
+    book.clear();
+    ASSERT_EQ(engine.getSignals().bidLevels, 0);
+    ASSERT_EQ(engine.getSignals().imbalance, 0.0);
+
+    // readers on another thread always see one whole set of signals
+    std::atomic<bool> done{false};
+    std::atomic<bool> torn{false};
+    std::thread reader([&]() {
+        uint64_t last = 0;
+        while (!done.load()) {
+            BookSignals read = engine.read();
+            // every write below keeps the bid depth at twice the bid orders
+            if (read.version < last || read.bidDepth != 2 * read.bidOrders) torn = true;
+            last = read.version;
+        }
+    });
+    for (int i = 0; i < 20000; ++i) {
+        book.addOrder(i + 1, false, 2, 100.0 - (i % 5));
+        if (i % 3 == 2) book.cancelOrder(i);
+    }
+    done = true;
+    reader.join();
+    ASSERT_TRUE(!torn);
+    ASSERT_EQ(engine.read().version, engine.getSignals().version);
+    book.setSignalEngine(nullptr);
+    book.clear();
+    ASSERT_TRUE(engine.read().bidLevels > 0);
+
+    // through an OrderBook, on the SmartBook
+    L2Book l2;
+    L3Book l3;
+    TradeContainer trades;
+    OrderBook ob(l2, l3, trades);
+    SignalEngine& signals = ob.enableSignals(2);
+    ASSERT_EQ(&ob.enableSignals(4), &signals);
+    ASSERT_EQ(signals.getDepth(), 2);
+    ob.processL3Update("ADD 1 BUY 100.0 10", 1);
+    ob.processL3Update("ADD 2 SELL 100.5 30", 2);
+    ob.processL3Update("ADD 3 BUY 99.5 10", 3);
+    ob.processL3Update("ADD 4 BUY 99.0 100", 4);
+    BookSignals top = signals.read();
+    ASSERT_EQ(top.microprice, 100.125);
+    ASSERT_EQ(top.bidDepth, 20);
+    ASSERT_EQ(top.spread, 0.5);
+    ASSERT_EQ(top.orderImbalance, 1.0 / 3);
+    ASSERT_TRUE(matchesTopLevels(top, ob.getSmartOrderBook(), 2));
+    ob.processL3Update("CANCEL 1", 5);
+    ASSERT_EQ(signals.read().bidDepth, 110);
+    ASSERT_TRUE(matchesTopLevels(signals.read(), ob.getSmartOrderBook(), 2));
+    setLogStream(nullptr);
+}
+
 int main() {
     TestSuite suite;
     suite.addTest("L3 ADD update", test_l3_add_order);
@@ -403,7 +3027,42 @@ int main() {
     suite.addTest("L2 Leads (P(Execute)=0) - Invalid", test_L2_leads_guess_modify_invalid);
     suite.addTest("L2 Leads Add", test_L2_leads_added_qty);
     suite.addTest("L2 Leads Add Invalid", test_L2_leads_added_qty_invalid);
-
-    suite.run();
-    return 0;
+    suite.addTest("L2 snapshot levels", test_L2_snapshot_levels);
+    suite.addTest("L2 level diff kernels", test_L2_diff_kernels);
+    suite.addTest("L2 unchanged snapshot", test_L2_unchanged_snapshot_no_guess);
+    suite.addTest("Feed parser lines", test_feed_parser_lines);
+    suite.addTest("Feed parser malformed lines", test_feed_parser_malformed);
+    suite.addTest("Feed parser prices", test_feed_parser_prices);
+    suite.addTest("Parallel chunked load", test_parallel_chunked_load);
+    suite.addTest("Parallel chunked replay", test_parallel_replay_file);
+    suite.addTest("Work stealing pool", test_work_stealing_pool);
+    suite.addTest("Batch replay runner", test_batch_replay_runner);
+    suite.addTest("Capture archive round trip", test_capture_archive_round_trip);
+    suite.addTest("Feed index seek", test_feed_index_seek);
+    suite.addTest("Checkpoint seek matches full replay", test_checkpoint_seek_matches_full_replay);
+    suite.addTest("Checkpoint keeps guess order", test_checkpoint_guess_order);
+    suite.addTest("Binary feed round trip", test_binary_feed_round_trip);
+    suite.addTest("Binary feed malformed input", test_binary_feed_malformed);
+    suite.addTest("UDP loopback feed", test_udp_loopback_feed);
+    suite.addTest("Async file reader", test_async_file_reader);
+    suite.addTest("Async replay matches mapped replay", test_async_replay_matches_mapped);
+    suite.addTest("L2 conflation", test_l2_conflation);
+    suite.addTest("Depth delta feed", test_depth_delta_feed);
+    suite.addTest("Shared memory book", test_shared_memory_book);
+    suite.addTest("Shared memory concurrent reader", test_shared_memory_concurrent_reader);
+    suite.addTest("Latency tracing", test_latency_histogram);
+    suite.addTest("Reconciliation metrics", test_reconciliation_metrics);
+    suite.addTest("Correction coalescing", test_correction_coalescing);
+    suite.addTest("Epoch book views", test_epoch_book_views);
+    suite.addTest("Persistent book fork", test_persistent_book_fork);
+    suite.addTest("Batched apply", test_batched_apply);
+    suite.addTest("Order pool layout", test_order_pool_layout);
+    suite.addTest("Book arena", test_book_arena);
+    suite.addTest("Zero allocation steady state", test_zero_allocation_steady_state);
+    suite.addTest("Book warmup", test_book_warmup);
+    suite.addTest("Thread placement", test_thread_config);
+    suite.addTest("Consolidated book", test_consolidated_book);
+    suite.addTest("Signal engine", test_signal_engine);
+
+    return suite.run() ? 0 : 1;
 }